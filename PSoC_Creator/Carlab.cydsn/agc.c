@@ -0,0 +1,372 @@
+/* ========================================
+ * agc.c
+ * Monica Lu and Victor Ying
+ *
+ * Sets UltraComp's threshold for each transmitter's ping, and
+ * shuts the receiver between the times the pings are expected, as
+ * described in agc.h.
+ *
+ * The task runs every AGC_WATCH with sched_every(), or sooner when
+ * a window opens or closes, and every millisecond while the first
+ * window waits for its ping. The positioning interrupt handler
+ * hands over each fix's pings and posts the task, which plans the
+ * next cycle from them once the one it's gating is over.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+
+#include "agc.h"
+#include "clock.h"
+#include "sched.h"
+#include "radio.h"
+#include "trace.h"
+#include "usb_uart.h"
+
+
+struct agc_stats {
+    uint16 windows;  // cycles gated
+    uint16 missed;  // windows with no trips
+    uint16 noisy;  // windows with more than one
+    uint16 late;  // pings that came late for the fix
+    uint32 worst;  // in microseconds the farthest a ping came from the middle
+};
+
+
+uint8 agc_enabled = 1u;
+uint8 agc_step = 8u;
+uint8 agc_window = 40u;
+uint8 agc_after = 15u;
+
+static uint8 level[POSITION_TRANSMITTERS];  // each ping's UltraDAC value
+
+// The latest fix's pings, from agc_pings(), until agc_gate() takes them
+static uint32 heard[POSITION_TRANSMITTERS];
+static uint8 heard_late;
+static volatile uint8 heard_new = 0u;
+
+static uint32 first;  // when the first ping of the last fix's cycle arrived
+static uint8 first_valid = 0u;
+static uint32 period = 0u;  // between cycles, or 0 until one has been measured
+
+// The cycle being gated
+static uint32 expect[POSITION_TRANSMITTERS];  // clock_now() each ping is due
+static uint8 trips[POSITION_TRANSMITTERS];  // in each window
+static uint8 gating = 0u;  // expect[] holds a cycle not over yet
+static uint8 gated = 0u;  // or one that's over, that the next fix may be from
+static uint8 slot;  // whose window opens or closes next
+static uint8 open;  // slot's window is open
+static uint8 at_open;  // GlitchCounter when it opened
+static uint8 first_count;  // UltraCounter when the first window opened
+static uint8 anchored;  // the first ping has been captured, and placed the rest
+
+static struct agc_stats stats[POSITION_TRANSMITTERS];
+
+// UltraCounter, watched for a set of pings left part way
+static uint8 counted;  // when it last changed
+static uint32 counted_at;
+static uint16 realigned = 0u;
+
+
+/*
+ * STATIC FUNCTION PROTOTYPES
+ */
+
+static uint32 next_edge(void) ;
+static void pass_edge(void) ;
+static void finish(void) ;
+static void plan(uint32 now) ;
+static void anchor(uint32 now) ;
+static void watch(uint32 now) ;
+static uint8 highest(void) ;
+static uint32 apart(uint32 a, uint32 b) ;
+static uint8 lower(uint8 value, uint8 by) ;
+static uint8 raise(uint8 value, uint8 by) ;
+
+
+/*
+ * agc_init:
+ * Sets UltraDAC for the receiver to be open, and starts watching
+ * UltraCounter. Must be called after clock_init(), UltraCounter_Start()
+ * and UltraDAC_Start().
+ */
+void agc_init(void) {
+    uint8 i;
+
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        level[i] = UltraDAC_DEFAULT_DATA < AGC_MAX ? UltraDAC_DEFAULT_DATA :
+                                                     AGC_MAX;
+    UltraDAC_SetValue(UltraDAC_DEFAULT_DATA);
+    counted = UltraCounter_ReadPeriod();
+    counted_at = clock_now();
+    sched_every(SCHED_GATE, AGC_WATCH);
+}
+
+/*
+ * agc_pings:
+ * Called by position.c with when each ping of a cycle that gave a fix
+ * arrived, in clock_now() time, and a bit set for each one that came late
+ * for the fix. Only to be called from the positioning interrupt handler.
+ */
+void agc_pings(const uint32 *arrived, uint8 late) {
+    uint8 i;
+
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        heard[i] = arrived[i];
+    heard_late = late;
+    heard_new = 1u;
+    sched_post(SCHED_GATE);
+}
+
+/*
+ * agc_gate:
+ * Run by sched.c every AGC_WATCH, when a window opens or closes, and after
+ * every fix. Sets UltraDAC, and the thresholds from what each window heard.
+ */
+void agc_gate(void) {
+    uint32 now = clock_now(), wait;
+
+    if (!agc_enabled) {
+        gating = 0u;
+        gated = 0u;
+        heard_new = 0u;
+        sched_every(SCHED_GATE, AGC_WATCH);
+        UltraDAC_SetValue(UltraDAC_DEFAULT_DATA);
+        return;
+    }
+
+    watch(now);
+    if (gating && slot == 0u && open && !anchored &&
+            UltraCounter_ReadCounter() != first_count)
+        anchor(now);
+
+    // Catch up on the windows due, even if this ran late
+    while (gating && (int32)(now - next_edge()) >= 0)
+        pass_edge();
+    if (!gating && heard_new)
+        plan(now);
+    if (!gating)
+        UltraDAC_SetValue(highest());
+
+    // Look often while waiting for the first ping, to place it closely
+    wait = gating && slot == 0u && open && !anchored ? AGC_ANCHOR : AGC_WATCH;
+    if (gating && next_edge() - now < wait)
+        wait = next_edge() - now;
+    sched_every(SCHED_GATE, wait);
+}
+
+/*
+ * agc_print:
+ * Prints each ping's threshold and what its windows heard over USB UART.
+ */
+void agc_print(void) {
+    char strbuf[112];
+    uint8 i;
+
+    if (!agc_enabled) {
+        sprintf(strbuf, "agc off, UltraDAC at %u",
+                (unsigned)UltraDAC_DEFAULT_DATA);
+        usb_uart_putline(strbuf);
+        return;
+    }
+    sprintf(strbuf, "cycle %lu us, windows %u then %u ms either side, %s, "
+            "realigned %u times", (unsigned long)period, (unsigned)agc_window,
+            (unsigned)agc_after, gating ? "gating" : "open", realigned);
+    usb_uart_putline(strbuf);
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++) {
+        sprintf(strbuf, "ping %u: threshold %u, %u windows, %u missed, "
+                "%u noisy, %u late, %lu us off at worst", (unsigned)i,
+                (unsigned)level[i], stats[i].windows, stats[i].missed,
+                stats[i].noisy, stats[i].late, (unsigned long)stats[i].worst);
+        usb_uart_putline(strbuf);
+    }
+}
+
+/*
+ * next_edge:
+ * Returns the clock_now() time the window of the ping in slot next opens
+ * or closes.
+ */
+static uint32 next_edge(void) {
+    uint32 window = (uint32)(slot > 0u && anchored ? agc_after : agc_window) *
+                    1000u;
+
+    return open ? expect[slot] + window : expect[slot] - window;
+}
+
+/*
+ * pass_edge:
+ * Opens or closes the window of the ping in slot, and moves on.
+ */
+static void pass_edge(void) {
+    uint8 count = (uint8)GlitchCounter_ReadCounter();
+
+    if (!open) {
+        at_open = count;
+        if (slot == 0u) {
+            first_count = UltraCounter_ReadCounter();
+            anchored = 0u;
+        }
+        UltraDAC_SetValue(level[slot]);
+        open = 1u;
+        return;
+    }
+    trips[slot] = count - at_open;
+    UltraDAC_SetValue(AGC_CLOSED);
+    open = 0u;
+    if (++slot == POSITION_TRANSMITTERS)
+        finish();
+}
+
+/*
+ * finish:
+ * Moves each threshold by how many times its window tripped, once the
+ * last window of the cycle has closed.
+ */
+static void finish(void) {
+    uint8 i;
+
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++) {
+        stats[i].windows++;
+        if (trips[i] == 0u) {
+            stats[i].missed++;
+            level[i] = lower(level[i], agc_step);
+        }
+        else if (trips[i] > 1u) {
+            stats[i].noisy++;
+            level[i] = raise(level[i], agc_step);
+        }
+        else {
+            level[i] = lower(level[i], 1u);
+        }
+    }
+    gating = 0u;
+    gated = 1u;
+}
+
+/*
+ * plan:
+ * Takes the latest fix's pings: lowers the thresholds of the ones that
+ * came late, measures the cycle period, and if it's known, starts gating
+ * the next cycle.
+ */
+static void plan(uint32 now) {
+    uint32 got[POSITION_TRANSMITTERS];
+    uint32 window = (uint32)agc_window * 1000u, gap;
+    uint8 late, same, i, status;
+
+    status = CyEnterCriticalSection();
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        got[i] = heard[i];
+    late = heard_late;
+    heard_new = 0u;
+    CyExitCriticalSection(status);
+
+    // Whether the fix is from the cycle just gated, so its windows heard
+    // these pings
+    same = gated && apart(got[0], expect[0]) <= window;
+    gated = 0u;
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++) {
+        if (late & (1u << i)) {
+            stats[i].late++;
+            level[i] = lower(level[i], agc_step);
+        }
+        if (same && apart(got[i], expect[i]) > stats[i].worst)
+            stats[i].worst = apart(got[i], expect[i]);
+        trace_record(TRACE_AGC, i, level[i], same ? trips[i] : -1.0,
+                     same ? (float)(int32)(got[i] - expect[i]) : 0.0);
+    }
+
+    // A longer gap means cycles were lost in between. Each cycle comes a
+    // little early or late, so the period is averaged over several.
+    gap = got[0] - first;
+    if (first_valid && gap >= RADIO_MIN_PERIOD && gap <= RADIO_MAX_PERIOD)
+        period = period == 0u ? gap : period + (int32)(gap - period) / 8;
+    first = got[0];
+    first_valid = 1u;
+    if (period == 0u || (int32)(got[0] + period - window - now) <= 0)
+        return;
+
+    // Every ping of the next cycle a period after this one's
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        expect[i] = got[i] + period;
+    slot = 0u;
+    open = 0u;
+    gating = 1u;
+    UltraDAC_SetValue(AGC_CLOSED);
+}
+
+/*
+ * anchor:
+ * Moves the rest of the cycle's windows by how far from the middle of its
+ * window the first ping was captured. The cycles come less regularly than
+ * the pings in one, so the rest can then be narrower.
+ */
+static void anchor(uint32 now) {
+    int32 shift = (int32)(now - expect[0]);
+    uint8 i;
+
+    for (i = 1u; i < POSITION_TRANSMITTERS; i++)
+        expect[i] += shift;
+    anchored = 1u;
+}
+
+/*
+ * watch:
+ * Starts the receiver's count of pings over if a set has been left part
+ * way for longer than pings of one cycle come apart, because one was lost
+ * or noise made a capture, so the next cycle's first ping starts a set.
+ */
+static void watch(uint32 now) {
+    uint8 count = UltraCounter_ReadCounter();
+
+    if (count != counted) {
+        counted = count;
+        counted_at = now;
+    }
+    else if (count != UltraCounter_ReadPeriod() &&
+             now - counted_at >= AGC_QUIET) {
+        position_realign();
+        realigned++;
+        counted = UltraCounter_ReadPeriod();
+        counted_at = now;
+    }
+}
+
+/*
+ * highest:
+ * Returns the highest of the thresholds, which the receiver is open at
+ * while it isn't gating.
+ */
+static uint8 highest(void) {
+    uint8 max = AGC_MIN, i;
+
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        if (level[i] > max)
+            max = level[i];
+    return max;
+}
+
+/*
+ * apart:
+ * Returns how far apart two clock_now() times are, either way round.
+ */
+static uint32 apart(uint32 a, uint32 b) {
+    return (int32)(a - b) < 0 ? b - a : a - b;
+}
+
+/*
+ * lower, raise:
+ * Move a threshold by the given number of codes, no further than AGC_MIN
+ * or AGC_MAX.
+ */
+static uint8 lower(uint8 value, uint8 by) {
+    return value > AGC_MIN + by ? (uint8)(value - by) : AGC_MIN;
+}
+
+static uint8 raise(uint8 value, uint8 by) {
+    return value + by < AGC_MAX ? value + by : AGC_MAX;
+}
+
+//[] END OF FILE
@@ -0,0 +1,93 @@
+/* ========================================
+ * agc.h
+ * Monica Lu and Victor Ying
+ *
+ * Sets UltraComp's threshold, the UltraDAC value, for each
+ * transmitter's ping on its own, and shuts the receiver between
+ * the times the pings are expected.
+ *
+ * After a fix, every ping of the next cycle should arrive one
+ * cycle period after this one's did, give or take how far the
+ * car moves. The receiver is open (UltraDAC at that ping's
+ * threshold) for agc_window either side of then, and closed
+ * (UltraDAC at AGC_CLOSED) the rest of the time, so noise and
+ * late echoes in between can't make a capture and throw off which
+ * capture is which ping. The cycle period wanders more than the
+ * pings within a cycle do, so once the first ping is captured,
+ * the rest are expected as far from their times as it was, and
+ * their windows are only agc_after wide. Without a fix the cycle before, or while
+ * the period isn't known, it stays open at the highest threshold.
+ * Either way, a set of pings left part way for AGC_QUIET, by a
+ * ping lost or noise making a capture, is thrown away, so the
+ * cycles after it don't start on the wrong ping.
+ *
+ * GlitchCounter counts every time the comparator trips, whether or
+ * not the glitch filter lets it through to a capture. A window
+ * that saw one trip heard just its ping; the threshold creeps down
+ * a code, towards hearing far pings sooner. More than one trip is
+ * noise or an echo getting in, and the threshold goes up
+ * agc_step; none is a missed ping, and it comes down agc_step. So
+ * does a ping that came late for the fix, which is what a direct
+ * path too quiet for the threshold looks like when an echo trips
+ * it instead.
+ * ========================================
+ */
+
+#ifndef AGC_H
+#define AGC_H
+
+#include <project.h>
+
+#include "position.h"
+
+
+#define AGC_MIN 4u  // lowest UltraDAC value a ping's threshold goes to
+#define AGC_MAX 240u  // highest
+#define AGC_CLOSED 255u  // UltraDAC value between windows
+#define AGC_MAX_WINDOW 45u  // in ms; windows must not overlap at 100 ms apart
+#define AGC_QUIET 150000u  // in us; longer than pings of a cycle come apart
+#define AGC_WATCH 10000u  // in us between looks at UltraCounter
+#define AGC_ANCHOR 1000u  // in us, while the first window is waiting for its ping
+
+
+// Change these with param.c
+extern uint8 agc_enabled;  // 0 leaves UltraDAC at its schematic value, always open
+extern uint8 agc_step;  // UltraDAC codes a threshold moves for a missed, late or noisy ping
+extern uint8 agc_window;  // in ms either side of when the first ping is expected
+extern uint8 agc_after;  // in ms either side for the rest, once the first came
+
+
+/*
+ * agc_init:
+ * Sets UltraDAC for the receiver to be open, and starts watching
+ * UltraCounter. Must be called after clock_init(), UltraCounter_Start()
+ * and UltraDAC_Start().
+ */
+void agc_init(void) ;
+
+/*
+ * agc_pings:
+ * Called by position.c with when each ping of a cycle that gave a fix
+ * arrived, in clock_now() time, and a bit set for each one that came late
+ * for the fix. Plans the next cycle's windows. Only to be called from the
+ * positioning interrupt handler.
+ */
+void agc_pings(const uint32 *arrived, uint8 late) ;
+
+/*
+ * agc_gate:
+ * Run by sched.c every AGC_WATCH, when a window opens or closes, and after
+ * every fix. Sets UltraDAC, and the thresholds from what each window heard.
+ */
+void agc_gate(void) ;
+
+/*
+ * agc_print:
+ * Prints each ping's threshold and what its windows heard over USB UART.
+ */
+void agc_print(void) ;
+
+
+#endif
+
+//[] END OF FILE
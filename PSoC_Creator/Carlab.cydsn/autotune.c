@@ -0,0 +1,216 @@
+/* ========================================
+ * autotune.c
+ * Monica Lu and Victor Ying
+ *
+ * Relay feedback auto-tuning for the PID controllers.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "autotune.h"
+#include "usb_uart.h"
+
+#define PI 3.14159265
+
+
+/*
+ * autotune_start:
+ * Starts a relay experiment around the current operating point.
+ */
+void autotune_start(struct autotune *tune, struct pid *pid,
+                    enum autotune_rule rule, float bias, float amplitude,
+                    float hysteresis) {
+    uint8 status = CyEnterCriticalSection();
+    
+    tune->pid = pid;
+    tune->rule = rule;
+    tune->bias = bias;
+    tune->amplitude = amplitude;
+    tune->hysteresis = hysteresis;
+    tune->high = 1u;
+    tune->timeout = (uint16)(AUTOTUNE_TIMEOUT / PID_TO_FLOAT(pid->interval));
+    tune->since_switch = 0u;
+    tune->since_rise = 0u;
+    tune->cycles = 0u;
+    tune->amplitude_sum = 0.0;
+    tune->period_sum = 0u;
+    tune->reported = 0u;
+    tune->state = AUTOTUNE_RUNNING;
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * autotune_running:
+ * Returns nonzero while the relay is in control.
+ */
+uint8 autotune_running(const struct autotune *tune) {
+    return tune->state == AUTOTUNE_RUNNING;
+}
+
+/*
+ * hand_back:
+ * Ends the experiment and makes the PID controller continue from output.
+ */
+static void hand_back(struct autotune *tune, enum autotune_state state,
+                      float output) CYREENTRANT {
+    if (output > PID_TO_FLOAT(tune->pid->out_max))
+        output = PID_TO_FLOAT(tune->pid->out_max);
+    else if (output < PID_TO_FLOAT(tune->pid->out_min))
+        output = PID_TO_FLOAT(tune->pid->out_min);
+    pid_bumpless(tune->pid, PID_FROM_FLOAT(output));
+    tune->state = state;
+}
+
+/*
+ * finish:
+ * Computes gains from the averaged oscillation and hands control back to the
+ * PID controller.
+ */
+static void finish(struct autotune *tune, float error) CYREENTRANT {
+    float a = tune->amplitude_sum / AUTOTUNE_CYCLES;
+    float h = tune->hysteresis;
+    
+    // The relay's fundamental is 4d/pi; hysteresis delays switching by the
+    // time the measurement takes to cross it
+    if (a <= h) {
+        hand_back(tune, AUTOTUNE_FAILED, tune->bias);
+        return;
+    }
+    tune->ku = 4 * tune->amplitude / (PI * sqrt(a*a - h*h));
+    tune->tu = (float)tune->period_sum / AUTOTUNE_CYCLES *
+               PID_TO_FLOAT(tune->pid->interval);
+    
+    switch (tune->rule) {
+    case AUTOTUNE_PI:
+        tune->kp = 0.45 * tune->ku;
+        tune->ki = tune->kp * 1.2 / tune->tu;
+        tune->kd = 0.0;
+        break;
+    case AUTOTUNE_PID:
+        tune->kp = 0.6 * tune->ku;
+        tune->ki = tune->kp * 2 / tune->tu;
+        tune->kd = tune->kp * tune->tu / 8;
+        break;
+    case AUTOTUNE_PID_NO_OVERSHOOT:
+        tune->kp = 0.2 * tune->ku;
+        tune->ki = tune->kp * 2 / tune->tu;
+        tune->kd = tune->kp * tune->tu / 3;
+        break;
+    case AUTOTUNE_PD:
+        tune->kp = 0.4 * tune->ku;
+        tune->ki = 0.0;
+        tune->kd = tune->kp * tune->tu / 4;
+        break;
+    default:
+        // Keep the gains it had rather than guess at a rule
+        hand_back(tune, AUTOTUNE_FAILED, tune->bias);
+        return;
+    }
+    
+    // Start from what the new proportional term would add to the bias, so the
+    // integral (which the bias ends up in) starts out holding the setpoint
+    pid_set_gains(tune->pid, tune->kp, tune->ki, tune->kd);
+    hand_back(tune, AUTOTUNE_DONE, tune->bias + tune->kp * error);
+}
+
+/*
+ * autotune_update:
+ * Runs one controller interval of the relay experiment. Reentrant, since
+ * the speed PID and camera interrupt handlers both tune their controllers.
+ */
+pid_value autotune_update(struct autotune *tune, float setpoint,
+                          float measurement) CYREENTRANT {
+    float error = setpoint - measurement;
+    float output;
+    
+    if (tune->state != AUTOTUNE_RUNNING)
+        return tune->pid->output;
+    
+    tune->since_switch++;
+    tune->since_rise++;
+    if (measurement > tune->peak)
+        tune->peak = measurement;
+    if (measurement < tune->trough)
+        tune->trough = measurement;
+    
+    if (tune->high && error < -tune->hysteresis) {
+        tune->high = 0u;
+        tune->since_switch = 0u;
+    }
+    else if (!tune->high && error > tune->hysteresis) {
+        // A rise ends one full oscillation
+        tune->high = 1u;
+        tune->since_switch = 0u;
+        if (tune->cycles >= AUTOTUNE_SETTLE_CYCLES) {
+            tune->amplitude_sum += (tune->peak - tune->trough) / 2;
+            tune->period_sum += tune->since_rise;
+        }
+        tune->cycles++;
+        tune->since_rise = 0u;
+        tune->peak = measurement;
+        tune->trough = measurement;
+        if (tune->cycles == AUTOTUNE_SETTLE_CYCLES + AUTOTUNE_CYCLES) {
+            finish(tune, error);
+            return tune->pid->output;
+        }
+    }
+    else if (tune->since_switch > tune->timeout) {
+        // Not oscillating, e.g. the relay is too weak to cross the setpoint
+        hand_back(tune, AUTOTUNE_FAILED, tune->bias);
+        return tune->pid->output;
+    }
+    if (tune->cycles == 0u) {
+        tune->peak = measurement;
+        tune->trough = measurement;
+    }
+    
+    output = tune->high ? tune->bias + tune->amplitude
+                        : tune->bias - tune->amplitude;
+    if (output > PID_TO_FLOAT(tune->pid->out_max))
+        output = PID_TO_FLOAT(tune->pid->out_max);
+    else if (output < PID_TO_FLOAT(tune->pid->out_min))
+        output = PID_TO_FLOAT(tune->pid->out_min);
+    return PID_FROM_FLOAT(output);
+}
+
+/*
+ * autotune_stop:
+ * Abandons a running experiment, leaving the gains as they were.
+ */
+void autotune_stop(struct autotune *tune) {
+    uint8 status = CyEnterCriticalSection();
+    
+    if (tune->state == AUTOTUNE_RUNNING)
+        hand_back(tune, AUTOTUNE_IDLE, tune->bias);
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * autotune_report:
+ * Prints the result of an experiment once after it ends.
+ */
+void autotune_report(struct autotune *tune, const char *name) {
+    char8 strbuf[64];
+    
+    if (tune->reported)
+        return;
+    if (tune->state == AUTOTUNE_DONE) {
+        sprintf(strbuf, "%s tuned: Ku %.4f Tu %.3f s", name, tune->ku, tune->tu);
+        usb_uart_putline(strbuf);
+        sprintf(strbuf, "kp %.4f ki %.4f kd %.4f", tune->kp, tune->ki, tune->kd);
+        usb_uart_putline(strbuf);
+        tune->reported = 1u;
+    }
+    else if (tune->state == AUTOTUNE_FAILED) {
+        sprintf(strbuf, "%s tuning failed; gains unchanged", name);
+        usb_uart_putline(strbuf);
+        tune->reported = 1u;
+    }
+}
+
+//[] END OF FILE
@@ -0,0 +1,105 @@
+/* ========================================
+ * autotune.h
+ * Monica Lu and Victor Ying
+ *
+ * Relay feedback (Astrom-Hagglund) auto-tuning for the PID
+ * controllers. While tuning, the controller output is switched
+ * between bias + amplitude and bias - amplitude whenever the error
+ * changes sign, which makes the loop oscillate at its ultimate
+ * period. The size of the oscillation gives the ultimate gain, and
+ * Ziegler-Nichols rules turn both into PID gains.
+ * ========================================
+ */
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <project.h>
+
+#include "pid.h"
+
+
+#define AUTOTUNE_SETTLE_CYCLES 2u  // oscillations ignored while things settle
+#define AUTOTUNE_CYCLES 4u  // oscillations averaged
+#define AUTOTUNE_TIMEOUT 5.0  // in seconds; give up if the relay doesn't switch
+
+enum autotune_state {
+    AUTOTUNE_IDLE = 0u,
+    AUTOTUNE_RUNNING = 1u,
+    AUTOTUNE_DONE = 2u,
+    AUTOTUNE_FAILED = 3u,
+};
+
+enum autotune_rule {
+    AUTOTUNE_PI = 0u,  // Ziegler-Nichols PI
+    AUTOTUNE_PID = 1u,  // Ziegler-Nichols PID
+    AUTOTUNE_PID_NO_OVERSHOOT = 2u,  // Ziegler-Nichols PID, less aggressive
+    AUTOTUNE_PD = 3u,  // for integrating plants, which need no integral term
+};
+
+struct autotune {
+    struct pid *pid;  // gains are applied here when tuning finishes
+    enum autotune_rule rule;
+    
+    // Relay
+    float bias, amplitude;  // in controller output units
+    float hysteresis;  // in measurement units, to keep noise from switching
+    uint8 high;  // nonzero while outputting bias + amplitude
+    
+    // Oscillation measurements, periods in controller updates
+    uint16 timeout;  // most updates allowed between switches
+    uint16 since_switch, since_rise;
+    uint8 cycles;
+    float peak, trough;  // extremes of the measurement this cycle
+    float amplitude_sum;
+    uint32 period_sum;
+    
+    // Results
+    volatile enum autotune_state state;
+    uint8 reported;
+    float ku, tu;  // ultimate gain and period in seconds
+    float kp, ki, kd;
+};
+
+
+/*
+ * autotune_start:
+ * Starts a relay experiment around the current operating point. bias should
+ * be the controller output that holds the measurement at the setpoint.
+ * When it finishes, gains chosen by rule are applied to pid.
+ */
+void autotune_start(struct autotune *tune, struct pid *pid,
+                    enum autotune_rule rule, float bias, float amplitude,
+                    float hysteresis) ;
+
+/*
+ * autotune_running:
+ * Returns nonzero while the relay is in control.
+ */
+uint8 autotune_running(const struct autotune *tune) ;
+
+/*
+ * autotune_update:
+ * Should be called instead of pid_update() every controller interval while
+ * tuning. Returns the controller output.
+ */
+pid_value autotune_update(struct autotune *tune, float setpoint,
+                          float measurement) CYREENTRANT ;
+
+/*
+ * autotune_stop:
+ * Abandons a running experiment, leaving the gains as they were.
+ */
+void autotune_stop(struct autotune *tune) ;
+
+/*
+ * autotune_report:
+ * Should be called from the main loop. Prints the result of an experiment
+ * once after it ends.
+ */
+void autotune_report(struct autotune *tune, const char *name) ;
+
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,162 @@
+/* ========================================
+ * clock.c
+ * Monica Lu and Victor Ying
+ *
+ * Free-running microsecond time base, so that position fixes,
+ * hall ticks, and control outputs can be compared in time.
+ *
+ * The time base is built on Speed_PID_Timer, which is fed by the
+ * same 1 MHz clock as the other timers. Its period interrupt
+ * adds up whole periods, carrying into a high word, and the
+ * counter register supplies the microseconds within the current
+ * period. We can't use the
+ * capture timers for this, since reading their counter forces a
+ * capture into the FIFO the interrupt handlers read from.
+ *
+ * A period can end while interrupts are off, or while a higher
+ * priority handler runs, before the period interrupt has counted
+ * it. The timer's terminal count status bit says so: it is set at
+ * the end of every period and stays set until read, so count()
+ * remembers it until the interrupt handler catches up.
+ * ========================================
+ */
+
+#include <project.h>
+
+#include "clock.h"
+
+
+static uint32 base = 0u;  // microseconds at the start of this period, low word
+static uint32 base_high = 0u;  // and high word
+static uint8 wrapped = 0u;  // a period ended that base doesn't include yet
+
+
+static uint32 count(uint32 *high) CYREENTRANT ;
+
+
+/*
+ * clock_init:
+ * Starts the time base. Must be called before anything asks for the time.
+ */
+void clock_init(void) {
+    Speed_PID_Timer_Start();
+}
+
+/*
+ * clock_period_elapsed:
+ * Must be called once every Speed_PID_Timer period, from its interrupt
+ * handler.
+ */
+void clock_period_elapsed(void) {
+    uint8 status = CyEnterCriticalSection();
+    Speed_PID_Timer_ReadStatusRegister();  // clear the terminal count
+    wrapped = 0u;
+    base += CLOCK_TICKS_PER_PERIOD;
+    if (base < CLOCK_TICKS_PER_PERIOD)
+        base_high++;
+    CyExitCriticalSection(status);
+}
+
+/*
+ * clock_now:
+ * Returns the number of microseconds since clock_init() was called, modulo
+ * 2^32. Safe to call from interrupt handlers.
+ */
+uint32 clock_now(void) CYREENTRANT {
+    uint32 high;
+    
+    return count(&high);
+}
+
+/*
+ * clock_stamp_now:
+ * Fills in *stamp with the time now. Safe to call from interrupt handlers.
+ */
+void clock_stamp_now(struct clock_stamp *stamp) CYREENTRANT {
+    uint32 high;
+    
+    stamp->low = count(&high);
+    stamp->high = high;
+}
+
+/*
+ * clock_extend:
+ * Fills in *stamp with the whole count of a clock_now() time, which must be
+ * less than half a wrap before or after now: the high word is now's, less
+ * one if the low word wrapped between them.
+ */
+void clock_extend(uint32 time, struct clock_stamp *stamp) CYREENTRANT {
+    struct clock_stamp now;
+    
+    clock_stamp_now(&now);
+    stamp->low = time;
+    stamp->high = now.high;
+    if ((int32)(now.low - time) >= 0) {
+        if (time > now.low)
+            stamp->high--;
+    }
+    else if (time < now.low) {
+        stamp->high++;
+    }
+}
+
+/*
+ * clock_from_capture:
+ * Converts a capture from a free-running, down-counting 1 MHz timer into
+ * clock_now() time. Both run off the same clock, so the offset between them
+ * never changes, but we only see it plus however long the interrupt took to
+ * be serviced. The smallest offset seen so far is the best estimate.
+ */
+uint32 clock_from_capture(struct clock_sync *sync, uint32 capture) CYREENTRANT {
+    uint32 up = ~capture;
+    uint32 offset = clock_now() - up;
+    
+    if (!sync->valid || (int32)(offset - sync->offset) < 0) {
+        sync->offset = offset;
+        sync->valid = 1u;
+    }
+    return up + sync->offset;
+}
+
+/*
+ * clock_restarted:
+ * Tells sync that its timer was started over from the top of its count at
+ * clock_now() time. Its count up is 0 then, so that's the new offset;
+ * clock_from_capture() only ever lowers it from there.
+ */
+void clock_restarted(struct clock_sync *sync, uint32 time) CYREENTRANT {
+    sync->offset = time;
+    sync->valid = 1u;
+}
+
+/*
+ * count:
+ * Returns clock_now(), and the high word of the whole count in *high.
+ */
+static uint32 count(uint32 *high) CYREENTRANT {
+    uint32 start, now, counter;
+    uint8 status = CyEnterCriticalSection();
+    
+    // The timer counts down towards zero within each period. If the period
+    // ended before clock_period_elapsed() could count it, read the counter
+    // again, since the first read may have been from before the end.
+    counter = Speed_PID_Timer_ReadCounter();
+    if (Speed_PID_Timer_ReadStatusRegister() & Speed_PID_Timer_STATUS_TC)
+        wrapped = 1u;
+    start = base;
+    *high = base_high;
+    if (wrapped) {
+        counter = Speed_PID_Timer_ReadCounter();
+        start += CLOCK_TICKS_PER_PERIOD;
+        if (start < CLOCK_TICKS_PER_PERIOD)
+            (*high)++;
+    }
+    now = start + (CLOCK_TICKS_PER_PERIOD - 1u - counter);
+    if (now < start)
+        (*high)++;
+    
+    CyExitCriticalSection(status);
+    return now;
+}
+
+//[] END OF FILE
@@ -0,0 +1,98 @@
+/* ========================================
+ * clock.h
+ * Monica Lu and Victor Ying
+ *
+ * Free-running microsecond time base, so that position fixes,
+ * hall ticks, and control outputs can be compared in time.
+ *
+ * clock_now() is the low 32 bits of a 64 bit count, which wraps
+ * every 71 minutes; everything the car stamps with the time keeps
+ * just those. C51 has no 64 bit integers, so the whole count is a
+ * struct clock_stamp of two halves, and clock_extend() turns any
+ * time within half a wrap of now back into one, for logs that run
+ * longer than the low word can tell apart.
+ * ========================================
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <project.h>
+
+
+#define CLOCK_TICKS_PER_SECOND 1000000u  // time base is in microseconds
+#define CLOCK_TICKS_PER_PERIOD 10000u  // Speed_PID_Timer period is 10 ms
+
+
+/*
+ * Relationship between a free-running capture timer and the time base.
+ * Start with valid = 0.
+ */
+struct clock_sync {
+    uint32 offset;  // clock_now() minus the timer's count, counting up
+    uint8 valid;
+};
+
+/*
+ * A time in microseconds since clock_init(), not wrapping: high * 2^32 + low.
+ * low is the clock_now() time.
+ */
+struct clock_stamp {
+    uint32 high;
+    uint32 low;
+};
+
+
+/*
+ * clock_init:
+ * Starts the time base. Must be called before anything asks for the time.
+ */
+void clock_init(void) ;
+
+/*
+ * clock_period_elapsed:
+ * Must be called once every Speed_PID_Timer period, from its interrupt
+ * handler.
+ */
+void clock_period_elapsed(void) ;
+
+/*
+ * clock_now:
+ * Returns the number of microseconds since clock_init() was called, modulo
+ * 2^32. Differences between two values are meaningful as long as they are
+ * less than about an hour apart. Safe to call from interrupt handlers.
+ */
+uint32 clock_now(void) CYREENTRANT ;
+
+/*
+ * clock_from_capture:
+ * Converts a capture from a free-running, down-counting 1 MHz timer into
+ * clock_now() time. Must be called from the capture's interrupt handler.
+ */
+uint32 clock_from_capture(struct clock_sync *sync, uint32 capture) CYREENTRANT ;
+
+/*
+ * clock_restarted:
+ * Tells sync that its timer was started over from the top of its count at
+ * clock_now() time, for a capture timer that is reset rather than
+ * free-running. The offset is exact if time is a capture from before the
+ * reset, converted by clock_from_capture(), and it can only improve after.
+ */
+void clock_restarted(struct clock_sync *sync, uint32 time) CYREENTRANT ;
+
+/*
+ * clock_stamp_now:
+ * Fills in *stamp with the time now. Safe to call from interrupt handlers.
+ */
+void clock_stamp_now(struct clock_stamp *stamp) CYREENTRANT ;
+
+/*
+ * clock_extend:
+ * Fills in *stamp with the whole count of a clock_now() time, which must be
+ * less than half a wrap, about 35 minutes, before or after now.
+ */
+void clock_extend(uint32 time, struct clock_stamp *stamp) CYREENTRANT ;
+
+#endif
+
+//[] END OF FILE
@@ -7,10 +7,34 @@
  */
  
 #include <project.h>
+#include <string.h>
  
 #include "drive.h"
 #include "speed.h"
 #include "steer.h"
+#include "profile.h"
+#include "position.h"
+#include "record.h"
+#include "sched.h"
+#include "usb_uart.h"
+#include "scope.h"
+#include "radio.h"
+#include "journal.h"
+
+
+#define STOP_DISTANCE 50.0  // in feet; about half a lap; initial drive_stop_distance
+#define DISPLAY_INTERVAL 200000u  // in microseconds; LCD is redrawn at 5 Hz
+
+enum display {
+    DISPLAY_OFF = 0u,
+    DISPLAY_SPEED = 1u,
+    DISPLAY_STEER = 2u,
+};
+
+
+float drive_stop_distance = STOP_DISTANCE;  // in feet
+
+static enum display display = DISPLAY_OFF;
 
 
 /*
@@ -28,24 +52,76 @@ void drive_init(void) {
 
 /*
  * magnet_callback:
- * Called on every hall sensor tick with a running total distance traveled.
+ * Run by sched.c after hall sensor ticks, with a running total distance
+ * traveled. Records the track while learning a lap, and follows the planned
+ * speed profile once there is one. The fixed stop distance only applies
+ * before either, so a lap being learned or driven isn't cut short.
  */
 void magnet_callback(void) {
-    // Do about half a lap
-    if (distance_traveled >= 50.0)
+    float distance, steer;
+    uint8 status = CyEnterCriticalSection();
+    
+    distance = distance_traveled;
+    steer = steer_output;
+    CyExitCriticalSection(status);
+    
+    if (profile_learning())
+        profile_record(distance, steer_curvature(steer));
+    else if (profile_ready())
+        speed_set(profile_speed(distance));
+    else if (distance >= drive_stop_distance)
         speed_brake();
+}
+
+/*
+ * drive_report_fix:
+ * Run by sched.c after each position fix. Records the fix and sends it over
+ * the radio.
+ */
+void drive_report_fix(void) {
+    struct position_fix fix;
+    
+    if (!position_data_available())
+        return;
     
-    /*
-    // Do two laps and maximum speed
-    if (distance_traveled < 1.0)
-        ;
-    else if ((distance_traveled > 3.0 && distance_traveled < 20.0) ||
-             (distance_traveled > 100.0 && distance_traveled < 118.0))
-        speed_set(9.0);
-    else if (distance_traveled < 194.0)
-        speed_set(5.7);
-    else
-        speed_brake(); */
+    // Snapshot is consistent without having to disable interrupts
+    position_snapshot(&fix);
+    record_fix(&fix);
+    scope_fix(&fix);
+    journal_fix(&fix);
+    radio_report_fix(&fix);
+}
+
+/*
+ * drive_display_info:
+ * Run periodically by sched.c once drive_set_display() has turned the
+ * display on. Shows speed or steering info on the LCD.
+ */
+void drive_display_info(void) {
+    if (display == DISPLAY_SPEED)
+        speed_display_info();
+    else if (display == DISPLAY_STEER)
+        steer_display_info();
+}
+
+/*
+ * drive_set_display:
+ * Shows "speed" or "steer" info on the LCD from now on, or stops updating
+ * it for "off".
+ */
+void drive_set_display(const char *which) {
+    if (strcmp(which, "speed") == 0)
+        display = DISPLAY_SPEED;
+    else if (strcmp(which, "steer") == 0)
+        display = DISPLAY_STEER;
+    else if (strcmp(which, "off") == 0)
+        display = DISPLAY_OFF;
+    else {
+        usb_uart_putline("Display speed, steer or off");
+        return;
+    }
+    LCD_ClearDisplay();
+    sched_every(SCHED_DISPLAY, display == DISPLAY_OFF ? 0u : DISPLAY_INTERVAL);
 }
 
 
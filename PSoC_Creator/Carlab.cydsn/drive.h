@@ -10,6 +10,11 @@
 #define DRIVE_H
 
 
+// In feet; the car brakes once it has gone this far, unless it is learning a
+// lap or following a planned speed profile
+extern float drive_stop_distance;
+
+
 /*
  * drive_init:
  * Begins driving the car.
@@ -18,10 +23,32 @@ void drive_init(void) ;
 
 /*
  * magnet_callback:
- * Called on every hall sensor tick with a running total distance traveled.
+ * Run by sched.c after hall sensor ticks, with a running total distance
+ * traveled.
  */
 void magnet_callback(void) ;
 
+/*
+ * drive_report_fix:
+ * Run by sched.c after each position fix. Records the fix and sends it over
+ * the radio.
+ */
+void drive_report_fix(void) ;
+
+/*
+ * drive_display_info:
+ * Run periodically by sched.c once drive_set_display() has turned the
+ * display on.
+ */
+void drive_display_info(void) ;
+
+/*
+ * drive_set_display:
+ * Shows "speed" or "steer" info on the LCD from now on, or stops updating
+ * it for "off".
+ */
+void drive_set_display(const char *which) ;
+
 #endif
 
 //[] END OF FILE
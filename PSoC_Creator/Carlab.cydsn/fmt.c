@@ -0,0 +1,172 @@
+/* ========================================
+ * fmt.c
+ * Monica Lu and Victor Ying
+ *
+ * Formats floats as fixed point text without sprintf.
+ *
+ * The float is taken apart into its integer part and its fraction,
+ * which are both exact: the fraction as a 48 bit binary fixed point
+ * number, which holds every fraction of a float from 2^-25 up.
+ * Multiplying the fraction by ten pushes out one decimal digit at a
+ * time, and whatever is left after the last digit decides the
+ * rounding. Smaller floats round to zero at six decimals anyway.
+ * Everything is 16 and 32 bit integer arithmetic.
+ * ========================================
+ */
+
+#include <project.h>
+
+#include "fmt.h"
+
+
+// Fraction in 2^-48ths: the top 32 bits, and the bottom 16
+struct fraction {
+    uint32 hi;
+    uint16 lo;
+};
+
+
+/*
+ * next_digit:
+ * Multiplies the fraction by ten, and returns the digit that moves past
+ * the binary point.
+ */
+static uint8 next_digit(struct fraction *f) {
+    uint32 lo = (uint32)f->lo * 10u;
+    uint32 mid = (f->hi & 0xFFFFu) * 10u + (lo >> 16);
+    uint32 top = (f->hi >> 16) * 10u + (mid >> 16);
+    
+    f->hi = (top << 16) | (mid & 0xFFFFu);
+    f->lo = (uint16)lo;
+    return (uint8)(top >> 16);
+}
+
+/*
+ * fmt_float:
+ * Writes value with the given number of decimals (at most
+ * FMT_MAX_DECIMALS) to buf, followed by a NUL, and returns a pointer to
+ * the NUL so that more can be appended. Writes "inf" or "nan", with a sign,
+ * for values too big or not numbers.
+ */
+char *fmt_float(char *buf, float value, uint8 decimals) {
+    union {
+        float f;
+        uint32 u;
+    } pun;
+    struct fraction frac;
+    char digits[10 + FMT_MAX_DECIMALS];  // integer part, then decimals
+    uint32 mantissa, integer;
+    int16 exponent;
+    uint8 n = 0u, i, round_up;
+    
+    if (decimals > FMT_MAX_DECIMALS)
+        decimals = FMT_MAX_DECIMALS;
+    pun.f = value;
+    if (pun.u & 0x80000000u)
+        *buf++ = '-';
+    exponent = (int16)((pun.u >> 23) & 0xFFu) - 127;
+    mantissa = pun.u & 0x7FFFFFu;
+    if (exponent == 128)
+        return fmt_string(buf, mantissa ? "nan" : "inf");
+    if (exponent >= 31)
+        return fmt_string(buf, "inf");
+    if (exponent > -127)
+        mantissa |= 0x800000u;
+    else
+        exponent = -126;  // denormal
+    
+    // value = mantissa * 2^(exponent - 23)
+    integer = 0u;
+    frac.hi = 0u;
+    frac.lo = 0u;
+    if (exponent >= 23) {
+        integer = mantissa << (exponent - 23);
+    }
+    else if (exponent >= -25) {
+        uint8 shift;  // to put the fraction's bits at 2^-48
+        
+        if (exponent >= 0) {
+            integer = mantissa >> (23 - exponent);
+            mantissa &= (1ul << (23 - exponent)) - 1u;
+        }
+        shift = (uint8)(25 + exponent);
+        if (shift >= 16u) {
+            frac.hi = mantissa << (shift - 16u);
+        }
+        else {
+            frac.hi = mantissa >> (16u - shift);
+            frac.lo = (uint16)(mantissa << shift);
+        }
+    }
+    
+    // Integer part, most significant digit first
+    do {
+        digits[n++] = (char)(integer % 10u);
+        integer /= 10u;
+    } while (integer != 0u);
+    for (i = 0u; i < n / 2u; i++) {
+        char swap = digits[i];
+        digits[i] = digits[n - 1u - i];
+        digits[n - 1u - i] = swap;
+    }
+    
+    for (i = 0u; i < decimals; i++)
+        digits[n++] = (char)next_digit(&frac);
+    
+    // Round what's left: up past a half, and a half to even
+    if (frac.hi != 0x80000000u)
+        round_up = frac.hi > 0x80000000u;
+    else if (frac.lo != 0u)
+        round_up = 1u;
+    else
+        round_up = digits[n - 1u] & 1u;
+    
+    if (round_up) {
+        for (i = n; i > 0u; i--) {
+            if (digits[i - 1u] != 9)
+                break;
+            digits[i - 1u] = 0;
+        }
+        if (i > 0u) {
+            digits[i - 1u]++;
+        }
+        else {
+            // Carried out of the top digit
+            *buf++ = '1';
+        }
+    }
+    
+    for (i = 0u; i < n; i++) {
+        if (i == n - decimals)
+            *buf++ = '.';
+        *buf++ = (char)('0' + digits[i]);
+    }
+    *buf = '\0';
+    return buf;
+}
+
+/*
+ * fmt_string:
+ * Copies str to buf, followed by a NUL, and returns a pointer to the NUL.
+ */
+char *fmt_string(char *buf, const char *str) {
+    while (*str != '\0')
+        *buf++ = *str++;
+    *buf = '\0';
+    return buf;
+}
+
+/*
+ * fmt_pad:
+ * Pads the text from start up to end with spaces until it is width
+ * characters long, for overwriting a field on the LCD. Returns a pointer
+ * to the NUL.
+ */
+char *fmt_pad(char *start, char *end, uint8 width) {
+    while (end - start < width)
+        *end++ = ' ';
+    *end = '\0';
+    return end;
+}
+
+//[] END OF FILE
@@ -0,0 +1,48 @@
+/* ========================================
+ * fmt.h
+ * Monica Lu and Victor Ying
+ *
+ * Formats floats as fixed point text without sprintf, which
+ * formats floats slowly on the 8051. The digits are the same as
+ * sprintf's "%.Nf" gives on a PC, rounding exactly (halves to
+ * even), for any float under 2^31 in size.
+ * ========================================
+ */
+
+#ifndef FMT_H
+#define FMT_H
+
+#include <project.h>
+
+
+#define FMT_MAX_DECIMALS 6
+#define FMT_MAX_LEN 18  // longest output, "-2147483647.999999", without the NUL
+
+
+/*
+ * fmt_float:
+ * Writes value with the given number of decimals (at most
+ * FMT_MAX_DECIMALS) to buf, followed by a NUL, and returns a pointer to
+ * the NUL so that more can be appended. Writes "inf" or "nan", with a sign,
+ * for values too big or not numbers.
+ */
+char *fmt_float(char *buf, float value, uint8 decimals) ;
+
+/*
+ * fmt_string:
+ * Copies str to buf, followed by a NUL, and returns a pointer to the NUL.
+ */
+char *fmt_string(char *buf, const char *str) ;
+
+/*
+ * fmt_pad:
+ * Pads the text from start up to end with spaces until it is width
+ * characters long, for overwriting a field on the LCD. Returns a pointer
+ * to the NUL.
+ */
+char *fmt_pad(char *start, char *end, uint8 width) ;
+
+
+#endif
+
+//[] END OF FILE
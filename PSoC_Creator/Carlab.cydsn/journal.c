@@ -0,0 +1,537 @@
+/* ========================================
+ * journal.c
+ * Monica Lu and Victor Ying
+ *
+ * Keeps the journal described in journal.h in flash.
+ *
+ * Entries go into one of two pages in RAM, from interrupt
+ * handlers or the main loop. When it fills, the other takes over
+ * and journal_write() programs the full one into its row. Pro-
+ * gramming a row holds up the main loop for milliseconds, so it is
+ * done just after a fix, when no pings are due for a while, unless
+ * positioning is idle. A page that isn't full yet is programmed
+ * into its row too, once JOURNAL_FLUSH has passed since it last
+ * was, so a reset loses little; that row is programmed again as the
+ * page fills. If both pages are full before a row is programmed,
+ * entries are dropped and counted.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "journal.h"
+#include "clock.h"
+#include "sched.h"
+#include "speed.h"
+#include "steer.h"
+
+
+// Where the header's fields are in a page
+#define MAGIC 0u
+#define USED 1u
+#define SEQ 2u
+#define HIGH 6u
+#define BOOT 10u
+#define CHECK 11u
+
+#define ENTRY_HEADER 5u  // type and time
+#define PINGS_SIZE (1u + 4u * POSITION_TRANSMITTERS)
+#define FIX_SIZE 15u
+#define CONTROL_SIZE 24u
+#define MAX_USED (JOURNAL_PAGE - JOURNAL_HEADER - 1u)  // so a page's length fits a uint8
+#define ROWS_PER_ARRAY (CY_FLASH_SIZEOF_ARRAY / CY_FLASH_SIZEOF_ROW)
+
+uint8 journal_every = 1u;
+uint8 journal_control = 20u;
+
+
+#ifdef JOURNAL_ENABLE
+
+// The rows the linker's RESERVE leaves alone, as journal.h describes
+#if JOURNAL_FIRST_ROW * CY_FLASH_SIZEOF_ROW != 0xE000u || \
+    JOURNAL_FIRST_ROW + JOURNAL_ROWS != CY_FLASH_NUMBER_ROWS
+#error "The journal's rows must match the linker's RESERVE(C:0xE000-C:0xFFFF)"
+#endif
+
+
+struct page {
+    uint8 row;  // of the journal's, that it is programmed into
+    uint8 bytes[JOURNAL_PAGE];
+};
+
+
+static struct page pages[2];
+static volatile uint8 filling = 0u;  // the page entries go into
+static volatile uint8 full = 0u;  // the other page is full, waiting for its row
+static volatile uint8 dirty = 0u;  // the filling page has entries not in flash yet
+static uint32 seq;  // of the filling page
+static uint8 boot;
+static uint8 blocked = 0u;  // the rows hold something else, so nothing is journaled
+
+static uint8 sets = 0u;  // of pings since the last one journaled
+static volatile uint8 fix_wanted = 0u;  // the last set was, so its fix is too
+static uint8 periods = 0u;  // speed PID periods since the last control sample
+static volatile uint8 after_fix = 0u;
+static uint32 last_fix, flushed;  // clock_now() times
+static uint8 fix_seen = 0u;
+
+static uint16 written = 0u;  // rows programmed since the reset
+static uint16 dropped = 0u;  // entries lost to both pages being full, saturating
+static uint8 failed = 0u;  // rows CyWriteRowData() couldn't program
+
+// The dump under way
+static uint8 dump_wanted = 0u;
+static uint8 dumping = 0u;
+static uint8 dump_row, dump_left, dump_offset;
+static uint16 dump_pages;
+
+
+/*
+ * STATIC FUNCTION PROTOTYPES
+ */
+
+static void append(uint8 type, uint32 time, const uint8 *body, uint8 len) CYREENTRANT ;
+static void start_page(struct page *p, uint8 row) CYREENTRANT ;
+static void program(struct page *p) ;
+static uint8 flush(uint8 now) ;
+static uint8 send_frame(void) ;
+static const uint8 CYCODE *flash_row(uint8 row) ;
+static uint8 page_ok(const uint8 *bytes) ;
+static uint8 blank(const uint8 *bytes) ;
+static uint32 get_u32(const uint8 *bytes) CYREENTRANT ;
+static void put_u32(uint8 *bytes, uint32 value) CYREENTRANT ;
+static void put_float(uint8 *bytes, float value) CYREENTRANT ;
+
+
+/*
+ * journal_init:
+ * Finds where the journal left off before the reset, and starts a new
+ * page after it. Must be called after clock_init().
+ */
+void journal_init(void) {
+    const uint8 CYCODE *bytes;
+    uint8 row, newest = JOURNAL_ROWS;
+
+    // Flash is programmed with the die temperature in mind
+    CySetTemp();
+
+    blocked = 0u;
+    for (row = 0u; row < JOURNAL_ROWS; row++) {
+        bytes = flash_row(row);
+        if (page_ok(bytes) && (newest == JOURNAL_ROWS ||
+                (int32)(get_u32(bytes + SEQ) - seq) > 0)) {
+            newest = row;
+            seq = get_u32(bytes + SEQ);
+            boot = bytes[BOOT];
+        }
+
+        // Code or constants the linker put here, which programming a
+        // page would overwrite
+        if (bytes[MAGIC] != JOURNAL_MAGIC && !blank(bytes))
+            blocked = 1u;
+    }
+    if (newest == JOURNAL_ROWS) {
+        newest = JOURNAL_ROWS - 1u;
+        seq = 0u;
+        boot = 0u;
+    }
+    else {
+        seq++;
+        boot++;
+    }
+
+    filling = 0u;
+    full = 0u;
+    dirty = 0u;
+    start_page(&pages[0], (newest + 1u) % JOURNAL_ROWS);
+    flushed = clock_now();
+}
+
+/*
+ * journal_pings:
+ * Called by the positioning interrupt handler with each set of captures,
+ * as read from UltraTimer, and the clock_now() time the last one arrived.
+ */
+void journal_pings(const uint32 *captures, uint32 time) {
+    uint8 body[PINGS_SIZE];
+    uint8 i;
+
+    fix_wanted = 0u;
+    if (journal_every == 0u || ++sets < journal_every)
+        return;
+    sets = 0u;
+
+    body[0] = POSITION_TRANSMITTERS;
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        put_u32(body + 1 + 4u * i, captures[i]);
+    append(JOURNAL_PINGS, time, body, PINGS_SIZE);
+    fix_wanted = 1u;
+}
+
+/*
+ * journal_fix:
+ * Called from the main loop with every new position fix. Journals it if
+ * the pings it came from were, and lets journal_write() program flash now
+ * that the next pings are a while off.
+ */
+void journal_fix(const struct position_fix *fix) {
+    uint8 body[FIX_SIZE];
+
+    if (fix_wanted) {
+        fix_wanted = 0u;
+        put_float(body, fix->x);
+        put_float(body + 4, fix->y);
+        put_float(body + 8, fix->error);
+        body[12] = (uint8)(fix->seq >> 8);
+        body[13] = (uint8)fix->seq;
+        body[14] = fix->excluded;
+        append(JOURNAL_FIX, fix->time, body, FIX_SIZE);
+    }
+    last_fix = clock_now();
+    fix_seen = 1u;
+    after_fix = 1u;
+    sched_post(SCHED_JOURNAL);
+}
+
+/*
+ * journal_sample:
+ * Called by the speed PID interrupt handler every period. Journals the
+ * controllers' state every journal_control periods while the car is
+ * driving.
+ */
+void journal_sample(void) {
+    uint8 body[CONTROL_SIZE];
+
+    if (journal_control == 0u || ++periods < journal_control)
+        return;
+    periods = 0u;
+    if (power_output == 0.0 && speed == 0.0)
+        return;
+
+    put_float(body, speed);
+    put_float(body + 4, speed_setpoint);
+    put_float(body + 8, power_output);
+    put_float(body + 12, distance_traveled);
+    put_float(body + 16, steer_output);
+    put_float(body + 20, steer_measurement());
+    append(JOURNAL_CONTROL, clock_now(), body, CONTROL_SIZE);
+}
+
+/*
+ * journal_write:
+ * Run by sched.c after a fix, every JOURNAL_FLUSH, and while dumping.
+ * Programs the full page, or the filling one if it's been a while, into
+ * flash, and sends the dump.
+ */
+void journal_write(void) {
+    uint32 now = clock_now();
+
+    // While a dump is being sent, its rows are left alone
+    if (dump_wanted) {
+        if (full) {
+            program(&pages[filling ^ 1u]);
+            full = 0u;
+        }
+        flush(1u);
+        dump_wanted = 0u;
+        dumping = 1u;
+
+        // Oldest first: the filling page's row is the newest if it has
+        // been flushed, and the oldest if it still holds an old page
+        dump_row = pages[filling].row;
+        if (get_u32(flash_row(dump_row) + SEQ) == seq)
+            dump_row = (dump_row + 1u) % JOURNAL_ROWS;
+        dump_left = JOURNAL_ROWS;
+        dump_offset = 0u;
+        dump_pages = 0u;
+    }
+    if (dumping) {
+        while (dumping) {
+            if (!USBUART_GetConfiguration()) {
+                dumping = 0u;  // nobody to send it to
+                return;
+            }
+            if (!USBUART_CDCIsReady()) {
+                sched_post(SCHED_JOURNAL);
+                return;
+            }
+            while (dumping && !send_frame())
+                ;
+        }
+        return;
+    }
+
+    if (!after_fix && fix_seen && now - last_fix < JOURNAL_FLUSH)
+        return;
+    after_fix = 0u;
+    if (full) {
+        program(&pages[filling ^ 1u]);
+        full = 0u;
+    }
+    else if (now - flushed >= JOURNAL_FLUSH && flush(0u))
+        flushed = now;
+}
+
+/*
+ * journal_command:
+ * The shell's "journal" command. args is "dump" to send the journal, or
+ * empty to print how much it holds.
+ */
+void journal_command(const char *args) {
+    char strbuf[112];
+    uint8 row, pages_ok = 0u;
+
+    if (strcmp(args, "dump") == 0) {
+        dump_wanted = 1u;
+        sched_post(SCHED_JOURNAL);
+        return;
+    }
+    if (*args != '\0') {
+        usb_uart_putline("usage: journal [dump]");
+        return;
+    }
+    if (blocked)
+        usb_uart_putline("Journal off: its flash rows hold something else; "
+                         "check the linker's RESERVE");
+    for (row = 0u; row < JOURNAL_ROWS; row++)
+        if (page_ok(flash_row(row)))
+            pages_ok++;
+    sprintf(strbuf, "%u of %u pages kept, page %lu going into row %u, "
+            "boot %u", (unsigned)pages_ok, (unsigned)JOURNAL_ROWS,
+            (unsigned long)seq,
+            (unsigned)pages[filling].row, (unsigned)boot);
+    usb_uart_putline(strbuf);
+    sprintf(strbuf, "%u rows programmed, %u failed, %u entries dropped",
+            written, (unsigned)failed, dropped);
+    usb_uart_putline(strbuf);
+    sprintf(strbuf, "pings every %u sets, control every %u ms while driving",
+            (unsigned)journal_every, journal_control *
+            (unsigned)(CLOCK_TICKS_PER_PERIOD / 1000u));
+    usb_uart_putline(strbuf);
+}
+
+/*
+ * append:
+ * Adds an entry to the filling page, moving on to the other page if it
+ * doesn't fit, or if the clock's high word has changed since the page
+ * began. Safe to call from interrupt handlers.
+ */
+static void append(uint8 type, uint32 time, const uint8 *body, uint8 len) CYREENTRANT {
+    struct clock_stamp stamp;
+    struct page *p;
+    uint8 status, *out;
+
+    if (blocked)
+        return;
+    status = CyEnterCriticalSection();
+    clock_extend(time, &stamp);
+    p = &pages[filling];
+    if (p->bytes[USED] > 0u &&
+            (p->bytes[USED] + ENTRY_HEADER + len > MAX_USED ||
+             stamp.high != get_u32(p->bytes + HIGH))) {
+        if (full) {
+            if (dropped < 0xFFFFu)
+                dropped++;
+            CyExitCriticalSection(status);
+            return;
+        }
+        full = 1u;
+        filling ^= 1u;
+        seq++;
+        start_page(&pages[filling], (p->row + 1u) % JOURNAL_ROWS);
+        p = &pages[filling];
+        sched_post(SCHED_JOURNAL);
+    }
+    if (p->bytes[USED] == 0u)
+        put_u32(p->bytes + HIGH, stamp.high);
+
+    out = p->bytes + JOURNAL_HEADER + p->bytes[USED];
+    out[0] = type;
+    put_u32(out + 1, time);
+    memcpy(out + ENTRY_HEADER, body, len);
+    p->bytes[USED] += ENTRY_HEADER + len;
+    dirty = 1u;
+    CyExitCriticalSection(status);
+}
+
+/*
+ * start_page:
+ * Makes p an empty page numbered seq, to be programmed into the given row.
+ */
+static void start_page(struct page *p, uint8 row) CYREENTRANT {
+    p->row = row;
+    p->bytes[MAGIC] = JOURNAL_MAGIC;
+    p->bytes[USED] = 0u;
+    put_u32(p->bytes + SEQ, seq);
+    p->bytes[BOOT] = boot;
+}
+
+/*
+ * program:
+ * Programs p into its row, after setting its check byte.
+ */
+static void program(struct page *p) {
+    uint16 row = JOURNAL_FIRST_ROW + p->row;
+    uint8 check = 0u, i, n = JOURNAL_HEADER + p->bytes[USED];
+
+    p->bytes[CHECK] = 0u;
+    for (i = 0u; i < n; i++)
+        check += p->bytes[i];
+    p->bytes[CHECK] = (uint8)-check;
+    if (CyWriteRowData((uint8)(row / ROWS_PER_ARRAY),
+                       (uint16)(row % ROWS_PER_ARRAY), p->bytes) == CYRET_SUCCESS)
+        written++;
+    else if (failed < 0xFFu)
+        failed++;
+}
+
+/*
+ * flush:
+ * Programs a copy of the filling page into its row, if it has entries
+ * that aren't in flash yet, or always if now is set and it has any.
+ * Returns nonzero if it did. The copy is made in the other page, marked
+ * full meanwhile so entries can't move on to it.
+ */
+static uint8 flush(uint8 now) {
+    struct page *copy;
+    uint8 status = CyEnterCriticalSection();
+
+    if (full || !(dirty || (now && pages[filling].bytes[USED] > 0u))) {
+        CyExitCriticalSection(status);
+        return 0u;
+    }
+    copy = &pages[filling ^ 1u];
+    *copy = pages[filling];
+    dirty = 0u;
+    full = 1u;
+    CyExitCriticalSection(status);
+    program(copy);
+    full = 0u;
+    return 1u;
+}
+
+/*
+ * send_frame:
+ * Sends the next frame of the dump, or skips a row that doesn't hold a
+ * good page and returns zero. Ends the dump after the newest row.
+ */
+static uint8 send_frame(void) {
+    uint8 frame[JOURNAL_CHUNK + 6u];
+    const uint8 CYCODE *bytes = flash_row(dump_row);
+    uint8 *body = frame + 2;
+    uint8 n, len, check, i;
+
+    if (dump_left == 0u) {
+        body[0] = (uint8)(dump_pages >> 8);
+        body[1] = (uint8)dump_pages;
+        body[2] = JOURNAL_END;
+        len = 3u;
+        dumping = 0u;
+    }
+    else if (dump_offset == 0u && !page_ok(bytes)) {
+        dump_row = (dump_row + 1u) % JOURNAL_ROWS;
+        dump_left--;
+        return 0u;
+    }
+    else {
+        n = JOURNAL_HEADER + bytes[USED] - dump_offset;
+        if (n > JOURNAL_CHUNK)
+            n = JOURNAL_CHUNK;
+        body[0] = (uint8)(dump_pages >> 8);
+        body[1] = (uint8)dump_pages;
+        body[2] = dump_offset;
+        for (i = 0u; i < n; i++)
+            body[3u + i] = bytes[dump_offset + i];
+        len = 3u + n;
+        dump_offset += n;
+        if (dump_offset == JOURNAL_HEADER + bytes[USED]) {
+            dump_offset = 0u;
+            dump_pages++;
+            dump_row = (dump_row + 1u) % JOURNAL_ROWS;
+            dump_left--;
+        }
+    }
+
+    check = len;
+    for (i = 0u; i < len; i++)
+        check += body[i];
+    frame[0] = JOURNAL_SYNC;
+    frame[1] = len;
+    frame[2u + len] = (uint8)-check;
+    USBUART_PutData(frame, len + 3u);
+    return 1u;
+}
+
+/*
+ * flash_row:
+ * Returns where the given row of the journal is, to read it.
+ */
+static const uint8 CYCODE *flash_row(uint8 row) {
+    return (const uint8 CYCODE *)(CY_FLASH_BASE +
+        (uint32)(JOURNAL_FIRST_ROW + row) * CY_FLASH_SIZEOF_ROW);
+}
+
+/*
+ * page_ok:
+ * Returns nonzero if bytes hold a page whose check byte is right.
+ */
+static uint8 page_ok(const uint8 *bytes) {
+    uint8 check = 0u, i, n;
+
+    if (bytes[MAGIC] != JOURNAL_MAGIC || bytes[USED] > MAX_USED)
+        return 0u;
+    n = JOURNAL_HEADER + bytes[USED];
+    for (i = 0u; i < n; i++)
+        check += bytes[i];
+    return check == 0u;
+}
+
+/*
+ * blank:
+ * Returns nonzero if bytes hold a row that has never been programmed.
+ */
+static uint8 blank(const uint8 *bytes) {
+    uint16 i;
+
+    for (i = 0u; i < JOURNAL_PAGE; i++)
+        if (bytes[i] != 0u)
+            return 0u;
+    return 1u;
+}
+
+/*
+ * get_u32, put_u32, put_float:
+ * Read and write values as bytes, most significant first.
+ */
+static uint32 get_u32(const uint8 *bytes) CYREENTRANT {
+    return (uint32)bytes[0] << 24 | (uint32)bytes[1] << 16 |
+           (uint32)bytes[2] << 8 | bytes[3];
+}
+static void put_u32(uint8 *bytes, uint32 value) CYREENTRANT {
+    bytes[0] = (uint8)(value >> 24);
+    bytes[1] = (uint8)(value >> 16);
+    bytes[2] = (uint8)(value >> 8);
+    bytes[3] = (uint8)value;
+}
+static void put_float(uint8 *bytes, float value) CYREENTRANT {
+    union { float f; uint32 u; } v;
+
+    v.f = value;
+    put_u32(bytes, v.u);
+}
+
+#else
+
+/*
+ * journal_command:
+ * The shell's "journal" command, without the journal.
+ */
+void journal_command(const char *args) {
+    usb_uart_putline("The journal is left out of this build");
+}
+
+#endif
+
+//[] END OF FILE
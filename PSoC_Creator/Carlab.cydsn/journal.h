@@ -0,0 +1,150 @@
+/* ========================================
+ * journal.h
+ * Monica Lu and Victor Ying
+ *
+ * A log in the top rows of flash of what the car heard and did:
+ * every journal_every'th set of ping captures and the fix made
+ * from it, and the controllers' state every journal_control speed
+ * PID periods while driving. The oldest is overwritten first, so
+ * it holds the last minute or two, and it outlasts a reset, so
+ * when a car misbehaves on the track there is a record to replay
+ * off line whether or not the radio was listening. "journal dump"
+ * sends it over USB UART, and host/journal reads it.
+ *
+ * Flash is programmed a whole row at a time. Each row is a page:
+ *   magic  1 byte, JOURNAL_MAGIC
+ *   used   1 byte, bytes of entries after the header
+ *   seq    4 bytes, pages started since the journal was first used
+ *   high   4 bytes, the clock_stamp high word of every entry's time
+ *   boot   1 byte, counts resets, after each of which the clock
+ *          starts over
+ *   check  1 byte, making the header and entries add up to zero
+ * then entries, each a type byte and the 4 byte clock_now() time:
+ *   JOURNAL_PINGS    a count, then that many UltraTimer captures
+ *                    (4 bytes each), as positioningHandler read
+ *                    them; the time is when the last one arrived
+ *   JOURNAL_FIX      x, y, error, seq (2 bytes), excluded (1 byte)
+ *                    of the fix, timed as it is
+ *   JOURNAL_CONTROL  speed, speed_setpoint, power_output,
+ *                    distance_traveled, steer_output and
+ *                    steer_measurement()
+ * Multi-byte fields are most significant byte first, floats are
+ * IEEE single. The rows are used in turn, starting after the page
+ * with the highest seq, so they wear evenly.
+ *
+ * "journal dump" sends every good page, oldest first, in frames
+ * framed like scope.h's: JOURNAL_SYNC, a length byte, that many
+ * bytes of body, and a check byte making the length, body and
+ * check add up to zero. The body is the page's number in the dump
+ * (2 bytes), an offset into it (1 byte), and up to JOURNAL_CHUNK
+ * bytes of the page from there. The last frame's offset is
+ * JOURNAL_END, its page number how many pages were sent, and it
+ * has no data.
+ *
+ * The flash rows from JOURNAL_FIRST_ROW to the end are kept out of
+ * the code by RESERVE(C:0xE000-C:0xFFFF) on the linker's command line
+ * (Build Settings, Linker, Command Line), so a program that grows
+ * into them fails to link. journal.c won't compile if the rows are
+ * moved without it, and journal_init() turns the journal off if it
+ * finds anything there but blank rows and pages.
+ * ========================================
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <project.h>
+
+#include "position.h"
+#include "usb_uart.h"
+
+
+#define JOURNAL_ENABLE  // Comment this out to leave out the journal and its 514 bytes of RAM
+
+
+#define JOURNAL_FIRST_ROW 224u  // flash row the journal starts at, 0xE000
+#define JOURNAL_ROWS 32u  // up to the end of the 64 KB of flash
+#define JOURNAL_PAGE CY_FLASH_SIZEOF_ROW
+#define JOURNAL_HEADER 12u
+#define JOURNAL_MAGIC 0x4Au
+#define JOURNAL_FLUSH 1000000u  // in us; longest entries wait in RAM while positioning is idle
+#define JOURNAL_SYNC 0x04u  // starts a frame; never printed as text
+#define JOURNAL_CHUNK 56u  // bytes of a page in a frame, so a frame fits a USB packet
+#define JOURNAL_END 0xFFu
+
+
+// The values are part of the page format, so only add to the end
+enum journal_type {
+    JOURNAL_PINGS = 1u,
+    JOURNAL_FIX = 2u,
+    JOURNAL_CONTROL = 3u,
+};
+
+
+// Change these with param.c
+extern uint8 journal_every;  // sets of pings per one journaled, with its fix; 0 for none
+extern uint8 journal_control;  // speed PID periods per control sample; 0 for none
+
+
+#ifdef JOURNAL_ENABLE
+
+/*
+ * journal_init:
+ * Finds where the journal left off before the reset, and starts a new
+ * page after it. Must be called after clock_init().
+ */
+void journal_init(void) ;
+
+/*
+ * journal_pings:
+ * Called by the positioning interrupt handler with each set of captures,
+ * as read from UltraTimer, and the clock_now() time the last one arrived.
+ */
+void journal_pings(const uint32 *captures, uint32 time) ;
+
+/*
+ * journal_fix:
+ * Called from the main loop with every new position fix. Journals it if
+ * the pings it came from were, and lets journal_write() program flash now
+ * that the next pings are a while off.
+ */
+void journal_fix(const struct position_fix *fix) ;
+
+/*
+ * journal_sample:
+ * Called by the speed PID interrupt handler every period. Journals the
+ * controllers' state every journal_control periods while the car is
+ * driving.
+ */
+void journal_sample(void) ;
+
+/*
+ * journal_write:
+ * Run by sched.c after a fix, every JOURNAL_FLUSH, and while dumping.
+ * Programs the full page, or the filling one if it's been a while, into
+ * flash, and sends the dump.
+ */
+void journal_write(void) ;
+
+#else
+
+// Without the journal, its two pages take no RAM and nothing is journaled
+#define journal_init()
+#define journal_pings(captures, time)
+#define journal_fix(fix)
+#define journal_sample()
+#define journal_write()
+
+#endif
+
+/*
+ * journal_command:
+ * The shell's "journal" command. args is "dump" to send the journal, or
+ * empty to print how much it holds.
+ */
+void journal_command(const char *args) ;
+
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,342 @@
+/* ========================================
+ * line.c
+ * Monica Lu and Victor Ying
+ *
+ * Finds the line in several camera rows per field, and fits its
+ * position and curvature ahead of the car.
+ *
+ * Camera_Timer captures the start and end of each row and of the
+ * line in it. The rows of a field go into one half of a double
+ * buffer while the other half, holding the last complete field, is
+ * fitted. Without CAMERA_USE_DMA, the interrupt handler copies each
+ * row in as it's captured, and a field is complete once as many
+ * rows have arrived as the last field had.
+ *
+ * How long a row lasts depends on the camera's line rate, so the
+ * expected row length follows the rows accepted. If the camera
+ * changes so much that none are, it jumps to the length a long
+ * enough run of rejected rows agree on.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "line.h"
+#include "clock.h"
+#include "usb_uart.h"
+
+
+#define FASTEST_CLK_FREQ 48000000.0  // 48 MHz
+#define EXPECTED_ROW_LEN ((uint16)(0.000045 * FASTEST_CLK_FREQ))  // in clock cycles
+#define ACCEPTABLE_ROW_FRACTION 5  // rows within 1/5 of the expected length are accepted
+#define MIN_ROW_LEN (EXPECTED_ROW_LEN / 3u * 2u)  // range the expected length can follow
+#define MAX_ROW_LEN (EXPECTED_ROW_LEN / 2u * 3u)  // into, short of two rows together
+#define ROW_LEN_SHIFT 4  // expected length moves 1/16 of the way to each row accepted
+#define RELOCK_ROWS 32  // agreeing rejected rows before the expected length jumps
+#define MAX_LINE_FRACTION 4  // a black strip over 1/4 of the row is a crossing line
+#define FIELD_GAP 2000u  // in microseconds; longer between rows means a new field
+#define BUFFER_LEN (CAMERA_ROWS * CAMERA_CAPTURES)
+
+
+static uint16 captures[2][BUFFER_LEN];
+static uint8 filling = 0u;  // half of the buffer the camera is filling
+static uint8 ready_rows = 0u;  // rows in the other half
+
+static struct line_stats counts = {0u, 0u, 0u, 0u, 0u, 0u, 0u, EXPECTED_ROW_LEN, 0u};
+static uint32 row_length_sum = (uint32)EXPECTED_ROW_LEN << ROW_LEN_SHIFT;
+static uint16 candidate_length = 0u;  // what recent rejected rows agree on
+static uint8 candidate_rows = 0u;  // and how many of them in a row
+
+#ifndef CAMERA_USE_DMA
+static uint8 expected_rows = CAMERA_ROWS;
+static uint8 field_rows = 0u;  // rows captured so far this field
+static uint32 last_row_time = 0u;
+#endif
+
+
+/*
+ * line_init:
+ * Starts the camera comparator, timers and (with CAMERA_USE_DMA) DMA.
+ */
+void line_init(void) {
+#ifdef CAMERA_USE_DMA
+    uint8 channel, td[2], i;
+
+    // Each half of the buffer gets its own TD, chained into a loop, so the
+    // camera never waits on us
+    channel = Camera_DMA_DmaInitialize(2u, 1u, HI16(CYDEV_PERIPH_BASE),
+                                       HI16(CYDEV_SRAM_BASE));
+    td[0] = CyDmaTdAllocate();
+    td[1] = CyDmaTdAllocate();
+    for (i = 0u; i < 2u; i++) {
+        CyDmaTdSetConfiguration(td[i], sizeof(captures[i]), td[i ^ 1u],
+                                TD_INC_DST_ADR | TD_SWAP_EN |
+                                Camera_DMA__TD_TERMOUT_EN);
+        CyDmaTdSetAddress(td[i], LO16((uint32)Camera_Timer_CAPTURE_LSB_PTR),
+                          LO16((uint32)captures[i]));
+    }
+    CyDmaChSetInitialTd(channel, td[0]);
+    CyDmaChEnable(channel, 1u);
+#endif
+
+    Camera_Comp_Start();
+    Camera_Counter_Start();
+    Camera_Timer_Start();
+}
+
+/*
+ * line_capture:
+ * Only to be called from the camera interrupt handler. Takes the row (or
+ * with CAMERA_USE_DMA, the field) just captured, and returns nonzero if that
+ * completes a field.
+ */
+uint8 line_capture(void) {
+#ifdef CAMERA_USE_DMA
+    // The DMA has just filled one half and moved on to the other
+    ready_rows = CAMERA_ROWS;
+    filling ^= 1u;
+    return 1u;
+#else
+    uint16 row[CAMERA_CAPTURES];
+    uint32 now = clock_now();
+    uint8 i, done = 0u;
+
+    for (i = 0u; i < CAMERA_CAPTURES; i++)
+        row[i] = Camera_Timer_ReadCapture();
+
+    // A new field. If the last one ended early, it's complete now, and the
+    // next ones will probably be as short.
+    if (now - last_row_time > FIELD_GAP) {
+        if (field_rows > 0u && field_rows < expected_rows) {
+            expected_rows = field_rows;
+            ready_rows = field_rows;
+            filling ^= 1u;
+            done = 1u;
+        }
+        field_rows = 0u;
+    }
+    last_row_time = now;
+
+    // Rows beyond the ones expected are ignored until the next field
+    if (field_rows < CAMERA_ROWS) {
+        for (i = 0u; i < CAMERA_CAPTURES; i++)
+            captures[filling][field_rows * CAMERA_CAPTURES + i] = row[i];
+    }
+    field_rows++;
+    if (field_rows == expected_rows) {
+        ready_rows = expected_rows;
+        filling ^= 1u;
+        done = 1u;
+    }
+    else if (field_rows > expected_rows && field_rows <= CAMERA_ROWS) {
+        // The field is longer than we thought; expect more rows next time
+        expected_rows = field_rows;
+    }
+    return done;
+#endif
+}
+
+/*
+ * line_fit:
+ * Fits the line to the rows of the last complete field. Returns zero if the
+ * line wasn't in any of them, in which case *est is unchanged.
+ */
+enum line_result line_fit(struct line_estimate *est) {
+    return line_fit_rows(captures[filling ^ 1u], ready_rows, est);
+}
+
+/*
+ * track_row_length:
+ * Decides whether a row of the given length is a full row, and updates the
+ * expected length: accepted rows pull it towards their length, and a run
+ * of RELOCK_ROWS rejected rows of about the same length moves it there.
+ */
+static uint8 track_row_length(uint16 length) {
+    uint16 margin = counts.row_length / ACCEPTABLE_ROW_FRACTION;
+
+    if (length >= counts.row_length - margin &&
+            length <= counts.row_length + margin) {
+        row_length_sum += length - (row_length_sum >> ROW_LEN_SHIFT);
+        counts.row_length = row_length_sum >> ROW_LEN_SHIFT;
+        candidate_rows = 0u;
+        return 1u;
+    }
+
+    if (length < counts.row_length)
+        counts.rows_short++;
+    else
+        counts.rows_long++;
+    if (length < MIN_ROW_LEN || length > MAX_ROW_LEN) {
+        candidate_rows = 0u;
+    }
+    else if (candidate_rows > 0u &&
+             length >= candidate_length - candidate_length / ACCEPTABLE_ROW_FRACTION / 2u &&
+             length <= candidate_length + candidate_length / ACCEPTABLE_ROW_FRACTION / 2u) {
+        if (++candidate_rows == RELOCK_ROWS) {
+            counts.row_length = candidate_length;
+            row_length_sum = (uint32)candidate_length << ROW_LEN_SHIFT;
+            counts.relocks++;
+            candidate_rows = 0u;
+        }
+    }
+    else {
+        candidate_length = length;
+        candidate_rows = 1u;
+    }
+    return 0u;
+}
+
+/*
+ * line_fit_rows:
+ * Fits the line to the given rows of Camera_Timer captures, CAMERA_CAPTURES
+ * per row, the nearest row last. Rows that don't look like a full row with
+ * a single line in it are left out, and counted in the statistics. Unless
+ * the result is LINE_FOUND, *est is unchanged.
+ *
+ * The line's distance left of the middle of each row, in feet, is fitted
+ * with a + b*u + c*u^2 by least squares, where u is how far the row is
+ * beyond the nearest one. a is then the offset in the nearest row. The
+ * curvature is that of the fitted curve halfway out, 2c/(1 + slope^2)^1.5,
+ * which unlike 2c alone holds up in tight turns, where the line ahead
+ * swings well across the rows. With fewer than three rows, the curvature
+ * is left at zero, and with one, the slope too.
+ */
+enum line_result line_fit_rows(const uint16 *captures, uint8 rows,
+                               struct line_estimate *est) {
+    float s[5], t[3];  // sums of u^k, and of u^k times the distance left
+    float m, u, uk, left, det, a, b, c, slope;
+    uint16 row_length, black_length, black_mid_time, row_mid_time;
+    uint8 i, k, n = 0u, crossing = 0u;
+
+    for (k = 0u; k < 5u; k++)
+        s[k] = 0.0;
+    for (k = 0u; k < 3u; k++)
+        t[k] = 0.0;
+
+    for (i = 0u; i < rows; i++, captures += CAMERA_CAPTURES) {
+        // Only use rows that look like a full row containing a single black
+        // strip no wider than the line
+        row_length = captures[0] - captures[3];
+        if (!track_row_length(row_length))
+            continue;
+        black_length = captures[1] - captures[2];
+        if (black_length > row_length / MAX_LINE_FRACTION) {
+            counts.rows_crossing++;
+            crossing = 1u;
+            continue;
+        }
+        black_mid_time = captures[2] + (uint16)(captures[1] - captures[2])/2u;
+        row_mid_time = captures[3] + row_length/2u;
+        m = (float)(int16)(black_mid_time - row_mid_time) * 2 / (float)row_length;
+
+        // Farther rows see more of the ground
+        u = (rows - 1u - i) * CAMERA_ROW_SPACING;
+        left = m * CAMERA_NEAR_HALF_WIDTH * (1.0 + u / CAMERA_NEAR_ROW);
+
+        uk = 1.0;
+        for (k = 0u; k < 5u; k++) {
+            s[k] += uk;
+            if (k < 3u)
+                t[k] += uk * left;
+            uk *= u;
+        }
+        n++;
+    }
+    counts.rows += n;
+    counts.fields++;
+    if (n == 0u) {
+        if (crossing) {
+            counts.fields_crossing++;
+            return LINE_CROSSING;
+        }
+        counts.fields_none++;
+        return LINE_NONE;
+    }
+
+    a = t[0] / s[0];
+    b = c = 0.0;
+    if (n >= 3u) {
+        // Cramer's rule on the normal equations
+        det = s[0]*(s[2]*s[4] - s[3]*s[3]) - s[1]*(s[1]*s[4] - s[2]*s[3])
+              + s[2]*(s[1]*s[3] - s[2]*s[2]);
+        if (det != 0.0) {
+            a = (t[0]*(s[2]*s[4] - s[3]*s[3]) - s[1]*(t[1]*s[4] - s[3]*t[2])
+                 + s[2]*(t[1]*s[3] - s[2]*t[2])) / det;
+            b = (s[0]*(t[1]*s[4] - s[3]*t[2]) - t[0]*(s[1]*s[4] - s[3]*s[2])
+                 + s[2]*(s[1]*t[2] - t[1]*s[2])) / det;
+            c = (s[0]*(s[2]*t[2] - t[1]*s[3]) - s[1]*(s[1]*t[2] - t[1]*s[2])
+                 + t[0]*(s[1]*s[3] - s[2]*s[2])) / det;
+        }
+    }
+    else if (n == 2u) {
+        det = s[0]*s[2] - s[1]*s[1];
+        if (det != 0.0) {
+            a = (s[2]*t[0] - s[1]*t[1]) / det;
+            b = (s[0]*t[1] - s[1]*t[0]) / det;
+        }
+    }
+
+    slope = b + c * (rows - 1u) * CAMERA_ROW_SPACING;
+    est->offset = a / CAMERA_NEAR_HALF_WIDTH;
+    est->slope = b;
+    est->curvature = 2*c / pow(1.0 + slope*slope, 1.5);
+    est->rows = n;
+    return LINE_FOUND;
+}
+
+/*
+ * line_predict:
+ * Moves *est on to where the line should be seen after the car drives the
+ * given distance in feet along an arc of the given curvature (1/feet,
+ * positive left), supposing the line carries on as it was fitted.
+ *
+ * Angles are taken to be small. Seen from where the car was, the nearest
+ * row is now distance feet further on, and has moved left by
+ * curvature*distance^2/2 plus the turn, curvature*distance, times how far
+ * ahead it is.
+ */
+void line_predict(struct line_estimate *est, float distance, float curvature) {
+    float turn = curvature * distance;
+    float left = est->offset * CAMERA_NEAR_HALF_WIDTH + est->slope * distance
+                 + est->curvature * distance * distance / 2;
+
+    left -= turn * distance / 2 + turn * CAMERA_NEAR_ROW;
+    est->offset = left / CAMERA_NEAR_HALF_WIDTH;
+    est->slope += est->curvature * distance - turn;
+}
+
+/*
+ * line_get_stats:
+ * Copies the row and field statistics into *stats.
+ */
+void line_get_stats(struct line_stats *stats) {
+    uint8 status = CyEnterCriticalSection();
+    *stats = counts;
+    CyExitCriticalSection(status);
+}
+
+/*
+ * line_print_stats:
+ * Prints the row and field statistics over USB UART.
+ */
+void line_print_stats(void) {
+    struct line_stats copy;
+    char strbuf[96];
+
+    line_get_stats(&copy);
+    sprintf(strbuf, "Rows: %lu fitted, %lu short, %lu long, %lu crossing",
+            (unsigned long)copy.rows, (unsigned long)copy.rows_short,
+            (unsigned long)copy.rows_long, (unsigned long)copy.rows_crossing);
+    usb_uart_putline(strbuf);
+    sprintf(strbuf, "Fields: %lu, %lu crossing, %lu without the line",
+            (unsigned long)copy.fields, (unsigned long)copy.fields_crossing,
+            (unsigned long)copy.fields_none);
+    usb_uart_putline(strbuf);
+    sprintf(strbuf, "Row length: %u counts, relocked %u times",
+            copy.row_length, copy.relocks);
+    usb_uart_putline(strbuf);
+}
+
+//[] END OF FILE
@@ -0,0 +1,116 @@
+/* ========================================
+ * line.h
+ * Monica Lu and Victor Ying
+ *
+ * Finds the line in several camera rows per field, and fits its
+ * position and curvature ahead of the car. Also notices crossing
+ * lines, and keeps track of how long a camera row is.
+ * ========================================
+ */
+
+#ifndef LINE_H
+#define LINE_H
+
+#include <project.h>
+
+
+// Rows captured per field; the capture buffer holds this many. Camera_Counter
+// decides which rows are captured, so it must agree.
+#ifndef CAMERA_ROWS
+#define CAMERA_ROWS 6
+#endif
+
+// Uncomment this to have Camera_DMA move the captures into the buffer, with
+// Camera_IRQ on its end of transfer, so there is one interrupt per field
+// instead of one per row. Needs Camera_DMA in TopDesign.
+//#define CAMERA_USE_DMA
+
+#define CAMERA_CAPTURES 4  // per row: row start, line start, line end, row end
+
+// Where the rows are on the ground. The nearest row is the last captured.
+#define CAMERA_NEAR_ROW 1.0  // feet ahead of the center of the car
+#define CAMERA_ROW_SPACING 0.25  // feet between rows
+#define CAMERA_NEAR_HALF_WIDTH 0.5  // feet from the middle of the nearest row to its edge
+
+
+enum line_result {
+    LINE_NONE = 0u,  // no row had the line in it
+    LINE_FOUND = 1u,  // some did, and it has been fitted
+    LINE_CROSSING = 2u,  // none did, but some were crossed by a wide black strip
+};
+
+struct line_estimate {
+    float offset;  // in the nearest row, from -1.0 to 1.0 across it, positive left
+    float slope;  // at the nearest row, feet left per foot ahead
+    float curvature;  // in units of 1/feet, positive for curving left
+    uint8 rows;  // number of rows the line was found in
+};
+
+struct line_stats {
+    uint32 rows;  // rows fitted
+    uint32 rows_short;  // left out for being shorter than a row should be
+    uint32 rows_long;  // or longer, usually two rows run together
+    uint32 rows_crossing;  // left out for a black strip too wide for the line
+    uint32 fields;  // fields fitted
+    uint32 fields_crossing;  // with no line, but a crossing line
+    uint32 fields_none;  // with neither
+    uint16 row_length;  // expected, in Camera_Timer counts
+    uint16 relocks;  // times the expected row length jumped to a new one
+};
+
+
+/*
+ * line_init:
+ * Starts the camera comparator, timers and (with CAMERA_USE_DMA) DMA.
+ */
+void line_init(void) ;
+
+/*
+ * line_capture:
+ * Only to be called from the camera interrupt handler. Takes the row (or
+ * with CAMERA_USE_DMA, the field) just captured, and returns nonzero if that
+ * completes a field.
+ */
+uint8 line_capture(void) ;
+
+/*
+ * line_fit:
+ * Fits the line to the rows of the last complete field. Unless the result
+ * is LINE_FOUND, *est is unchanged.
+ */
+enum line_result line_fit(struct line_estimate *est) ;
+
+/*
+ * line_fit_rows:
+ * Fits the line to the given rows of Camera_Timer captures, CAMERA_CAPTURES
+ * per row, the nearest row last. Rows that don't look like a full row with
+ * a single line in it are left out, and counted in the statistics. Unless
+ * the result is LINE_FOUND, *est is unchanged.
+ */
+enum line_result line_fit_rows(const uint16 *captures, uint8 rows,
+                               struct line_estimate *est) ;
+
+/*
+ * line_predict:
+ * Moves *est on to where the line should be seen after the car drives the
+ * given distance in feet along an arc of the given curvature (1/feet,
+ * positive left), supposing the line carries on as it was fitted.
+ */
+void line_predict(struct line_estimate *est, float distance, float curvature) ;
+
+/*
+ * line_get_stats:
+ * Copies the row and field statistics into *stats.
+ */
+void line_get_stats(struct line_stats *stats) ;
+
+/*
+ * line_print_stats:
+ * Prints the row and field statistics over USB UART.
+ */
+void line_print_stats(void) ;
+
+
+#endif
+
+//[] END OF FILE
@@ -3,11 +3,29 @@
  * Victor A. Ying and Monica Lu
  *
  * This is the main program. It contains very little code.
+ *
+ * RAM: the CY8C3866 has 8 KB of SRAM. Keil's large memory model
+ * puts our variables there, along with the generated components',
+ * the locals of non-reentrant functions (which the linker overlays)
+ * and the stack of CYREENTRANT functions' locals. Our variables are
+ * kept to about 5 KB to leave room for the rest. The biggest, in
+ * bytes on the 8051, and what sets their size:
+ *   record.c    recording     784  RECORD_BUFFER_SIZE
+ *   timing.c    statistics    735  TIMING_ENABLE
+ *   trace.c     event ring    580  TRACE_LEN, TRACE_ENABLE
+ *   journal.c   two pages     552  JOURNAL_ENABLE
+ *   odometry.c  tick history  365  ODOMETRY_HISTORY_LEN
+ *   scope.c     sample ring   363  SCOPE_RING
+ *   param.c     frame buffer  268  PARAM_MAX_BODY
+ *   profile.c   lap table     265  PROFILE_MAX_BINS
+ *   path.c      segments      198  the waypoints
+ *   the rest                 1030
+ * Keep anything new that adds RAM within this, and check the xdata
+ * figure in the "Program Size" line at the end of the build.
  * ========================================
  */
 
 #include <project.h>
-#include <stdio.h>
 
 #include "usb_uart.h"
 #include "shell.h"
@@ -15,6 +33,9 @@
 #include "speed.h"
 #include "steer.h"
 #include "position.h"
+#include "clock.h"
+#include "sched.h"
+#include "journal.h"
 
 /*
  * MAIN PROGRAM
@@ -32,40 +53,23 @@ int main(void) {
     // Initialize radio communincation
     UART_Start();
     
+    // Start the shared time base
+    clock_init();
+    
+    // Carry on the flash journal from before the reset
+    journal_init();
+    
     // Begin positioning
     position_init();
     
     // Initialize navigation stuff
     drive_init();
     
-    // Main loop performs user interface/communication actions.
-    // Other actions are performed in interrupt handlers.
+    // Main loop runs the tasks in sched.c, which hall ticks, position
+    // fixes and timers make ready. Other actions are performed in
+    // interrupt handlers.
     for (;;) {
-//        shell_handle_received_chars();
-//        speed_display_info();
-
-        // Display position to LCD
-        if (position_data_available()) {
-            char buf[32], radiobuf[32];
-            float x, y;
-            uint16 counter = 0u;
-            uint8 status = CyEnterCriticalSection();
-            x = position_x();
-            y = position_y();
-            sprintf(radiobuf, "X%.2fY%.2f\n", x, y);
-            UART_PutString(radiobuf);
-            /*
-            LCD_Position(0,0);
-            LCD_PrintNumber(counter++);
-            sprintf(buf, "Error:%.2f   ", error());
-            LCD_Position(0,4);
-            LCD_PrintString(buf);
-            sprintf(buf, "X:%.2f Y:%.2f    ", x, y);
-            LCD_Position(1,0);
-            LCD_PrintString(buf);
-            */
-            CyExitCriticalSection(status);
-        }        
+        sched_poll();
     }
 }
 
@@ -0,0 +1,263 @@
+/* ========================================
+ * odometry.c
+ * Monica Lu and Victor Ying
+ *
+ * Remembers recent hall sensor ticks and the steering at each,
+ * so that the path driven since some time can be dead reckoned.
+ *
+ * Speed is estimated by a least squares fit of tick times against
+ * tick number over the last SPEED_WINDOW ticks. The tick numbers
+ * are fixed (0 for the oldest up to n-1 for the newest), so the
+ * fit only needs running sums of t and s*t, both of which can be
+ * slid along by one tick in O(1). The sums are kept in modular
+ * unsigned arithmetic: the fitted slope doesn't change when all
+ * the times are shifted, so wrapping around cancels out.
+ * ========================================
+ */
+
+#include <project.h>
+#include <math.h>
+
+#include "odometry.h"
+#include "clock.h"
+#include "steer.h"
+
+
+#define MAX_ACCEL 20.0  // in feet per second squared; more is noise
+
+
+struct tick {
+    uint32 time;  // clock_now() time of the tick
+    int8 steer;  // steer_output at the tick, scaled by 127
+};
+
+// Ring of recent ticks, written only by the hall sensor handler, and read
+// under a seqlock the same way as the position history.
+static volatile struct tick ticks[ODOMETRY_HISTORY_LEN];
+static volatile uint8 ticks_head = 0u;
+static volatile uint8 ticks_count = 0u;
+static volatile uint8 seqlock = 0u;
+
+// Speed estimator state, also only touched by the hall sensor handler
+static uint8 window = 0u;  // number of ticks currently being fit
+static uint32 sum_t = 0u, sum_st = 0u;  // sums of t and s*t over the window
+static float tick_rate = 0.0;  // fitted ticks per second at the newest tick
+static float accel = 0.0;
+static float prev_rates[SPEED_WINDOW / 2];  // fits from the last few ticks
+static uint32 prev_times[SPEED_WINDOW / 2];  // and the times they're centered on
+static uint8 prev_index = 0u;
+
+
+/*
+ * odometry_tick_distance:
+ * Returns the distance traveled by the center of the car during one tick
+ * with the given steering output.
+ */
+float odometry_tick_distance(float steer) CYREENTRANT {
+    return DISTANCE_PER_TICK / (1.0 + steer * SPEED_ADJUSTMENT_COEFFICIENT);
+}
+
+/*
+ * update_estimate:
+ * Adds a tick at time t to the least squares window, sliding the oldest one
+ * out if it's full, and refits.
+ */
+static void update_estimate(uint32 t) {
+    uint32 newest = ticks[ticks_head].time;
+    uint32 center, numerator, sum_s;
+    float rate, denominator, span;
+    
+    // After a long gap we had stopped, and the old ticks say nothing about now
+    if (window > 0 && t - newest > SPEED_STALE_TIME) {
+        window = 0u;
+        sum_t = 0u;
+        sum_st = 0u;
+        tick_rate = 0.0;
+        accel = 0.0;
+    }
+    
+    if (window < SPEED_WINDOW) {
+        sum_t += t;
+        sum_st += window * t;
+        window++;
+    }
+    else {
+        uint8 oldest_index = (ticks_head + ODOMETRY_HISTORY_LEN - (SPEED_WINDOW - 1))
+                             % ODOMETRY_HISTORY_LEN;
+        uint32 oldest = ticks[oldest_index].time;
+        
+        sum_st -= sum_t - oldest;
+        sum_st += (SPEED_WINDOW - 1) * t;
+        sum_t += t - oldest;
+    }
+    if (window < 2)
+        return;
+    
+    // Slope of t against s: (n*sum(st) - sum(s)sum(t)) / (n*sum(s^2) - sum(s)^2)
+    sum_s = (uint32)window * (window - 1) / 2;
+    numerator = window * sum_st - sum_s * sum_t;
+    denominator = (float)window * window * ((uint32)window * window - 1) / 12;
+    span = (float)(int32)numerator / denominator;  // microseconds per tick
+    if (span <= 0.0)
+        return;
+    rate = CLOCK_TICKS_PER_SECOND / span;
+    
+    // The fit is for the middle of the window; compare it with the fit from
+    // half a window ago to get the acceleration, and use that to bring the
+    // estimate up to the newest tick.
+    center = t - (uint32)(span * (window - 1) / 2);
+    if (window == SPEED_WINDOW) {
+        float dt = (float)(int32)(center - prev_times[prev_index]) /
+                   CLOCK_TICKS_PER_SECOND;
+        if (dt > 0.0) {
+            accel = (rate - prev_rates[prev_index]) * DISTANCE_PER_TICK / dt;
+            if (accel > MAX_ACCEL)
+                accel = MAX_ACCEL;
+            else if (accel < -MAX_ACCEL)
+                accel = -MAX_ACCEL;
+        }
+    }
+    prev_rates[prev_index] = rate;
+    prev_times[prev_index] = center;
+    prev_index = (prev_index + 1) % (SPEED_WINDOW / 2);
+    
+    rate += accel / DISTANCE_PER_TICK * (float)(int32)(t - center) /
+            CLOCK_TICKS_PER_SECOND;
+    tick_rate = rate > 0.0 ? rate : 0.0;
+}
+
+/*
+ * odometry_record_tick:
+ * Remembers a tick seen at the given clock_now() time with the given
+ * steering output, and updates the speed estimate.
+ */
+void odometry_record_tick(uint32 time, float steer) {
+    uint8 next = (ticks_head + 1) % ODOMETRY_HISTORY_LEN;
+    
+    update_estimate(time);
+    
+    seqlock++;
+    ticks[next].time = time;
+    ticks[next].steer = (int8)(steer * 127.0);
+    ticks_head = next;
+    if (ticks_count < ODOMETRY_HISTORY_LEN)
+        ticks_count++;
+    seqlock++;
+}
+
+/*
+ * odometry_speed:
+ * Returns the estimated speed in feet per second, no more than the speed at
+ * which the next tick would already have arrived.
+ */
+float odometry_speed(void) CYREENTRANT {
+    float rate, bound;
+    uint32 since;
+    uint8 status = CyEnterCriticalSection();
+    
+    rate = tick_rate;
+    since = clock_now() - ticks[ticks_head].time;
+    
+    CyExitCriticalSection(status);
+    
+    // Capture times can land a little after clock_now; treat that as no gap
+    if ((int32)since <= 0)
+        since = 0u;
+    if (since > SPEED_STALE_TIME)
+        return 0.0;
+    if (since > 0u) {
+        bound = CLOCK_TICKS_PER_SECOND / (float)since;
+        if (bound < rate)
+            rate = bound;
+    }
+    return rate * odometry_tick_distance(steer_output);
+}
+
+/*
+ * odometry_accel:
+ * Returns the estimated acceleration in feet per second squared.
+ */
+float odometry_accel(void) {
+    return accel;
+}
+
+/*
+ * rotate:
+ * Rotates the unit vector (*c, *s) counterclockwise by a small angle, which
+ * is much cheaper than calling cos() and sin() again.
+ */
+static void rotate(float *c, float *s, float angle) {
+    float cos_angle = 1.0 - angle*angle/2;
+    float sin_angle = angle;
+    float new_c = *c*cos_angle - *s*sin_angle;
+    
+    *s = *s*cos_angle + *c*sin_angle;
+    *c = new_c;
+}
+
+/*
+ * odometry_integrate:
+ * Dead reckons the path driven from time since until now. Each tick is
+ * treated as a short arc of constant curvature, integrated at its midpoint.
+ */
+uint8 odometry_integrate(uint32 since, float heading,
+                         float *dx, float *dy, float *dheading) {
+    uint8 seq, index, count, covered;
+    uint32 now = clock_now();
+    
+    do {
+        float c = cos(heading), s = sin(heading), turn = 0.0, step, half_turn;
+        uint32 last_time = since;
+        
+        seq = seqlock;
+        *dx = 0.0;
+        *dy = 0.0;
+        
+        // Walk back to the oldest remembered tick after time since
+        index = ticks_head;
+        count = 0u;
+        while (count < ticks_count && (int32)(ticks[index].time - since) > 0) {
+            index = (index + ODOMETRY_HISTORY_LEN - 1) % ODOMETRY_HISTORY_LEN;
+            count++;
+        }
+        
+        // If every remembered tick is newer, some may have been forgotten
+        covered = count < ticks_count || ticks_count < ODOMETRY_HISTORY_LEN;
+        
+        // Then integrate forward through each of them
+        while (count > 0) {
+            float steer;
+            
+            index = (index + 1) % ODOMETRY_HISTORY_LEN;
+            count--;
+            steer = ticks[index].steer / 127.0;
+            step = odometry_tick_distance(steer);
+            half_turn = steer_curvature(steer) * step / 2;
+            rotate(&c, &s, half_turn);
+            *dx += step * c;
+            *dy += step * s;
+            rotate(&c, &s, half_turn);
+            turn += 2 * half_turn;
+            last_time = ticks[index].time;
+        }
+        
+        // Extrapolate part of a tick for the time since the most recent one
+        step = odometry_speed() * (float)(int32)(now - last_time) /
+               CLOCK_TICKS_PER_SECOND;
+        if (step > DISTANCE_PER_TICK)
+            step = DISTANCE_PER_TICK;
+        if (step > 0.0) {
+            half_turn = steer_curvature(steer_output) * step / 2;
+            rotate(&c, &s, half_turn);
+            *dx += step * c;
+            *dy += step * s;
+            turn += 2 * half_turn;
+        }
+        
+        *dheading = turn;
+    } while ((seq & 1u) || seq != seqlock);
+    
+    return covered;
+}
+
+//[] END OF FILE
@@ -0,0 +1,70 @@
+/* ========================================
+ * odometry.h
+ * Monica Lu and Victor Ying
+ *
+ * Remembers recent hall sensor ticks and the steering at each,
+ * so that the path driven since some time can be dead reckoned.
+ * ========================================
+ */
+
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include <project.h>
+
+
+#define DISTANCE_PER_TICK 0.1285  // in feet
+#define ODOMETRY_HISTORY_LEN 64  // number of ticks remembered
+#define SPEED_WINDOW 8  // most ticks fit at once by the speed estimator
+#define SPEED_STALE_TIME 250000u  // in microseconds; longer means we'd stopped
+
+// Because the speed sensor is on the right side of the car, it underestimates
+// speed during right turns and overestimates during left turns. This is for a
+// compensating correction term.
+#define SPEED_ADJUSTMENT_COEFFICIENT (-0.12)
+
+
+/*
+ * odometry_tick_distance:
+ * Returns the distance traveled by the center of the car during one tick
+ * with the given steering output.
+ */
+float odometry_tick_distance(float steer) CYREENTRANT ;
+
+/*
+ * odometry_record_tick:
+ * Remembers a tick seen at the given clock_now() time with the given
+ * steering output, and updates the speed estimate. Only to be called from
+ * the hall sensor handler.
+ */
+void odometry_record_tick(uint32 time, float steer) ;
+
+/*
+ * odometry_speed:
+ * Returns the estimated speed in feet per second. Between ticks, the
+ * estimate never exceeds the speed at which the next tick would already
+ * have arrived.
+ */
+float odometry_speed(void) CYREENTRANT ;
+
+/*
+ * odometry_accel:
+ * Returns the estimated acceleration in feet per second squared.
+ */
+float odometry_accel(void) ;
+
+/*
+ * odometry_integrate:
+ * Dead reckons the path driven from time since until now, assuming the car
+ * was pointing in direction heading (radians counterclockwise from the +x
+ * axis) at time since. Stores the displacement in feet in *dx and *dy, and
+ * the change in heading in *dheading. Returns nonzero if the remembered
+ * ticks reach back all the way to time since. Must not be called from an
+ * interrupt handler.
+ */
+uint8 odometry_integrate(uint32 since, float heading,
+                         float *dx, float *dy, float *dheading) ;
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,446 @@
+/* ========================================
+ * param.c
+ * Monica Lu and Victor Ying
+ *
+ * Named, typed tunable parameters, set from the shell or in
+ * batches over the binary frame protocol described in param.h.
+ *
+ * Each parameter points at the variable that holds it. Variables
+ * read by interrupt handlers are only written with interrupts off,
+ * and PID gains go through pid_set_gains(), which converts them to
+ * the controller's fixed point.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "param.h"
+#include "clock.h"
+#include "usb_uart.h"
+#include "pid.h"
+#include "speed.h"
+#include "steer.h"
+#include "drive.h"
+#include "position.h"
+#include "radio.h"
+#include "agc.h"
+#include "journal.h"
+
+
+#define FRAME_TIMEOUT 100000u  // in microseconds; a frame stalled this long is dropped
+#define GET_RESULT_LEN 6u  // id, status and value
+#define SET_ARG_LEN 5u  // id and value
+
+// How a parameter is stored
+enum kind {
+    KIND_FLOAT = 0u,
+    KIND_UINT8 = 1u,
+    KIND_KP = 2u,  // gains of a struct pid
+    KIND_KI = 3u,
+    KIND_KD = 4u,
+};
+
+enum state {
+    IDLE = 0u,
+    LENGTH = 1u,
+    BODY = 2u,
+    CHECK = 3u,
+};
+
+struct param {
+    const char *name;
+    enum kind kind;
+    void *var;
+    float min, max;
+};
+
+
+// Sorted by name, for param_find()
+static CYCODE const struct param params[] = {
+    {"agc", KIND_UINT8, &agc_enabled, 0.0, 1.0},
+    {"agcafter", KIND_UINT8, &agc_after, 1.0, AGC_MAX_WINDOW},
+    {"agcstep", KIND_UINT8, &agc_step, 0.0, 64.0},
+    {"agcwindow", KIND_UINT8, &agc_window, 1.0, AGC_MAX_WINDOW},
+    {"carid", KIND_UINT8, &radio_car, 0.0, 255.0},
+    {"journalctl", KIND_UINT8, &journal_control, 0.0, 255.0},
+    {"journalsets", KIND_UINT8, &journal_every, 0.0, 255.0},
+    {"maxerror", KIND_FLOAT, &position_max_error, 0.0, 100.0},
+    {"maxiter", KIND_UINT8, &position_max_iterations, 1.0, 255.0},
+    {"maxsubsets", KIND_UINT8, &position_max_subsets, 0.0, POSITION_MAX_SUBSETS},
+    {"radioslots", KIND_UINT8, &radio_slots, 0.0, RADIO_MAX_SLOTS},
+    {"solvestep", KIND_FLOAT, &position_step, 0.0, 1.0},
+    {"solvetol", KIND_FLOAT, &position_tolerance, 0.0, 100.0},
+    {"speedkd", KIND_KD, &speed_pid, 0.0, 1000.0},
+    {"speedki", KIND_KI, &speed_pid, 0.0, 1000.0},
+    {"speedkp", KIND_KP, &speed_pid, 0.0, 1000.0},
+    {"speedset", KIND_FLOAT, &speed_setpoint, -20.0, 20.0},
+    {"steerkd", KIND_KD, &steer_pid, 0.0, 1000.0},
+    {"steerki", KIND_KI, &steer_pid, 0.0, 1000.0},
+    {"steerkp", KIND_KP, &steer_pid, 0.0, 1000.0},
+    {"stopdist", KIND_FLOAT, &drive_stop_distance, 0.0, 10000.0},
+};
+
+#define NUM_PARAMS (sizeof(params) / sizeof(params[0]))
+
+// A frame's body is received where its reply's body goes, and the reply is
+// written over it, so one buffer holds both: sync, length, body and check
+static uint8 buffer[PARAM_MAX_BODY + 3u];
+static uint8 *const frame = buffer + 2;
+static enum state state = IDLE;
+static uint8 frame_len, received, sum;
+static uint32 last_byte_time;
+
+
+/*
+ * type:
+ * Returns the type a parameter is reported as.
+ */
+static enum param_type type(uint8 id) {
+    return params[id].kind == KIND_UINT8 ? PARAM_UINT8 : PARAM_FLOAT;
+}
+
+/*
+ * put_float, get_float:
+ * Convert between floats and four bytes, most significant first.
+ */
+static void put_float(uint8 *bytes, float value) {
+    union { float f; uint32 u; } v;
+
+    v.f = value;
+    bytes[0] = (uint8)(v.u >> 24);
+    bytes[1] = (uint8)(v.u >> 16);
+    bytes[2] = (uint8)(v.u >> 8);
+    bytes[3] = (uint8)v.u;
+}
+static float get_float(const uint8 *bytes) {
+    union { float f; uint32 u; } v;
+
+    v.u = (uint32)bytes[0] << 24 | (uint32)bytes[1] << 16 |
+          (uint32)bytes[2] << 8 | bytes[3];
+    return v.f;
+}
+
+/*
+ * in_range:
+ * Returns nonzero if value can be given to the parameter. NaN never can.
+ */
+static uint8 in_range(uint8 id, float value) {
+    return value >= params[id].min && value <= params[id].max;
+}
+
+/*
+ * param_find:
+ * Returns the id of the parameter with the given name, or PARAM_NONE.
+ */
+uint8 param_find(const char *name) {
+    uint8 low = 0u, high = NUM_PARAMS;
+
+    while (low < high) {
+        uint8 mid = (low + high) / 2u;
+        int cmp = strcmp(name, params[mid].name);
+
+        if (cmp == 0)
+            return mid;
+        if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1u;
+    }
+    return PARAM_NONE;
+}
+
+/*
+ * param_get:
+ * Returns the value of the given parameter.
+ */
+float param_get(uint8 id) {
+    const struct param *p = &params[id];
+    float value;
+    uint8 status = CyEnterCriticalSection();
+
+    switch (p->kind) {
+    case KIND_FLOAT:
+        value = *(float *)p->var;
+        break;
+    case KIND_UINT8:
+        value = *(uint8 *)p->var;
+        break;
+    case KIND_KP:
+        value = PID_TO_FLOAT(((struct pid *)p->var)->kp);
+        break;
+    case KIND_KI:
+        value = PID_TO_FLOAT(((struct pid *)p->var)->ki);
+        break;
+    default:
+        value = PID_TO_FLOAT(((struct pid *)p->var)->kd);
+        break;
+    }
+
+    CyExitCriticalSection(status);
+    return value;
+}
+
+/*
+ * param_set:
+ * Sets the given parameter, if value is in its range, and returns a
+ * param_status.
+ */
+uint8 param_set(uint8 id, float value) {
+    const struct param *p;
+    uint8 status;
+
+    if (id >= NUM_PARAMS)
+        return PARAM_BAD_ID;
+    if (!in_range(id, value))
+        return PARAM_OUT_OF_RANGE;
+    p = &params[id];
+
+    status = CyEnterCriticalSection();
+    switch (p->kind) {
+    case KIND_FLOAT:
+        *(float *)p->var = value;
+        break;
+    case KIND_UINT8:
+        *(uint8 *)p->var = (uint8)(value + 0.5);
+        break;
+    case KIND_KP:
+        pid_set_kp((struct pid *)p->var, value);
+        break;
+    case KIND_KI:
+        pid_set_ki((struct pid *)p->var, value);
+        break;
+    default:
+        pid_set_kd((struct pid *)p->var, value);
+        break;
+    }
+    CyExitCriticalSection(status);
+
+    return PARAM_OK;
+}
+
+/*
+ * param_command:
+ * If name is a parameter, prints it, or sets it to the value in args if
+ * there is one, and returns nonzero. Otherwise returns zero.
+ */
+uint8 param_command(const char *name, const char *args) {
+    char strbuf[64];
+    uint8 id = param_find(name);
+
+    if (id == PARAM_NONE)
+        return 0u;
+
+    if (*args != '\0' && param_set(id, atof(args)) != PARAM_OK) {
+        sprintf(strbuf, "%s must be from %g to %g", params[id].name,
+                params[id].min, params[id].max);
+        usb_uart_putline(strbuf);
+    }
+    sprintf(strbuf, "%s = %g", params[id].name, param_get(id));
+    usb_uart_putline(strbuf);
+    return 1u;
+}
+
+/*
+ * param_print:
+ * Prints every parameter with its id, value and range over USB UART.
+ */
+void param_print(void) {
+    char strbuf[80];
+    uint8 id;
+
+    for (id = 0u; id < NUM_PARAMS; id++) {
+        sprintf(strbuf, "%2u %-10s %-10g %s from %g to %g", id,
+                params[id].name, param_get(id),
+                type(id) == PARAM_UINT8 ? "integer" : "float",
+                params[id].min, params[id].max);
+        usb_uart_putline(strbuf);
+    }
+}
+
+/*
+ * send_reply:
+ * Sends a reply whose body has been written over the frame.
+ */
+static void send_reply(uint8 len) {
+    uint8 check = len, i;
+
+    for (i = 0u; i < len; i++)
+        check += frame[i];
+    buffer[0] = PARAM_SYNC;
+    buffer[1] = len;
+    frame[len] = (uint8)-check;
+    usb_uart_putdata(buffer, len + 3u);
+}
+
+/*
+ * list:
+ * Writes (id, type, name length, name) from parameter first on, as many as
+ * fit, to out. Returns the number of bytes written.
+ */
+static uint8 list(uint8 first, uint8 *out, uint8 space) {
+    uint8 id, len, n = 0u;
+
+    for (id = first; id < NUM_PARAMS; id++) {
+        len = strlen(params[id].name);
+        if (n + 3u + len > space)
+            break;
+        out[n++] = id;
+        out[n++] = type(id);
+        out[n++] = len;
+        memcpy(out + n, params[id].name, len);
+        n += len;
+    }
+    return n;
+}
+
+/*
+ * arg_status:
+ * Returns the param_status of setting parameter id to value.
+ */
+static uint8 arg_status(uint8 id, float value) {
+    if (id >= NUM_PARAMS)
+        return PARAM_BAD_ID;
+    return in_range(id, value) ? PARAM_OK : PARAM_OUT_OF_RANGE;
+}
+
+/*
+ * get:
+ * Writes (id, status, value) for each of the n ids in args to out. out may
+ * be args + 1, as when the reply overwrites the frame: results are written
+ * last first, and result i only covers arguments after the ith.
+ */
+static uint8 get(const uint8 *args, uint8 n, uint8 *out) {
+    uint8 i, id, result = PARAM_OK;
+
+    for (i = n; i-- > 0u; ) {
+        id = args[i];
+        out[i * GET_RESULT_LEN] = id;
+        out[i * GET_RESULT_LEN + 1u] = id < NUM_PARAMS ? PARAM_OK : PARAM_BAD_ID;
+        put_float(out + i * GET_RESULT_LEN + 2u,
+                  id < NUM_PARAMS ? param_get(id) : 0.0);
+        if (id >= NUM_PARAMS)
+            result = PARAM_BAD_ID;
+    }
+    return result;
+}
+
+/*
+ * set:
+ * Sets the n (id, value) pairs in args, if all of them can be, at once.
+ * Writes (id, status, value) for each to out, with the value read back.
+ * Returns the overall status. out may be args + 1, as for get().
+ */
+static uint8 set(const uint8 *args, uint8 n, uint8 *out) {
+    uint8 i, id, status, result = PARAM_OK;
+    float value;
+
+    for (i = 0u; i < n; i++) {
+        status = arg_status(args[i * SET_ARG_LEN],
+                            get_float(args + i * SET_ARG_LEN + 1u));
+        if (status != PARAM_OK)
+            result = status;
+    }
+
+    if (result == PARAM_OK) {
+        status = CyEnterCriticalSection();
+        for (i = 0u; i < n; i++)
+            param_set(args[i * SET_ARG_LEN], get_float(args + i * SET_ARG_LEN + 1));
+        CyExitCriticalSection(status);
+    }
+
+    // Each argument is read before its result overwrites it
+    for (i = n; i-- > 0u; ) {
+        id = args[i * SET_ARG_LEN];
+        value = get_float(args + i * SET_ARG_LEN + 1u);
+        out[i * GET_RESULT_LEN] = id;
+        out[i * GET_RESULT_LEN + 1u] = arg_status(id, value);
+        put_float(out + i * GET_RESULT_LEN + 2u,
+                  id < NUM_PARAMS ? param_get(id) : 0.0);
+    }
+    return result;
+}
+
+/*
+ * handle_frame:
+ * Carries out the request in frame and replies to it, with the reply's body
+ * (op, status and results) written over the frame's (op and arguments).
+ */
+static void handle_frame(void) {
+    uint8 op = frame_len > 0u ? frame[0] : 0u;
+    uint8 n = frame_len - 1u;  // bytes of arguments
+    uint8 len = 2u, status = PARAM_BAD_REQUEST;
+
+    if (frame_len == 0u) {
+        // Nothing to do
+    }
+    else if (op == PARAM_OP_LIST && n == 1u) {
+        len += list(frame[1], frame + 2, PARAM_MAX_BODY - 2u);
+        status = PARAM_OK;
+    }
+    else if (op == PARAM_OP_GET &&
+             n <= (PARAM_MAX_BODY - 2u) / GET_RESULT_LEN) {
+        status = get(frame + 1, n, frame + 2);
+        len += n * GET_RESULT_LEN;
+    }
+    else if (op == PARAM_OP_SET && n % SET_ARG_LEN == 0u &&
+             n / SET_ARG_LEN <= (PARAM_MAX_BODY - 2u) / GET_RESULT_LEN) {
+        status = set(frame + 1, n / SET_ARG_LEN, frame + 2);
+        len += n / SET_ARG_LEN * GET_RESULT_LEN;
+    }
+
+    frame[0] = op;
+    frame[1] = status;
+    send_reply(len);
+}
+
+/*
+ * param_receive:
+ * Passes a byte from USB UART to the binary frame decoder. Returns nonzero
+ * if the byte was part of a frame, zero if it's for the shell. Replies to
+ * each whole frame.
+ */
+uint8 param_receive(uint8 c) {
+    uint32 now = clock_now();
+
+    // Give up on a frame the host stopped sending part way through
+    if (state != IDLE && now - last_byte_time > FRAME_TIMEOUT)
+        state = IDLE;
+    last_byte_time = now;
+
+    switch (state) {
+    case IDLE:
+        if (c != PARAM_SYNC)
+            return 0u;
+        state = LENGTH;
+        break;
+    case LENGTH:
+        frame_len = c;
+        received = 0u;
+        sum = c;
+        state = frame_len > 0u ? BODY : CHECK;
+        break;
+    case BODY:
+        frame[received++] = c;
+        sum += c;
+        if (received == frame_len)
+            state = CHECK;
+        break;
+    default:
+        state = IDLE;
+        if ((uint8)(sum + c) == 0u) {
+            handle_frame();
+        }
+        else {
+            frame[0] = frame_len > 0u ? frame[0] : 0u;
+            frame[1] = PARAM_BAD_CHECK;
+            send_reply(2u);
+        }
+        break;
+    }
+    return 1u;
+}
+
+//[] END OF FILE
@@ -0,0 +1,100 @@
+/* ========================================
+ * param.h
+ * Monica Lu and Victor Ying
+ *
+ * Named, typed tunable parameters: the PID gains, the speed
+ * setpoint, the position solver's settings and so on. They can be
+ * read and changed from the shell by name, or many at a time in a
+ * binary frame from a host tool such as host/param.
+ *
+ * A binary frame is PARAM_SYNC, a length byte, that many bytes of
+ * body, and a check byte making the length, body and check add up
+ * to zero. A request body is an operation and its arguments; the
+ * reply body is the same operation, a status, then the results:
+ *   PARAM_OP_LIST first    -> (id, type, name length, name)...
+ *       from parameter first, as many as fit
+ *   PARAM_OP_GET id...     -> (id, status, value)...
+ *   PARAM_OP_SET (id, value)... -> (id, status, value)...
+ *       all or none are set; values read back after setting
+ * Values are IEEE single floats, most significant byte first, for
+ * every type. Ids are positions in a table sorted by name, so they
+ * change when parameters are added; host tools should LIST them.
+ * ========================================
+ */
+
+#ifndef PARAM_H
+#define PARAM_H
+
+#include <project.h>
+
+
+#define PARAM_SYNC 0x02u  // starts a binary frame; never typed at the shell
+#define PARAM_MAX_BODY 255u
+#define PARAM_NONE 0xFFu  // id returned for names that aren't parameters
+
+
+// The values are part of the frame format, so only add to the end
+enum param_op {
+    PARAM_OP_LIST = 1u,
+    PARAM_OP_GET = 2u,
+    PARAM_OP_SET = 3u,
+};
+
+enum param_status {
+    PARAM_OK = 0u,
+    PARAM_BAD_ID = 1u,
+    PARAM_OUT_OF_RANGE = 2u,
+    PARAM_BAD_REQUEST = 3u,  // unknown operation, or malformed arguments
+    PARAM_BAD_CHECK = 4u,  // reply to a frame that didn't add up; no results
+};
+
+enum param_type {
+    PARAM_FLOAT = 0u,
+    PARAM_UINT8 = 1u,
+};
+
+
+/*
+ * param_find:
+ * Returns the id of the parameter with the given name, or PARAM_NONE.
+ */
+uint8 param_find(const char *name) ;
+
+/*
+ * param_get:
+ * Returns the value of the given parameter.
+ */
+float param_get(uint8 id) ;
+
+/*
+ * param_set:
+ * Sets the given parameter, if value is in its range, and returns a
+ * param_status.
+ */
+uint8 param_set(uint8 id, float value) ;
+
+/*
+ * param_command:
+ * If name is a parameter, prints it, or sets it to the value in args if
+ * there is one, and returns nonzero. Otherwise returns zero.
+ */
+uint8 param_command(const char *name, const char *args) ;
+
+/*
+ * param_print:
+ * Prints every parameter with its id, value and range over USB UART.
+ */
+void param_print(void) ;
+
+/*
+ * param_receive:
+ * Passes a byte from USB UART to the binary frame decoder. Returns nonzero
+ * if the byte was part of a frame, zero if it's for the shell. Replies to
+ * each whole frame.
+ */
+uint8 param_receive(uint8 c) ;
+
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,202 @@
+/* ========================================
+ * path.c
+ * Monica Lu and Victor Ying
+ *
+ * A route made of straight segments between waypoints, with
+ * cheap tracking of the point on it nearest to the car.
+ * ========================================
+ */
+
+#include <project.h>
+#include <math.h>
+
+#include "path.h"
+
+
+#define PATH_CLOSED 1  // Nonzero if the last waypoint connects to the first
+
+
+struct waypoint {
+    float x, y;  // in feet, in the same coordinates as position fixes
+};
+
+struct segment {
+    float x, y;  // start of the segment
+    float ux, uy;  // unit vector along the segment
+    float length;
+    float s;  // distance along the path to the start of the segment
+};
+
+
+// A loop around the middle of the room, counterclockwise, with the corners
+// cut off so there are no sharp turns.
+static CYCODE const struct waypoint waypoints[] = {
+    {-3.0, -12.0},
+    { 3.0, -12.0},
+    { 6.0,  -9.0},
+    { 6.0,   9.0},
+    { 3.0,  12.0},
+    {-3.0,  12.0},
+    {-6.0,   9.0},
+    {-6.0,  -9.0},
+};
+#define NUM_WAYPOINTS (sizeof(waypoints) / sizeof(waypoints[0]))
+#define NUM_SEGMENTS (PATH_CLOSED ? NUM_WAYPOINTS : NUM_WAYPOINTS - 1)
+
+static struct segment segments[NUM_WAYPOINTS];
+static float total_length = 0.0;
+static uint8 current = 0u;  // segment the car was nearest to last time
+static uint8 acquired = 0u;  // Boolean indicating whether current is valid
+
+
+/*
+ * path_init:
+ * Precomputes the segment table from the waypoints.
+ */
+void path_init(void) {
+    uint8 i;
+    
+    total_length = 0.0;
+    for (i = 0; i < NUM_SEGMENTS; i++) {
+        const struct waypoint *from = &waypoints[i];
+        const struct waypoint *to = &waypoints[(i + 1) % NUM_WAYPOINTS];
+        float dx = to->x - from->x, dy = to->y - from->y;
+        
+        segments[i].x = from->x;
+        segments[i].y = from->y;
+        segments[i].length = sqrt(dx*dx + dy*dy);
+        segments[i].ux = dx / segments[i].length;
+        segments[i].uy = dy / segments[i].length;
+        segments[i].s = total_length;
+        total_length += segments[i].length;
+    }
+    path_reset();
+}
+
+/*
+ * path_reset:
+ * Forgets where on the path the car was.
+ */
+void path_reset(void) {
+    current = 0u;
+    acquired = 0u;
+}
+
+/*
+ * path_length:
+ * Returns the total length of the path in feet.
+ */
+float path_length(void) {
+    return total_length;
+}
+
+/*
+ * project:
+ * Returns how far along segment i the point nearest to (x, y) on the line
+ * through it is. May be negative or beyond the end of the segment.
+ */
+static float project(uint8 i, float x, float y) {
+    return (x - segments[i].x) * segments[i].ux +
+           (y - segments[i].y) * segments[i].uy;
+}
+
+/*
+ * distance_squared:
+ * Returns the squared distance from (x, y) to the point t along segment i.
+ */
+static float distance_squared(uint8 i, float t, float x, float y) {
+    float dx = x - (segments[i].x + t * segments[i].ux);
+    float dy = y - (segments[i].y + t * segments[i].uy);
+    return dx*dx + dy*dy;
+}
+
+/*
+ * clamp_to_segment:
+ * Limits t to lie on segment i.
+ */
+static float clamp_to_segment(uint8 i, float t) {
+    if (t < 0.0)
+        return 0.0;
+    if (t > segments[i].length)
+        return segments[i].length;
+    return t;
+}
+
+/*
+ * path_track:
+ * Returns the distance along the path of the point on the path nearest to
+ * (x, y), starting the search from the segment we were on last time.
+ */
+float path_track(float x, float y) {
+    uint8 i, steps;
+    float t;
+    
+    // The first time, search every segment
+    if (!acquired) {
+        float best = -1.0;
+        
+        for (i = 0; i < NUM_SEGMENTS; i++) {
+            float d;
+            
+            t = clamp_to_segment(i, project(i, x, y));
+            d = distance_squared(i, t, x, y);
+            if (best < 0.0 || d < best) {
+                best = d;
+                current = i;
+            }
+        }
+        acquired = 1u;
+    }
+    
+    // Afterwards, move forward a segment at a time while we're past the end
+    // of the current one, and back at most one if we've fallen behind it.
+    t = project(current, x, y);
+    for (steps = 0; t > segments[current].length && steps < NUM_SEGMENTS;
+            steps++) {
+        if (!PATH_CLOSED && current == NUM_SEGMENTS - 1)
+            break;
+        current = (current + 1) % NUM_SEGMENTS;
+        t = project(current, x, y);
+    }
+    if (t < 0.0 && (PATH_CLOSED || current > 0)) {
+        i = (current + NUM_SEGMENTS - 1) % NUM_SEGMENTS;
+        if (project(i, x, y) < segments[i].length) {
+            current = i;
+            t = project(current, x, y);
+        }
+    }
+    
+    return segments[current].s + clamp_to_segment(current, t);
+}
+
+/*
+ * path_point:
+ * Finds the point at distance s along the path, walking forward from the
+ * segment path_track() last found.
+ */
+void path_point(float s, float *x, float *y) {
+    uint8 i = current, steps;
+    float t;
+    
+    if (PATH_CLOSED) {
+        while (s >= total_length)
+            s -= total_length;
+        while (s < 0.0)
+            s += total_length;
+    }
+    
+    for (steps = 0; steps < NUM_SEGMENTS; steps++) {
+        t = s - segments[i].s;
+        if (t >= 0.0 && t <= segments[i].length)
+            break;
+        if (!PATH_CLOSED && i == NUM_SEGMENTS - 1)
+            break;
+        i = (i + 1) % NUM_SEGMENTS;
+    }
+    
+    t = clamp_to_segment(i, s - segments[i].s);
+    *x = segments[i].x + t * segments[i].ux;
+    *y = segments[i].y + t * segments[i].uy;
+}
+
+//[] END OF FILE
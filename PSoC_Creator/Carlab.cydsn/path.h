@@ -0,0 +1,54 @@
+/* ========================================
+ * path.h
+ * Monica Lu and Victor Ying
+ *
+ * A route made of straight segments between waypoints, with
+ * cheap tracking of the point on it nearest to the car.
+ * ========================================
+ */
+
+#ifndef PATH_H
+#define PATH_H
+
+#include <project.h>
+
+
+/*
+ * path_init:
+ * Precomputes the segment table from the waypoints. Must be called before
+ * any of the other path functions.
+ */
+void path_init(void) ;
+
+/*
+ * path_reset:
+ * Forgets where on the path the car was, so the next call to path_track()
+ * searches the whole path.
+ */
+void path_reset(void) ;
+
+/*
+ * path_length:
+ * Returns the total length of the path in feet.
+ */
+float path_length(void) ;
+
+/*
+ * path_track:
+ * Returns the distance along the path, in feet, of the point on the path
+ * nearest to (x, y). Starts looking from where the car was last time, so
+ * this is O(1) amortized as long as it's called often compared to how fast
+ * the car moves past waypoints.
+ */
+float path_track(float x, float y) ;
+
+/*
+ * path_point:
+ * Finds the point at distance s along the path, which should be at or just
+ * ahead of the last value returned by path_track().
+ */
+void path_point(float s, float *x, float *y) ;
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,240 @@
+/* ========================================
+ * pid.c
+ * Monica Lu and Victor Ying
+ *
+ * PID controller shared by speed and steering control.
+ * ========================================
+ */
+
+#include <project.h>
+
+#include "pid.h"
+#ifdef PID_MEASURE_TIME
+#include "clock.h"
+#endif
+
+
+#ifdef PID_FIXED_POINT
+
+#define PID_MAX ((pid_value)0x7FFFFFFFL)
+#define PID_MIN (-PID_MAX)
+
+/*
+ * mul:
+ * Multiplies two 16.16 fixed point numbers, saturating instead of
+ * overflowing. There's no 64 bit type on the 8051, so the product is built
+ * from 16 bit halves.
+ */
+static pid_value mul(pid_value a, pid_value b) CYREENTRANT {
+    uint32 ua, ub, part, result;
+    uint8 negative = 0u;
+    
+    if (a < 0) {
+        ua = (uint32)-a;
+        negative = 1u;
+    }
+    else {
+        ua = (uint32)a;
+    }
+    if (b < 0) {
+        ub = (uint32)-b;
+        negative ^= 1u;
+    }
+    else {
+        ub = (uint32)b;
+    }
+    
+    // (ah*2^16 + al)(bh*2^16 + bl) / 2^16
+    //     = ah*bh*2^16 + ah*bl + al*bh + al*bl/2^16
+    part = (uint32)(uint16)(ua >> 16) * (uint16)(ub >> 16);
+    if (part >= 0x8000u)
+        return negative ? PID_MIN : PID_MAX;
+    result = part << 16;
+    part = (uint32)(uint16)(ua >> 16) * (uint16)ub;
+    result += part;
+    if (result < part)
+        return negative ? PID_MIN : PID_MAX;
+    part = (uint32)(uint16)ua * (uint16)(ub >> 16);
+    result += part;
+    if (result < part)
+        return negative ? PID_MIN : PID_MAX;
+    part = ((uint32)(uint16)ua * (uint16)ub) >> 16;
+    result += part;
+    if (result < part || result > (uint32)PID_MAX)
+        return negative ? PID_MIN : PID_MAX;
+    
+    return negative ? -(pid_value)result : (pid_value)result;
+}
+
+/*
+ * add:
+ * Adds two 16.16 fixed point numbers, saturating instead of overflowing.
+ */
+static pid_value add(pid_value a, pid_value b) CYREENTRANT {
+    pid_value sum = (pid_value)((uint32)a + (uint32)b);
+    
+    if (a >= 0 && b >= 0 && sum < 0)
+        return PID_MAX;
+    if (a < 0 && b < 0 && sum >= 0)
+        return PID_MIN;
+    return sum;
+}
+
+#else
+
+#define mul(a, b) ((a) * (b))
+#define add(a, b) ((a) + (b))
+
+#endif
+
+
+/*
+ * pid_init:
+ * Sets up a controller updated every interval seconds.
+ */
+void pid_init(struct pid *pid, float kp, float ki, float kd, float interval,
+              float out_min, float out_max, float max_step,
+              uint8 deriv_averaging) {
+    uint8 status = CyEnterCriticalSection();
+    
+    pid->kp = PID_FROM_FLOAT(kp);
+    pid->ki = PID_FROM_FLOAT(ki);
+    pid->kd = PID_FROM_FLOAT(kd);
+    pid->interval = PID_FROM_FLOAT(interval);
+    pid->rate = PID_FROM_FLOAT(1.0 / interval);
+    pid->out_min = PID_FROM_FLOAT(out_min);
+    pid->out_max = PID_FROM_FLOAT(out_max);
+    pid->max_step = PID_FROM_FLOAT(max_step);
+    
+    // An exponential average with this weight lags about as much as a plain
+    // average of deriv_averaging samples
+    pid->deriv_weight = PID_FROM_FLOAT(2.0 / (deriv_averaging + 1));
+    
+    pid->integral = 0;
+    pid->prev_measurement = 0;
+    pid->deriv = 0;
+    pid->output = 0;
+    pid->primed = 0u;
+    pid->bumpless = 0u;
+#ifdef PID_MEASURE_TIME
+    pid->update_time = 0u;
+    pid->max_update_time = 0u;
+#endif
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * pid_set_gains:
+ * Changes all three gains at once. The integral term is stored already
+ * multiplied by ki, so changing ki doesn't make the output jump.
+ */
+void pid_set_gains(struct pid *pid, float kp, float ki, float kd) CYREENTRANT {
+    pid_value new_kp = PID_FROM_FLOAT(kp);
+    pid_value new_ki = PID_FROM_FLOAT(ki);
+    pid_value new_kd = PID_FROM_FLOAT(kd);
+    uint8 status = CyEnterCriticalSection();
+    
+    pid->kp = new_kp;
+    pid->ki = new_ki;
+    pid->kd = new_kd;
+    pid->bumpless = 1u;
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * pid_set_k*:
+ * Change one gain.
+ */
+void pid_set_kp(struct pid *pid, float kp) {
+    pid_set_gains(pid, kp, PID_TO_FLOAT(pid->ki), PID_TO_FLOAT(pid->kd));
+}
+void pid_set_ki(struct pid *pid, float ki) {
+    pid_set_gains(pid, PID_TO_FLOAT(pid->kp), ki, PID_TO_FLOAT(pid->kd));
+}
+void pid_set_kd(struct pid *pid, float kd) {
+    pid_set_gains(pid, PID_TO_FLOAT(pid->kp), PID_TO_FLOAT(pid->ki), kd);
+}
+
+/*
+ * pid_bumpless:
+ * Makes the next update continue smoothly from output.
+ */
+void pid_bumpless(struct pid *pid, pid_value output) CYREENTRANT {
+    uint8 status = CyEnterCriticalSection();
+    
+    pid->output = output;
+    pid->primed = 0u;
+    pid->bumpless = 1u;
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * pid_update:
+ * Runs one step of the controller and returns the new output. Reentrant,
+ * since the speed PID and camera interrupt handlers both run controllers.
+ */
+pid_value pid_update(struct pid *pid, pid_value setpoint,
+                     pid_value measurement, pid_value feedforward) CYREENTRANT {
+    pid_value error, others, next_integral, output, limited;
+#ifdef PID_MEASURE_TIME
+    uint32 start = clock_now();
+#endif
+    
+    error = add(setpoint, -measurement);
+    
+    // Derivative of the measurement, smoothed
+    if (pid->primed) {
+        pid_value raw = mul(add(pid->prev_measurement, -measurement), pid->rate);
+        pid->deriv = add(pid->deriv, mul(pid->deriv_weight, add(raw, -pid->deriv)));
+    }
+    else {
+        pid->deriv = 0;
+        pid->primed = 1u;
+    }
+    pid->prev_measurement = measurement;
+    
+    // Everything but the integral term
+    others = add(add(feedforward, mul(pid->kp, error)), mul(pid->kd, pid->deriv));
+    
+    // For a bumpless transfer, pick the integral that reproduces the previous
+    // output. Without integral action nothing would ever wind that back out,
+    // so a PD controller just starts from its own output.
+    if (pid->bumpless) {
+        pid->integral = pid->ki != 0 ? add(pid->output, -others) : 0;
+        pid->bumpless = 0u;
+    }
+    
+    next_integral = add(pid->integral, mul(mul(pid->ki, error), pid->interval));
+    output = add(others, next_integral);
+    
+    // Limit to valid outputs, and how fast the output may change
+    limited = output;
+    if (pid->max_step > 0) {
+        if (limited > add(pid->output, pid->max_step))
+            limited = add(pid->output, pid->max_step);
+        else if (limited < add(pid->output, -pid->max_step))
+            limited = add(pid->output, -pid->max_step);
+    }
+    if (limited > pid->out_max)
+        limited = pid->out_max;
+    else if (limited < pid->out_min)
+        limited = pid->out_min;
+    
+    // Anti-windup: only allow integrator to build up if not limited
+    if (limited == output)
+        pid->integral = next_integral;
+    pid->output = limited;
+    
+#ifdef PID_MEASURE_TIME
+    pid->update_time = (uint16)(clock_now() - start);
+    if (pid->update_time > pid->max_update_time)
+        pid->max_update_time = pid->update_time;
+#endif
+    
+    return limited;
+}
+
+//[] END OF FILE
@@ -0,0 +1,103 @@
+/* ========================================
+ * pid.h
+ * Monica Lu and Victor Ying
+ *
+ * PID controller shared by speed and steering control.
+ * ========================================
+ */
+
+#ifndef PID_H
+#define PID_H
+
+#include <project.h>
+
+
+#define PID_FIXED_POINT  // Comment this out to do the control math in floats
+#define PID_MEASURE_TIME  // Comment this out to stop timing pid_update()
+
+
+#ifdef PID_FIXED_POINT
+// Signed 16.16 fixed point. The 8051 has no floating point hardware, so this
+// is several times faster than floats in the interrupt handlers.
+typedef int32 pid_value;
+#define PID_FROM_FLOAT(f) ((pid_value)((f) * 65536.0))
+#define PID_TO_FLOAT(v) ((float)(v) * (1.0 / 65536.0))
+#else
+typedef float pid_value;
+#define PID_FROM_FLOAT(f) ((pid_value)(f))
+#define PID_TO_FLOAT(v) ((float)(v))
+#endif
+
+
+struct pid {
+    // Gains, in output per unit error, per unit error-second, and per unit
+    // error per second
+    pid_value kp, ki, kd;
+    
+    // Configuration
+    pid_value interval;  // seconds between updates
+    pid_value rate;  // updates per second
+    pid_value out_min, out_max;
+    pid_value max_step;  // largest change in output per update, 0 for none
+    pid_value deriv_weight;  // weight of each new derivative sample, 0 to 1
+    
+    // State
+    pid_value integral;  // integral control term, already multiplied by ki
+    pid_value prev_measurement;
+    pid_value deriv;  // filtered rate of change of the measurement
+    pid_value output;
+    uint8 primed;  // nonzero once prev_measurement is valid
+    uint8 bumpless;  // nonzero to continue smoothly from output next update
+    
+#ifdef PID_MEASURE_TIME
+    uint16 update_time, max_update_time;  // in microseconds
+#endif
+};
+
+
+/*
+ * pid_init:
+ * Sets up a controller updated every interval seconds, with output limited
+ * to between out_min and out_max and to changing by at most max_step per
+ * update (0 for no limit). The derivative is smoothed over about
+ * deriv_averaging updates.
+ */
+void pid_init(struct pid *pid, float kp, float ki, float kd, float interval,
+              float out_min, float out_max, float max_step,
+              uint8 deriv_averaging) ;
+
+/*
+ * pid_set_gains:
+ * Changes all three gains at once, so an update never sees a mix of old and
+ * new gains. Changing gains never makes the output jump.
+ */
+void pid_set_gains(struct pid *pid, float kp, float ki, float kd) CYREENTRANT ;
+
+/*
+ * pid_set_k*:
+ * Change one gain.
+ */
+void pid_set_kp(struct pid *pid, float kp) ;
+void pid_set_ki(struct pid *pid, float ki) ;
+void pid_set_kd(struct pid *pid, float kd) ;
+
+/*
+ * pid_bumpless:
+ * Makes the next update continue smoothly from output, e.g. whatever was
+ * being output manually before the controller was switched on. Only works
+ * with a nonzero ki, since the difference is made up by the integral term.
+ */
+void pid_bumpless(struct pid *pid, pid_value output) CYREENTRANT ;
+
+/*
+ * pid_update:
+ * Runs one step of the controller and returns the new output. feedforward
+ * is added to the output before limiting. The derivative acts on the
+ * measurement rather than the error, so setpoint changes don't kick.
+ */
+pid_value pid_update(struct pid *pid, pid_value setpoint,
+                     pid_value measurement, pid_value feedforward) CYREENTRANT ;
+
+#endif
+
+//[] END OF FILE
@@ -5,20 +5,25 @@
  *
  * Provides positioning using time difference of arrival
  * multilateration with four transmitters arranged in a
- * rectangle. Assumes the transmitters send out pings in turn
- * with a certain amount of spacing time between when pings are
- * sent, and that these pings are sent in a counterclockwise
- * order.
+ * rectangle, or more (see position.h). Assumes the transmitters
+ * send out pings in turn with a certain amount of spacing time
+ * between when pings are sent, and that these pings are sent in a
+ * counterclockwise order.
  *
  * ===========================================================
  */
 
 #include <project.h>
 #include <math.h>
-#include <limits.h>
-#include <stdio.h>
 
 #include "position.h"
+#include "clock.h"
+#include "odometry.h"
+#include "timing.h"
+#include "trace.h"
+#include "sched.h"
+#include "agc.h"
+#include "journal.h"
 
 
 /*
@@ -29,32 +34,100 @@
 #define Y 33.75  // distance between second and third transmitters in feet
 #define Z 7.583
 #define CLOCK_FREQ 1000000  // Hz
+#define TIMER_START 0xFFFFFFFFu  // UltraTimer counts down from here
 #define WAVE_SPEED 1135.0  // ft/s
 #define TX_SPACING 100  // ms
+#define SET_SPAN (POSITION_TRANSMITTERS * TX_SPACING)  // ms; longer than a cycle's pings take
 #define EPSILON 0.5  // ft
-#define DEL_FACTOR 0.1  // ft
-#define MAX_ERROR 0.5  // ft^2
-#define ERROR_THRESHOLD 0.01  // ft^2
-#define MAX_ITERATIONS 100
+#define DEL_FACTOR 0.1  // initial position_step
+#define MAX_ERROR 0.5  // ft^2; initial position_max_error
+#define ERROR_THRESHOLD 0.01  // ft^2; initial position_tolerance
+#define MAX_ITERATIONS 100  // initial position_max_iterations
+#define MAX_SUBSETS 6  // initial position_max_subsets
+#define MIN_PINGS 4  // fewest that can show one of them is wrong
+#define AGREE 3.0  // ft between subsets' fixes that still agree
+#define OUTSIDE 3.0  // ft past the transmitters a subset's fix may be
+#define LATE 1.0  // ft farther than the fix says a ping came, to tell agc.c
+#define ALL_PINGS ((1u << POSITION_TRANSMITTERS) - 1u)
+#define MIN_HEADING_BASELINE 1.0  // ft between fixes used to find the heading
+
+#if POSITION_TRANSMITTERS < 4 || POSITION_TRANSMITTERS > POSITION_MAX_TRANSMITTERS
+#error "POSITION_TRANSMITTERS must be from 4 to POSITION_MAX_TRANSMITTERS"
+#endif
 
 //#define SHOW_GARBAGE  // Uncomment this to check if sanity checks are failing
-#define PRINT_CONVERGENCE  // Comment this out to make positioning silent
+#define TRACE_CONVERGENCE  // Comment this out to stop tracing Newton iterations
+#define TRACE_STRIDE 4  // trace every 4th iteration, so a whole solve fits in the trace
+
+/*
+ * TYPES
+ */
+
+// The result of solving with some of the pings
+struct solution {
+    uint8 use;  // bit i set if transmitter i's ping was used
+    float x, y;
+    float fxy;  // in units of feet squared
+    uint8 iters;
+};
+
 
 /*
  * STATIC FUNCTION PROTOTYPES
  */
 
 static CY_ISR_PROTO(positioningHandler) ;
+static void locate(void) ;
+static void solve(const float *diff, struct solution *sol, float *resid) ;
+static void residuals(const float *diff, const struct solution *sol,
+                      float *resid) ;
+static uint8 consensus(const float *diff, const float *resid,
+                       struct solution *sol) ;
+static uint8 leave_out(const float *diff, const uint8 *order, uint8 used,
+                       struct solution *best, uint8 *disagree) ;
+static uint8 try_subset(const float *diff, uint8 all, uint8 use,
+                        struct solution *best, uint8 *disagree) ;
+static void publish_fix(float new_x, float new_y, float new_fxy, uint32 time,
+                        uint8 excluded) ;
 
 
 /*
  * GLOBAL VARIABLES
  */
 
-static float x = 0.0, y = 0.0;  // the current position
-static float fxy = 0.0; // the current error
+// Where each transmitter is, in the order they ping: the four corners
+// counterclockwise, then any more down the middle of the long sides
+static CYCODE const float tx_x[POSITION_MAX_TRANSMITTERS] = {
+    -X/2, X/2, X/2, -X/2, -X/2, X/2
+};
+static CYCODE const float tx_y[POSITION_MAX_TRANSMITTERS] = {
+    -Y/2, -Y/2, Y/2, Y/2, 0.0, 0.0
+};
+
+// Ring of recent fixes, written only by positioningHandler. The fix at
+// history[history_head] is the current one. Readers use the seqlock: it is
+// odd while the handler is updating, and changes on every update, so a reader
+// who sees the same even value before and after copying got a consistent
+// copy. It is a single byte so that reading it is atomic on the 8051.
+static volatile struct position_fix history[POSITION_HISTORY_LEN];
+static volatile uint8 history_head = 0u;
+static volatile uint8 history_count = 0u;
+static volatile uint8 seqlock = 0u;
+static uint16 fix_seq = 0u;
+
 static uint8 new_data = 0u;  // Boolean indicating whether new data available
 
+// UltraTimer to clock_now() time. It starts over with the last ping of each
+// set, and whenever position_realign() starts the set over.
+static struct clock_sync ultra_sync;
+
+// Solver settings, which param.c can change
+float position_max_error = MAX_ERROR;
+float position_tolerance = ERROR_THRESHOLD;
+float position_step = DEL_FACTOR;
+uint8 position_max_iterations = MAX_ITERATIONS;
+uint8 position_max_subsets = MAX_SUBSETS;
+
 
 /*
  * FUNCTIONS
@@ -70,6 +143,7 @@ void position_init(void) {
     UltraTimer_Start();
     UltraComp_Start();
     UltraDAC_Start();
+    agc_init();
     UltraIRQ_Start();
     UltraIRQ_SetVector(positioningHandler);
 }
@@ -86,20 +160,151 @@ uint8 position_data_available(void) {
     return ret;
 }
 
+/*
+ * position_snapshot:
+ * Copies the most recent fix into *fix. The fields always come from the
+ * same fix, without interrupts being disabled.
+ */
+void position_snapshot(struct position_fix *fix) {
+    uint8 seq;
+    
+    do {
+        seq = seqlock;
+        *fix = history[history_head];
+    } while ((seq & 1u) || seq != seqlock);
+}
+
+/*
+ * position_history:
+ * Copies up to max of the most recent fixes into fixes, newest first, and
+ * returns how many were copied.
+ */
+uint8 position_history(struct position_fix *fixes, uint8 max) {
+    uint8 seq, count, index, i;
+    
+    do {
+        seq = seqlock;
+        count = history_count < max ? history_count : max;
+        index = history_head;
+        for (i = 0; i < count; i++) {
+            fixes[i] = history[index];
+            index = (index + POSITION_HISTORY_LEN - 1) % POSITION_HISTORY_LEN;
+        }
+    } while ((seq & 1u) || seq != seqlock);
+    
+    return count;
+}
+
+/*
+ * position_now:
+ * Estimates where the car is right now, by propagating the most recent fix
+ * forward along the path the hall sensor and steering say the car drove
+ * since its pings arrived.
+ */
+void position_now(struct position_estimate *est) {
+    struct position_fix fixes[POSITION_HISTORY_LEN];
+    float bx = 0.0, by = 0.0, dx, dy, turn_since_old, turn_since_new, heading;
+    uint8 count, i;
+    
+    count = position_history(fixes, POSITION_HISTORY_LEN);
+    est->time = clock_now();
+    est->propagated = 0u;
+    est->heading = 0.0;
+    if (count == 0) {
+        est->x = 0.0;
+        est->y = 0.0;
+        est->seq = 0u;
+        return;
+    }
+    est->x = fixes[0].x;
+    est->y = fixes[0].y;
+    est->seq = fixes[0].seq;
+    
+    // Find an older fix far enough away to tell which way we're going
+    for (i = 1; i < count; i++) {
+        bx = fixes[0].x - fixes[i].x;
+        by = fixes[0].y - fixes[i].y;
+        if (bx*bx + by*by >= MIN_HEADING_BASELINE*MIN_HEADING_BASELINE)
+            break;
+    }
+    if (i == count)
+        return;
+    
+    // The chord of an arc points halfway between the headings at its ends, so
+    // correct the chord's direction by half of how much we turned in between.
+    // If the ticks since the older fix are forgotten, the chord may span
+    // much of a turn and no heading can be had from it.
+    odometry_integrate(fixes[0].time, 0.0, &dx, &dy, &turn_since_new);
+    if (!odometry_integrate(fixes[i].time, 0.0, &bx, &by, &turn_since_old))
+        return;
+    heading = atan2(fixes[0].y - fixes[i].y, fixes[0].x - fixes[i].x) +
+              (turn_since_old - turn_since_new) / 2;
+    
+    // Rotate the path driven since the newest fix to match our heading then
+    est->x += dx*cos(heading) - dy*sin(heading);
+    est->y += dx*sin(heading) + dy*cos(heading);
+    est->heading = heading + turn_since_new;
+    est->propagated = 1u;
+}
+
+/*
+ * position_ping_sent:
+ * Returns the clock_now() time at which the first ping of the fix's cycle
+ * was sent, from when its pings arrived and how far they came.
+ */
+uint32 position_ping_sent(const struct position_fix *fix) {
+    float dx, dy, after = 0.0;
+    uint8 i, n = 0u;
+    
+    // The fix is timed at the mean arrival of the pings it used, each of
+    // which came its slot and its flight after the first was sent
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++) {
+        if (fix->excluded & (1u << i))
+            continue;
+        dx = fix->x - tx_x[i];
+        dy = fix->y - tx_y[i];
+        after += (float)i * (CLOCK_FREQ/1000*TX_SPACING) +
+                 sqrt(dx*dx + dy*dy + Z*Z) * (CLOCK_FREQ/WAVE_SPEED);
+        n++;
+    }
+    return fix->time - (uint32)(after / n);
+}
+
+/*
+ * position_realign:
+ * Starts UltraCounter and UltraTimer over and throws away any captures
+ * waiting, so that the next ping is taken as the first of a set.
+ */
+void position_realign(void) {
+    uint8 status = CyEnterCriticalSection();
+
+    UltraCounter_WriteCounter(UltraCounter_ReadPeriod());
+    UltraTimer_ClearFIFO();
+    UltraTimer_WriteCounter(TIMER_START);
+    clock_restarted(&ultra_sync, clock_now());
+    CyExitCriticalSection(status);
+}
+
 /*
  * position_?:
  * Getter functions for position in units of feet, with the origin at the
  * center of the rectangle formed by the transmitters.
  */
 float position_x(void) {
-    return x;
+    struct position_fix fix;
+    position_snapshot(&fix);
+    return fix.x;
 }
 float position_y(void) {
-    return y;
+    struct position_fix fix;
+    position_snapshot(&fix);
+    return fix.y;
 }
 
 float error(void) {
-    return fxy;
+    struct position_fix fix;
+    position_snapshot(&fix);
+    return fix.error;
 }
 
 float fabsf(float num) {
@@ -111,82 +316,170 @@ float fabsf(float num) {
 
 /*
  * positioningHandler:
- * Interrupt handler run after sequence of four pings, calculating position.
+ * Interrupt handler run after a sequence of POSITION_TRANSMITTERS pings.
  */
 static CY_ISR(positioningHandler) {
-    uint32 time[4];
-    float diff[4];
-    int i, iters;
-    float new_x, new_y, new_fxy;
+    uint32 start = timing_start(TIMING_POSITIONING);
+    
+    locate();
+    timing_end(TIMING_POSITIONING, start);
+}
 
-    // Get the times of arrival
-    for (i = 0; i < 4; i++) {
+/*
+ * locate:
+ * Calculates position from the last POSITION_TRANSMITTERS pings. Only to be
+ * called from positioningHandler.
+ */
+static void locate(void) {
+    uint32 time[POSITION_TRANSMITTERS], arrived[POSITION_TRANSMITTERS];
+    float diff[POSITION_TRANSMITTERS], resid[POSITION_TRANSMITTERS];
+    struct solution sol;
+    float all_fxy;
+    uint8 usable = POSITION_TRANSMITTERS, tried = 0u;
+    int i;
+
+    // Get the times of arrival. The captures count down, so time[i] -
+    // time[last] is how long before the last one, which just triggered us,
+    // ping i arrived. UltraTimer started over with the last one.
+    for (i = 0; i < (int)POSITION_TRANSMITTERS; i++)
         time[i] = UltraTimer_ReadCapture();
+    arrived[POSITION_TRANSMITTERS - 1] =
+        clock_from_capture(&ultra_sync, time[POSITION_TRANSMITTERS - 1]);
+    for (i = 0; i < (int)POSITION_TRANSMITTERS; i++)
+        arrived[i] = arrived[POSITION_TRANSMITTERS - 1] -
+                     (time[i] - time[POSITION_TRANSMITTERS - 1]);
+    clock_restarted(&ultra_sync, arrived[POSITION_TRANSMITTERS - 1]);
+    journal_pings(time, arrived[POSITION_TRANSMITTERS - 1]);
 
-        // If more than a second since the last reset, then throw away this
-        // set of measurements
-        if (time[i] == 0u || time[i] < ULONG_MAX - CLOCK_FREQ) {
+    // If the pings came further apart than a cycle's do, the set started on
+    // one left over from before, or the timer ran out waiting for them, so
+    // throw away this set of measurements
+    for (i = 0; i < (int)POSITION_TRANSMITTERS; i++) {
+        if (time[i] == 0u || time[i] - time[POSITION_TRANSMITTERS - 1] >
+                                 (uint32)SET_SPAN * (CLOCK_FREQ/1000)) {
+            trace_record(TRACE_REJECT, TRACE_REJECT_STALE, i,
+                         time[i] - time[POSITION_TRANSMITTERS - 1], 0.0);
 #ifdef SHOW_GARBAGE
-            x = (float)i;
-            y = (float)time[i];
-            new_data = 1u;
+            publish_fix((float)i, (float)time[i], 0.0, clock_now(), 0u);
 #endif
             return;
         }
     }
 
     // Calculate differences in distances in feet
-    for (i = 1; i < 4; i++) {
+    sol.use = ALL_PINGS;
+    diff[0] = 0.0;
+    for (i = 1; i < (int)POSITION_TRANSMITTERS; i++) {
         diff[i] = (float)((int32)(time[0] - time[i])
                           - i*(CLOCK_FREQ/1000*TX_SPACING))
                   * (WAVE_SPEED/CLOCK_FREQ);
         
         // If difference is much larger than the size of the rectangle of
-        // transmitter stations, the data is probably bad, so throw it away
+        // transmitter stations, the data is probably bad, so throw it away,
+        // or just this ping if there are enough others to go on
         if (fabsf(diff[i]) > X + Y) {
-        
+            if (usable > MIN_PINGS) {
+                sol.use &= ~(1u << i);
+                usable--;
+                continue;
+            }
+            trace_record(TRACE_REJECT, TRACE_REJECT_DIFF, i, diff[i], 0.0);
 #ifdef SHOW_GARBAGE
-            x = (float)i;
-            y = diff[i];
-            new_data = 1u;
+            publish_fix((float)i, diff[i], 0.0, clock_now(), 0u);
 #endif
             return;
         }
     }
     
-    // Positioning using Newton's method
-    new_x = x;
-    new_y = y;
+    trace_record(TRACE_PINGS, 0u, diff[1], diff[2], diff[3]);
+    
+    // Positioning using Newton's method, starting from the previous fix,
+    // then without the pings that don't agree with the rest
+    solve(diff, &sol, resid);
+    all_fxy = sol.fxy;
+    if (POSITION_TRANSMITTERS > MIN_PINGS &&
+            fabsf(sol.fxy) >= position_max_error)
+        tried = consensus(diff, resid, &sol);
+    if (sol.use != ALL_PINGS || tried > 0u)
+        trace_record(TRACE_EXCLUDE, ALL_PINGS & ~sol.use, tried, all_fxy,
+                     sol.fxy);
+    
+    if (fabsf(sol.fxy) < position_max_error) {
+        uint32 before = 0u;
+        uint8 late = 0u, used = 0u;
+        
+        // The car moves while the pings come in, so the fix is where it was
+        // at about the middle of them: time it at their mean arrival
+        for (i = 0; i < (int)POSITION_TRANSMITTERS; i++) {
+            if (sol.use & (1u << i)) {
+                before += arrived[POSITION_TRANSMITTERS - 1] - arrived[i];
+                used++;
+            }
+        }
+        trace_record(TRACE_FIX, sol.iters, sol.x, sol.y, sol.fxy);
+        publish_fix(sol.x, sol.y, sol.fxy,
+                    arrived[POSITION_TRANSMITTERS - 1] - before / used,
+                    ALL_PINGS & ~sol.use);
+        
+        // Tell agc.c when each ping came, and which came late for the fix
+        if (tried > 0u)
+            residuals(diff, &sol, resid);
+        for (i = 0; i < (int)POSITION_TRANSMITTERS; i++) {
+            if (resid[i] > LATE)
+                late |= 1u << i;
+        }
+        agc_pings(arrived, late);
+    }
+    else {
+        trace_record(TRACE_REJECT, TRACE_REJECT_ERROR, sol.x, sol.y, sol.fxy);
+    }
+
+    // Clear interrupt
+    UltraTimer_ReadStatusRegister();
+}
+
+/*
+ * solve:
+ * Finds the position whose range differences best match diff, using the
+ * pings in sol->use, with Newton's method from the previous fix. Fills in
+ * the rest of *sol, and every ping's error in resid, used or not: how much
+ * farther it came than the position says it should have, measured against
+ * the first ping used, whose error is 0.
+ */
+static void solve(const float *diff, struct solution *sol, float *resid) {
+    float dist[POSITION_TRANSMITTERS];
+    uint8 ref, i;
+    int iters;
+    float new_x, new_y, new_fxy;
+
+    for (ref = 0u; !(sol->use & (1u << ref)); ref++)
+        ;
+    new_x = history[history_head].x;
+    new_y = history[history_head].y;
     iters = 0;
     do {
-        float dfx, dfy, gradient_magnitude_squared;
-        float dist[4], error[4];
-        char buf[32];
-        uint8 status;
+        float dfx = 0.0, dfy = 0.0, gradient_magnitude_squared, error;
         
         // Calculate what the distances should be based on our most recent (x,y)
-        dist[0] = sqrt((new_x+X/2)*(new_x+X/2) + (new_y+Y/2)*(new_y+Y/2) + Z*Z);
-        dist[1] = sqrt((new_x-X/2)*(new_x-X/2) + (new_y+Y/2)*(new_y+Y/2) + Z*Z);
-        dist[2] = sqrt((new_x-X/2)*(new_x-X/2) + (new_y-Y/2)*(new_y-Y/2) + Z*Z);
-        dist[3] = sqrt((new_x+X/2)*(new_x+X/2) + (new_y-Y/2)*(new_y-Y/2) + Z*Z);
-       
-        // Calculate disagreement between hypothetical distances and measurements
-        for (i = 1; i < 4; i++)
-            error[i] = (dist[i]-dist[0]) - diff[i];
-            
-        // Calculate our metric as the sum of the squares of the errors
-        new_fxy = 0.0;
-        for (i = 1; i < 4; i++)
-            new_fxy += error[i]*error[i];
+        for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+            if (sol->use & (1u << i))
+                dist[i] = sqrt((new_x - tx_x[i])*(new_x - tx_x[i]) +
+                               (new_y - tx_y[i])*(new_y - tx_y[i]) + Z*Z);
         
-        // Calculate the partial derivatives of the metric
-        dfx = 2*error[2] * (((new_x - X/2)/dist[2]) - (new_x + X/2)/dist[0]);
-        dfx += 2*error[3] * (((new_x + X/2)/dist[3]) - (new_x + X/2)/dist[0]);
-        dfx += 2*error[1] * (((new_x - X/2)/dist[1]) - (new_x + X/2)/dist[0]);
-       
-        dfy = 2*error[2] * (((new_y - Y/2)/dist[2]) - (new_y + Y/2)/dist[0]);
-        dfy += 2*error[3] * (((new_y - Y/2)/dist[3]) - (new_y + Y/2)/dist[0]);
-        dfy += 2*error[1] * (((new_y + Y/2)/dist[1]) - (new_y + Y/2)/dist[0]);
+        // Calculate the disagreement between hypothetical distances and
+        // measurements, our metric as the sum of the squares of them, and
+        // its partial derivatives
+        new_fxy = 0.0;
+        for (i = 0u; i < POSITION_TRANSMITTERS; i++) {
+            if (i == ref || !(sol->use & (1u << i)))
+                continue;
+            error = (dist[i]-dist[ref]) - (diff[i]-diff[ref]);
+            new_fxy += error*error;
+            dfx += 2*error * ((new_x - tx_x[i])/dist[i] -
+                              (new_x - tx_x[ref])/dist[ref]);
+            dfy += 2*error * ((new_y - tx_y[i])/dist[i] -
+                              (new_y - tx_y[ref])/dist[ref]);
+        }
         
         // Quit now if we're already at a stationary point
         gradient_magnitude_squared = dfx*dfx + dfy*dfy;
@@ -194,37 +487,191 @@ static CY_ISR(positioningHandler) {
             break;
         
         // Otherwise, update according to a version of Newton's method
-        new_x -= DEL_FACTOR * new_fxy * dfx / gradient_magnitude_squared;
-        new_y -= DEL_FACTOR * new_fxy * dfy / gradient_magnitude_squared;
+        new_x -= position_step * new_fxy * dfx / gradient_magnitude_squared;
+        new_y -= position_step * new_fxy * dfy / gradient_magnitude_squared;
         
-#ifdef PRINT_CONVERGENCE
-        // Show convergence happening on the LCD
-        status = CyEnterCriticalSection();
-        sprintf(buf, "dX:%.1f dY:%.1f %d  ", dfx, dfy, iters);
-        LCD_Position(1,0);
-        LCD_PrintString(buf);
-        sprintf(buf, "X:%.1f Y:%.1f   ", new_x, new_y);
-        LCD_Position(0,0);
-        LCD_PrintString(buf);
-        sprintf(buf, " %.1f     ", new_fxy);
-        LCD_Position(0,13);
-        LCD_PrintString(buf);
-        CyExitCriticalSection(status);
+#ifdef TRACE_CONVERGENCE
+        if (iters % TRACE_STRIDE == 0)
+            trace_record(TRACE_ITERATION, iters, dfx, dfy, new_fxy);
 #endif
 
         iters++;
-    } while ((fabsf(new_fxy) > ERROR_THRESHOLD) && (iters < MAX_ITERATIONS));  
+    } while ((fabsf(new_fxy) > position_tolerance) &&
+             (iters < position_max_iterations));
     
-    if (fabsf(new_fxy) < MAX_ERROR) {
-        x = new_x;
-        y = new_y;
-        fxy = new_fxy;
-        new_data = 1u;
+    sol->x = new_x;
+    sol->y = new_y;
+    sol->fxy = new_fxy;
+    sol->iters = iters;
+    residuals(diff, sol, resid);
+}
+
+/*
+ * residuals:
+ * Fills in every ping's error in resid at the position in *sol, used or
+ * not, as solve() does.
+ */
+static void residuals(const float *diff, const struct solution *sol,
+                      float *resid) {
+    float dist[POSITION_TRANSMITTERS];
+    uint8 ref, i;
+
+    for (ref = 0u; !(sol->use & (1u << ref)); ref++)
+        ;
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        dist[i] = sqrt((sol->x - tx_x[i])*(sol->x - tx_x[i]) +
+                       (sol->y - tx_y[i])*(sol->y - tx_y[i]) + Z*Z);
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        resid[i] = (diff[i]-diff[ref]) - (dist[i]-dist[ref]);
+}
+
+/*
+ * consensus:
+ * Called when the pings in sol->use don't agree on a position, as when one
+ * came off an echo. Ranks them by how far their errors in resid stand out
+ * from the rest and has leave_out() try solving without them. Puts the
+ * best solution found in *sol if it beats it, unless another good enough
+ * for a fix was more than AGREE away, and returns how many subsets were
+ * tried.
+ */
+static uint8 consensus(const float *diff, const float *resid,
+                       struct solution *sol) {
+    uint8 order[POSITION_TRANSMITTERS];
+    float spread[POSITION_TRANSMITTERS];
+    struct solution best;
+    float mean = 0.0;
+    uint8 used = 0u, disagree = 0u, tried, i, j;
+
+    // Rank the pings by how far their errors are from the average
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        if (sol->use & (1u << i)) {
+            mean += resid[i];
+            used++;
+        }
+    mean /= used;
+    used = 0u;
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++) {
+        if (!(sol->use & (1u << i)))
+            continue;
+        spread[i] = fabsf(resid[i] - mean);
+        for (j = used++; j > 0u && spread[order[j - 1u]] < spread[i]; j--)
+            order[j] = order[j - 1u];
+        order[j] = i;
     }
+    
+    best = *sol;
+    tried = leave_out(diff, order, used, &best, &disagree);
 
-    // Clear interrupt
-    UltraTimer_ReadStatusRegister();
+    // Subsets that each fit but put the car in different places mean an
+    // echo got into one that fit anyway, and there's no telling which
+    if (!disagree)
+        *sol = best;
+    return tried;
+}
+
+/*
+ * leave_out:
+ * Solves again without each of the used pings in order, then without each
+ * pair while MIN_PINGS are left. Stops at the first subset that converges,
+ * or after position_max_subsets solves, or after the subsets of one size
+ * if one of them gave a fix. Returns how many subsets were tried. Only to
+ * be called from consensus().
+ */
+static uint8 leave_out(const float *diff, const uint8 *order, uint8 used,
+                       struct solution *best, uint8 *disagree) {
+    uint8 use = best->use, tried = 0u, i, j, k;
+
+    // Leave out one
+    for (i = 0u; used > MIN_PINGS && i < used; i++) {
+        if (tried == position_max_subsets)
+            return tried;
+        tried++;
+        if (try_subset(diff, use, use & ~(1u << order[i]), best, disagree))
+            return tried;
+    }
+    if (fabsf(best->fxy) < position_max_error)
+        return tried;
+    
+    // Then two
+    for (i = 0u; used > MIN_PINGS + 1u && i < used; i++)
+        for (j = i + 1u; j < used; j++) {
+            if (tried == position_max_subsets)
+                return tried;
+            tried++;
+            k = (1u << order[i]) | (1u << order[j]);
+            if (try_subset(diff, use, use & ~k, best, disagree))
+                return tried;
+        }
+    return tried;
 }
 
+/*
+ * try_subset:
+ * Solves with just the pings in use, out of all, and puts the solution in
+ * *best if it has less error, the pings left out came late for it, and it
+ * isn't more than OUTSIDE past the rectangle of transmitters. Sets
+ * *disagree if it and *best are both good enough for a fix but more than
+ * AGREE apart. Returns nonzero if it was put there and converged. Only to
+ * be called from leave_out().
+ */
+static uint8 try_subset(const float *diff, uint8 all, uint8 use,
+                        struct solution *best, uint8 *disagree) {
+    struct solution sol;
+    float resid[POSITION_TRANSMITTERS];
+    float latest = 0.0;  // the first ping kept
+    float dx, dy;
+    uint8 i;
+
+    sol.use = use;
+    solve(diff, &sol, resid);
+
+    // An echo only ever comes late, so the pings left out must have come
+    // later for this position than any of the pings kept
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        if ((use & (1u << i)) && resid[i] > latest)
+            latest = resid[i];
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        if ((all & ~use & (1u << i)) && resid[i] <= latest)
+            return 0u;
+
+    // With just one ping to spare, an echo that's kept can still fit, but
+    // mostly somewhere off the track
+    if (fabsf(sol.x) > X/2 + OUTSIDE || fabsf(sol.y) > Y/2 + OUTSIDE)
+        return 0u;
+
+    dx = sol.x - best->x;
+    dy = sol.y - best->y;
+    if (fabsf(sol.fxy) < position_max_error &&
+            fabsf(best->fxy) < position_max_error &&
+            dx*dx + dy*dy > AGREE*AGREE)
+        *disagree = 1u;
+    if (fabsf(sol.fxy) < fabsf(best->fxy))
+        *best = sol;
+    return fabsf(sol.fxy) <= position_tolerance;
+}
+
+/*
+ * publish_fix:
+ * Adds a fix to the history ring. Only to be called from locate().
+ */
+static void publish_fix(float new_x, float new_y, float new_fxy, uint32 time,
+                        uint8 excluded) {
+    uint8 next = (history_head + 1) % POSITION_HISTORY_LEN;
+    
+    seqlock++;
+    history[next].x = new_x;
+    history[next].y = new_y;
+    history[next].error = new_fxy;
+    history[next].time = time;
+    history[next].seq = ++fix_seq;
+    history[next].excluded = excluded;
+    history_head = next;
+    if (history_count < POSITION_HISTORY_LEN)
+        history_count++;
+    seqlock++;
+    
+    new_data = 1u;
+    sched_post(SCHED_FIX);
+}
 
 /* [] END OF FILE */
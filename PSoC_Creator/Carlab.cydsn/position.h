@@ -5,7 +5,13 @@
  *
  * Provides positioning using time difference of arrival
  * multilateration with four transmitters arranged in a
- * rectangle.
+ * rectangle, or more for a room that has them.
+ *
+ * With five or more, one ping that comes in late off an echo
+ * doesn't cost the fix: when the pings don't agree on a
+ * position, the solver tries again without each in turn (then
+ * without pairs, while four are left) and keeps the position the
+ * rest agree on, reporting which transmitters it left out.
  *
  * ===========================================================
  */
@@ -15,6 +21,53 @@
 
 #include <project.h>
 
+
+#define POSITION_HISTORY_LEN 8  // number of recent fixes remembered
+
+// Transmitters pinging in turn, counterclockwise from the first corner.
+// More than four also takes TopDesign: UltraCounter's period must match,
+// and UltraTimer's capture FIFO only holds four captures.
+#ifndef POSITION_TRANSMITTERS
+#define POSITION_TRANSMITTERS 4u
+#endif
+#define POSITION_MAX_TRANSMITTERS 6u
+#define POSITION_MAX_SUBSETS 21u  // most position_max_subsets can be: six, less one or two
+
+
+/*
+ * A single position fix. Position is in units of feet, with the origin at
+ * the center of the rectangle formed by the transmitters.
+ */
+struct position_fix {
+    float x, y;
+    float error;  // in units of feet squared
+    uint32 time;  // clock_now() at the mean arrival of the pings used
+    uint16 seq;  // increases by one with every accepted fix
+    uint8 excluded;  // bit i set if transmitter i's ping was left out
+};
+
+/*
+ * A position estimate brought up to the present by dead reckoning from the
+ * most recent fix.
+ */
+struct position_estimate {
+    float x, y;  // in units of feet
+    float heading;  // radians counterclockwise from the +x axis
+    uint32 time;  // clock_now() time the estimate is for
+    uint16 seq;  // seq of the fix it was propagated from
+    uint8 propagated;  // zero if the heading is unknown, so x and y weren't moved
+};
+
+
+// Solver settings. Change them with param.c, which keeps the interrupt
+// handler from seeing half-written values.
+extern float position_max_error;  // in feet squared; fixes with more error are rejected
+extern float position_tolerance;  // in feet squared; iterating stops with less error
+extern float position_step;  // fraction of each Newton step taken
+extern uint8 position_max_iterations;
+extern uint8 position_max_subsets;  // solves without some pings, when they don't agree
+
+
 /*
  * position_init:
  * Start positioning.
@@ -27,10 +80,52 @@ void position_init(void) ;
  */
 uint8 position_data_available(void) ;
 
+/*
+ * position_snapshot:
+ * Copies the most recent fix into *fix. The fields always come from the
+ * same fix, without interrupts being disabled. Must not be called from an
+ * interrupt handler.
+ */
+void position_snapshot(struct position_fix *fix) ;
+
+/*
+ * position_history:
+ * Copies up to max of the most recent fixes into fixes, newest first, and
+ * returns how many were copied. Must not be called from an interrupt
+ * handler.
+ */
+uint8 position_history(struct position_fix *fixes, uint8 max) ;
+
+/*
+ * position_ping_sent:
+ * Returns the clock_now() time at which the first ping of the fix's cycle
+ * was sent, from when its pings arrived and how far they came. Every car
+ * hearing the same cycle gets the same time.
+ */
+uint32 position_ping_sent(const struct position_fix *fix) ;
+
+/*
+ * position_realign:
+ * Starts UltraCounter and UltraTimer over and throws away any captures
+ * waiting, so that the next ping is taken as the first of a set. Called by
+ * agc.c between cycles; a ping lost or a capture made by something else
+ * would otherwise leave every set after it starting on the wrong ping.
+ */
+void position_realign(void) ;
+
+/*
+ * position_now:
+ * Estimates where the car is right now, by propagating the most recent fix
+ * forward along the path the hall sensor and steering say the car drove
+ * since its pings arrived. Must not be called from an interrupt handler.
+ */
+void position_now(struct position_estimate *est) ;
+
 /*
  * position_?:
  * Getter functions for position in units of feet, with the origin at the
- * center of the rectangle formed by the transmitters.
+ * center of the rectangle formed by the transmitters. Two calls may see
+ * two different fixes; use position_snapshot() if that matters.
  */
 float position_x(void) ;
 float position_y(void) ;
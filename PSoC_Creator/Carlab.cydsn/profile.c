@@ -0,0 +1,187 @@
+/* ========================================
+ * profile.c
+ * Monica Lu and Victor Ying
+ *
+ * Speed profile planning. Learns how sharply the track curves
+ * over one lap, then plans the fastest speed at every point of
+ * the lap that stays within grip and acceleration limits.
+ * ========================================
+ */
+
+#include <project.h>
+#include <math.h>
+
+#include "profile.h"
+#include "steer.h"
+
+
+#define TOP_SPEED 9.0  // in feet per second
+#define MIN_SPEED 3.0  // in feet per second
+#define LATERAL_ACCEL 11.0  // in feet per second squared, before sliding
+#define ACCEL 6.0  // in feet per second squared, under full power
+#define DECEL 8.0  // in feet per second squared, under braking
+
+enum state {
+    EMPTY = 0u,
+    LEARNING = 1u,
+    READY = 2u,
+};
+
+
+// While learning, each entry is the sharpest curvature seen in that bin, in
+// units of STEER_MAX_CURVATURE/255. Once planned, each entry is the speed for
+// that bin in units of PROFILE_SPEED_UNIT.
+static uint8 table[PROFILE_MAX_BINS];
+static uint16 num_bins = 0u;
+static float start_distance = 0.0;
+static float lap_length = 0.0;  // in feet, once planned
+static enum state current_state = EMPTY;
+
+
+/*
+ * profile_learn:
+ * Starts recording a lap, beginning at the given distance traveled.
+ */
+void profile_learn(float distance) {
+    uint16 i;
+    uint8 status = CyEnterCriticalSection();
+    
+    current_state = EMPTY;
+    for (i = 0; i < PROFILE_MAX_BINS; i++)
+        table[i] = 0u;
+    start_distance = distance;
+    num_bins = 0u;
+    current_state = LEARNING;
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * profile_learning:
+ * Returns nonzero while a lap is being recorded.
+ */
+uint8 profile_learning(void) {
+    return current_state == LEARNING;
+}
+
+/*
+ * profile_record:
+ * Records the curvature of the path, in units of 1/feet, at the given
+ * distance traveled.
+ */
+void profile_record(float distance, float curvature) {
+    float bin = (distance - start_distance) * (1.0 / PROFILE_BIN_LENGTH);
+    float code = fabs(curvature) * (255.0 / STEER_MAX_CURVATURE);
+    uint16 i;
+    
+    if (current_state != LEARNING || bin < 0.0 || bin >= PROFILE_MAX_BINS)
+        return;
+    i = (uint16)bin;
+    if (code > 255.0)
+        code = 255.0;
+    if ((uint8)code > table[i])
+        table[i] = (uint8)code;
+    if (i >= num_bins)
+        num_bins = i + 1;
+}
+
+/*
+ * limit:
+ * Lowers table[i] so that it can be reached from table[prev] by accelerating
+ * at accel over one bin.
+ */
+static void limit(uint16 i, uint16 prev, float accel) {
+    float prev_v = table[prev] * PROFILE_SPEED_UNIT;
+    float reachable = sqrt(prev_v*prev_v + 2*accel*PROFILE_BIN_LENGTH);
+    
+    if (reachable < table[i] * PROFILE_SPEED_UNIT)
+        table[i] = (uint8)(reachable / PROFILE_SPEED_UNIT);
+}
+
+/*
+ * profile_plan:
+ * Ends the recorded lap at the given distance traveled and plans the speed
+ * profile for it, in place in the table. Returns nonzero on success.
+ */
+uint8 profile_plan(float distance) {
+    float lap_bins = (distance - start_distance) * (1.0 / PROFILE_BIN_LENGTH);
+    uint16 i, n, pass;
+    uint8 first, prev, here, next, code;
+    
+    if (current_state != LEARNING || lap_bins < 2.0 ||
+            lap_bins > PROFILE_MAX_BINS)
+        return 0u;
+    n = (uint16)lap_bins;
+    current_state = EMPTY;
+    
+    // Fastest we can take each bin without sliding, looking at its
+    // neighbors too, since the curvature changes before the steering does.
+    // The lap wraps around, so the neighbors of the ends are each other.
+    first = table[0];
+    prev = table[n - 1];
+    for (i = 0; i < n; i++) {
+        float curvature, v = TOP_SPEED;
+        
+        here = table[i];
+        next = (i + 1 < n) ? table[i + 1] : first;
+        code = here;
+        if (next > code)
+            code = next;
+        if (prev > code)
+            code = prev;
+        prev = here;
+        
+        curvature = code * (STEER_MAX_CURVATURE / 255.0);
+        if (curvature * TOP_SPEED * TOP_SPEED > LATERAL_ACCEL)
+            v = sqrt(LATERAL_ACCEL / curvature);
+        if (v < MIN_SPEED)
+            v = MIN_SPEED;
+        table[i] = (uint8)(v / PROFILE_SPEED_UNIT);
+    }
+    
+    // Limit how fast we can speed up going forward, and how fast we can slow
+    // down going backward. Go around twice so the limits carry across the
+    // start of the lap.
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 1; i <= n; i++)
+            limit(i % n, i - 1, ACCEL);
+        for (i = n - 1; i > 0; i--)
+            limit(i - 1, i, DECEL);
+        limit(n - 1, 0, DECEL);
+    }
+    
+    num_bins = n;
+    lap_length = distance - start_distance;
+    current_state = READY;
+    return 1u;
+}
+
+/*
+ * profile_ready:
+ * Returns nonzero if a speed profile has been planned.
+ */
+uint8 profile_ready(void) {
+    return current_state == READY;
+}
+
+/*
+ * profile_speed:
+ * Returns the planned speed in feet per second at the given distance
+ * traveled, repeating the lap. The lap is rarely a whole number of bins, so
+ * the bin is found from how far around the lap we are, which doesn't drift
+ * from lap to lap.
+ */
+float profile_speed(float distance) {
+    float laps;
+    uint16 i;
+    
+    if (current_state != READY || distance < start_distance)
+        return 0.0;
+    laps = (distance - start_distance) / lap_length;
+    i = (uint16)((laps - floor(laps)) * num_bins);
+    if (i >= num_bins)
+        i = num_bins - 1;  // rounding at the very end of a lap
+    return table[i] * PROFILE_SPEED_UNIT;
+}
+
+//[] END OF FILE
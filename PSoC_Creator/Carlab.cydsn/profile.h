@@ -0,0 +1,63 @@
+/* ========================================
+ * profile.h
+ * Monica Lu and Victor Ying
+ *
+ * Speed profile planning. Learns how sharply the track curves
+ * over one lap, then plans the fastest speed at every point of
+ * the lap that stays within grip and acceleration limits.
+ * ========================================
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <project.h>
+
+
+#define PROFILE_BIN_LENGTH 0.5  // feet of track per table entry
+#define PROFILE_MAX_BINS 256  // so laps up to 128 feet long
+#define PROFILE_SPEED_UNIT 0.05  // feet per second per table count
+
+
+/*
+ * profile_learn:
+ * Starts recording a lap, beginning at the given distance traveled.
+ */
+void profile_learn(float distance) ;
+
+/*
+ * profile_learning:
+ * Returns nonzero while a lap is being recorded.
+ */
+uint8 profile_learning(void) ;
+
+/*
+ * profile_record:
+ * Records the curvature of the path, in units of 1/feet, at the given
+ * distance traveled. Called from the main loop after each hall tick.
+ */
+void profile_record(float distance, float curvature) ;
+
+/*
+ * profile_plan:
+ * Ends the recorded lap at the given distance traveled and plans the speed
+ * profile for it. Returns nonzero on success.
+ */
+uint8 profile_plan(float distance) ;
+
+/*
+ * profile_ready:
+ * Returns nonzero if a speed profile has been planned.
+ */
+uint8 profile_ready(void) ;
+
+/*
+ * profile_speed:
+ * Returns the planned speed in feet per second at the given distance
+ * traveled, repeating the lap. O(1).
+ */
+float profile_speed(float distance) ;
+
+#endif
+
+//[] END OF FILE
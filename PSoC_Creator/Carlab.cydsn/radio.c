@@ -0,0 +1,133 @@
+/* ========================================
+ * radio.c
+ * Monica Lu and Victor Ying
+ *
+ * Sends position fixes to the base station over the XBee, each
+ * in this car's slot during the next cycle's pings, as described
+ * in radio.h.
+ *
+ * The slot is held with sched_every(), set to go off once at the
+ * slot and turned off again by radio_send(). A fix that comes in
+ * while the last one is still waiting replaces it.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+
+#include "radio.h"
+#include "clock.h"
+#include "sched.h"
+#include "usb_uart.h"
+#include "fmt.h"
+
+
+uint8 radio_car = 0u;
+uint8 radio_slots = 1u;
+
+static char line[2 * FMT_MAX_LEN + 8];  // "<car>:X<x>Y<y>\n"
+static uint8 waiting = 0u;  // line is waiting for the slot
+static struct radio_cycle cycle;
+static uint32 sent = 0u;
+static uint16 unplanned = 0u;  // fixes dropped while the period wasn't known
+static uint16 replaced = 0u;  // fixes that never got to their slot
+
+
+/*
+ * radio_plan:
+ * Returns the clock_now() time at which the given car should send the fix
+ * of the cycle whose first ping was sent at sent, or 0 if the cycle's
+ * period isn't known yet.
+ */
+uint32 radio_plan(struct radio_cycle *cycle, uint32 sent, uint32 now,
+                  uint8 car, uint8 slots) {
+    uint32 gap = sent - cycle->sent;
+    uint32 at;
+
+    // A longer gap means cycles were lost in between
+    if (cycle->valid && gap >= RADIO_MIN_PERIOD && gap <= RADIO_MAX_PERIOD)
+        cycle->period = gap;
+    cycle->sent = sent;
+    cycle->valid = 1u;
+    if (cycle->period == 0u)
+        return 0u;
+
+    // The slot during the next cycle's pings, or a later cycle's if working
+    // out the fix took that long
+    at = sent + RADIO_WINDOW_START + (car % slots) * (RADIO_WINDOW / slots);
+    do {
+        at += cycle->period;
+    } while ((int32)(at - now) <= 0);
+    return at != 0u ? at : 1u;
+}
+
+/*
+ * radio_report_fix:
+ * Sends a fix, now if radio_slots is 0, otherwise in this car's slot.
+ */
+void radio_report_fix(const struct position_fix *fix) {
+    uint32 now = clock_now();
+    uint32 at;
+    char *p;
+
+    if (waiting)
+        replaced++;
+    waiting = 0u;
+    p = fmt_float(line, radio_car, 0u);
+    p = fmt_string(p, ":X");
+    p = fmt_float(p, fix->x, 2u);
+    p = fmt_string(p, "Y");
+    p = fmt_float(p, fix->y, 2u);
+    fmt_string(p, "\n");
+
+    if (radio_slots == 0u) {
+        UART_PutString(line);
+        sent++;
+        return;
+    }
+    at = radio_plan(&cycle, position_ping_sent(fix), now, radio_car,
+                    radio_slots);
+    if (at == 0u) {
+        unplanned++;
+        return;
+    }
+    waiting = 1u;
+    sched_every(SCHED_RADIO, at - now);
+}
+
+/*
+ * radio_send:
+ * Run by sched.c when this car's slot comes round. Sends the fix waiting
+ * for it.
+ */
+void radio_send(void) {
+    sched_every(SCHED_RADIO, 0u);
+    if (!waiting)
+        return;
+    waiting = 0u;
+    UART_PutString(line);
+    sent++;
+}
+
+/*
+ * radio_print:
+ * Prints the car number, slots, cycle period and counts of fixes sent and
+ * not sent over USB UART.
+ */
+void radio_print(void) {
+    char strbuf[64];
+
+    if (radio_slots == 0u)
+        sprintf(strbuf, "car %u, sending each fix at once",
+                (unsigned)radio_car);
+    else
+        sprintf(strbuf, "car %u, slot %u of %u, cycle %lu us",
+                (unsigned)radio_car, (unsigned)(radio_car % radio_slots),
+                (unsigned)radio_slots, (unsigned long)cycle.period);
+    usb_uart_putline(strbuf);
+    sprintf(strbuf, "%lu fixes sent, %u before the cycle was known, "
+            "%u replaced", (unsigned long)sent, unplanned, replaced);
+    usb_uart_putline(strbuf);
+}
+
+//[] END OF FILE
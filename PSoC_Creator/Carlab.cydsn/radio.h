@@ -0,0 +1,89 @@
+/* ========================================
+ * radio.h
+ * Monica Lu and Victor Ying
+ *
+ * Sends position fixes to the base station over the XBee, as
+ * lines of "<car>:X<x>Y<y>", so several cars can share one
+ * channel and host/telemetry can tell them apart. Anything that
+ * looked for the X, like XBeePlot.m, still works.
+ *
+ * The transmitters' own radio traffic (latency tests, then 'p')
+ * keeps the channel busy except while they ping, and several cars
+ * sending at once fight over it. So each car sends its fix during
+ * the next cycle's pings, in a slot of its own: the cycle's first
+ * ping goes out at the same moment for every car, and each car
+ * works out when that was from its fix and how far it is from the
+ * first transmitter, so the cars agree on the slots without
+ * talking to each other.
+ *
+ * Set each car's XBee to send to the base station's address (DL)
+ * rather than broadcast, so it retries a lost fix and the
+ * transmitters never hear the car's lines, which they would take
+ * for latency replies.
+ * ========================================
+ */
+
+#ifndef RADIO_H
+#define RADIO_H
+
+#include <project.h>
+
+#include "position.h"
+
+
+#define RADIO_MAX_SLOTS 10u  // cars that fit between the pings
+#define RADIO_WINDOW_START 20000u  // in microseconds after the first ping is sent
+#define RADIO_WINDOW 270000u  // in microseconds; the slots, before the next latency test
+#define RADIO_MIN_PERIOD 400000u  // in microseconds; shortest believable cycle
+#define RADIO_MAX_PERIOD 1000000u  // in microseconds; longer gaps have lost cycles
+
+
+// Change these with param.c
+extern uint8 radio_car;  // sent with every fix; this car's slot is radio_car % radio_slots
+extern uint8 radio_slots;  // cars sharing the channel, or 0 to send each fix at once
+
+/*
+ * How one car follows the transmitters' cycle. Start it zeroed.
+ */
+struct radio_cycle {
+    uint32 sent;  // clock_now() when the last cycle's first ping was sent
+    uint32 period;  // between cycles, or 0 until one has been measured
+    uint8 valid;  // sent is set
+};
+
+
+/*
+ * radio_plan:
+ * Takes the time the first ping of a cycle was sent, and returns the
+ * clock_now() time at which the given car should send that cycle's fix,
+ * in its slot among slots during the next cycle's pings. Returns 0 if the
+ * cycle's period isn't known yet, so the fix shouldn't be sent. now is
+ * clock_now(); slots must not be 0.
+ */
+uint32 radio_plan(struct radio_cycle *cycle, uint32 sent, uint32 now,
+                  uint8 car, uint8 slots) ;
+
+/*
+ * radio_report_fix:
+ * Sends a fix, now if radio_slots is 0, otherwise in this car's slot.
+ */
+void radio_report_fix(const struct position_fix *fix) ;
+
+/*
+ * radio_send:
+ * Run by sched.c when this car's slot comes round. Sends the fix waiting
+ * for it.
+ */
+void radio_send(void) ;
+
+/*
+ * radio_print:
+ * Prints the car number, slots, cycle period and counts of fixes sent and
+ * not sent over USB UART.
+ */
+void radio_print(void) ;
+
+
+#endif
+
+//[] END OF FILE
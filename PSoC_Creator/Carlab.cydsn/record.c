@@ -0,0 +1,222 @@
+/* ========================================
+ * record.c
+ * Monica Lu and Victor Ying
+ *
+ * Teach and repeat. Records what the car did over a lap or so,
+ * and plays the steering and speed back as feedforward so the
+ * PID controllers only have to correct small deviations.
+ *
+ * The recording is a stream of variable length entries:
+ *   sample: speed, change in steer_output, change in measurement
+ *           (3 bytes, one every RECORD_TICK_DECIMATION ticks)
+ *   fix:    FIX_MARKER, x, y (5 bytes, x and y in hundredths of feet,
+ *           most significant byte first)
+ * The changes are in units of 1/127. If one is too big to fit in a byte,
+ * the rest is carried over into the next sample, so the error never
+ * accumulates.
+ * ========================================
+ */
+
+#include <project.h>
+
+#include "record.h"
+#include "speed.h"
+#include "steer.h"
+
+
+#define FIX_MARKER 0xFFu  // speeds are never recorded as this value
+#define SAMPLE_SIZE 3u
+#define FIX_SIZE 5u
+
+// Normalized drive power needed per foot per second of speed, on top of the
+// fixed offset speed_pid_control() always adds.
+#define POWER_PER_SPEED 0.025
+
+enum state {
+    IDLE = 0u,
+    RECORDING = 1u,
+    REPLAYING = 2u,
+};
+
+
+static uint8 buffer[RECORD_BUFFER_SIZE];
+static uint16 used = 0u;  // bytes recorded
+static uint16 cursor = 0u;  // next byte to replay
+static uint8 tick_phase = 0u;  // ticks since the last sample
+static int8 last_steer = 0, last_measurement = 0;  // as of the last sample
+static float replay_factor = 1.0;
+static enum state current_state = IDLE;
+
+
+static void replay_next(void) ;
+
+
+/*
+ * quantize:
+ * Returns the change from *last to value in units of 1/127, limited to fit
+ * in a byte, and updates *last to what the decoder will reconstruct.
+ */
+static int8 quantize(int8 *last, float value) {
+    int16 change;
+    
+    if (value > 1.0)
+        value = 1.0;
+    else if (value < -1.0)
+        value = -1.0;
+    change = (int16)(value * 127.0) - *last;
+    if (change > 127)
+        change = 127;
+    else if (change < -128)
+        change = -128;
+    *last += (int8)change;
+    return (int8)change;
+}
+
+/*
+ * record_start:
+ * Discards any previous recording and starts recording.
+ */
+void record_start(void) {
+    uint8 status = CyEnterCriticalSection();
+    
+    record_stop();
+    used = 0u;
+    tick_phase = 0u;
+    last_steer = 0;
+    last_measurement = 0;
+    current_state = RECORDING;
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * replay_start:
+ * Starts replaying the recording from the beginning, with the speeds
+ * scaled by speed_factor.
+ */
+void replay_start(float speed_factor) {
+    uint8 status = CyEnterCriticalSection();
+    
+    record_stop();
+    cursor = 0u;
+    tick_phase = 0u;
+    last_steer = 0;
+    last_measurement = 0;
+    replay_factor = speed_factor;
+    current_state = REPLAYING;
+    
+    // Each sample is applied a sample early, to lead the motor and servo lag
+    replay_next();
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * record_stop:
+ * Stops recording or replaying, and removes any feedforward.
+ */
+void record_stop(void) {
+    uint8 status = CyEnterCriticalSection();
+    
+    if (current_state == REPLAYING) {
+        steer_replay_stop();
+        speed_set_feedforward(0.0);
+    }
+    current_state = IDLE;
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * replay_next:
+ * Decodes the next sample of the recording, skipping fixes, and applies it
+ * as feedforward. Stops at the end of the recording.
+ */
+static void replay_next(void) {
+    float v;
+    
+    while (cursor < used && buffer[cursor] == FIX_MARKER)
+        cursor += FIX_SIZE;
+    if (cursor + SAMPLE_SIZE > used) {
+        record_stop();
+        return;
+    }
+    
+    v = buffer[cursor] * RECORD_SPEED_UNIT * replay_factor;
+    last_steer += (int8)buffer[cursor + 1];
+    last_measurement += (int8)buffer[cursor + 2];
+    cursor += SAMPLE_SIZE;
+    
+    speed_set(v);
+    speed_set_feedforward(POWER_PER_SPEED * v);
+    steer_replay(last_steer / 127.0, last_measurement / 127.0);
+}
+
+/*
+ * record_tick:
+ * Called by the hall sensor handler on every tick. Records or replays one
+ * sample every RECORD_TICK_DECIMATION ticks.
+ */
+void record_tick(void) {
+    float code;
+    
+    if (current_state == IDLE)
+        return;
+    if (++tick_phase < RECORD_TICK_DECIMATION)
+        return;
+    tick_phase = 0u;
+    
+    if (current_state == REPLAYING) {
+        replay_next();
+        return;
+    }
+    
+    if (used + SAMPLE_SIZE > RECORD_BUFFER_SIZE) {
+        record_stop();
+        return;
+    }
+    code = speed / RECORD_SPEED_UNIT;
+    buffer[used] = code >= FIX_MARKER ? FIX_MARKER - 1u : (uint8)code;
+    buffer[used + 1] = quantize(&last_steer, steer_output);
+    buffer[used + 2] = quantize(&last_measurement, steer_measurement());
+    used += SAMPLE_SIZE;
+}
+
+/*
+ * record_fix:
+ * Called from the main loop with every new position fix.
+ */
+void record_fix(const struct position_fix *fix) {
+    int16 x = (int16)(fix->x * 100.0), y = (int16)(fix->y * 100.0);
+    uint8 status = CyEnterCriticalSection();
+    
+    if (current_state == RECORDING) {
+        if (used + FIX_SIZE > RECORD_BUFFER_SIZE) {
+            record_stop();
+        }
+        else {
+            buffer[used] = FIX_MARKER;
+            buffer[used + 1] = (uint8)((uint16)x >> 8);
+            buffer[used + 2] = (uint8)x;
+            buffer[used + 3] = (uint8)((uint16)y >> 8);
+            buffer[used + 4] = (uint8)y;
+            used += FIX_SIZE;
+        }
+    }
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * record_used:
+ * Returns how many bytes of the recording buffer are in use.
+ */
+uint16 record_used(void) {
+    uint16 ret;
+    uint8 status = CyEnterCriticalSection();
+    ret = used;
+    CyExitCriticalSection(status);
+    return ret;
+}
+
+//[] END OF FILE
@@ -0,0 +1,68 @@
+/* ========================================
+ * record.h
+ * Monica Lu and Victor Ying
+ *
+ * Teach and repeat. Records what the car did over a lap or so,
+ * and plays the steering and speed back as feedforward so the
+ * PID controllers only have to correct small deviations.
+ * ========================================
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <project.h>
+
+#include "position.h"
+
+
+// Bytes of RAM the recording takes; 768 holds about a lap. Define it in the
+// compiler settings to record longer, RAM allowing.
+#ifndef RECORD_BUFFER_SIZE
+#define RECORD_BUFFER_SIZE 768
+#endif
+#define RECORD_TICK_DECIMATION 4  // hall ticks per recorded sample
+#define RECORD_SPEED_UNIT 0.05  // feet per second per recorded count
+
+
+/*
+ * record_start:
+ * Discards any previous recording and starts recording.
+ */
+void record_start(void) ;
+
+/*
+ * replay_start:
+ * Starts replaying the recording from the beginning, with the speeds
+ * scaled by speed_factor.
+ */
+void replay_start(float speed_factor) ;
+
+/*
+ * record_stop:
+ * Stops recording or replaying, and removes any feedforward.
+ */
+void record_stop(void) ;
+
+/*
+ * record_tick:
+ * Should be called by the hall sensor handler on every tick, after the
+ * distance and speed have been updated.
+ */
+void record_tick(void) ;
+
+/*
+ * record_fix:
+ * Should be called from the main loop with every new position fix.
+ */
+void record_fix(const struct position_fix *fix) ;
+
+/*
+ * record_used:
+ * Returns how many bytes of the recording buffer are in use.
+ */
+uint16 record_used(void) ;
+
+#endif
+
+//[] END OF FILE
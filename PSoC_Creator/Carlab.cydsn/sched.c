@@ -0,0 +1,177 @@
+/* ========================================
+ * sched.c
+ * Monica Lu and Victor Ying
+ *
+ * Runs the work that doesn't have to happen inside an interrupt
+ * handler from the main loop, as tasks.
+ *
+ * Ready tasks are bits in one word, which interrupt handlers set
+ * in a critical section. Periodic tasks are made ready by
+ * sched_poll() comparing clock_now() against when each is next
+ * due; a period that comes round while the task is still waiting
+ * to run is dropped, so a slow task never piles up work.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+
+#include "sched.h"
+#include "clock.h"
+#include "timing.h"
+#include "usb_uart.h"
+#include "drive.h"
+#include "steer.h"
+#include "speed.h"
+#include "shell.h"
+#include "scope.h"
+#include "radio.h"
+#include "agc.h"
+#include "journal.h"
+
+
+#define SHELL_INTERVAL 10000u  // in microseconds; commands are read at 100 Hz
+#define REPORT_INTERVAL 100000u  // in microseconds
+
+
+static CYCODE const char *const names[SCHED_TASKS] = {
+    "gate", "drive", "path", "fix", "shell", "reports", "display", "scope",
+    "radio", "journal",
+};
+
+static uint16 ready = 0u;  // bit per task
+static uint32 periods[SCHED_TASKS] = {
+    0u, 0u, STEER_PATH_INTERVAL, 0u, SHELL_INTERVAL, REPORT_INTERVAL, 0u, 0u,
+    0u, JOURNAL_FLUSH,
+};
+static uint32 due[SCHED_TASKS];  // clock_now() when each periodic task is next ready
+static uint32 runs[SCHED_TASKS];
+static uint16 merged[SCHED_TASKS];  // posts made while already ready
+
+
+/*
+ * run:
+ * Runs the given task. The calls are direct rather than through a table of
+ * function pointers, so the compiler can still see which functions call
+ * which when it overlays their local variables.
+ */
+static void run(enum sched_task task) {
+    switch (task) {
+    case SCHED_GATE:
+        agc_gate();
+        break;
+    case SCHED_DRIVE:
+        magnet_callback();
+        break;
+    case SCHED_PATH:
+        steer_path_poll();
+        break;
+    case SCHED_FIX:
+        drive_report_fix();
+        break;
+    case SCHED_SHELL:
+        shell_handle_received_chars();
+        break;
+    case SCHED_REPORT:
+        speed_autotune_report();
+        steer_autotune_report();
+        break;
+    case SCHED_DISPLAY:
+        drive_display_info();
+        break;
+    case SCHED_SCOPE:
+        scope_send();
+        break;
+    case SCHED_RADIO:
+        radio_send();
+        break;
+    case SCHED_JOURNAL:
+        journal_write();
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * sched_post:
+ * Marks the given task ready to run. Posting a task that is already ready
+ * runs it only once. Safe to call from interrupt handlers.
+ */
+void sched_post(enum sched_task task) CYREENTRANT {
+    uint16 bit = 1u << task;
+    uint8 status = CyEnterCriticalSection();
+
+    if ((ready & bit) && merged[task] < 0xFFFFu)
+        merged[task]++;
+    ready |= bit;
+
+    CyExitCriticalSection(status);
+}
+
+/*
+ * sched_every:
+ * Makes the given task ready every period microseconds from now on, or
+ * never again if period is 0.
+ */
+void sched_every(enum sched_task task, uint32 period) {
+    uint8 status = CyEnterCriticalSection();
+
+    periods[task] = period;
+    due[task] = clock_now() + period;
+
+    CyExitCriticalSection(status);
+}
+
+/*
+ * sched_poll:
+ * Runs the highest priority task that is ready, if any. Returns nonzero if
+ * one ran.
+ */
+uint8 sched_poll(void) {
+    uint32 now = clock_now();
+    uint32 start;
+    uint8 task, status;
+
+    for (task = 0u; task < SCHED_TASKS; task++) {
+        if (periods[task] == 0u || (int32)(now - due[task]) < 0)
+            continue;
+        due[task] += periods[task];
+        if ((int32)(now - due[task]) >= 0)
+            due[task] = now + periods[task];  // fell behind; skip the missed ones
+        sched_post(task);
+    }
+
+    status = CyEnterCriticalSection();
+    for (task = 0u; task < SCHED_TASKS && !(ready & (1u << task)); task++)
+        ;
+    if (task < SCHED_TASKS)
+        ready &= ~(1u << task);
+    CyExitCriticalSection(status);
+    if (task == SCHED_TASKS)
+        return 0u;
+
+    start = timing_start((enum timing_slot)(TIMING_TASK_GATE + task));
+    run(task);
+    timing_end((enum timing_slot)(TIMING_TASK_GATE + task), start);
+    runs[task]++;
+    return 1u;
+}
+
+/*
+ * sched_print:
+ * Prints how often each task ran, and how often it was posted again before
+ * it got to run, over USB UART. Time spent in each is in timing_print().
+ */
+void sched_print(void) {
+    char strbuf[64];
+    uint8 task;
+
+    for (task = 0u; task < SCHED_TASKS; task++) {
+        sprintf(strbuf, "task %s: %lu runs, %u posts merged", names[task],
+                (unsigned long)runs[task], merged[task]);
+        usb_uart_putline(strbuf);
+    }
+}
+
+//[] END OF FILE
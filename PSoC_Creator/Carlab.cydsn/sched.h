@@ -0,0 +1,67 @@
+/* ========================================
+ * sched.h
+ * Monica Lu and Victor Ying
+ *
+ * Runs the work that doesn't have to happen inside an interrupt
+ * handler from the main loop, as tasks. A task runs when an
+ * interrupt handler posts it or its period comes round, and always
+ * runs to completion; when several are ready, the one earliest in
+ * enum sched_task goes first.
+ * ========================================
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <project.h>
+
+
+// Every task, highest priority first. The timing.c slots for the tasks are
+// in the same order.
+enum sched_task {
+    SCHED_GATE = 0u,  // agc_gate(), periodic, sooner at receiver windows and fixes
+    SCHED_DRIVE = 1u,  // magnet_callback(), posted by every hall tick
+    SCHED_PATH = 2u,  // steer_path_poll(), periodic
+    SCHED_FIX = 3u,  // drive_report_fix(), posted by every position fix
+    SCHED_SHELL = 4u,  // commands from USB UART, periodic
+    SCHED_REPORT = 5u,  // autotune reports, periodic
+    SCHED_DISPLAY = 6u,  // drive_display_info(), periodic once turned on
+    SCHED_SCOPE = 7u,  // scope_send(), posted by every scope sample
+    SCHED_RADIO = 8u,  // radio_send(), once when this car's radio slot comes
+    SCHED_JOURNAL = 9u,  // journal_write(), periodic, after fixes and full pages
+    SCHED_TASKS = 10u,  // at most 16, the bits of ready
+};
+
+
+/*
+ * sched_post:
+ * Marks the given task ready to run. Posting a task that is already ready
+ * runs it only once. Safe to call from interrupt handlers.
+ */
+void sched_post(enum sched_task task) CYREENTRANT ;
+
+/*
+ * sched_every:
+ * Makes the given task ready every period microseconds from now on, or
+ * never again if period is 0.
+ */
+void sched_every(enum sched_task task, uint32 period) ;
+
+/*
+ * sched_poll:
+ * Runs the highest priority task that is ready, if any. Returns nonzero if
+ * one ran. Should be called over and over from the main loop.
+ */
+uint8 sched_poll(void) ;
+
+/*
+ * sched_print:
+ * Prints how often each task ran, and how often it was posted again before
+ * it got to run, over USB UART.
+ */
+void sched_print(void) ;
+
+
+#endif
+
+//[] END OF FILE
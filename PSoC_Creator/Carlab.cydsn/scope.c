@@ -0,0 +1,327 @@
+/* ========================================
+ * scope.c
+ * Monica Lu and Victor Ying
+ *
+ * Streams controller variables over USB UART in the frames
+ * described in scope.h.
+ *
+ * The speed PID interrupt handler takes the samples into a ring,
+ * and the scope_send() task packs them into frames. While USB is
+ * busy the samples pile up, so each frame carries more of them;
+ * once the ring is full, new samples are dropped and counted
+ * rather than holding up the interrupt handler or the main loop.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "scope.h"
+#include "clock.h"
+#include "sched.h"
+#include "usb_uart.h"
+#include "speed.h"
+#include "steer.h"
+
+
+struct sample {
+    uint16 seq;
+    uint32 time;  // clock_now() when it was taken
+    float value[SCOPE_VARS];  // the variables in mask, packed to the front
+};
+
+// Names for the shell and host/scope, in the order of enum scope_var
+static CYCODE const char *const names[SCOPE_VARS] = {
+    "speed", "setpoint", "power", "dist", "steer", "meas", "x", "y", "err",
+};
+
+static struct sample ring[SCOPE_RING];
+static volatile uint8 head = 0u;  // next written by scope_sample()
+static volatile uint8 tail = 0u;  // next sent by scope_send()
+static uint16 mask = 0u;  // variables sampled; zero when not streaming
+static uint8 num_vars = 0u;  // bits set in mask
+static uint8 decimation = 1u;
+static uint8 phase = 0u;  // periods since the last sample
+static uint16 seq = 0u;  // of the next sample
+static uint16 dropped = 0u;  // saturating
+static uint32 frames = 0u;
+static float fix_x = 0.0, fix_y = 0.0, fix_error = 0.0;
+
+
+#ifdef SCOPE_ENABLE
+
+/*
+ * read_var:
+ * Returns the current value of the given variable. Called with interrupts
+ * off, so no float is caught half written.
+ */
+static float read_var(uint8 var) {
+    switch (var) {
+    case SCOPE_SPEED:
+        return speed;
+    case SCOPE_SETPOINT:
+        return speed_setpoint;
+    case SCOPE_POWER:
+        return power_output;
+    case SCOPE_DISTANCE:
+        return distance_traveled;
+    case SCOPE_STEER:
+        return steer_output;
+    case SCOPE_MEASUREMENT:
+        return steer_measurement();
+    case SCOPE_X:
+        return fix_x;
+    case SCOPE_Y:
+        return fix_y;
+    case SCOPE_ERROR:
+        return fix_error;
+    default:
+        return 0.0;
+    }
+}
+
+/*
+ * scope_sample:
+ * Called by the speed PID interrupt handler every period. Takes a sample
+ * every decimation periods while streaming.
+ */
+void scope_sample(void) {
+    struct sample *s;
+    uint8 next, var, n = 0u;
+    uint8 status;
+
+    if (mask == 0u || ++phase < decimation)
+        return;
+    phase = 0u;
+
+    next = (head + 1u) % SCOPE_RING;
+    if (next == tail) {
+        if (dropped < 0xFFFFu)
+            dropped++;
+        seq++;
+        return;
+    }
+    s = &ring[head];
+    s->seq = seq++;
+    s->time = clock_now();
+    status = CyEnterCriticalSection();
+    for (var = 0u; var < SCOPE_VARS; var++)
+        if (mask & (1u << var))
+            s->value[n++] = read_var(var);
+    CyExitCriticalSection(status);
+    head = next;
+    sched_post(SCHED_SCOPE);
+}
+
+/*
+ * scope_fix:
+ * Gives the scope the latest position fix to sample.
+ */
+void scope_fix(const struct position_fix *fix) {
+    uint8 status = CyEnterCriticalSection();
+
+    fix_x = fix->x;
+    fix_y = fix->y;
+    fix_error = fix->error;
+    CyExitCriticalSection(status);
+}
+
+#endif
+
+/*
+ * put_u16, put_u32, put_float:
+ * Write values as bytes, most significant first.
+ */
+static void put_u16(uint8 *bytes, uint16 value) {
+    bytes[0] = (uint8)(value >> 8);
+    bytes[1] = (uint8)value;
+}
+static void put_u32(uint8 *bytes, uint32 value) {
+    put_u16(bytes, (uint16)(value >> 16));
+    put_u16(bytes + 2, (uint16)value);
+}
+static void put_float(uint8 *bytes, float value) {
+    union { float f; uint32 u; } v;
+
+    v.f = value;
+    put_u32(bytes, v.u);
+}
+
+/*
+ * pack_frame:
+ * Moves the consecutive samples at the front of the ring into frame, as
+ * many as fit, and returns the frame's length.
+ */
+static uint8 pack_frame(uint8 *frame) {
+    uint8 *body = frame + 2;
+    uint8 *out = body + SCOPE_HEADER;
+    uint8 per_frame = (SCOPE_MAX_BODY - SCOPE_HEADER) / (4u * num_vars);
+    const struct sample *first = &ring[tail];
+    uint8 count = 0u, len, check, i, status;
+    uint16 lost;
+
+    while (tail != head && count < per_frame &&
+            ring[tail].seq == (uint16)(first->seq + count)) {
+        for (i = 0u; i < num_vars; i++, out += 4)
+            put_float(out, ring[tail].value[i]);
+        tail = (tail + 1u) % SCOPE_RING;
+        count++;
+    }
+
+    status = CyEnterCriticalSection();
+    lost = dropped;
+    CyExitCriticalSection(status);
+    put_u16(body, mask);
+    put_u16(body + 2, first->seq);
+    put_u32(body + 4, first->time);
+    put_u16(body + 8, lost);
+    body[10] = decimation;
+    body[11] = count;
+
+    len = (uint8)(out - body);
+    check = len;
+    for (i = 0u; i < len; i++)
+        check += body[i];
+    frame[0] = SCOPE_SYNC;
+    frame[1] = len;
+    frame[2u + len] = (uint8)-check;
+    return len + 3u;
+}
+
+/*
+ * scope_send:
+ * Run by sched.c once there are samples. Sends as many frames as USB UART
+ * will take without waiting, and posts itself again if any are left.
+ */
+void scope_send(void) {
+    uint8 frame[SCOPE_MAX_FRAME];
+    uint8 len;
+
+    while (tail != head) {
+        if (!USBUART_GetConfiguration()) {
+            tail = head;  // nobody to send them to
+            return;
+        }
+        if (!USBUART_CDCIsReady()) {
+            sched_post(SCHED_SCOPE);
+            return;
+        }
+        len = pack_frame(frame);
+        USBUART_PutData(frame, len);
+        frames++;
+    }
+}
+
+/*
+ * print_status:
+ * Prints what is being streamed, and the variables there are.
+ */
+static void print_status(void) {
+    char strbuf[96];
+    uint8 var, status;
+    uint16 lost;
+    int n;
+
+    status = CyEnterCriticalSection();
+    lost = dropped;
+    CyExitCriticalSection(status);
+    if (mask == 0u) {
+        usb_uart_putline("Scope off");
+    } else {
+        n = sprintf(strbuf, "Scope every %u ms:",
+                    decimation * (unsigned)(CLOCK_TICKS_PER_PERIOD / 1000u));
+        for (var = 0u; var < SCOPE_VARS; var++)
+            if (mask & (1u << var))
+                n += sprintf(strbuf + n, " %s", names[var]);
+        usb_uart_putline(strbuf);
+        sprintf(strbuf, "%lu frames sent, %u samples dropped",
+                (unsigned long)frames, lost);
+        usb_uart_putline(strbuf);
+    }
+    n = sprintf(strbuf, "Variables:");
+    for (var = 0u; var < SCOPE_VARS; var++)
+        n += sprintf(strbuf + n, " %s", names[var]);
+    usb_uart_putline(strbuf);
+}
+
+/*
+ * find_var:
+ * Returns the variable whose name is the n characters at name, or
+ * SCOPE_VARS.
+ */
+static uint8 find_var(const char *name, uint8 n) {
+    uint8 var;
+
+    for (var = 0u; var < SCOPE_VARS; var++)
+        if (strlen(names[var]) == n && strncmp(name, names[var], n) == 0)
+            break;
+    return var;
+}
+
+/*
+ * scope_command:
+ * The shell's "scope" command. args is a decimation and variable names to
+ * start streaming, "off" to stop, or empty to print the variables and what
+ * is being streamed.
+ */
+void scope_command(const char *args) {
+    uint16 new_mask = 0u;
+    uint8 new_decimation = 1u, new_vars = 0u;
+    uint8 var, n, status;
+    int every;
+
+    if (*args == '\0') {
+        print_status();
+        return;
+    }
+    if (strcmp(args, "off") != 0) {
+        if (isdigit(*args)) {
+            every = atoi(args);
+            if (every < 1 || every > 255) {
+                usb_uart_putline("Scope decimation must be from 1 to 255");
+                return;
+            }
+            new_decimation = (uint8)every;
+            while (isdigit(*args))
+                args++;
+        }
+        for (;;) {
+            while (isspace(*args))
+                args++;
+            for (n = 0u; args[n] != '\0' && !isspace(args[n]); n++)
+                ;
+            if (n == 0u)
+                break;
+            var = find_var(args, n);
+            if (var == SCOPE_VARS)
+                break;
+            if (!(new_mask & (1u << var)))
+                new_vars++;
+            new_mask |= 1u << var;
+            args += n;
+        }
+        if (*args != '\0' || new_mask == 0u) {
+            usb_uart_putline("Scope [decimation] variable..., or off");
+            print_status();
+            return;
+        }
+    }
+
+    // Start afresh, so the stream's seq and dropped count from zero
+    status = CyEnterCriticalSection();
+    mask = new_mask;
+    num_vars = new_vars;
+    decimation = new_decimation;
+    phase = new_decimation - 1u;  // first sample at the next period
+    seq = 0u;
+    dropped = 0u;
+    head = 0u;
+    tail = 0u;
+    frames = 0u;
+    CyExitCriticalSection(status);
+}
+
+//[] END OF FILE
@@ -0,0 +1,107 @@
+/* ========================================
+ * scope.h
+ * Monica Lu and Victor Ying
+ *
+ * Streams controller variables to a host over USB UART, sampled
+ * at a fixed rate, for plotting like an oscilloscope. The shell
+ * command "scope" picks which variables and how often; host/scope
+ * starts a stream and writes it to a file.
+ *
+ * Samples are sent in binary frames, framed like param.h's:
+ * SCOPE_SYNC, a length byte, that many bytes of body, and a check
+ * byte making the length, body and check add up to zero. A whole
+ * frame is at most one USB packet, so text the shell prints never
+ * lands inside one. The body is:
+ *   mask        2 bytes, bit per enum scope_var sampled
+ *   seq         2 bytes, number of the first sample in the frame
+ *   time        4 bytes, clock_now() when it was taken
+ *   dropped     2 bytes, samples lost so far to a full buffer
+ *   decimation  1 byte, speed PID periods per sample
+ *   count       1 byte, samples in the frame
+ * then count samples, each the variables in mask in the order of
+ * enum scope_var as IEEE single floats. Multi-byte fields are most
+ * significant byte first. The samples in a frame are consecutive,
+ * so the seq of the next frame tells which were dropped.
+ * ========================================
+ */
+
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <project.h>
+
+#include "position.h"
+#include "usb_uart.h"
+
+
+#define SCOPE_ENABLE  // Comment this out to leave out streaming
+
+#define SCOPE_SYNC 0x03u  // starts a frame; never printed as text
+#define SCOPE_MAX_FRAME USB_UART_PACKET
+#define SCOPE_MAX_BODY (SCOPE_MAX_FRAME - 3u)
+#define SCOPE_HEADER 12u
+// Samples buffered while USB is busy, 42 bytes of RAM each. One slot is
+// always free, so 8 rides out 70 ms of USB being busy at the full 100
+// samples a second. Define it in the compiler settings to ride out more.
+#ifndef SCOPE_RING
+#define SCOPE_RING 8u
+#endif
+
+
+// The values are part of the frame format, so only add to the end
+enum scope_var {
+    SCOPE_SPEED = 0u,  // feet per second
+    SCOPE_SETPOINT = 1u,  // speed_setpoint
+    SCOPE_POWER = 2u,  // power_output
+    SCOPE_DISTANCE = 3u,  // distance_traveled in feet
+    SCOPE_STEER = 4u,  // steer_output
+    SCOPE_MEASUREMENT = 5u,  // steer_measurement()
+    SCOPE_X = 6u,  // of the latest position fix, in feet
+    SCOPE_Y = 7u,
+    SCOPE_ERROR = 8u,  // of the latest position fix, in feet squared
+    SCOPE_VARS = 9u,
+};
+
+
+#ifdef SCOPE_ENABLE
+
+/*
+ * scope_sample:
+ * Called by the speed PID interrupt handler every period. Takes a sample
+ * every decimation periods while streaming.
+ */
+void scope_sample(void) ;
+
+/*
+ * scope_fix:
+ * Gives the scope the latest position fix to sample. Position fixes can't
+ * be read from an interrupt handler, so this is called as each is made.
+ */
+void scope_fix(const struct position_fix *fix) ;
+
+#else
+
+#define scope_sample()
+#define scope_fix(fix)
+
+#endif
+
+/*
+ * scope_send:
+ * Run by sched.c once there are samples. Sends as many frames as USB UART
+ * will take without waiting, and posts itself again if any are left.
+ */
+void scope_send(void) ;
+
+/*
+ * scope_command:
+ * The shell's "scope" command. args is a decimation and variable names to
+ * start streaming, "off" to stop, or empty to print the variables and what
+ * is being streamed.
+ */
+void scope_command(const char *args) ;
+
+
+#endif
+
+//[] END OF FILE
@@ -15,6 +15,118 @@
 #include "steer.h"
 #include "usb_uart.h"
 #include "drive.h"
+#include "profile.h"
+#include "record.h"
+#include "timing.h"
+#include "trace.h"
+#include "sched.h"
+#include "param.h"
+#include "scope.h"
+#include "radio.h"
+#include "agc.h"
+#include "journal.h"
+
+
+enum command_id {
+    CMD_AGC = 0u,
+    CMD_BRAKE = 1u,
+    CMD_BW = 2u,
+    CMD_CAMSTATS = 3u,
+    CMD_COAST = 4u,
+    CMD_DISPLAY = 5u,
+    CMD_FW = 6u,
+    CMD_JOURNAL = 7u,
+    CMD_LCD = 8u,
+    CMD_LEARN = 9u,
+    CMD_PARAMS = 10u,
+    CMD_PID = 11u,
+    CMD_PIDTIME = 12u,
+    CMD_PLAN = 13u,
+    CMD_POWER = 14u,
+    CMD_PROF = 15u,
+    CMD_RADIO = 16u,
+    CMD_REC = 17u,
+    CMD_RECSTOP = 18u,
+    CMD_REPEAT = 19u,
+    CMD_REPLAY = 20u,
+    CMD_SCOPE = 21u,
+    CMD_SERIAL = 22u,
+    CMD_SPEEDTUNE = 23u,
+    CMD_STEERPATH = 24u,
+    CMD_STEERPID = 25u,
+    CMD_STEERSET = 26u,
+    CMD_STEERSTOP = 27u,
+    CMD_STEERTUNE = 28u,
+    CMD_TRACE = 29u,
+    CMD_UNKNOWN = 30u,
+};
+
+struct command {
+    const char *name;
+    enum command_id id;
+};
+
+
+// Sorted by name, for find_command(). Parameters in param.c are commands
+// too: "speedkp" prints the gain and "speedkp 0.2" sets it.
+static CYCODE const struct command commands[] = {
+    {"agc", CMD_AGC},
+    {"brake", CMD_BRAKE},
+    {"bw", CMD_BW},
+    {"camstats", CMD_CAMSTATS},
+    {"coast", CMD_COAST},
+    {"display", CMD_DISPLAY},
+    {"fw", CMD_FW},
+    {"journal", CMD_JOURNAL},
+    {"lcd", CMD_LCD},
+    {"learn", CMD_LEARN},
+    {"params", CMD_PARAMS},
+    {"pid", CMD_PID},
+#ifdef PID_MEASURE_TIME
+    {"pidtime", CMD_PIDTIME},
+#endif
+    {"plan", CMD_PLAN},
+    {"power", CMD_POWER},
+    {"prof", CMD_PROF},
+    {"radio", CMD_RADIO},
+    {"rec", CMD_REC},
+    {"recstop", CMD_RECSTOP},
+    {"repeat", CMD_REPEAT},
+    {"replay", CMD_REPLAY},
+    {"scope", CMD_SCOPE},
+    {"serial", CMD_SERIAL},
+    {"speedtune", CMD_SPEEDTUNE},
+    {"steerpath", CMD_STEERPATH},
+    {"steerpid", CMD_STEERPID},
+    {"steerset", CMD_STEERSET},
+    {"steerstop", CMD_STEERSTOP},
+    {"steertune", CMD_STEERTUNE},
+    {"trace", CMD_TRACE},
+};
+
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+
+/*
+ * find_command:
+ * Returns the command with the given name, or CMD_UNKNOWN.
+ */
+static enum command_id find_command(const char *name) {
+    uint8 low = 0u, high = NUM_COMMANDS;
+    
+    while (low < high) {
+        uint8 mid = (low + high) / 2u;
+        int cmp = strcmp(name, commands[mid].name);
+        
+        if (cmp == 0)
+            return commands[mid].id;
+        if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1u;
+    }
+    return CMD_UNKNOWN;
+}
 
 /*
  * vshell_do_command()
@@ -23,6 +135,7 @@
  */
 void shell_do_command(const char* line) CYREENTRANT {
     char cmd[SHELL_MAX_COMMAND_LENGTH + 1];
+    char8 strbuf[128];
     uint8 i = 0u;
     
     // Ignore leading whitespace
@@ -41,14 +154,15 @@ void shell_do_command(const char* line) CYREENTRANT {
     while (isspace(*line))
         line++;
     
-    // Now we can execute the identified command
-    
     // Do nothing in case of empty command
-    if (strcmp(cmd, "") == 0) 
-        ;
+    if (cmd[0] == '\0')
+        return;
+    
+    // Now we can execute the identified command
+    switch (find_command(cmd)) {
     
     // Shell built-in commands
-    else if (strcmp(cmd, "repeat") == 0) {
+    case CMD_REPEAT: {
         char numloops[SHELL_MAX_COMMAND_LENGTH];
         i = 0u;
         
@@ -64,67 +178,120 @@ void shell_do_command(const char* line) CYREENTRANT {
         for (i = 0; i < atoi(numloops); i++) {
             shell_do_command(line);
         }
+        break;
     }
     
     // Other commands
-    else if (strcmp(cmd, "serial") ==0) {
+    case CMD_SERIAL:
         usb_uart_print_info();
-    }
-    else if (strcmp(cmd, "lcd") == 0) {
-        LCD_ClearDisplay();
+        break;
+    case CMD_LCD:
+        drive_set_display("off");
         LCD_PrintString(line);
-    }
-    else if (strcmp(cmd, "pid") == 0) {
+        break;
+    case CMD_DISPLAY:
+        drive_set_display(line);
+        break;
+    case CMD_PARAMS:
+        param_print();
+        break;
+    case CMD_RADIO:
+        radio_print();
+        break;
+    case CMD_AGC:
+        agc_print();
+        break;
+    case CMD_SCOPE:
+        scope_command(line);
+        break;
+    case CMD_JOURNAL:
+        journal_command(line);
+        break;
+    case CMD_PID:
         speed_pid_start(line);
-    }
-    else if (strcmp(cmd, "brake") == 0) {
+        break;
+    case CMD_BRAKE:
         speed_brake();
-    }
-    else if (strcmp(cmd, "coast") == 0) {
+        break;
+    case CMD_COAST:
         speed_coast();
-    }
-    else if (strcmp(cmd, "fw") == 0) {
+        break;
+    case CMD_FW:
         speed_forward();
-    }
-    else if (strcmp(cmd, "bw") == 0) {
+        break;
+    case CMD_BW:
         speed_backward();
-    }
-    else if (strcmp(cmd, "power") == 0) {
+        break;
+    case CMD_POWER:
         speed_set_power(line);
-    }
-    else if (strcmp(cmd, "speedkp") == 0) {
-        speed_set_kp(line);
-    }
-    else if (strcmp(cmd, "speedki") == 0) {
-        speed_set_ki(line);
-    }
-    else if (strcmp(cmd, "speedkd") == 0) {
-        speed_set_kd(line);
-    }
-    else if (strcmp(cmd, "steerpid") == 0) {
+        break;
+    case CMD_LEARN:
+        profile_learn(distance_traveled);
+        break;
+    case CMD_PLAN:
+        if (!profile_plan(distance_traveled))
+            usb_uart_putline("Can only plan after learning a lap!");
+        break;
+    case CMD_REC:
+        record_start();
+        break;
+    case CMD_REPLAY:
+        replay_start(*line != '\0' ? atof(line) : 1.0);
+        break;
+    case CMD_RECSTOP:
+        record_stop();
+        sprintf(strbuf, "%u bytes recorded", record_used());
+        usb_uart_putline(strbuf);
+        break;
+    case CMD_SPEEDTUNE:
+        speed_autotune_start(line);
+        break;
+#ifdef PID_MEASURE_TIME
+    case CMD_PIDTIME:
+        sprintf(strbuf, "Speed PID: %u us (max %u us)",
+                speed_pid.update_time, speed_pid.max_update_time);
+        usb_uart_putline(strbuf);
+        sprintf(strbuf, "Steering PID: %u us (max %u us)",
+                steer_pid.update_time, steer_pid.max_update_time);
+        usb_uart_putline(strbuf);
+        speed_pid.max_update_time = 0u;
+        steer_pid.max_update_time = 0u;
+        break;
+#endif
+    case CMD_STEERPID:
         steer_pid_start();
-    }
-    else if (strcmp(cmd, "steerstop") == 0) {
+        break;
+    case CMD_STEERPATH:
+        steer_path_start();
+        break;
+    case CMD_STEERSTOP:
         steer_stop();
-    }
-    else if (strcmp(cmd, "steerset") == 0) {
+        break;
+    case CMD_STEERSET:
         steer_set(line);
-    }
-    else if (strcmp(cmd, "steerkp") == 0) {
-        steer_set_kp(line);
-    }
-    else if (strcmp(cmd, "steerki") == 0) {
-        steer_set_ki(line);
-    }
-    else if (strcmp(cmd, "steerkd") == 0) {
-        steer_set_kd(line);
-    }
-    // If command was not any of the above...
-    else {
-        char8 strbuf[128];
-        
-        sprintf(strbuf, "Command \"%s\" not recognized", cmd);
-        usb_uart_putline(strbuf);
+        break;
+    case CMD_STEERTUNE:
+        steer_autotune_start(line);
+        break;
+    case CMD_CAMSTATS:
+        steer_print_line_info();
+        break;
+    case CMD_PROF:
+        timing_print();
+        timing_reset();
+        sched_print();
+        break;
+    case CMD_TRACE:
+        trace_dump();
+        break;
+    
+    // If command was not any of the above, it may be a parameter
+    default:
+        if (!param_command(cmd, line)) {
+            sprintf(strbuf, "Command \"%s\" not recognized", cmd);
+            usb_uart_putline(strbuf);
+        }
+        break;
     }
 }
 
@@ -137,6 +304,10 @@ void shell_handle_char(char c) {
     static char linebuf[SHELL_MAX_COMMAND_LENGTH + 1];
     static uint8 line_index = 0;
     
+    // Binary parameter frames from a host tool aren't typed
+    if (param_receive((uint8)c))
+        return;
+    
     if (c < 127 && c >= 32) { // If the user pressed a character 
         #ifdef SHELL_LCD_DEBUG
         // For debugging purposes, display the character to the LCD
@@ -201,9 +372,12 @@ void shell_handle_char(char c) {
  * shell_handle_recieved_chars()
  * For every character that has been received, calls handler with
  * that character. Does nothing if no data has been received since
- * the previous time this function was called.
+ * the previous time this function was called, or if USB UART
+ * hasn't been set up.
  */
 void shell_handle_received_chars(void) {
+    if (!USBUART_GetConfiguration())
+        return;
     while(USBUART_DataIsReady()) {  // Check for input data from PC
         uint8 i, count, buffer[128];
         
@@ -12,14 +12,25 @@
 #include <limits.h>
 
 #include "speed.h"
+#include "clock.h"
+#include "odometry.h"
 #include "steer.h"
-#include "drive.h"
+#include "sched.h"
 #include "usb_uart.h"
+#include "record.h"
+#include "pid.h"
+#include "autotune.h"
+#include "timing.h"
+#include "fmt.h"
+#include "scope.h"
+#include "journal.h"
 
-#define DISTANCE_PER_TICK 0.1285  // in feet
 #define DERIV_CONTROL_AVERAGING 3
-#define TIMER_COUNTS_PER_SECOND 1000000.0  // timers are fed by 1 MHz clock
 #define PID_INTERVALS_PER_SECOND 100.0  // PID control is reevaluated every 10 ms
+#define BASE_POWER 0.15  // normalized control output always added
+#define MAX_POWER_STEP 0.05  // most the control output may change every 10 ms
+#define TUNE_AMPLITUDE 0.05  // normalized control output above and below bias
+#define TUNE_HYSTERESIS 0.1  // in feet per second
 
 enum state {
     COAST = 0u,
@@ -28,11 +39,6 @@ enum state {
     BRAKE = 3u,
 };
 
-// Because the speed sensor is on the right side of the car, it underestimates
-// speed during right turns and overestimates during left turns. This is for a
-// compensating correction term.
-#define SPEED_ADJUSTMENT_COEFFICIENT (-0.12)
-
 
 static CY_ISR_PROTO(hall_handler) ;
 static CY_ISR_PROTO(speed_pid_handler) ;
@@ -43,13 +49,20 @@ static enum state current_state;
 float speed = 0.0;
 float distance_traveled = 0.0;
 float power_output = 0.0;
+float speed_setpoint = 0.0;  // in feet per second
+struct pid speed_pid;
 
-static uint16 count_since_magnet = 0u;
+static struct clock_sync hall_sync;
+static struct autotune speed_tune;
 static uint8 speed_pid_enabled = 0u;  // Boolean value indicating whether or not to do PID speed control.
-static float speed_setpoint = 0.0;  // in feet per second
-static float kp = 0.1;  // in normalized control output adjustment per (feet per second) error.
-static float ki = 0.2;  // in normalized control output adjustment per (feet per second) error per second.
-static float kd = 0.0;  // in normalized control output adjustment per (change in feet per second per second).
+static float speed_feedforward = 0.0;  // normalized control output
+
+// Initial gains, in normalized control output adjustment per (feet per second)
+// error, per (feet per second) error per second, and per (change in feet per
+// second per second).
+#define INITIAL_KP 0.1
+#define INITIAL_KI 0.2
+#define INITIAL_KD 0.0
 
 
 static void set_state(enum state desired) {
@@ -62,18 +75,22 @@ static void set_state(enum state desired) {
 /*
  * speed_init:
  * Initializes timers, pwm, etc. for controlling speed. Initializes
- * to coasting state.
+ * to coasting state. Must be called after clock_init(), which starts
+ * Speed_PID_Timer.
  */
 void speed_init(void) {
     uint8 status = CyEnterCriticalSection();
     
     speed_coast();
+    
+    pid_init(&speed_pid, INITIAL_KP, INITIAL_KI, INITIAL_KD,
+             1.0 / PID_INTERVALS_PER_SECOND, 0.0, 1.0, MAX_POWER_STEP,
+             DERIV_CONTROL_AVERAGING);
 
     Hall_Timer_Start();
     Hall_IRQ_Start();
     Hall_IRQ_SetVector(hall_handler);
 
-    Speed_PID_Timer_Start();
     Speed_PID_IRQ_Start();
     Speed_PID_IRQ_SetVector(speed_pid_handler);
     
@@ -87,23 +104,25 @@ void speed_init(void) {
  * Print current speed and normalized controller output to the LCD.
  */
 void speed_display_info(void) {
-    char strbuf[17];
+    char strbuf[8 + FMT_MAX_LEN + 1];
+    float current_speed, output;
+    uint8 enabled;
     
     uint8 status = CyEnterCriticalSection();
+    current_speed = speed;
+    output = power_output;
+    enabled = speed_pid_enabled;
+    CyExitCriticalSection(status);
     
     // Print out info
-    sprintf(strbuf, "Speed:  %.6f", speed);
+    fmt_float(fmt_string(strbuf, "Speed:  "), current_speed, 3u);
     LCD_Position(0,0);
     LCD_PrintString(strbuf);
-    if (speed_pid_enabled) {
-        sprintf(strbuf, "Control:%.6f", power_output);
+    if (enabled) {
+        fmt_float(fmt_string(strbuf, "Control:"), output, 4u);
         LCD_Position(1,0);
         LCD_PrintString(strbuf);
     }
-    
-    CyExitCriticalSection(status);
-    
-    CyDelay(50u);
 }
 
 /*
@@ -116,11 +135,45 @@ void speed_pid_start(const char* desired_speed) {
     
     if (*desired_speed != '\0')
         speed_setpoint = atof(desired_speed);
+    
+    // Pick up from whatever power was being output manually
+    if (!speed_pid_enabled)
+        pid_bumpless(&speed_pid, PID_FROM_FLOAT(power_output));
     speed_pid_enabled = 1;
 
     CyExitCriticalSection(status);
 }
 
+/*
+ * speed_autotune_start:
+ * Tunes the PID gains with a relay experiment around the current speed
+ * setpoint, switching the power by the given amplitude (or TUNE_AMPLITUDE).
+ * PID speed control must already be holding the setpoint.
+ */
+void speed_autotune_start(const char *amplitude) {
+    uint8 status = CyEnterCriticalSection();
+    
+    if (!speed_pid_enabled) {
+        usb_uart_putline("Start PID speed control before tuning!");
+    }
+    else {
+        autotune_start(&speed_tune, &speed_pid, AUTOTUNE_PI, power_output,
+                       *amplitude != '\0' ? atof(amplitude) : TUNE_AMPLITUDE,
+                       TUNE_HYSTERESIS);
+    }
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * speed_autotune_report:
+ * Run periodically by sched.c. Prints the tuned gains once tuning
+ * finishes.
+ */
+void speed_autotune_report(void) {
+    autotune_report(&speed_tune, "Speed");
+}
+
 /*
  * speed_set:
  * Sets the speed_setpoint.
@@ -133,6 +186,18 @@ void speed_set(float desired) {
     CyExitCriticalSection(status);
 }
 
+/*
+ * speed_set_feedforward:
+ * Sets a normalized drive power added to the PID controller's output.
+ */
+void speed_set_feedforward(float feedforward) {
+    uint8 status = CyEnterCriticalSection();
+    
+    speed_feedforward = feedforward;
+    
+    CyExitCriticalSection(status);
+}
+
 /*
  * speed_coast:
  * Disables PID speed control, and sets main drive motor PWM compare value
@@ -142,6 +207,7 @@ void speed_coast(void) {
     uint8 status = CyEnterCriticalSection();
     
     speed_pid_enabled = 0;
+    autotune_stop(&speed_tune);
     Drive_PWM_WriteCompare(0);
     set_state(COAST);
     
@@ -157,6 +223,7 @@ void speed_brake(void) {
     uint8 status = CyEnterCriticalSection();
     
     speed_pid_enabled = 0;
+    autotune_stop(&speed_tune);
     Drive_PWM_WriteCompare(0);
     if (current_state == FORWARD || current_state == BACKWARD) {
         set_state(COAST);
@@ -225,26 +292,6 @@ void speed_set_power(const char *valstr) {
     CyExitCriticalSection(status);
 }
 
-/*
- * speed_set_k*:
- * Set PID control constants.
- */
-void speed_set_kp(const char *val) {
-    uint8 status = CyEnterCriticalSection();
-    kp = atof(val);
-    CyExitCriticalSection(status);
-}
-void speed_set_ki(const char *val) {
-    uint8 status = CyEnterCriticalSection();
-    ki = atof(val);
-    CyExitCriticalSection(status);
-}
-void speed_set_kd(const char *val) {
-    uint8 status = CyEnterCriticalSection();
-    kd = atof(val);
-    CyExitCriticalSection(status);
-}
-
 
 /*
  * hall_handler:
@@ -252,29 +299,22 @@ void speed_set_kd(const char *val) {
  * Recalculates the current speed estimate.
  */
 static CY_ISR(hall_handler) {
-    static uint32 prev;
+    uint32 start = timing_start(TIMING_HALL);
     uint32 val = Hall_Timer_ReadCapture();
-    uint32 diff = prev - val;
-    float time;
     uint8 status;
     
-    prev = val;
-    
-    time = (float)diff / TIMER_COUNTS_PER_SECOND;
-    speed = DISTANCE_PER_TICK / time;  // in units of feet/second
-    speed /= 1.0 + steer_output * SPEED_ADJUSTMENT_COEFFICIENT;
-    
-    count_since_magnet = 0;
-    
-    distance_traveled += DISTANCE_PER_TICK /
-            (1.0 + steer_output * SPEED_ADJUSTMENT_COEFFICIENT);
+    distance_traveled += odometry_tick_distance(steer_output);
+    odometry_record_tick(clock_from_capture(&hall_sync, val), steer_output);
+    speed = odometry_speed();  // in feet/second
             
     status = CyEnterCriticalSection();
-    magnet_callback();
+    record_tick();
     CyExitCriticalSection(status);
+    sched_post(SCHED_DRIVE);
     
     // Clear interrupt
     Hall_Timer_ReadStatusRegister();
+    timing_end(TIMING_HALL, start);
 }
 
 /*
@@ -282,64 +322,40 @@ static CY_ISR(hall_handler) {
  * Should run once every 10 ms interval. Does speed control.
  */
 static CY_ISR(speed_pid_handler) {
+    uint32 start = timing_start(TIMING_SPEED_PID);
     uint8 saved_interrupt_status;
     
-    // If a magnet is not seen for a long time, decrease the speed estimate
-    if (count_since_magnet > 0) {
-        float time_since_magnet = count_since_magnet / PID_INTERVALS_PER_SECOND;
-        float speed_estimate = DISTANCE_PER_TICK / time_since_magnet;
-        speed_estimate /= 1.0 + steer_output * SPEED_ADJUSTMENT_COEFFICIENT;
-        if (speed_estimate < speed)
-            speed = speed_estimate;
-    }
-    count_since_magnet++;
+    clock_period_elapsed();
+    
+    // If a magnet is not seen for a long time, this decreases the speed
+    speed = odometry_speed();
     
     saved_interrupt_status = CyEnterCriticalSection();
     if (speed_pid_enabled && 
             (current_state == FORWARD || current_state == BACKWARD))
         speed_pid_control();
     CyExitCriticalSection(saved_interrupt_status);
+    scope_sample();
+    journal_sample();
+    timing_end(TIMING_SPEED_PID, start);
 }
 
+/*
+ * speed_pid_control:
+ * Runs one step of the speed controller and outputs the result.
+ */
 static void speed_pid_control(void) {
-    float error, deriv, next_riemann_sum,
-          prop_control, integ_control, deriv_control;
-    static float riemann_sum = 0.0;
-    static float prev_errors[DERIV_CONTROL_AVERAGING];
-    static uint8 prev_errors_index = 0;
-    float change;
+    pid_value output;
     uint16 pwm_cmp;
     uint8 status;
-
-    // Begin control calculations
-    error = speed_setpoint - speed;
     
-    // Proportional control
-    prop_control = kp * error;
-    
-    // Integral control
-    next_riemann_sum = riemann_sum + error / PID_INTERVALS_PER_SECOND; 
-    integ_control = ki * next_riemann_sum;
-    
-    // Derivative control
-    change = error - prev_errors[prev_errors_index];
-    deriv = change * PID_INTERVALS_PER_SECOND / (float)DERIV_CONTROL_AVERAGING;
-    prev_errors[prev_errors_index] = error;
-    prev_errors_index = (prev_errors_index + 1) % DERIV_CONTROL_AVERAGING;
-    deriv_control = kd * deriv;
-    
-    // Add it all together, with limiting to valid duty cycle values
-    power_output = 0.15 + prop_control + integ_control + deriv_control;
-    if (power_output < 0.0) {
-        power_output = 0.0;
-    }
-    else if (power_output > 1.0) {
-        power_output = 1.0;
-    }
-    else {
-        // Anti-windup: only allow integrator to build up if not saturating
-        riemann_sum = next_riemann_sum;  
-    }
+    if (autotune_running(&speed_tune))
+        output = autotune_update(&speed_tune, speed_setpoint, speed);
+    else
+        output = pid_update(&speed_pid, PID_FROM_FLOAT(speed_setpoint),
+                            PID_FROM_FLOAT(speed),
+                            PID_FROM_FLOAT(BASE_POWER + speed_feedforward));
+    power_output = PID_TO_FLOAT(output);
     
     // Scale control value to a PWM compare value
     pwm_cmp = (uint16)(USHRT_MAX * power_output);
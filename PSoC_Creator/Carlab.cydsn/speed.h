@@ -9,16 +9,20 @@
 #ifndef SPEED_H
 #define SPEED_H
 
+#include "pid.h"
+
 
 extern float speed;
 extern float distance_traveled;
 extern float power_output;
+extern float speed_setpoint;  // in feet per second
+extern struct pid speed_pid;
 
 
 /*
  * speed_init:
  * Initializes timers, interrupts, pwm, etc. for speed control. Initializes
- * to coasting state.
+ * to coasting state. Must be called after clock_init().
  */
 void speed_init(void) ;
 
@@ -35,12 +39,33 @@ void speed_display_info(void) ;
  */
 void speed_pid_start(const char* desired_speed) ;
 
+/*
+ * speed_autotune_start:
+ * Tunes the PID gains with a relay experiment around the current speed
+ * setpoint, switching the power by the given amplitude (or a default).
+ * PID speed control must already be holding the setpoint.
+ */
+void speed_autotune_start(const char *amplitude) ;
+
+/*
+ * speed_autotune_report:
+ * Run periodically by sched.c. Prints the tuned gains once tuning
+ * finishes.
+ */
+void speed_autotune_report(void) ;
+
 /*
  * speed_set:
  * Sets the speed_setpoint.
  */
 void speed_set(float speed_setpoint) ;
 
+/*
+ * speed_set_feedforward:
+ * Sets a normalized drive power added to the PID controller's output.
+ */
+void speed_set_feedforward(float feedforward) ;
+
 /*
  * speed_brake:
  * Disables PID speed control, and sets main drive motor PWM compare value
@@ -73,14 +98,6 @@ void speed_backward(void) ;
  */
 void speed_set_power(const char *cmpstr) ;
 
-/*
- * speed_set_k*:
- * Set PID control constants.
- */
-void speed_set_kp(const char *val) ;
-void speed_set_ki(const char *val) ;
-void speed_set_kd(const char *val) ;
-
 
 #endif
 
@@ -2,26 +2,38 @@
  * steer.c
  * Monica Lu and Victor Ying
  *
- * Line detection and steering control.
+ * Steering control, following the line found by line.c or the path.
  * ========================================
  */
 
 #include <project.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "steer.h"
 #include "usb_uart.h"
+#include "path.h"
+#include "position.h"
+#include "pid.h"
+#include "autotune.h"
+#include "line.h"
+#include "speed.h"
+#include "timing.h"
+#include "fmt.h"
 
 
-#define FASTEST_CLK_FREQ 48000000.0  // 48 MHz
-#define EXPECTED_ROW_LEN (0.000045 * FASTEST_CLK_FREQ)  // in clock cycles
-#define ACCEPTABLE_ROW_MARGIN 0.2
-#define MIN_ACCEPTABLE_ROW_LEN ((uint16)(EXPECTED_ROW_LEN * (1.0 - ACCEPTABLE_ROW_MARGIN)))
-#define MAX_ACCEPTABLE_ROW_LEN ((uint16)(EXPECTED_ROW_LEN * (1.0 + ACCEPTABLE_ROW_MARGIN)))
 #define PID_INTERVALS_PER_SECOND 60.0 // Camera is 30 fps interlaced
 #define DERIV_CONTROL_AVERAGING 4
 #define STEERING_CENTER 1500 // 1.5 ms pulse = steer straight ahead
+#define STEER_PATH_LOOKAHEAD 3.0  // in feet
+#define LOOKAHEAD_GAIN 1.0  // fraction of the line's curvature steered for ahead of time
+#define LINE_PREDICT_DISTANCE 3.0  // feet driven on a predicted line before giving up
+#define TUNE_AMPLITUDE 0.3  // steering output either side of bias
+#define TUNE_HYSTERESIS 0.02  // in row widths
+#define INITIAL_KP 0.75
+#define INITIAL_KI 0.0
+#define INITIAL_KD 0.03
 
 
 static CY_ISR_PROTO(camera_handler) ;
@@ -29,12 +41,19 @@ static void steer_pid_control(void) ;
 
 
 float steer_output = 0.0;
+struct pid steer_pid;
 
+static struct line_estimate line;  // where the line was seen, or should be by now
+static enum steer_line_state line_state = STEER_LINE_LOST;
+static float line_seen_distance = 0.0;  // distance_traveled when it was last seen
+static float field_distance = 0.0;  // distance_traveled at the last field
 static float measurement = 0.0;
+static float lookahead = 0.0;  // steering for the curvature of the line ahead
+static uint8 replaying = 0u;  // steering along a recorded run
+static float replay_output = 0.0, replay_measurement = 0.0;  // as recorded
+static struct autotune steer_tune;
 static uint8 steer_pid_enabled = 0; // Boolean value indicating whether or not to do PID steering control.
-static float kp = 0.75;
-static float ki = 0.0;
-static float kd = 0.03;
+static uint8 steer_path_enabled = 0; // Boolean value indicating whether or not to follow the path.
 
 
 /*
@@ -44,13 +63,17 @@ static float kd = 0.03;
 void steer_init(void) {
     steer_stop();
     
-    Camera_Comp_Start();
-    Camera_Counter_Start();
-    Camera_Timer_Start();
+    pid_init(&steer_pid, INITIAL_KP, INITIAL_KI, INITIAL_KD,
+             1.0 / PID_INTERVALS_PER_SECOND, -1.0, 1.0, 0.0,
+             DERIV_CONTROL_AVERAGING);
+    
+    line_init();
     Camera_IRQ_Start();
     Camera_IRQ_SetVector(camera_handler);
 
     Steering_PWM_Start();
+    
+    path_init();
 }
 
 /*
@@ -58,16 +81,24 @@ void steer_init(void) {
  * Print current measurements and normalized controller output to the LCD.
  */
 void steer_display_info(void) {
-    char strbuf[17];
+    char strbuf[7 + FMT_MAX_LEN + 1];
+    float meas, steer;
+    char *p;
+    uint8 status = CyEnterCriticalSection();
     
-    // Print out info
-    sprintf(strbuf, "Meas.: %f  ", measurement);
+    meas = measurement;
+    steer = steer_output;
+    CyExitCriticalSection(status);
+    
+    // Print out info, padded to overwrite what was there
+    p = fmt_float(fmt_string(strbuf, "Meas.: "), meas, 4u);
+    fmt_pad(strbuf, p, 16u);
     LCD_Position(0,0);
     LCD_PrintString(strbuf);
-    sprintf(strbuf, "Steer: %f ", steer_output);
+    p = fmt_float(fmt_string(strbuf, "Steer: "), steer, 4u);
+    fmt_pad(strbuf, p, 16u);
     LCD_Position(1,0);
     LCD_PrintString(strbuf);
-    CyDelay(50u);
 }
 
 /*
@@ -75,15 +106,113 @@ void steer_display_info(void) {
  * Enables PID steering control
  */
 void steer_pid_start(void) {
+    uint8 status = CyEnterCriticalSection();
+    
+    // Pick up from whatever steering was being output before
+    steer_path_enabled = 0u;
+    if (!steer_pid_enabled)
+        pid_bumpless(&steer_pid, PID_FROM_FLOAT(steer_output));
     steer_pid_enabled = 1u;
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * steer_autotune_start:
+ * Tunes the PID gains with a relay experiment around the line, switching the
+ * steering by the given amplitude (or TUNE_AMPLITUDE). PID steering control
+ * must already be following the line.
+ */
+void steer_autotune_start(const char *amplitude) {
+    uint8 status = CyEnterCriticalSection();
+    
+    if (!steer_pid_enabled) {
+        usb_uart_putline("Start PID steering control before tuning!");
+    }
+    else {
+        autotune_start(&steer_tune, &steer_pid, AUTOTUNE_PD, steer_output,
+                       *amplitude != '\0' ? atof(amplitude) : TUNE_AMPLITUDE,
+                       TUNE_HYSTERESIS);
+    }
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * steer_autotune_report:
+ * Run periodically by sched.c. Prints the tuned gains once tuning
+ * finishes.
+ */
+void steer_autotune_report(void) {
+    autotune_report(&steer_tune, "Steering");
+}
+
+/*
+ * steer_path_start:
+ * Switches from following the line to following the path in path.c, using
+ * the position estimate.
+ */
+void steer_path_start(void) {
+    steer_pid_enabled = 0u;
+    autotune_stop(&steer_tune);
+    path_reset();
+    steer_path_enabled = 1u;
+}
+
+/*
+ * steer_path_poll:
+ * Run by sched.c every STEER_PATH_INTERVAL microseconds. When following the
+ * path, updates the steering using pure pursuit: steer along the arc that
+ * passes through the point on the path STEER_PATH_LOOKAHEAD feet ahead of
+ * the nearest one.
+ */
+void steer_path_poll(void) {
+    struct position_estimate est;
+    float target_x, target_y, dx, dy, ahead, left, curvature;
+    uint16 pwm_cmp;
+    uint8 status;
+    
+    if (!steer_path_enabled)
+        return;
+    
+    // Hold the current steering until we know which way we're facing
+    position_now(&est);
+    if (!est.propagated)
+        return;
+    
+    path_point(path_track(est.x, est.y) + STEER_PATH_LOOKAHEAD,
+               &target_x, &target_y);
+    
+    // Where the target is relative to the car
+    dx = target_x - est.x;
+    dy = target_y - est.y;
+    ahead = dx*cos(est.heading) + dy*sin(est.heading);
+    left = dy*cos(est.heading) - dx*sin(est.heading);
+    
+    // Curvature of the arc tangent to our heading through the target
+    curvature = 2*left / (ahead*ahead + left*left);
+    
+    status = CyEnterCriticalSection();
+    if (steer_path_enabled) {
+        steer_output = -curvature / STEER_MAX_CURVATURE;
+        if (steer_output > 1.0)
+            steer_output = 1.0;
+        else if (steer_output < -1.0)
+            steer_output = -1.0;
+        pwm_cmp = (int16)(500.0 * steer_output) + STEERING_CENTER;
+        Steering_PWM_WriteCompare(pwm_cmp);
+    }
+    CyExitCriticalSection(status);
 }
 
 /*
  * steer_stop:
- * Disables PID steering control.
+ * Disables PID steering control and path following.
  */
 void steer_stop(void) {
     steer_pid_enabled = 0u;
+    autotune_stop(&steer_tune);
+    steer_path_enabled = 0u;
 }
 
 /*
@@ -93,7 +222,7 @@ void steer_stop(void) {
 void steer_set(const char *valstr) {
     uint8 status = CyEnterCriticalSection();
     
-    if (steer_pid_enabled) {
+    if (steer_pid_enabled || steer_path_enabled) {
         usb_uart_putline(
             "Cannot manually set steering while PID control is running!");
     }
@@ -112,47 +241,130 @@ void steer_set(const char *valstr) {
 }
 
 /*
- * steer_set_k*:
- * Set PID control constants.
+ * steer_measurement:
+ * Returns where the line was last seen, from -1.0 to 1.0 across the nearest
+ * row.
  */
-void steer_set_kp(const char *val) {
-    kp = atof(val);
+float steer_measurement(void) {
+    return measurement;
+}
+
+/*
+ * steer_line_state:
+ * Returns whether the line is being followed, predicted or has been lost.
+ */
+enum steer_line_state steer_line_state(void) {
+    return line_state;
+}
+
+/*
+ * steer_print_line_info:
+ * Prints the line following state and camera statistics over USB UART.
+ */
+void steer_print_line_info(void) {
+    static CYCODE const char *const names[] = {
+        "following", "hidden by a crossing line", "missing", "lost"
+    };
+    char strbuf[64];
+    
+    sprintf(strbuf, "Line: %s, %.2f ft since seen", names[line_state],
+            distance_traveled - line_seen_distance);
+    usb_uart_putline(strbuf);
+    line_print_stats();
+}
+
+/*
+ * steer_replay:
+ * Steers with output, as recorded when the line was seen at measurement.
+ * The recorded output already includes the PID controller's and the
+ * lookahead's steering, so neither is added again: the controller acts on
+ * the difference from the recorded measurement instead.
+ */
+void steer_replay(float output, float measurement) {
+    uint8 status = CyEnterCriticalSection();
+    
+    // The difference starts from zero, so don't kick the derivative
+    if (!replaying)
+        pid_bumpless(&steer_pid, PID_FROM_FLOAT(steer_output));
+    replay_output = output;
+    replay_measurement = measurement;
+    replaying = 1u;
+    
+    CyExitCriticalSection(status);
 }
-void steer_set_ki(const char *val) {
-    ki = atof(val);
+
+/*
+ * steer_replay_stop:
+ * Goes back to steering for the line alone.
+ */
+void steer_replay_stop(void) {
+    uint8 status = CyEnterCriticalSection();
+    
+    if (replaying)
+        pid_bumpless(&steer_pid, PID_FROM_FLOAT(steer_output));
+    replaying = 0u;
+    
+    CyExitCriticalSection(status);
 }
-void steer_set_kd(const char *val) {
-    kd = atof(val);
+
+/*
+ * steer_curvature:
+ * Returns the curvature of the path driven with the given steering output,
+ * in units of 1/feet, positive for counterclockwise (left) turns.
+ */
+float steer_curvature(float steer) CYREENTRANT {
+    return -steer * STEER_MAX_CURVATURE;
 }
 
 static CY_ISR(camera_handler) {
-    uint16 row_start_time = Camera_Timer_ReadCapture();
-    uint16 black_start_time = Camera_Timer_ReadCapture();
-    uint16 black_end_time = Camera_Timer_ReadCapture();
-    uint16 row_end_time = Camera_Timer_ReadCapture();
-    uint16 black_mid_time, row_mid_time;
+    uint32 start = timing_start(TIMING_CAMERA);
+    struct line_estimate fit;
+    enum line_result result;
+    float moved;
     uint8 saved_interrupt_status;
     
-    // Only update our measurement of where the black strip is if the row looks
-    // like a full row containing a single black strip. (This effectively tosses
-    // out data at intersections.)
-    uint16 row_length = row_start_time - row_end_time;
-    if (row_length >= MIN_ACCEPTABLE_ROW_LEN &&
-            row_length <= MAX_ACCEPTABLE_ROW_LEN) {
-        black_mid_time = black_end_time + (black_start_time - black_end_time)/2u;
-        row_mid_time = row_end_time + row_length/2u;
-    
-        measurement = (float)(int16)(black_mid_time - row_mid_time) * 2 / (float)row_length;
+    // Steer once per field
+    if (line_capture()) {
+        moved = distance_traveled - field_distance;
+        field_distance = distance_traveled;
+        
+        result = line_fit(&fit);
+        if (result == LINE_FOUND) {
+            line = fit;
+            line_seen_distance = distance_traveled;
+            
+            // Don't kick the steering with what happened while it was held
+            if (line_state == STEER_LINE_LOST)
+                pid_bumpless(&steer_pid, PID_FROM_FLOAT(steer_output));
+            line_state = STEER_LINE_FOLLOWING;
+        }
+        else if (distance_traveled - line_seen_distance < LINE_PREDICT_DISTANCE) {
+            // Keep steering for where the line should be by now, given how
+            // we've been steering since the last field
+            line_predict(&line, moved, steer_curvature(steer_output));
+            if (result == LINE_CROSSING || line_state == STEER_LINE_CROSSING)
+                line_state = STEER_LINE_CROSSING;
+            else
+                line_state = STEER_LINE_MISSING;
+        }
+        else {
+            line_state = STEER_LINE_LOST;
+        }
+        measurement = line.offset;
+        lookahead = -LOOKAHEAD_GAIN * line.curvature / STEER_MAX_CURVATURE;
+        
+        // Do PID steering control, or hold the steering once the line is lost
+        saved_interrupt_status = CyEnterCriticalSection();
+        if (steer_pid_enabled && line_state != STEER_LINE_LOST)
+            steer_pid_control();
+        CyExitCriticalSection(saved_interrupt_status);
     }
     
-    // Do PID steering control
-    saved_interrupt_status = CyEnterCriticalSection();
-    if (steer_pid_enabled)
-        steer_pid_control();
-    CyExitCriticalSection(saved_interrupt_status);
-    
+#ifndef CAMERA_USE_DMA
     // Clear interrupt
     Camera_Timer_ReadStatusRegister();
+#endif
+    timing_end(TIMING_CAMERA, start);
 }
 
 /*
@@ -160,44 +372,20 @@ static CY_ISR(camera_handler) {
  * Should run once after every new video frame. Does steering control.
  */
 static void steer_pid_control(void) {
-    float error, deriv, next_riemann_sum,
-          prop_control, integ_control, deriv_control;
-    static float riemann_sum = 0.0;
-    static float prev_errors[DERIV_CONTROL_AVERAGING] = {0};
-    static uint8 prev_errors_index = 0;
-    float change;
+    pid_value output;
     uint16 pwm_cmp;
     uint8 status;
-
-    // Begin control calculations
-    error = - measurement;
-    
-    // Proportional control
-    prop_control = kp * error;
-    
-    // Integral control
-    next_riemann_sum = riemann_sum + error/PID_INTERVALS_PER_SECOND; 
-    integ_control = ki * next_riemann_sum;
     
-    // Derivative control
-    change = error - prev_errors[prev_errors_index];
-    deriv = change * PID_INTERVALS_PER_SECOND / (float)DERIV_CONTROL_AVERAGING;
-    prev_errors[prev_errors_index] = error;
-    prev_errors_index = (prev_errors_index + 1) % DERIV_CONTROL_AVERAGING;
-    deriv_control = kd * deriv;
-    
-    // Add it all together, with limiting to valid duty cycle values
-    steer_output = prop_control + integ_control + deriv_control;
-    if (steer_output < -1.0) {
-        steer_output = -1.0;
-    }
-    else if (steer_output > 1.0) {
-        steer_output = 1.0;
-    }
-    else {
-        // Anti-windup: only allow integrator to build up if not saturating
-        riemann_sum = next_riemann_sum;  
-    }
+    if (autotune_running(&steer_tune))
+        output = autotune_update(&steer_tune, 0.0, measurement);
+    else if (replaying)
+        output = pid_update(&steer_pid, 0,
+                            PID_FROM_FLOAT(measurement - replay_measurement),
+                            PID_FROM_FLOAT(replay_output));
+    else
+        output = pid_update(&steer_pid, 0, PID_FROM_FLOAT(measurement),
+                            PID_FROM_FLOAT(lookahead));
+    steer_output = PID_TO_FLOAT(output);
     
     // Scale control value to a PWM compare value
     pwm_cmp = (int16)(500.0 * steer_output) + STEERING_CENTER;
@@ -2,15 +2,33 @@
  * steer.h
  * Monica Lu and Victor Ying
  *
- * Line detection and steering control.
+ * Steering control, following the line found by line.c or the path.
  * ========================================
  */
 
 #ifndef STEER_H
 #define STEER_H
 
+#include "pid.h"
+
 
 extern float steer_output;  // Ranges from -1.0 to 1.0.
+extern struct pid steer_pid;
+
+
+enum steer_line_state {
+    STEER_LINE_FOLLOWING = 0u,  // seen in the last field
+    STEER_LINE_CROSSING = 1u,  // hidden by a crossing line; steering for where it should be
+    STEER_LINE_MISSING = 2u,  // not seen; steering for where it should be
+    STEER_LINE_LOST = 3u,  // not seen for too long; steering held
+};
+
+
+// Curvature of the path driven at full lock, in units of 1/feet. Positive
+// steer_output turns right.
+#define STEER_MAX_CURVATURE 0.33
+
+#define STEER_PATH_INTERVAL 20000u  // in microseconds; path following is at 50 Hz
 
     
 /*
@@ -31,9 +49,38 @@ void steer_display_info(void) ;
  */
 void steer_pid_start(void) ;
 
+/*
+ * steer_autotune_start:
+ * Tunes the PID gains with a relay experiment around the line, switching the
+ * steering by the given amplitude (or a default). PID steering control must
+ * already be following the line.
+ */
+void steer_autotune_start(const char *amplitude) ;
+
+/*
+ * steer_autotune_report:
+ * Run periodically by sched.c. Prints the tuned gains once tuning
+ * finishes.
+ */
+void steer_autotune_report(void) ;
+
+/*
+ * steer_path_start:
+ * Switches from following the line to following the path in path.c, using
+ * the position estimate.
+ */
+void steer_path_start(void) ;
+
+/*
+ * steer_path_poll:
+ * Run by sched.c every STEER_PATH_INTERVAL microseconds. When following the
+ * path, updates the steering.
+ */
+void steer_path_poll(void) ;
+
 /*
  * steer_stop:
- * Disables PID steering control.
+ * Disables PID steering control and path following.
  */
 void steer_stop(void) ;
 
@@ -44,12 +91,44 @@ void steer_stop(void) ;
 void steer_set(const char *valstr) ;
 
 /*
- * steer_set_steer_k*:
- * Set PID control constants.
+ * steer_measurement:
+ * Returns where the line was last seen, from -1.0 to 1.0 across the nearest
+ * row.
+ */
+float steer_measurement(void) ;
+
+/*
+ * steer_line_state:
+ * Returns whether the line is being followed, predicted or has been lost.
+ */
+enum steer_line_state steer_line_state(void) ;
+
+/*
+ * steer_print_line_info:
+ * Prints the line following state and camera statistics over USB UART.
+ */
+void steer_print_line_info(void) ;
+
+/*
+ * steer_replay:
+ * Steers with output, as recorded on an earlier run when the line was seen at
+ * measurement. The PID controller then only corrects for the line being seen
+ * somewhere else than in the recording.
+ */
+void steer_replay(float output, float measurement) ;
+
+/*
+ * steer_replay_stop:
+ * Goes back to steering for the line alone.
+ */
+void steer_replay_stop(void) ;
+
+/*
+ * steer_curvature:
+ * Returns the curvature of the path driven with the given steering output,
+ * in units of 1/feet, positive for counterclockwise (left) turns.
  */
-void steer_set_kp(const char *val) ;
-void steer_set_ki(const char *val) ;
-void steer_set_kd(const char *val) ;
+float steer_curvature(float steer) CYREENTRANT ;
 
 
 #endif
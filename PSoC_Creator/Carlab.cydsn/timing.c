@@ -0,0 +1,161 @@
+/* ========================================
+ * timing.c
+ * Monica Lu and Victor Ying
+ *
+ * Measures how long the interrupt handlers and the main loop's
+ * tasks take, and how often they interrupt each other.
+ *
+ * Times come from clock_now(), so they are in whole microseconds
+ * and include the few microseconds clock_now() itself takes. The
+ * slots running at any moment are kept on a stack: starting a slot
+ * while another is on top means it interrupted that one.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "timing.h"
+#include "clock.h"
+#include "usb_uart.h"
+
+
+#ifdef TIMING_ENABLE
+
+static CYCODE const char *const names[TIMING_SLOTS] = {
+    "hall", "speed_pid", "camera", "positioning",
+    "task: gate", "task: drive", "task: path", "task: fix", "task: shell",
+    "task: reports", "task: display", "task: scope", "task: radio",
+    "task: journal",
+};
+
+static struct timing_stats stats[TIMING_SLOTS];
+static uint8 running[TIMING_MAX_DEPTH];  // slots started and not yet ended
+static uint8 depth = 0u;
+
+
+/*
+ * timing_start:
+ * Marks the start of the given slot, and returns the time to pass to
+ * timing_end(). Safe to call from interrupt handlers.
+ */
+uint32 timing_start(enum timing_slot slot) CYREENTRANT {
+    uint8 status = CyEnterCriticalSection();
+
+    if (depth > 0u && depth <= TIMING_MAX_DEPTH && slot < TIMING_INTERRUPTS &&
+            stats[running[depth - 1u]].preempted_by[slot] < 0xFFFFu)
+        stats[running[depth - 1u]].preempted_by[slot]++;
+    if (depth < TIMING_MAX_DEPTH)
+        running[depth] = slot;
+    depth++;
+
+    CyExitCriticalSection(status);
+    return clock_now();
+}
+
+/*
+ * timing_end:
+ * Marks the end of the given slot, started at the given time.
+ */
+void timing_end(enum timing_slot slot, uint32 start) CYREENTRANT {
+    uint32 elapsed = clock_now() - start;
+    uint16 time = elapsed > 0xFFFFu ? 0xFFFFu : (uint16)elapsed;
+    struct timing_stats *s = &stats[slot];
+    uint8 bucket = 0u;
+    uint8 status;
+
+    // Bucket k holds times from 2^(k-1) up to 2^k - 1 microseconds
+    while (bucket < TIMING_BUCKETS - 1u && (time >> bucket) != 0u)
+        bucket++;
+
+    status = CyEnterCriticalSection();
+    if (depth > 0u)
+        depth--;
+    if (s->count == 0u || time < s->min)
+        s->min = time;
+    if (time > s->max)
+        s->max = time;
+    s->count++;
+    s->total += elapsed;
+    if (s->histogram[bucket] < 0xFFFFu)
+        s->histogram[bucket]++;
+    CyExitCriticalSection(status);
+}
+
+/*
+ * timing_get_stats:
+ * Copies the statistics for the given slot into *copy.
+ */
+void timing_get_stats(enum timing_slot slot, struct timing_stats *copy) {
+    uint8 status = CyEnterCriticalSection();
+    *copy = stats[slot];
+    CyExitCriticalSection(status);
+}
+
+/*
+ * timing_print:
+ * Prints the statistics for every slot timed so far over USB UART: a line
+ * of min/mean/max, then the nonempty histogram buckets as upper bound:count,
+ * then who interrupted it.
+ */
+void timing_print(void) {
+    struct timing_stats s;
+    char strbuf[96];
+    uint8 slot, i, n;
+
+    for (slot = 0u; slot < TIMING_SLOTS; slot++) {
+        timing_get_stats(slot, &s);
+        if (s.count == 0u)
+            continue;
+
+        sprintf(strbuf, "%s: %lu calls, %u/%lu/%u us min/mean/max",
+                names[slot], (unsigned long)s.count, s.min,
+                (unsigned long)(s.total / s.count), s.max);
+        usb_uart_putline(strbuf);
+
+        n = sprintf(strbuf, "  us <");
+        for (i = 0u; i < TIMING_BUCKETS; i++) {
+            if (s.histogram[i] == 0u)
+                continue;
+            if (n > sizeof(strbuf) - 16u) {
+                usb_uart_putline(strbuf);
+                n = sprintf(strbuf, "      ");
+            }
+            if (i == TIMING_BUCKETS - 1u)
+                n += sprintf(strbuf + n, " more:%u", s.histogram[i]);
+            else
+                n += sprintf(strbuf + n, " %u:%u", 1u << i, s.histogram[i]);
+        }
+        usb_uart_putline(strbuf);
+
+        n = 0u;
+        for (i = 0u; i < TIMING_INTERRUPTS; i++) {
+            if (s.preempted_by[i] == 0u)
+                continue;
+            if (n == 0u)
+                n = sprintf(strbuf, "  interrupted by");
+            else if (n > sizeof(strbuf) - 24u) {
+                usb_uart_putline(strbuf);
+                n = sprintf(strbuf, "   ");
+            }
+            n += sprintf(strbuf + n, " %s %u", names[i], s.preempted_by[i]);
+        }
+        if (n > 0u)
+            usb_uart_putline(strbuf);
+    }
+}
+
+/*
+ * timing_reset:
+ * Clears the statistics. Anything running carries on being timed.
+ */
+void timing_reset(void) {
+    uint8 status = CyEnterCriticalSection();
+    memset(stats, 0, sizeof(stats));
+    CyExitCriticalSection(status);
+}
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,103 @@
+/* ========================================
+ * timing.h
+ * Monica Lu and Victor Ying
+ *
+ * Measures how long the interrupt handlers and the main loop's
+ * tasks take, and how often they interrupt each other, using
+ * the clock.c time base. Kept as call counts, min/mean/max and a
+ * histogram with a bucket per power of two microseconds.
+ * ========================================
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <project.h>
+
+
+#define TIMING_ENABLE  // Comment this out to stop timing handlers and the main loop
+
+#define TIMING_BUCKETS 16u  // the last holds everything from 2^14 us up
+#define TIMING_MAX_DEPTH 6u  // main loop plus every interrupt priority
+
+
+// What can be timed. Anything timed while another is running counts as
+// preempting it, and its time is included in the other's.
+enum timing_slot {
+    TIMING_HALL = 0u,
+    TIMING_SPEED_PID = 1u,
+    TIMING_CAMERA = 2u,
+    TIMING_POSITIONING = 3u,
+    TIMING_TASK_GATE = 4u,  // sched.c tasks, in the order of enum sched_task
+    TIMING_TASK_DRIVE = 5u,
+    TIMING_TASK_PATH = 6u,
+    TIMING_TASK_FIX = 7u,
+    TIMING_TASK_SHELL = 8u,
+    TIMING_TASK_REPORT = 9u,
+    TIMING_TASK_DISPLAY = 10u,
+    TIMING_TASK_SCOPE = 11u,
+    TIMING_TASK_RADIO = 12u,
+    TIMING_TASK_JOURNAL = 13u,
+    TIMING_SLOTS = 14u,
+};
+
+// The slots before the tasks are interrupt handlers. Tasks run one at a time
+// from the main loop, so only handlers ever preempt anything.
+#define TIMING_INTERRUPTS TIMING_TASK_GATE
+
+struct timing_stats {
+    uint32 count;
+    uint32 total;  // in microseconds, for the mean
+    uint16 min, max;  // in microseconds, saturating
+    uint16 histogram[TIMING_BUCKETS];  // bucket k counts times of k bits
+    uint16 preempted_by[TIMING_INTERRUPTS];  // times each handler cut in
+};
+
+
+#ifdef TIMING_ENABLE
+
+/*
+ * timing_start:
+ * Marks the start of the given slot, and returns the time to pass to
+ * timing_end(). Safe to call from interrupt handlers.
+ */
+uint32 timing_start(enum timing_slot slot) CYREENTRANT ;
+
+/*
+ * timing_end:
+ * Marks the end of the given slot, started at the given time.
+ */
+void timing_end(enum timing_slot slot, uint32 start) CYREENTRANT ;
+
+/*
+ * timing_get_stats:
+ * Copies the statistics for the given slot into *copy.
+ */
+void timing_get_stats(enum timing_slot slot, struct timing_stats *copy) ;
+
+/*
+ * timing_print:
+ * Prints the statistics for every slot timed so far over USB UART.
+ */
+void timing_print(void) ;
+
+/*
+ * timing_reset:
+ * Clears the statistics.
+ */
+void timing_reset(void) ;
+
+#else
+
+// Without timing, the statistics take no RAM and prof prints nothing
+#define timing_start(slot) 0u
+#define timing_end(slot, start)
+#define timing_print()
+#define timing_reset()
+
+#endif
+
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,109 @@
+/* ========================================
+ * trace.c
+ * Monica Lu and Victor Ying
+ *
+ * A ring of small binary event records, cheap enough to write
+ * from interrupt handlers. Recording an event copies a few bytes
+ * and reads the clock; all the formatting is left to trace_dump()
+ * in the main loop, and the decoding to the host.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+
+#include "trace.h"
+#include "clock.h"
+#include "usb_uart.h"
+
+
+#ifdef TRACE_ENABLE
+
+static struct trace_event ring[TRACE_LEN];
+static uint16 recorded = 0u;  // events ever recorded, modulo 2^16
+static uint16 dumped = 0u;  // value of recorded at the end of the last dump
+
+
+/*
+ * trace_record:
+ * Adds an event to the ring, overwriting the oldest if it is full. Safe to
+ * call from interrupt handlers.
+ */
+void trace_record(uint8 type, uint8 arg, float a, float b, float c) CYREENTRANT {
+    struct trace_event *event;
+    uint8 status = CyEnterCriticalSection();
+    
+    event = &ring[recorded % TRACE_LEN];
+    recorded++;
+    event->time = clock_now();
+    event->type = type;
+    event->arg = arg;
+    event->value[0] = a;
+    event->value[1] = b;
+    event->value[2] = c;
+    
+    CyExitCriticalSection(status);
+}
+
+/*
+ * bits:
+ * Returns the IEEE 754 bit pattern of a float, which is the same whichever
+ * order its bytes are in memory (the 8051 compiler stores them big endian).
+ */
+static uint32 bits(float f) {
+    union {
+        float f;
+        uint32 u;
+    } pun;
+    
+    pun.f = f;
+    return pun.u;
+}
+
+/*
+ * trace_dump:
+ * Prints the events in the ring over USB UART, oldest first, then empties
+ * the ring. Events recorded while dumping are kept for next time, unless
+ * they overwrite ones not dumped yet.
+ */
+void trace_dump(void) {
+    struct trace_event event;
+    struct clock_stamp now;
+    char strbuf[64];
+    uint16 seq, end;
+    uint8 status;
+    
+    status = CyEnterCriticalSection();
+    end = recorded;
+    seq = (uint16)(end - dumped) > TRACE_LEN ? end - TRACE_LEN : dumped;
+    CyExitCriticalSection(status);
+    
+    if (seq != end) {
+        clock_stamp_now(&now);
+        sprintf(strbuf, "C %08lX %08lX", (unsigned long)now.high,
+                (unsigned long)now.low);
+        usb_uart_putline(strbuf);
+    }
+    for (; seq != end; seq++) {
+        status = CyEnterCriticalSection();
+        // Skip anything overwritten since we started
+        if ((uint16)(recorded - seq) > TRACE_LEN) {
+            CyExitCriticalSection(status);
+            continue;
+        }
+        event = ring[seq % TRACE_LEN];
+        CyExitCriticalSection(status);
+        
+        sprintf(strbuf, "T %04X %02X %02X %08lX %08lX %08lX %08lX",
+                seq, (uint16)event.type, (uint16)event.arg,
+                (unsigned long)event.time, (unsigned long)bits(event.value[0]),
+                (unsigned long)bits(event.value[1]),
+                (unsigned long)bits(event.value[2]));
+        usb_uart_putline(strbuf);
+    }
+    dumped = end;
+}
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,91 @@
+/* ========================================
+ * trace.h
+ * Monica Lu and Victor Ying
+ *
+ * A ring of small binary event records, cheap enough to write
+ * from interrupt handlers, for seeing what the positioning solver
+ * did without printing from inside it. The trace shell command
+ * dumps the ring as hex, and host/trace_decode turns a log of
+ * that back into something readable.
+ * ========================================
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <project.h>
+
+
+#define TRACE_ENABLE  // Comment this out to stop recording events
+
+// Events kept, 18 bytes of RAM each; must be a power of two. 32 holds about
+// one positioning cycle's worth; define it larger in the compiler settings
+// to look further back while debugging.
+#ifndef TRACE_LEN
+#define TRACE_LEN 32u
+#endif
+#define TRACE_VALUES 3u
+
+
+// Event types. The values are part of the dump format, so only add to the
+// end.
+enum trace_type {
+    TRACE_EMPTY = 0u,
+    TRACE_PINGS = 1u,  // values: range differences to transmitters 1-3, feet
+    TRACE_ITERATION = 2u,  // arg: iteration; values: dx, dy, fxy
+    TRACE_FIX = 3u,  // arg: iterations; values: x, y, fxy
+    TRACE_REJECT = 4u,  // arg: enum trace_reject; values depend on it
+    TRACE_EXCLUDE = 5u,  // arg: pings left out, a bit each; values: subsets
+                         // tried, fxy before and after leaving them out
+    TRACE_AGC = 6u,  // arg: ping; values: its threshold, times its window
+                     // tripped and microseconds it came after the middle,
+                     // or -1 and 0 if the cycle wasn't gated
+};
+
+// Why a set of pings gave no fix
+enum trace_reject {
+    TRACE_REJECT_STALE = 0u,  // values: ping, microseconds before the set's last
+    TRACE_REJECT_DIFF = 1u,  // values: ping, range difference in feet
+    TRACE_REJECT_ERROR = 2u,  // values: x, y, fxy where Newton's method gave up
+};
+
+struct trace_event {
+    uint32 time;  // clock_now()
+    uint8 type;  // enum trace_type
+    uint8 arg;
+    float value[TRACE_VALUES];
+};
+
+
+#ifdef TRACE_ENABLE
+
+/*
+ * trace_record:
+ * Adds an event to the ring, overwriting the oldest if it is full. Safe to
+ * call from interrupt handlers.
+ */
+void trace_record(uint8 type, uint8 arg, float a, float b, float c) CYREENTRANT ;
+
+/*
+ * trace_dump:
+ * Prints the events in the ring over USB UART, oldest first, one per line
+ * as "T seq type arg time value value value", every field in hex and the
+ * values as IEEE 754 bit patterns. seq counts every event ever recorded,
+ * so gaps show where the ring overflowed. Then empties the ring. Before
+ * them, "C high low" is the clock_stamp_now() time, so the events' 32 bit
+ * times can be extended to it however long the car has been running.
+ */
+void trace_dump(void) ;
+
+#else
+
+// Without tracing, the ring takes no RAM and the trace command prints nothing
+#define trace_record(type, arg, a, b, c)
+#define trace_dump()
+
+#endif
+
+
+#endif
+
+//[] END OF FILE
@@ -37,7 +37,8 @@ void usb_uart_print_info(void) {
     uint8 parity = USBUART_GetParityType();
     uint8 data_bits = USBUART_GetDataBits();
     sprintf(strbuf, 
-            "UART over USB data rate is %lu bits per second", rate);
+            "UART over USB data rate is %lu bits per second",
+            (unsigned long)rate);
     usb_uart_putline(strbuf); 
     sprintf(strbuf, 
             "UART over USB characters consist of %i data bits",
@@ -65,9 +66,17 @@ void usb_uart_print_info(void) {
  * that wait for previous Tx to finish before continuing.
  */
 void usb_uart_putdata(const uint8* pData, uint16 length)  { 
-    while(!USBUART_CDCIsReady())
-        ;
-    USBUART_PutData((uint8 *)pData, length);
+    uint16 n;
+    
+    // PutData() sends at most one packet
+    do {
+        n = length < USB_UART_PACKET ? length : USB_UART_PACKET;
+        while(!USBUART_CDCIsReady())
+            ;
+        USBUART_PutData((uint8 *)pData, n);
+        pData += n;
+        length -= n;
+    } while (length > 0u);
 }
 void usb_uart_putstring(const char8* str) {
     while(!USBUART_CDCIsReady())
@@ -13,6 +13,9 @@
 #include "USBUART.h"
 #include "shell.h"
 
+
+#define USB_UART_PACKET 64u  // bytes in a full speed bulk packet
+
 /*
  * usb_uart_init()
  * Initialize USBUART (and possibly LCD) for I/O
@@ -88,7 +88,7 @@ void loop()
   sendPing();
   Serial.print("Total Time: ");
   Serial.println(micros()-startTotTime);
-  delay(300);
+  delay(100 * NUM_TRANSMITTERS);  // until the last slave has pinged
 }
 
 void LongToBytes(unsigned long val, byte b[4]) {
@@ -0,0 +1,298 @@
+/* ========================================
+ * journal.cpp
+ * Monica Lu and Victor Ying
+ *
+ * Fetches the car's flash journal (see journal.h) over its USB
+ * serial port with the shell's "journal dump" command, and saves
+ * the pages, oldest first, to a file. Each page is saved as it is
+ * in flash, header and entries, without the unused end of the row.
+ *   ./journal -d /dev/ttyACM0 -o run.bin
+ *
+ * With -r, prints a saved journal's entries instead, one to a
+ * line, or as CSV with -c, for replaying off line: the ping
+ * captures are as UltraTimer gave them to the positioning handler,
+ * so they can be fed back to the solver.
+ *   ./journal -r run.bin -c > run.csv
+ * The CSV columns are boot, seconds since that boot, the entry
+ * type, and its fields in the order journal.h gives them.
+ * sim/journal_sim -p serves the firmware's shell on a pseudo-
+ * terminal to try this against.
+ *
+ * Build from the repository root:
+ *   c++ -std=c++11 -O2 -Wall host/journal.cpp host/serial.cpp -o journal
+ *   ./journal [-d device] [-o file]
+ *   ./journal -r file [-c]
+ * ========================================
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+#include "serial.h"
+
+namespace {
+
+// Must match journal.h
+const uint8_t SYNC = 0x04;
+const uint8_t MAGIC = 0x4A;
+const uint8_t END = 0xFF;
+const unsigned PAGE = 256;
+const unsigned HEADER = 12;
+const uint8_t PINGS = 1, FIX = 2, CONTROL = 3;
+const char *const control_names[] = {
+    "speed", "setpoint", "power", "dist", "steer", "meas",
+};
+
+double seconds_now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+uint32_t get_u32(const uint8_t *bytes) {
+    return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 |
+           uint32_t(bytes[2]) << 8 | bytes[3];
+}
+
+float get_float(const uint8_t *bytes) {
+    uint32_t u = get_u32(bytes);
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Returns whether page holds a whole page with the right check byte
+bool page_ok(const std::vector<uint8_t> &page) {
+    if (page.size() < HEADER || page[0] != MAGIC ||
+            page.size() != HEADER + page[1])
+        return false;
+    uint8_t sum = 0;
+    for (uint8_t b : page)
+        sum += b;
+    return sum == 0;
+}
+
+// The pages of a dump as its frames arrive
+struct Dump {
+    std::map<unsigned, std::vector<uint8_t>> pages;
+    bool ended = false;
+    unsigned sent = 0;  // pages, as the end frame says
+    uint64_t frames = 0, corrupt = 0;
+
+    void frame(const uint8_t *body, unsigned len) {
+        unsigned n = unsigned(body[0]) << 8 | body[1], offset = body[2];
+
+        frames++;
+        if (offset == END) {
+            ended = true;
+            sent = n;
+            return;
+        }
+        std::vector<uint8_t> &page = pages[n];
+        if (offset != page.size() || offset + len - 3 > PAGE) {
+            corrupt++;
+            return;
+        }
+        page.insert(page.end(), body + 3, body + len);
+    }
+};
+
+int fetch(const char *device, const char *path) {
+    serial::Link link(device);
+    link.drain();
+
+    Dump dump;
+    std::vector<uint8_t> buf;
+    double last_data = seconds_now();
+    link.command("journal dump");
+    while (!dump.ended) {
+        if (link.read(buf, 100)) {
+            last_data = seconds_now();
+            serial::take_frames(buf, SYNC, 3, 255,
+                                [&](const uint8_t *body, unsigned len) {
+                                    dump.frame(body, len);
+                                    return !dump.ended;
+                                }, dump.corrupt);
+        } else if (seconds_now() - last_data > 3.0) {
+            std::fprintf(stderr, "nothing from the car for 3 seconds\n");
+            break;
+        }
+    }
+
+    FILE *out = std::fopen(path, "wb");
+    if (out == nullptr) {
+        std::perror(path);
+        return 1;
+    }
+    unsigned saved = 0, bad = 0;
+    for (const auto &p : dump.pages) {
+        if (!page_ok(p.second)) {
+            bad++;
+            continue;
+        }
+        std::fwrite(p.second.data(), 1, p.second.size(), out);
+        saved++;
+    }
+    std::fclose(out);
+
+    std::fprintf(stderr, "%u pages saved to %s", saved, path);
+    if (dump.ended && dump.sent != dump.pages.size())
+        std::fprintf(stderr, ", %u of %u never arrived",
+                     unsigned(dump.sent - dump.pages.size()), dump.sent);
+    std::fprintf(stderr, ", %u bad, %llu corrupt frames\n", bad,
+                 static_cast<unsigned long long>(dump.corrupt));
+    return dump.ended && bad == 0 && dump.sent == saved ? 0 : 1;
+}
+
+// Prints one entry, returning its size, or 0 if it doesn't make sense
+unsigned print_entry(const uint8_t *e, unsigned left, unsigned boot,
+                     uint32_t high, bool csv) {
+    if (left < 5)
+        return 0;
+    uint8_t type = e[0];
+    double t = (double(high) * 4294967296.0 + get_u32(e + 1)) * 1e-6;
+    const uint8_t *f = e + 5;
+
+    if (csv)
+        std::printf("%u,%.6f", boot, t);
+    else
+        std::printf("boot %u %12.6f s  ", boot, t);
+    switch (type) {
+    case PINGS: {
+        unsigned n = left > 5 ? f[0] : 0;
+        if (n == 0 || left < 6 + 4 * n)
+            return 0;
+        std::printf(csv ? ",pings,%u" : "pings   %u:", n);
+        for (unsigned i = 0; i < n; i++)
+            std::printf(csv ? ",%lu" : " %08lX",
+                        static_cast<unsigned long>(get_u32(f + 1 + 4 * i)));
+        if (!csv) {
+            std::printf("  (us before the last:");
+            for (unsigned i = 0; i < n; i++)
+                std::printf(" %lu", static_cast<unsigned long>(
+                    get_u32(f + 1 + 4 * i) - get_u32(f + 1 + 4 * (n - 1))));
+            std::printf(")");
+        }
+        std::printf("\n");
+        return 6 + 4 * n;
+    }
+    case FIX:
+        if (left < 20)
+            return 0;
+        if (csv)
+            std::printf(",fix,%.9g,%.9g,%.9g,%u,%u\n", get_float(f),
+                        get_float(f + 4), get_float(f + 8),
+                        unsigned(f[12]) << 8 | f[13], f[14]);
+        else
+            std::printf("fix     %u: x %.3f y %.3f error %.4f excluded %02X\n",
+                        unsigned(f[12]) << 8 | f[13], get_float(f),
+                        get_float(f + 4), get_float(f + 8), f[14]);
+        return 20;
+    case CONTROL:
+        if (left < 29)
+            return 0;
+        std::printf(csv ? ",control" : "control");
+        for (unsigned i = 0; i < 6; i++) {
+            if (csv)
+                std::printf(",%.9g", get_float(f + 4 * i));
+            else
+                std::printf(" %s %.4g", control_names[i], get_float(f + 4 * i));
+        }
+        std::printf("\n");
+        return 29;
+    default:
+        return 0;
+    }
+}
+
+int replay(const char *path, bool csv) {
+    FILE *in = std::fopen(path, "rb");
+    if (in == nullptr) {
+        std::perror(path);
+        return 1;
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), in)) > 0)
+        bytes.insert(bytes.end(), chunk, chunk + n);
+    std::fclose(in);
+
+    if (csv)
+        std::printf("boot,time,type,fields...\n");
+    size_t at = 0;
+    unsigned pages = 0;
+    while (at + HEADER <= bytes.size()) {
+        std::vector<uint8_t> page(bytes.begin() + at,
+                                  bytes.begin() + std::min(bytes.size(),
+                                                           at + HEADER + bytes[at + 1]));
+        if (!page_ok(page)) {
+            std::fprintf(stderr, "%s: bad page at byte %lu\n", path,
+                         static_cast<unsigned long>(at));
+            return 1;
+        }
+        unsigned boot = page[10];
+        uint32_t high = get_u32(&page[6]);
+        if (!csv)
+            std::printf("page %lu\n", static_cast<unsigned long>(
+                get_u32(&page[2])));
+        for (unsigned i = HEADER; i < page.size(); ) {
+            unsigned size = print_entry(&page[i], page.size() - i, boot, high,
+                                        csv);
+            if (size == 0) {
+                std::fprintf(stderr, "%s: bad entry in page %lu\n", path,
+                             static_cast<unsigned long>(get_u32(&page[2])));
+                return 1;
+            }
+            i += size;
+        }
+        at += page.size();
+        pages++;
+    }
+    std::fprintf(stderr, "%u pages\n", pages);
+    return 0;
+}
+
+void usage(const char *name) {
+    std::fprintf(stderr,
+                 "usage: %s [-d device] [-o file]\n"
+                 "       %s -r file [-c]\n", name, name);
+    std::exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const char *device = "/dev/ttyACM0";
+    const char *path = "journal.bin";
+    const char *replay_path = nullptr;
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            device = argv[++i];
+        else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            path = argv[++i];
+        else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            replay_path = argv[++i];
+        else if (std::strcmp(argv[i], "-c") == 0)
+            csv = true;
+        else
+            usage(argv[0]);
+    }
+    if (replay_path != nullptr)
+        return replay(replay_path, csv);
+    if (csv)
+        usage(argv[0]);
+    return fetch(device, path);
+}
+
+//[] END OF FILE
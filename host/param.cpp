@@ -0,0 +1,276 @@
+/* ========================================
+ * param.cpp
+ * Monica Lu and Victor Ying
+ *
+ * Reads and sets the car's tunable parameters (see param.h) over
+ * its USB serial port, using the binary frame protocol, so that
+ * any number of them take one round trip. Parameters are looked up
+ * by name with a LIST request first, so this doesn't need to know
+ * which ones the firmware has.
+ *
+ * With no names, prints every parameter. A name prints that one,
+ * and name=value sets it; all the sets on one command line are made
+ * together, or none are if any value is out of range.
+ *   ./param -d /dev/ttyACM0 speedkp=0.12 speedki=0.3 steerkp
+ * sim/param_sim -p serves the firmware's shell on a pseudo-terminal
+ * to try this against.
+ *
+ * Build from the repository root:
+ *   c++ -std=c++11 -O2 -Wall host/param.cpp host/serial.cpp -o param
+ *   ./param [-d device] [name | name=value]...
+ * ========================================
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "serial.h"
+
+namespace {
+
+// Must match param.h
+const uint8_t SYNC = 0x02;
+const unsigned MAX_BODY = 255;
+const unsigned RESULT_LEN = 6;  // id, status and value
+const unsigned MAX_ITEMS = (MAX_BODY - 2) / RESULT_LEN;
+
+enum Op { OP_LIST = 1, OP_GET = 2, OP_SET = 3 };
+enum Type { TYPE_FLOAT = 0, TYPE_UINT8 = 1 };
+
+const char *const status_names[] = {
+    "ok", "no such parameter", "out of range", "bad request", "corrupted",
+};
+
+const int TIMEOUT_MS = 1000;
+
+struct Param {
+    uint8_t id;
+    uint8_t type;
+};
+
+struct Reply {
+    uint8_t op = 0;
+    uint8_t status = 0;
+    std::vector<uint8_t> body;  // after op and status
+};
+
+const char *status_name(unsigned status) {
+    return status < sizeof(status_names) / sizeof(*status_names)
+               ? status_names[status] : "unknown status";
+}
+
+void put_float(std::vector<uint8_t> &out, float value) {
+    uint32_t u;
+    std::memcpy(&u, &value, sizeof(u));
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<uint8_t>(u >> shift));
+}
+
+float get_float(const uint8_t *bytes) {
+    uint32_t u = uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 |
+                 uint32_t(bytes[2]) << 8 | bytes[3];
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Sends a request and waits for the reply to it, skipping anything else
+// the car prints meanwhile.
+bool transact(serial::Link &link, const std::vector<uint8_t> &body,
+              Reply &reply) {
+    std::vector<uint8_t> buf;
+    uint64_t corrupt = 0;
+    bool got = false;
+
+    if (!link.write(serial::frame(SYNC, body)))
+        return false;
+    while (!got) {
+        if (!link.read(buf, TIMEOUT_MS)) {
+            std::fprintf(stderr, "no reply from the car\n");
+            return false;
+        }
+        serial::take_frames(buf, SYNC, 2, MAX_BODY,
+                            [&](const uint8_t *frame, unsigned len) {
+                                if (frame[0] != body[0] && frame[1] != 4)
+                                    return true;
+                                reply.op = frame[0];
+                                reply.status = frame[1];
+                                reply.body.assign(frame + 2, frame + len);
+                                got = true;
+                                return false;
+                            }, corrupt);
+    }
+    return true;
+}
+
+// Finds every parameter's id and type by name
+bool list(serial::Link &link, std::map<std::string, Param> &params,
+          std::vector<std::string> &order) {
+    uint8_t first = 0;
+
+    for (;;) {
+        Reply reply;
+        if (!transact(link, {OP_LIST, first}, reply))
+            return false;
+        if (reply.status != 0) {
+            std::fprintf(stderr, "list: %s\n", status_name(reply.status));
+            return false;
+        }
+        size_t n = 0;
+        unsigned got = 0;
+        while (n + 3 <= reply.body.size()) {
+            const uint8_t *entry = &reply.body[n];
+            std::string name(reinterpret_cast<const char *>(entry + 3),
+                             entry[2]);
+            params[name] = Param{entry[0], entry[1]};
+            order.push_back(name);
+            first = entry[0] + 1;
+            n += 3 + entry[2];
+            got++;
+        }
+        if (got == 0)
+            return true;
+    }
+}
+
+void print_value(const std::string &name, const Param &p, float value) {
+    if (p.type == TYPE_UINT8)
+        std::printf("%-12s %.0f\n", name.c_str(), value);
+    else
+        std::printf("%-12s %.9g\n", name.c_str(), value);
+}
+
+// Prints the (id, status, value) results in a reply. Returns false if any
+// failed.
+bool print_results(const Reply &reply,
+                   const std::vector<std::string> &names,
+                   const std::map<std::string, Param> &params) {
+    bool ok = true;
+
+    for (size_t i = 0; i < names.size(); i++) {
+        const uint8_t *r = &reply.body[i * RESULT_LEN];
+        if (r[1] != 0) {
+            std::fprintf(stderr, "%s: %s\n", names[i].c_str(),
+                         status_name(r[1]));
+            ok = false;
+        }
+        print_value(names[i], params.at(names[i]), get_float(r + 2));
+    }
+    return ok;
+}
+
+bool get(serial::Link &link, const std::vector<std::string> &names,
+         const std::map<std::string, Param> &params) {
+    bool ok = true;
+
+    for (size_t start = 0; start < names.size(); start += MAX_ITEMS) {
+        std::vector<std::string> batch(
+            names.begin() + start,
+            names.begin() + std::min(names.size(), start + MAX_ITEMS));
+        std::vector<uint8_t> body{OP_GET};
+        Reply reply;
+
+        for (const auto &name : batch)
+            body.push_back(params.at(name).id);
+        if (!transact(link, body, reply) ||
+                reply.body.size() != batch.size() * RESULT_LEN)
+            return false;
+        ok = print_results(reply, batch, params) && ok;
+    }
+    return ok;
+}
+
+bool set(serial::Link &link, const std::vector<std::string> &names,
+         const std::vector<float> &values,
+         const std::map<std::string, Param> &params) {
+    std::vector<uint8_t> body{OP_SET};
+    Reply reply;
+
+    if (names.size() > MAX_ITEMS) {
+        std::fprintf(stderr, "can only set %u at once\n", MAX_ITEMS);
+        return false;
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        body.push_back(params.at(names[i]).id);
+        put_float(body, values[i]);
+    }
+    if (!transact(link, body, reply) ||
+            reply.body.size() != names.size() * RESULT_LEN) {
+        if (reply.status != 0)
+            std::fprintf(stderr, "set: %s\n", status_name(reply.status));
+        return false;
+    }
+    if (reply.status != 0)
+        std::fprintf(stderr, "nothing was set\n");
+    return print_results(reply, names, params);
+}
+
+void usage(const char *name) {
+    std::fprintf(stderr, "usage: %s [-d device] [name | name=value]...\n",
+                 name);
+    std::exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const char *device = "/dev/ttyACM0";
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            device = argv[++i];
+        else if (argv[i][0] == '-')
+            usage(argv[0]);
+        else
+            args.push_back(argv[i]);
+    }
+
+    serial::Link link(device);
+    std::map<std::string, Param> params;
+    std::vector<std::string> order;
+    if (!list(link, params, order))
+        return 1;
+
+    std::vector<std::string> gets, sets;
+    std::vector<float> values;
+    for (const auto &arg : args) {
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        if (params.count(name) == 0) {
+            std::fprintf(stderr, "no parameter %s\n", name.c_str());
+            return 1;
+        }
+        if (eq == std::string::npos) {
+            gets.push_back(name);
+            continue;
+        }
+        char *end;
+        errno = 0;
+        float value = std::strtof(arg.c_str() + eq + 1, &end);
+        if (errno != 0 || end == arg.c_str() + eq + 1 || *end != '\0') {
+            std::fprintf(stderr, "bad value in %s\n", arg.c_str());
+            return 1;
+        }
+        sets.push_back(name);
+        values.push_back(value);
+    }
+    if (args.empty())
+        gets = order;
+
+    bool ok = true;
+    if (!sets.empty())
+        ok = set(link, sets, values, params);
+    if (!gets.empty())
+        ok = get(link, gets, params) && ok;
+    return ok ? 0 : 1;
+}
+
+//[] END OF FILE
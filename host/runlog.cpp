@@ -0,0 +1,455 @@
+/* ========================================
+ * runlog.cpp
+ * Monica Lu and Victor Ying
+ *
+ * Writes and maps the run log files described in runlog.h.
+ *
+ * The writer fills a block in memory and writes it with one
+ * pwrite() when it is full, or when flushed, in which case the
+ * same block is written again, fuller, next time. Writes go to the
+ * page cache, which a reader's mapping shares, so nothing needs
+ * syncing for readers on the same machine to see them in order.
+ * ========================================
+ */
+
+#include "runlog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace runlog {
+
+namespace {
+
+size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+bool write_at(int fd, const void *data, size_t len, uint64_t offset) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+
+    while (len > 0) {
+        ssize_t n = ::pwrite(fd, p, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool read_at(int fd, void *data, size_t len, uint64_t offset) {
+    uint8_t *p = static_cast<uint8_t *>(data);
+
+    while (len > 0) {
+        ssize_t n = ::pread(fd, p, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+// Checks the parts of a header that say where everything is
+bool valid(const FileHeader &h, uint64_t file_size) {
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            h.version != VERSION || h.num_columns < 1 ||
+            h.num_columns > MAX_COLUMNS || h.rows_per_block == 0 ||
+            h.columns[0].type != I64 || h.index_offset < sizeof(FileHeader) ||
+            h.data_offset < h.index_offset + h.max_blocks * sizeof(IndexEntry) ||
+            h.num_blocks > h.max_blocks || h.data_offset > file_size)
+        return false;
+    for (unsigned c = 0; c < h.num_columns; c++) {
+        if (h.columns[c].type > I64 ||
+                h.columns[c].offset + h.rows_per_block *
+                    type_size(static_cast<Type>(h.columns[c].type)) >
+                h.block_size)
+            return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+size_t type_size(Type type) {
+    switch (type) {
+    case F32:
+    case I32:
+    case U32:
+        return 4;
+    default:
+        return 8;
+    }
+}
+
+double Slice::value(unsigned c, size_t r) const {
+    const uint8_t *p = block_ + header_->columns[c].offset;
+
+    r += first_;
+    switch (header_->columns[c].type) {
+    case F32:
+        return reinterpret_cast<const float *>(p)[r];
+    case F64:
+        return reinterpret_cast<const double *>(p)[r];
+    case I32:
+        return reinterpret_cast<const int32_t *>(p)[r];
+    case U32:
+        return reinterpret_cast<const uint32_t *>(p)[r];
+    case I64:
+        return static_cast<double>(reinterpret_cast<const int64_t *>(p)[r]);
+    default:
+        return 0.0;
+    }
+}
+
+bool Writer::create(const std::string &path,
+                    const std::vector<Column> &columns,
+                    uint32_t rows_per_block, uint64_t max_blocks) {
+    return start(path, columns, rows_per_block, max_blocks, false);
+}
+
+bool Writer::append_to(const std::string &path,
+                       const std::vector<Column> &columns,
+                       uint32_t rows_per_block, uint64_t max_blocks) {
+    return start(path, columns, rows_per_block, max_blocks, true);
+}
+
+bool Writer::fail(const std::string &what) {
+    error_ = what;
+    return false;
+}
+
+// Closes a file that turned out not to be usable, and fails
+bool Writer::abandon(const std::string &what) {
+    ::close(fd_);
+    fd_ = -1;
+    block_num_ = 0;
+    block_rows_ = 0;
+    last_time_ = INT64_MIN;
+    rows_ = 0;
+    return fail(what);
+}
+
+bool Writer::start(const std::string &path,
+                   const std::vector<Column> &columns,
+                   uint32_t rows_per_block, uint64_t max_blocks,
+                   bool append) {
+    close();
+    error_.clear();
+    if (columns.size() + 1 > MAX_COLUMNS)
+        return fail("too many columns");
+    if (rows_per_block == 0 || max_blocks == 0)
+        return fail("no room for rows");
+
+    // The header this log should have
+    header_.assign(PAGE, 0);
+    FileHeader &h = *reinterpret_cast<FileHeader *>(header_.data());
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.num_columns = static_cast<uint32_t>(columns.size() + 1);
+    h.rows_per_block = rows_per_block;
+    h.max_blocks = max_blocks;
+    h.index_offset = PAGE;
+    h.data_offset = PAGE + round_up(max_blocks * sizeof(IndexEntry), PAGE);
+    std::strcpy(h.columns[0].name, "time");
+    h.columns[0].type = I64;
+    size_t offset = 0;
+    for (unsigned c = 0; c < h.num_columns; c++) {
+        if (c > 0) {
+            const Column &col = columns[c - 1];
+            if (col.name.empty() || col.name.size() > MAX_NAME)
+                return fail("bad column name \"" + col.name + "\"");
+            std::strcpy(h.columns[c].name, col.name.c_str());
+            h.columns[c].type = col.type;
+        }
+        h.columns[c].offset = static_cast<uint32_t>(offset);
+        offset = round_up(offset + rows_per_block *
+                              type_size(static_cast<Type>(h.columns[c].type)),
+                          8);
+    }
+    h.block_size = round_up(offset, PAGE);
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC),
+                 0644);
+    if (fd_ < 0)
+        return fail(path + ": " + std::strerror(errno));
+    struct stat st;
+    if (fstat(fd_, &st) < 0)
+        return abandon(path + ": " + std::strerror(errno));
+
+    if (st.st_size == 0) {
+        if (!write_at(fd_, header_.data(), PAGE, 0) ||
+                ftruncate(fd_, static_cast<off_t>(h.data_offset)) < 0)
+            return abandon(path + ": " + std::strerror(errno));
+        block_.assign(h.block_size, 0);
+        return true;
+    }
+
+    // Appending: the file's geometry wins, but the columns must match
+    std::vector<uint8_t> old(PAGE);
+    const FileHeader &o = *reinterpret_cast<const FileHeader *>(old.data());
+    if (!read_at(fd_, old.data(), PAGE, 0) ||
+            !valid(o, static_cast<uint64_t>(st.st_size)))
+        return abandon(path + ": not a run log");
+    if (o.num_columns != h.num_columns)
+        return abandon(path + ": has different columns");
+    for (unsigned c = 0; c < h.num_columns; c++)
+        if (std::strcmp(o.columns[c].name, h.columns[c].name) != 0 ||
+                o.columns[c].type != h.columns[c].type)
+            return abandon(path + ": has different columns");
+    header_ = old;
+    block_.assign(o.block_size, 0);
+    block_num_ = o.num_blocks;
+    if (o.num_blocks > 0) {
+        IndexEntry last;
+        if (!read_at(fd_, &last, sizeof(last),
+                     o.index_offset + (o.num_blocks - 1) * sizeof(last)))
+            return abandon(path + ": " + std::strerror(errno));
+        last_time_ = last.last_time;
+        rows_ = (o.num_blocks - 1) * o.rows_per_block + last.rows;
+        if (last.rows < o.rows_per_block) {
+            // Carry on filling the partial last block
+            block_num_--;
+            block_rows_ = last.rows;
+            if (!read_at(fd_, block_.data(), block_.size(),
+                         o.data_offset + block_num_ * o.block_size))
+                return abandon(path + ": " + std::strerror(errno));
+        }
+    }
+    return true;
+}
+
+bool Writer::append(int64_t time, const double *values) {
+    const FileHeader &h = *reinterpret_cast<const FileHeader *>(header_.data());
+
+    if (fd_ < 0)
+        return fail("not open");
+    if (time < last_time_)
+        return fail("time went backwards");
+    if (block_num_ >= h.max_blocks)
+        return fail("log is full");
+
+    uint8_t *block = block_.data();
+    reinterpret_cast<int64_t *>(block)[block_rows_] = time;
+    for (unsigned c = 1; c < h.num_columns; c++) {
+        uint8_t *p = block + h.columns[c].offset;
+        double v = values[c - 1];
+        switch (h.columns[c].type) {
+        case F32:
+            reinterpret_cast<float *>(p)[block_rows_] = static_cast<float>(v);
+            break;
+        case F64:
+            reinterpret_cast<double *>(p)[block_rows_] = v;
+            break;
+        case I32:
+            reinterpret_cast<int32_t *>(p)[block_rows_] = static_cast<int32_t>(v);
+            break;
+        case U32:
+            reinterpret_cast<uint32_t *>(p)[block_rows_] = static_cast<uint32_t>(v);
+            break;
+        case I64:
+            reinterpret_cast<int64_t *>(p)[block_rows_] = static_cast<int64_t>(v);
+            break;
+        }
+    }
+    last_time_ = time;
+    rows_++;
+    if (++block_rows_ < h.rows_per_block)
+        return true;
+    if (!write_block())
+        return false;
+    block_num_++;
+    block_rows_ = 0;
+    return true;
+}
+
+/*
+ * Writes block_, then its index entry, then the number of blocks, in that
+ * order, so a reader only ever counts blocks that are all there.
+ */
+bool Writer::write_block() {
+    FileHeader &h = *reinterpret_cast<FileHeader *>(header_.data());
+    const int64_t *time = reinterpret_cast<const int64_t *>(block_.data());
+    IndexEntry entry = {time[0], time[block_rows_ - 1], block_rows_, 0};
+
+    if (!write_at(fd_, block_.data(), block_.size(),
+                  h.data_offset + block_num_ * h.block_size) ||
+            !write_at(fd_, &entry, sizeof(entry),
+                      h.index_offset + block_num_ * sizeof(entry)))
+        return fail(std::strerror(errno));
+    if (h.num_blocks != block_num_ + 1) {
+        h.num_blocks = block_num_ + 1;
+        if (!write_at(fd_, &h.num_blocks, sizeof(h.num_blocks),
+                      offsetof(FileHeader, num_blocks)))
+            return fail(std::strerror(errno));
+    }
+    return true;
+}
+
+bool Writer::flush() {
+    if (fd_ < 0)
+        return fail("not open");
+    return block_rows_ == 0 || write_block();
+}
+
+void Writer::close() {
+    if (fd_ < 0)
+        return;
+    flush();
+    ::close(fd_);
+    fd_ = -1;
+    block_num_ = 0;
+    block_rows_ = 0;
+    last_time_ = INT64_MIN;
+    rows_ = 0;
+}
+
+bool Reader::open(const std::string &path) {
+    close();
+    error_.clear();
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        error_ = path + ": " + std::strerror(errno);
+        return false;
+    }
+    if (!refresh()) {
+        error_ = path + ": " + error_;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool Reader::refresh() {
+    struct stat st;
+
+    if (fd_ < 0 || fstat(fd_, &st) < 0) {
+        error_ = "not open";
+        return false;
+    }
+    if (static_cast<size_t>(st.st_size) != map_len_) {
+        if (map_ != nullptr)
+            munmap(const_cast<uint8_t *>(map_), map_len_);
+        map_ = nullptr;
+        map_len_ = 0;
+        if (st.st_size < static_cast<off_t>(PAGE)) {
+            error_ = "not a run log";
+            return false;
+        }
+        void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+        if (m == MAP_FAILED) {
+            error_ = std::strerror(errno);
+            return false;
+        }
+        map_ = static_cast<const uint8_t *>(m);
+        map_len_ = st.st_size;
+        header_ = reinterpret_cast<const FileHeader *>(map_);
+    }
+    if (!valid(*header_, map_len_)) {
+        error_ = "not a run log";
+        return false;
+    }
+    index_ = reinterpret_cast<const IndexEntry *>(map_ + header_->index_offset);
+
+    // Only count blocks that are wholly in the mapping
+    uint64_t blocks = __atomic_load_n(&header_->num_blocks, __ATOMIC_ACQUIRE);
+    uint64_t mapped = (map_len_ - header_->data_offset) / header_->block_size;
+    num_blocks_ = std::min(blocks, mapped);
+    return true;
+}
+
+void Reader::close() {
+    if (map_ != nullptr)
+        munmap(const_cast<uint8_t *>(map_), map_len_);
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+    map_ = nullptr;
+    map_len_ = 0;
+    header_ = nullptr;
+    index_ = nullptr;
+    num_blocks_ = 0;
+}
+
+Slice Reader::slice(uint64_t block, size_t first, size_t rows) const {
+    Slice s;
+
+    s.block_ = map_ + header_->data_offset + block * header_->block_size;
+    s.header_ = header_;
+    s.first_ = first;
+    s.rows_ = rows;
+    return s;
+}
+
+std::vector<Slice> Reader::range(int64_t from, int64_t to) const {
+    std::vector<Slice> slices;
+
+    if (num_blocks_ == 0 || from >= to)
+        return slices;
+
+    // The first block with any row at or after from
+    const IndexEntry *end = index_ + num_blocks_;
+    const IndexEntry *e = std::lower_bound(
+        index_, end, from,
+        [](const IndexEntry &a, int64_t t) { return a.last_time < t; });
+
+    for (; e != end && e->first_time < to; ++e) {
+        uint64_t block = e - index_;
+        const int64_t *time = reinterpret_cast<const int64_t *>(
+            map_ + header_->data_offset + block * header_->block_size);
+        size_t first = std::lower_bound(time, time + e->rows, from) - time;
+        size_t last = std::lower_bound(time + first, time + e->rows, to) - time;
+        if (last > first)
+            slices.push_back(slice(block, first, last - first));
+    }
+    return slices;
+}
+
+std::vector<Slice> Reader::all() const {
+    std::vector<Slice> slices;
+
+    for (uint64_t block = 0; block < num_blocks_; block++)
+        slices.push_back(slice(block, 0, index_[block].rows));
+    return slices;
+}
+
+unsigned Reader::num_columns() const {
+    return header_ != nullptr ? header_->num_columns : 0;
+}
+
+const char *Reader::column_name(unsigned c) const {
+    return header_->columns[c].name;
+}
+
+Type Reader::column_type(unsigned c) const {
+    return static_cast<Type>(header_->columns[c].type);
+}
+
+int Reader::find_column(const std::string &name) const {
+    for (unsigned c = 0; c < num_columns(); c++)
+        if (name == header_->columns[c].name)
+            return static_cast<int>(c);
+    return -1;
+}
+
+uint64_t Reader::rows() const {
+    if (num_blocks_ == 0)
+        return 0;
+    return (num_blocks_ - 1) * header_->rows_per_block +
+           index_[num_blocks_ - 1].rows;
+}
+
+}  // namespace runlog
+
+//[] END OF FILE
@@ -0,0 +1,238 @@
+/* ========================================
+ * runlog.h
+ * Monica Lu and Victor Ying
+ *
+ * Run logs: telemetry from a run (position fixes, captures,
+ * odometry, controller outputs) stored by column in a file that
+ * is only ever appended to, so analysis tools can map it into
+ * memory and read any stretch of time without copying or parsing.
+ *
+ * A log holds one table: a time column of int64 microseconds that
+ * never decreases, and up to MAX_COLUMNS - 1 more numeric columns.
+ * Log different kinds of records (fixes at 10 Hz, hall ticks at
+ * 100 Hz) in different files. Rows are kept in blocks of a fixed
+ * number of rows, each column contiguous within a block:
+ *
+ *   header     one page: geometry, columns, number of blocks
+ *   index      max_blocks entries of (first time, last time, rows)
+ *   blocks     block_size bytes each, page aligned; in each, the
+ *              rows_per_block slots of every column in turn
+ *
+ * The index is the sparse time index: one entry per block, in a
+ * few pages at the front, so finding a time range binary searches
+ * it without touching the blocks. A writer writes a block, then its
+ * index entry, then the block count in the header, so a reader
+ * that maps the file while it is being written never sees a block
+ * that isn't there yet. The last block may be partly filled; its
+ * index entry says how many rows it has.
+ *
+ * Numbers are stored in the host's byte order, which is little
+ * endian on every PC this runs on.
+ * ========================================
+ */
+
+#ifndef RUNLOG_H
+#define RUNLOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace runlog {
+
+const unsigned MAX_COLUMNS = 48;  // including time
+const unsigned MAX_NAME = 31;
+const uint32_t DEFAULT_ROWS_PER_BLOCK = 4096;
+const uint64_t DEFAULT_MAX_BLOCKS = 65536;  // 256M rows at the default
+
+// The values are part of the file format, so only add to the end
+enum Type : uint32_t {
+    F32 = 0,
+    F64 = 1,
+    I32 = 2,
+    U32 = 3,
+    I64 = 4,
+};
+
+struct Column {
+    std::string name;
+    Type type;
+};
+
+struct FileHeader;
+
+// One entry of the time index
+struct IndexEntry {
+    int64_t first_time;  // in microseconds
+    int64_t last_time;
+    uint32_t rows;
+    uint32_t reserved;
+};
+
+// The part of a time range that lies in one block. Columns are arrays of
+// rows values, read straight out of the mapped file.
+class Slice {
+public:
+    size_t rows() const { return rows_; }
+    const int64_t *time() const { return column<int64_t>(0); }
+
+    // Returns column c as an array of T, which must match its Type, or
+    // null if it doesn't.
+    template <typename T> const T *column(unsigned c) const;
+
+    // Returns row r of column c converted to double, whatever its type.
+    double value(unsigned c, size_t r) const;
+
+private:
+    friend class Reader;
+    const uint8_t *block_ = nullptr;
+    const FileHeader *header_ = nullptr;
+    size_t first_ = 0, rows_ = 0;  // rows of the block in the slice
+};
+
+class Writer {
+public:
+    Writer() = default;
+    ~Writer() { close(); }
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    // Starts a new log at path with a time column followed by columns,
+    // replacing any file there. Returns false and sets error() if it can't.
+    bool create(const std::string &path, const std::vector<Column> &columns,
+                uint32_t rows_per_block = DEFAULT_ROWS_PER_BLOCK,
+                uint64_t max_blocks = DEFAULT_MAX_BLOCKS);
+
+    // Opens an existing log to add rows to the end of it, or creates it if
+    // there isn't one. Its columns must be the given ones.
+    bool append_to(const std::string &path,
+                   const std::vector<Column> &columns,
+                   uint32_t rows_per_block = DEFAULT_ROWS_PER_BLOCK,
+                   uint64_t max_blocks = DEFAULT_MAX_BLOCKS);
+
+    // Adds a row: a time no earlier than the last row's, and a value for
+    // every column after time, converted to the column's type. Returns
+    // false if the time goes backwards or the log is full.
+    bool append(int64_t time, const double *values);
+
+    // Writes out the rows appended so far, so readers can see them.
+    bool flush();
+
+    // Flushes and closes the file.
+    void close();
+
+    uint64_t rows() const { return rows_; }
+    const std::string &error() const { return error_; }
+
+private:
+    bool start(const std::string &path, const std::vector<Column> &columns,
+               uint32_t rows_per_block, uint64_t max_blocks, bool append);
+    bool write_block();
+    bool fail(const std::string &what);
+    bool abandon(const std::string &what);
+
+    int fd_ = -1;
+    std::vector<uint8_t> header_;  // the header page
+    std::vector<uint8_t> block_;  // the block being filled
+    uint64_t block_num_ = 0;  // of block_
+    uint32_t block_rows_ = 0;  // rows in block_
+    int64_t last_time_ = INT64_MIN;
+    uint64_t rows_ = 0;
+    std::string error_;
+};
+
+class Reader {
+public:
+    Reader() = default;
+    ~Reader() { close(); }
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    // Maps the log at path. Returns false and sets error() if it isn't one.
+    bool open(const std::string &path);
+
+    // Maps any blocks a writer has added since open() or the last refresh().
+    bool refresh();
+
+    void close();
+
+    // Returns the slices, in time order, holding every row with
+    // from <= time < to.
+    std::vector<Slice> range(int64_t from, int64_t to) const;
+
+    // Returns the slices holding every row.
+    std::vector<Slice> all() const;
+
+    unsigned num_columns() const;  // including time
+    const char *column_name(unsigned c) const;
+    Type column_type(unsigned c) const;
+
+    // Returns the index of the named column, or -1.
+    int find_column(const std::string &name) const;
+
+    uint64_t rows() const;
+    uint64_t num_blocks() const { return num_blocks_; }
+    const IndexEntry *index() const { return index_; }
+    const std::string &error() const { return error_; }
+
+private:
+    Slice slice(uint64_t block, size_t first, size_t rows) const;
+
+    int fd_ = -1;
+    const uint8_t *map_ = nullptr;
+    size_t map_len_ = 0;
+    const FileHeader *header_ = nullptr;
+    const IndexEntry *index_ = nullptr;
+    uint64_t num_blocks_ = 0;
+    std::string error_;
+};
+
+
+// The layout of the header page
+struct ColumnDesc {
+    char name[MAX_NAME + 1];
+    uint32_t type;
+    uint32_t offset;  // in bytes from the start of a block
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_columns;
+    uint32_t rows_per_block;
+    uint32_t reserved;
+    uint64_t block_size;
+    uint64_t max_blocks;
+    uint64_t index_offset;
+    uint64_t data_offset;
+    uint64_t num_blocks;  // written last
+    ColumnDesc columns[MAX_COLUMNS];
+};
+
+const char MAGIC[8] = {'R', 'U', 'N', 'L', 'O', 'G', '\0', '\0'};
+const uint32_t VERSION = 1;
+const size_t PAGE = 4096;
+
+// Bytes taken by one value of each type
+size_t type_size(Type type);
+
+template <typename T> struct TypeOf;
+template <> struct TypeOf<float> { static const Type type = F32; };
+template <> struct TypeOf<double> { static const Type type = F64; };
+template <> struct TypeOf<int32_t> { static const Type type = I32; };
+template <> struct TypeOf<uint32_t> { static const Type type = U32; };
+template <> struct TypeOf<int64_t> { static const Type type = I64; };
+
+template <typename T> const T *Slice::column(unsigned c) const {
+    if (c >= header_->num_columns || header_->columns[c].type != TypeOf<T>::type)
+        return nullptr;
+    return reinterpret_cast<const T *>(block_ + header_->columns[c].offset) +
+           first_;
+}
+
+}  // namespace runlog
+
+#endif
+
+//[] END OF FILE
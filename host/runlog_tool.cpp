@@ -0,0 +1,313 @@
+/* ========================================
+ * runlog_tool.cpp
+ * Monica Lu and Victor Ying
+ *
+ * Looks at and makes run logs (see runlog.h) from the command line.
+ *
+ *   runlog info log...
+ *       columns, rows and time span of each log
+ *   runlog dump [-f seconds] [-t seconds] log
+ *       the rows from -f up to -t as CSV, time in seconds
+ *   runlog import [-a] [-s] csv log
+ *       a CSV file whose first column is time in seconds, such as
+ *       host/scope writes, into a log, or onto the end of it with -a;
+ *       -s keeps the values as single floats rather than doubles
+ *   runlog bench [-n rows] [-c columns] log
+ *       writes a log of made up rows, then times opening it and
+ *       reading windows of it, checking every value read
+ *
+ * For example, the half second after 12 s of a recorded scope run:
+ *   ./scope -o run.csv speed power && ./runlog import run.csv run.log
+ *   ./runlog dump -f 12 -t 12.5 run.log
+ *
+ * Build from the repository root:
+ *   c++ -std=c++11 -O2 -Wall host/runlog_tool.cpp host/runlog.cpp -o runlog
+ * ========================================
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "runlog.h"
+
+namespace {
+
+const double US_PER_S = 1e6;
+
+const char *const type_names[] = {"f32", "f64", "i32", "u32", "i64"};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start).count();
+}
+
+int usage() {
+    std::fprintf(stderr,
+                 "usage: runlog info log...\n"
+                 "       runlog dump [-f seconds] [-t seconds] log\n"
+                 "       runlog import [-a] [-s] csv log\n"
+                 "       runlog bench [-n rows] [-c columns] log\n");
+    return 2;
+}
+
+int info(int argc, char **argv) {
+    if (argc < 1)
+        return usage();
+    for (int i = 0; i < argc; i++) {
+        runlog::Reader log;
+        if (!log.open(argv[i])) {
+            std::fprintf(stderr, "%s\n", log.error().c_str());
+            return 1;
+        }
+        std::printf("%s: %" PRIu64 " rows in %" PRIu64 " blocks\n", argv[i],
+                    log.rows(), log.num_blocks());
+        if (log.num_blocks() > 0)
+            std::printf("  time %.6f to %.6f s\n",
+                        log.index()[0].first_time / US_PER_S,
+                        log.index()[log.num_blocks() - 1].last_time / US_PER_S);
+        for (unsigned c = 0; c < log.num_columns(); c++)
+            std::printf("  %-12s %s\n", log.column_name(c),
+                        type_names[log.column_type(c)]);
+    }
+    return 0;
+}
+
+int dump(int argc, char **argv) {
+    double from = -INFINITY, to = INFINITY;
+    int i;
+
+    for (i = 0; i < argc && argv[i][0] == '-'; i++) {
+        if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            from = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            to = std::atof(argv[++i]);
+        else
+            return usage();
+    }
+    if (i + 1 != argc)
+        return usage();
+
+    runlog::Reader log;
+    if (!log.open(argv[i])) {
+        std::fprintf(stderr, "%s\n", log.error().c_str());
+        return 1;
+    }
+    int64_t start = std::isinf(from) ? INT64_MIN
+                                     : static_cast<int64_t>(std::ceil(from * US_PER_S));
+    int64_t end = std::isinf(to) ? INT64_MAX
+                                 : static_cast<int64_t>(std::ceil(to * US_PER_S));
+
+    std::printf("time");
+    for (unsigned c = 1; c < log.num_columns(); c++)
+        std::printf(",%s", log.column_name(c));
+    std::printf("\n");
+    for (const runlog::Slice &s : log.range(start, end)) {
+        for (size_t r = 0; r < s.rows(); r++) {
+            std::printf("%.6f", s.time()[r] / US_PER_S);
+            for (unsigned c = 1; c < log.num_columns(); c++)
+                std::printf(",%.9g", s.value(c, r));
+            std::printf("\n");
+        }
+    }
+    return 0;
+}
+
+// Splits a CSV line into fields
+std::vector<std::string> split(const std::string &line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+
+    while (std::getline(ss, field, ','))
+        fields.push_back(field);
+    return fields;
+}
+
+int import(int argc, char **argv) {
+    bool append = false, single = false;
+    int i;
+
+    for (i = 0; i < argc && argv[i][0] == '-'; i++) {
+        if (std::strcmp(argv[i], "-a") == 0)
+            append = true;
+        else if (std::strcmp(argv[i], "-s") == 0)
+            single = true;
+        else
+            return usage();
+    }
+    if (i + 2 != argc)
+        return usage();
+
+    std::ifstream in(argv[i]);
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+        std::fprintf(stderr, "%s: can't read\n", argv[i]);
+        return 1;
+    }
+    std::vector<std::string> names = split(line);
+    std::vector<runlog::Column> columns;
+    for (size_t c = 1; c < names.size(); c++)
+        columns.push_back({names[c], single ? runlog::F32 : runlog::F64});
+
+    runlog::Writer log;
+    if (!(append ? log.append_to(argv[i + 1], columns)
+                 : log.create(argv[i + 1], columns))) {
+        std::fprintf(stderr, "%s\n", log.error().c_str());
+        return 1;
+    }
+    uint64_t before = log.rows();
+    std::vector<double> values(columns.size());
+    unsigned skipped = 0;
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields = split(line);
+        if (fields.size() != names.size()) {
+            skipped++;
+            continue;
+        }
+        for (size_t c = 0; c < values.size(); c++)
+            values[c] = std::atof(fields[c + 1].c_str());
+        int64_t time = std::llround(std::atof(fields[0].c_str()) * US_PER_S);
+        if (!log.append(time, values.data())) {
+            std::fprintf(stderr, "%s\n", log.error().c_str());
+            return 1;
+        }
+    }
+    uint64_t imported = log.rows() - before;
+    log.close();
+    std::printf("%" PRIu64 " rows imported", imported);
+    if (skipped > 0)
+        std::printf(", %u lines skipped", skipped);
+    std::printf("\n");
+    return 0;
+}
+
+// The made up value of column c in row r, exact in a float
+float bench_value(uint64_t r, unsigned c) {
+    return static_cast<float>((r * 7 + c) % 65536) * 0.25f;
+}
+
+int bench(int argc, char **argv) {
+    uint64_t rows = 10000000;
+    unsigned num_columns = 8;
+    const int64_t period = 1000;  // microseconds between rows
+    int i;
+
+    for (i = 0; i < argc && argv[i][0] == '-'; i++) {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            rows = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            num_columns = std::atoi(argv[++i]);
+        else
+            return usage();
+    }
+    if (i + 1 != argc || num_columns < 1 ||
+            num_columns >= runlog::MAX_COLUMNS)
+        return usage();
+    const char *path = argv[i];
+
+    std::vector<runlog::Column> columns;
+    for (unsigned c = 0; c < num_columns; c++)
+        columns.push_back({"v" + std::to_string(c), runlog::F32});
+
+    // Write
+    auto start = std::chrono::steady_clock::now();
+    {
+        runlog::Writer log;
+        std::vector<double> values(num_columns);
+        uint64_t max_blocks = rows / runlog::DEFAULT_ROWS_PER_BLOCK + 1;
+        if (!log.create(path, columns, runlog::DEFAULT_ROWS_PER_BLOCK,
+                        max_blocks)) {
+            std::fprintf(stderr, "%s\n", log.error().c_str());
+            return 1;
+        }
+        for (uint64_t r = 0; r < rows; r++) {
+            for (unsigned c = 0; c < num_columns; c++)
+                values[c] = bench_value(r, c);
+            if (!log.append(static_cast<int64_t>(r) * period, values.data())) {
+                std::fprintf(stderr, "%s\n", log.error().c_str());
+                return 1;
+            }
+        }
+    }
+    double write_time = seconds_since(start);
+    double bytes = static_cast<double>(rows) * (8 + 4 * num_columns);
+    std::printf("wrote %" PRIu64 " rows of %u columns in %.2f s, %.0f MB/s\n",
+                rows, num_columns, write_time, bytes / write_time / 1e6);
+
+    // Open
+    start = std::chrono::steady_clock::now();
+    runlog::Reader log;
+    if (!log.open(path)) {
+        std::fprintf(stderr, "%s\n", log.error().c_str());
+        return 1;
+    }
+    double open_time = seconds_since(start);
+    std::printf("opened in %.1f us: %" PRIu64 " rows\n", open_time * 1e6,
+                log.rows());
+    bool ok = log.rows() == rows;
+
+    // Read random one second windows, checking every row is there once
+    std::mt19937_64 random(1);
+    const unsigned windows = 1000;
+    const int64_t window = 1000000;
+    uint64_t read = 0;
+    double sum = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (unsigned w = 0; w < windows && rows > 0; w++) {
+        int64_t from = static_cast<int64_t>(random() % rows) * period - 500;
+        uint64_t expect = from < 0 ? 0 : (from + period - 1) / period;
+        for (const runlog::Slice &s : log.range(from, from + window)) {
+            const int64_t *time = s.time();
+            for (unsigned c = 0; c < num_columns; c++) {
+                const float *v = s.column<float>(c + 1);
+                for (size_t r = 0; r < s.rows(); r++) {
+                    uint64_t row = expect + r;
+                    ok = ok && v[r] == bench_value(row, c) &&
+                         time[r] == static_cast<int64_t>(row) * period;
+                    sum += v[r];
+                }
+            }
+            expect += s.rows();
+            read += s.rows();
+        }
+        uint64_t last = std::min<uint64_t>(rows, (from + window + period - 1) / period);
+        ok = ok && expect == last;
+    }
+    double read_time = seconds_since(start);
+    std::printf("read %u one second windows, %" PRIu64 " rows, in %.3f s: "
+                "%.1f us a window, %.0f M values/s\n",
+                windows, read, read_time, read_time / windows * 1e6,
+                read * num_columns / read_time / 1e6);
+    if (sum < 0.0)
+        std::printf("%g\n", sum);  // keeps the reads from being optimized out
+    std::printf("%s\n", ok ? "every value checked" : "FAIL values read wrong");
+    return ok ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2)
+        return usage();
+    std::string command = argv[1];
+    if (command == "info")
+        return info(argc - 2, argv + 2);
+    if (command == "dump")
+        return dump(argc - 2, argv + 2);
+    if (command == "import")
+        return import(argc - 2, argv + 2);
+    if (command == "bench")
+        return bench(argc - 2, argv + 2);
+    return usage();
+}
+
+//[] END OF FILE
@@ -0,0 +1,237 @@
+/* ========================================
+ * scope.cpp
+ * Monica Lu and Victor Ying
+ *
+ * Streams variables from the car over its USB serial port (see
+ * scope.h) and writes them to a CSV file for plotting: a column
+ * of seconds since the first sample, the sample number, and one
+ * column per variable. Starts the stream with the shell's scope
+ * command, and stops it again on Ctrl-C or after -t seconds.
+ *
+ * Samples lost on the way show up as gaps in the sample numbers.
+ * At the end it says how many there were, and how many of them the
+ * car counted as dropped because USB couldn't keep up; the rest
+ * were frames corrupted or lost between the car and here.
+ *   ./scope -d /dev/ttyACM0 -r 2 -o run.csv speed setpoint power
+ * sim/scope_sim -p serves the firmware's shell on a pseudo-terminal
+ * to try this against.
+ *
+ * Build from the repository root:
+ *   c++ -std=c++11 -O2 -Wall host/scope.cpp host/serial.cpp -o scope
+ *   ./scope [-d device] [-r decimation] [-t seconds] [-o file] variable...
+ * ========================================
+ */
+
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+#include "serial.h"
+
+namespace {
+
+// Must match scope.h and the names in scope.c
+const uint8_t SYNC = 0x03;
+const unsigned MAX_BODY = 61;
+const unsigned HEADER = 12;
+const double PERIOD = 0.01;  // seconds per decimation step
+const char *const var_names[] = {
+    "speed", "setpoint", "power", "dist", "steer", "meas", "x", "y", "err",
+};
+const unsigned NUM_VARS = sizeof(var_names) / sizeof(*var_names);
+
+volatile std::sig_atomic_t stop = 0;
+
+void on_signal(int) { stop = 1; }
+
+double seconds_now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+uint32_t get_u32(const uint8_t *bytes) {
+    return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 |
+           uint32_t(bytes[2]) << 8 | bytes[3];
+}
+
+float get_float(const uint8_t *bytes) {
+    uint32_t u = get_u32(bytes);
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+struct Totals {
+    uint64_t samples = 0, frames = 0, corrupt = 0, bytes = 0;
+    uint64_t missing = 0;  // gaps in the sample numbers
+    unsigned dropped = 0;  // as the car counted them
+};
+
+// Turns frames into CSV rows, keeping track of what was lost
+class Writer {
+public:
+    Writer(FILE *out, uint16_t mask) : out_(out), mask_(mask) {
+        std::fprintf(out_, "time,seq");
+        for (unsigned v = 0; v < NUM_VARS; v++)
+            if (mask_ & (1u << v))
+                std::fprintf(out_, ",%s", var_names[v]);
+        std::fprintf(out_, "\n");
+    }
+
+    void frame(const uint8_t *body, unsigned len, Totals &totals) {
+        uint16_t mask = uint16_t(body[0] << 8 | body[1]);
+        uint16_t seq = uint16_t(body[2] << 8 | body[3]);
+        uint32_t time = get_u32(body + 4);
+        unsigned decimation = body[10], count = body[11];
+        unsigned n = 0;
+
+        for (unsigned v = 0; v < NUM_VARS; v++)
+            n += (mask >> v) & 1u;
+        if (mask != mask_ || len != HEADER + count * 4 * n) {
+            totals.corrupt++;  // or left over from an earlier stream
+            return;
+        }
+        totals.frames++;
+        totals.dropped = uint16_t(body[8] << 8 | body[9]);
+
+        // Unwrap the 16 bit sample numbers and 32 bit microsecond clock
+        if (started_) {
+            seq_ += uint16_t(seq - uint16_t(seq_));
+            time_ += uint32_t(time - uint32_t(time_));
+            if (seq_ > next_seq_)
+                totals.missing += seq_ - next_seq_;
+        } else {
+            seq_ = seq;
+            time_ = time;
+            first_time_ = time;
+            started_ = true;
+        }
+
+        const uint8_t *value = body + HEADER;
+        for (unsigned k = 0; k < count; k++) {
+            double t = (time_ - first_time_) * 1e-6 + k * decimation * PERIOD;
+            std::fprintf(out_, "%.6f,%llu", t,
+                         static_cast<unsigned long long>(seq_ + k));
+            for (unsigned i = 0; i < n; i++, value += 4)
+                std::fprintf(out_, ",%.9g", get_float(value));
+            std::fprintf(out_, "\n");
+        }
+        totals.samples += count;
+        next_seq_ = seq_ + count;
+    }
+
+private:
+    FILE *out_;
+    uint16_t mask_;
+    bool started_ = false;
+    uint64_t seq_ = 0, next_seq_ = 0, time_ = 0, first_time_ = 0;
+};
+
+void usage(const char *name) {
+    std::fprintf(stderr,
+                 "usage: %s [-d device] [-r decimation] [-t seconds] "
+                 "[-o file] variable...\nvariables:", name);
+    for (unsigned v = 0; v < NUM_VARS; v++)
+        std::fprintf(stderr, " %s", var_names[v]);
+    std::fprintf(stderr, "\n");
+    std::exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const char *device = "/dev/ttyACM0";
+    const char *path = "scope.csv";
+    unsigned decimation = 1;
+    double duration = 0.0;
+    uint16_t mask = 0;
+    std::string command;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            device = argv[++i];
+        } else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            decimation = std::atoi(argv[++i]);
+            if (decimation < 1 || decimation > 255)
+                usage(argv[0]);
+        } else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            duration = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            unsigned v = 0;
+            while (v < NUM_VARS && std::strcmp(argv[i], var_names[v]) != 0)
+                v++;
+            if (v == NUM_VARS)
+                usage(argv[0]);
+            mask |= 1u << v;
+            command += std::string(" ") + argv[i];
+        }
+    }
+    if (mask == 0)
+        usage(argv[0]);
+
+    FILE *out = std::fopen(path, "w");
+    if (out == nullptr) {
+        std::perror(path);
+        return 1;
+    }
+    static char out_buf[1 << 16];
+    std::setvbuf(out, out_buf, _IOFBF, sizeof(out_buf));
+
+    serial::Link link(device);
+    link.command("scope off");
+    link.drain();
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    Writer writer(out, mask);
+    Totals totals;
+    std::vector<uint8_t> buf;
+    double start = seconds_now(), last_data = start;
+    link.command("scope " + std::to_string(decimation) + command);
+
+    while (!stop && (duration <= 0.0 || seconds_now() - start < duration)) {
+        size_t before = buf.size();
+        if (link.read(buf, 100)) {
+            totals.bytes += buf.size() - before;
+            last_data = seconds_now();
+            serial::take_frames(buf, SYNC, HEADER, MAX_BODY,
+                                [&](const uint8_t *body, unsigned len) {
+                                    writer.frame(body, len, totals);
+                                    return true;
+                                }, totals.corrupt);
+        } else if (seconds_now() - last_data > 2.0) {
+            std::fprintf(stderr, "nothing from the car for 2 seconds\n");
+            break;
+        }
+    }
+    double elapsed = seconds_now() - start;
+    link.command("scope off");
+    std::fclose(out);
+
+    std::fprintf(stderr,
+                 "%llu samples in %llu frames over %.1f s (%.0f bytes/s) "
+                 "to %s\n",
+                 static_cast<unsigned long long>(totals.samples),
+                 static_cast<unsigned long long>(totals.frames), elapsed,
+                 totals.bytes / elapsed, path);
+    std::fprintf(stderr,
+                 "%llu samples missing: %u dropped by the car, "
+                 "%llu corrupt frames\n",
+                 static_cast<unsigned long long>(totals.missing),
+                 totals.dropped,
+                 static_cast<unsigned long long>(totals.corrupt));
+    return totals.samples > 0 ? 0 : 1;
+}
+
+//[] END OF FILE
@@ -0,0 +1,127 @@
+/* ========================================
+ * serial.cpp
+ * Monica Lu and Victor Ying
+ *
+ * Opens the car's USB serial port and frames and unframes the
+ * binary frames described in serial.h.
+ * ========================================
+ */
+
+#include "serial.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace serial {
+
+Link::Link(const char *device) {
+    fd_ = ::open(device, O_RDWR | O_NOCTTY);
+    if (fd_ < 0) {
+        std::perror(device);
+        std::exit(1);
+    }
+    if (isatty(fd_)) {
+        struct termios t;
+        tcgetattr(fd_, &t);
+        cfmakeraw(&t);
+        cfsetspeed(&t, B115200);
+        tcsetattr(fd_, TCSANOW, &t);
+        tcflush(fd_, TCIFLUSH);
+    }
+}
+
+Link::~Link() { ::close(fd_); }
+
+void Link::command(const std::string &line) {
+    std::string text = line + "\r";
+    if (::write(fd_, text.data(), text.size()) !=
+            static_cast<ssize_t>(text.size()))
+        std::perror("write");
+}
+
+bool Link::write(const std::vector<uint8_t> &bytes) {
+    if (::write(fd_, bytes.data(), bytes.size()) !=
+            static_cast<ssize_t>(bytes.size())) {
+        std::perror("write");
+        return false;
+    }
+    return true;
+}
+
+bool Link::read(std::vector<uint8_t> &buf, int timeout_ms) {
+    uint8_t chunk[4096];
+    struct pollfd p = {fd_, POLLIN, 0};
+
+    if (poll(&p, 1, timeout_ms) <= 0)
+        return false;
+    ssize_t n = ::read(fd_, chunk, sizeof(chunk));
+    if (n <= 0)
+        return false;
+    buf.insert(buf.end(), chunk, chunk + n);
+    return true;
+}
+
+void Link::drain() {
+    std::vector<uint8_t> junk;
+    while (read(junk, 200))
+        junk.clear();
+}
+
+std::vector<uint8_t> frame(uint8_t sync, const std::vector<uint8_t> &body) {
+    std::vector<uint8_t> out;
+    uint8_t sum = static_cast<uint8_t>(body.size());
+
+    out.push_back(sync);
+    out.push_back(static_cast<uint8_t>(body.size()));
+    for (uint8_t b : body) {
+        out.push_back(b);
+        sum += b;
+    }
+    out.push_back(static_cast<uint8_t>(-sum));
+    return out;
+}
+
+void take_frames(std::vector<uint8_t> &buf, uint8_t sync, unsigned min_len,
+                 unsigned max_len, const FrameHandler &handler,
+                 uint64_t &corrupt) {
+    size_t i = 0;
+
+    while (i < buf.size()) {
+        if (buf[i] != sync) {
+            i++;
+            continue;
+        }
+        if (i + 2 > buf.size())
+            break;
+        unsigned len = buf[i + 1];
+        if (len > max_len || len < min_len) {
+            corrupt++;
+            i++;
+            continue;
+        }
+        if (i + len + 3 > buf.size())
+            break;
+        uint8_t sum = 0;
+        for (unsigned j = 1; j < len + 3; j++)
+            sum += buf[i + j];
+        if (sum != 0) {
+            corrupt++;
+            i++;
+            continue;
+        }
+        bool more = handler(&buf[i + 2], len);
+        i += len + 3;
+        if (!more)
+            break;
+    }
+    buf.erase(buf.begin(), buf.begin() + i);
+}
+
+}  // namespace serial
+
+//[] END OF FILE
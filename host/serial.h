@@ -0,0 +1,72 @@
+/* ========================================
+ * serial.h
+ * Monica Lu and Victor Ying
+ *
+ * The car's USB serial port, for the host tools that talk to its
+ * shell, and the binary frames the firmware sends over it (see
+ * param.h, scope.h and journal.h):
+ *
+ *   sync, length, body of length bytes, check
+ *
+ * where the check byte makes length, body and check add up to zero.
+ * Each kind of frame has its own sync byte, and text the shell
+ * prints may come between frames.
+ * ========================================
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace serial {
+
+class Link {
+public:
+    // Opens device, raw at 115200 baud if it is a terminal. Exits with a
+    // message if it can't be opened.
+    explicit Link(const char *device);
+    ~Link();
+    Link(const Link &) = delete;
+    Link &operator=(const Link &) = delete;
+
+    // Types a line at the shell
+    void command(const std::string &line);
+
+    // Sends bytes as they are. Returns false if they couldn't all be sent.
+    bool write(const std::vector<uint8_t> &bytes);
+
+    // Reads whatever arrives within timeout_ms onto the end of buf
+    bool read(std::vector<uint8_t> &buf, int timeout_ms);
+
+    // Throws away anything arriving until the line has been quiet a while
+    void drain();
+
+private:
+    int fd_;
+};
+
+// Returns body framed with the given sync byte. body must be no more than
+// 255 bytes.
+std::vector<uint8_t> frame(uint8_t sync, const std::vector<uint8_t> &body);
+
+// Called with each frame's body. Returns false to leave the rest of the
+// buffer for later.
+typedef std::function<bool(const uint8_t *body, unsigned len)> FrameHandler;
+
+// Takes every whole frame with the given sync byte off the front of buf,
+// skipping text between them, and passes its body to handler. Frames
+// with a length outside min_len to max_len, or the wrong check byte, are
+// skipped and counted in corrupt.
+void take_frames(std::vector<uint8_t> &buf, uint8_t sync, unsigned min_len,
+                 unsigned max_len, const FrameHandler &handler,
+                 uint64_t &corrupt);
+
+}  // namespace serial
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,946 @@
+/* ========================================
+ * telemetry.cpp
+ * Monica Lu and Victor Ying
+ *
+ * Collects position fixes from any number of cars at once, in
+ * place of XBeePlot.m. Each car's radio is a serial port (or a
+ * pseudo-terminal standing in for one); every port is read as its
+ * data arrives, with epoll, and the fixes the cars send as lines
+ * like "2:X1.25Y-3.50" are:
+ *   - recorded, one run log per car (see runlog.h), with -o
+ *   - sent to every program connected to a local socket, with -s,
+ *     as lines of "car seconds x y", for plotting them live:
+ *         socat - UNIX-CONNECT:/tmp/carlab.sock
+ *     A program that falls behind misses lines rather than holding
+ *     up the rest.
+ * A fix is from the car numbered before the colon, which is how
+ * several cars share the base station's radio (see radio.h), or,
+ * from a car that doesn't send a number, from the car numbered by
+ * the place of its port among those given. Ctrl-C stops it, and it
+ * prints what each port and car sent.
+ *
+ * "telemetry test" checks the server against pseudo-terminals:
+ * lines split across reads, garbage, overlong lines, a radio going
+ * away, what reaches the recorder and the socket. "telemetry bench"
+ * measures how many fixes a second it keeps up with from many
+ * cars at once.
+ *
+ * Build from the repository root:
+ *   c++ -std=c++11 -O2 -Wall -pthread host/telemetry.cpp host/runlog.cpp \
+ *       -o telemetry
+ *   ./telemetry [-b baud] [-o directory] [-s socket] port...
+ *   ./telemetry test
+ *   ./telemetry bench [-n cars] [-f fixes per car] [-o directory]
+ * ========================================
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "runlog.h"
+
+namespace {
+
+const size_t MAX_LINE = 64;  // only the end of a longer line is kept
+const unsigned MAX_CARS = 256;
+const size_t MAX_CLIENT_BACKLOG = 64 * 1024;  // bytes queued for one client
+const int FLUSH_INTERVAL = 1;  // seconds between recorder flushes
+const unsigned MAX_EVENTS = 64;
+
+struct Fix {
+    int64_t time;  // microseconds since the epoch, when it arrived
+    unsigned car;
+    float x, y;
+};
+
+int64_t now_us() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return int64_t(t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+}
+
+/*
+ * Parses a fix line as radio_report_fix() sends it: the car's number, a
+ * colon, X, a number, Y, a number. Anything before the last X that isn't
+ * the car's number is ignored, as XBeePlot.m did, since the transmitters'
+ * latency tests (binary, NULs and all) share the channel and run into the
+ * start of the line. car is -1 if the line has no number.
+ */
+bool parse_fix(const char *line, size_t len, int &car, float &x, float &y) {
+    const char *p = line + len;
+    char *end;
+
+    while (p > line && *--p != 'X')
+        ;
+    if (*p != 'X')
+        return false;
+    car = -1;
+    if (p > line && p[-1] == ':') {
+        const char *digits = p - 1;
+        unsigned number = 0, scale = 1;
+        while (digits > line && digits[-1] >= '0' && digits[-1] <= '9' &&
+               scale < 1000) {
+            digits--;
+            number += (*digits - '0') * scale;
+            scale *= 10;
+        }
+        if (digits < p - 1 && number < MAX_CARS)
+            car = static_cast<int>(number);
+    }
+    x = std::strtof(p + 1, &end);
+    if (end == p + 1 || *end != 'Y')
+        return false;
+    p = end + 1;
+    y = std::strtof(p, &end);
+    if (end == p || !std::isfinite(x) || !std::isfinite(y))
+        return false;
+    while (end < line + len && (*end == '\r' || *end == ' '))
+        end++;
+    return end == line + len;
+}
+
+int baud_constant(unsigned baud) {
+    switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default: return -1;
+    }
+}
+
+// One car's radio
+struct Port {
+    std::string path;
+    int fd = -1;
+    unsigned car = 0;
+    char line[MAX_LINE + 1];
+    size_t len = 0;
+    uint64_t bytes = 0, fixes = 0, bad_lines = 0;
+};
+
+// A program reading fixes from the socket
+struct Client {
+    int fd = -1;
+    std::string out;  // queued, not yet written
+    uint64_t dropped = 0;  // lines that didn't fit in out
+};
+
+// What epoll tells us about, kept in epoll_event.data.u64
+enum Source : uint32_t {
+    SOURCE_PORT = 0,
+    SOURCE_LISTEN = 1,
+    SOURCE_CLIENT = 2,
+    SOURCE_TIMER = 3,
+    SOURCE_STOP = 4,
+};
+
+uint64_t tag(Source source, uint32_t index) {
+    return uint64_t(source) << 32 | index;
+}
+
+class Server {
+public:
+    ~Server();
+
+    // Each of these returns false, having said why, if it can't
+    bool add_port(const std::string &path, unsigned baud);
+    bool record_to(const std::string &directory);
+    bool listen_on(const std::string &path);
+
+    // Runs until stop_fd() is written to or every port has gone away
+    bool run();
+
+    // An eventfd (or signalfd) that stops run() when readable
+    void stop_on(int fd) { stop_fd_ = fd; }
+
+    void print_stats(FILE *out) const;
+
+    const std::vector<Port> &ports() const { return ports_; }
+    uint64_t fixes() const { return fixes_.load(); }
+    unsigned clients() const { return num_clients_.load(); }
+
+private:
+    bool watch(int fd, uint32_t events, uint64_t data);
+    void read_port(Port &port);
+    void handle_line(Port &port, int64_t time);
+    void accept_clients();
+    void write_client(size_t index);
+    void drop_client(Client &c);
+    void broadcast(const Fix &fix);
+    runlog::Writer *recorder(unsigned car);
+    void flush_recorders();
+    void finish();
+
+    int epoll_fd_ = -1;
+    int listen_fd_ = -1;
+    int timer_fd_ = -1;
+    int stop_fd_ = -1;
+    std::string socket_path_;
+    std::string directory_;
+    std::vector<Port> ports_;
+    std::vector<std::unique_ptr<runlog::Writer>> recorders_;
+    std::vector<int64_t> last_time_;  // keeps each recorder's time from going back
+    std::vector<uint64_t> car_fixes_;
+    std::vector<Client> clients_;
+    std::atomic<uint64_t> fixes_{0};
+    std::atomic<unsigned> num_clients_{0};
+};
+
+Server::~Server() {
+    for (Port &p : ports_)
+        if (p.fd >= 0)
+            ::close(p.fd);
+    for (Client &c : clients_)
+        if (c.fd >= 0)
+            ::close(c.fd);
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        ::unlink(socket_path_.c_str());
+    }
+    if (timer_fd_ >= 0)
+        ::close(timer_fd_);
+    if (epoll_fd_ >= 0)
+        ::close(epoll_fd_);
+}
+
+bool Server::add_port(const std::string &path, unsigned baud) {
+    Port port;
+    int speed = baud_constant(baud);
+
+    if (speed < 0) {
+        std::fprintf(stderr, "unsupported baud rate %u\n", baud);
+        return false;
+    }
+    port.path = path;
+    port.car = static_cast<unsigned>(ports_.size());
+    port.fd = ::open(path.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (port.fd < 0) {
+        std::perror(path.c_str());
+        return false;
+    }
+    if (isatty(port.fd)) {
+        struct termios t;
+        tcgetattr(port.fd, &t);
+        cfmakeraw(&t);
+        cfsetspeed(&t, speed);
+        t.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(port.fd, TCSANOW, &t);
+    }
+    ports_.push_back(port);
+    return true;
+}
+
+bool Server::record_to(const std::string &directory) {
+    ::mkdir(directory.c_str(), 0755);
+    directory_ = directory;
+    return true;
+}
+
+bool Server::listen_on(const std::string &path) {
+    struct sockaddr_un addr;
+
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::fprintf(stderr, "%s: path too long\n", path.c_str());
+        return false;
+    }
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    ::unlink(path.c_str());
+    if (listen_fd_ < 0 ||
+            ::bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+                   sizeof(addr)) < 0 ||
+            ::listen(listen_fd_, 16) < 0) {
+        std::perror(path.c_str());
+        return false;
+    }
+    socket_path_ = path;
+    return true;
+}
+
+bool Server::watch(int fd, uint32_t events, uint64_t data) {
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.u64 = data;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        std::perror("epoll_ctl");
+        return false;
+    }
+    return true;
+}
+
+bool Server::run() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        std::perror("epoll_create1");
+        return false;
+    }
+    for (size_t i = 0; i < ports_.size(); i++)
+        if (!watch(ports_[i].fd, EPOLLIN, tag(SOURCE_PORT, i)))
+            return false;
+    if (listen_fd_ >= 0 && !watch(listen_fd_, EPOLLIN, tag(SOURCE_LISTEN, 0)))
+        return false;
+    if (stop_fd_ >= 0 && !watch(stop_fd_, EPOLLIN, tag(SOURCE_STOP, 0)))
+        return false;
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec period = {{FLUSH_INTERVAL, 0}, {FLUSH_INTERVAL, 0}};
+    if (timer_fd_ < 0 || timerfd_settime(timer_fd_, 0, &period, nullptr) < 0 ||
+            !watch(timer_fd_, EPOLLIN, tag(SOURCE_TIMER, 0)))
+        return false;
+
+    size_t open_ports = ports_.size();
+    struct epoll_event events[MAX_EVENTS];
+    while (open_ports > 0) {
+        int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            std::perror("epoll_wait");
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+            uint32_t index = static_cast<uint32_t>(events[i].data.u64);
+            switch (static_cast<Source>(events[i].data.u64 >> 32)) {
+            case SOURCE_PORT:
+                read_port(ports_[index]);
+                if (ports_[index].fd < 0)
+                    open_ports--;
+                break;
+            case SOURCE_LISTEN:
+                accept_clients();
+                break;
+            case SOURCE_CLIENT:
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    drop_client(clients_[index]);
+                else
+                    write_client(index);
+                break;
+            case SOURCE_TIMER: {
+                uint64_t expirations;
+                if (::read(timer_fd_, &expirations, sizeof(expirations)) > 0)
+                    flush_recorders();
+                break;
+            }
+            case SOURCE_STOP:
+                finish();
+                return true;
+            }
+        }
+    }
+    finish();
+    return true;
+}
+
+void Server::finish() {
+    flush_recorders();
+
+    // Readers get a second to take what's queued for them, then the end
+    // of the stream
+    for (Client &c : clients_) {
+        struct timeval timeout = {1, 0};
+        if (c.fd < 0)
+            continue;
+        fcntl(c.fd, F_SETFL, fcntl(c.fd, F_GETFL) & ~O_NONBLOCK);
+        setsockopt(c.fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL) < 0)
+            c.dropped += std::count(c.out.begin(), c.out.end(), '\n');
+        drop_client(c);
+    }
+}
+
+void Server::read_port(Port &port) {
+    char buf[4096];
+
+    for (;;) {
+        ssize_t n = ::read(port.fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return;
+        if (n <= 0) {
+            // Unplugged, or the other end of a pseudo-terminal closed
+            std::fprintf(stderr, "%s: closed\n", port.path.c_str());
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, port.fd, nullptr);
+            ::close(port.fd);
+            port.fd = -1;
+            return;
+        }
+        int64_t time = now_us();  // close enough for every line in buf
+        port.bytes += n;
+        for (ssize_t i = 0; i < n; i++) {
+            char c = buf[i];
+            if (c == '\n') {
+                handle_line(port, time);
+                port.len = 0;
+            } else {
+                if (port.len == MAX_LINE) {
+                    // Keep the end, where a fix after the latency tests is
+                    std::memmove(port.line, port.line + 1, MAX_LINE - 1);
+                    port.len--;
+                }
+                port.line[port.len++] = c;
+            }
+        }
+    }
+}
+
+void Server::handle_line(Port &port, int64_t time) {
+    Fix fix;
+    int car;
+
+    port.line[port.len] = '\0';
+    if (port.len == 0)
+        return;
+    if (!parse_fix(port.line, port.len, car, fix.x, fix.y)) {
+        port.bad_lines++;
+        return;
+    }
+    fix.time = time;
+    fix.car = car >= 0 ? unsigned(car) : port.car;
+    port.fixes++;
+    if (fix.car >= car_fixes_.size())
+        car_fixes_.resize(fix.car + 1);
+    car_fixes_[fix.car]++;
+
+    runlog::Writer *r = recorder(fix.car);
+    if (r != nullptr) {
+        double values[2] = {fix.x, fix.y};
+        int64_t &last = last_time_[fix.car];
+        last = std::max(last, fix.time);  // the wall clock can step back
+        if (!r->append(last, values))
+            std::fprintf(stderr, "car %u: %s\n", fix.car, r->error().c_str());
+    }
+    broadcast(fix);
+    fixes_++;
+}
+
+// Returns the car's recorder, opening it with its first fix, or null if
+// not recording
+runlog::Writer *Server::recorder(unsigned car) {
+    if (directory_.empty())
+        return nullptr;
+    if (car >= recorders_.size()) {
+        recorders_.resize(car + 1);
+        last_time_.resize(car + 1, INT64_MIN);
+    }
+    if (!recorders_[car]) {
+        std::string path = directory_ + "/car" + std::to_string(car) + ".log";
+        std::unique_ptr<runlog::Writer> w(new runlog::Writer);
+        if (!w->append_to(path, {{"x", runlog::F32}, {"y", runlog::F32}})) {
+            std::fprintf(stderr, "%s\n", w->error().c_str());
+            return nullptr;
+        }
+        recorders_[car] = std::move(w);
+    }
+    return recorders_[car].get();
+}
+
+void Server::accept_clients() {
+    for (;;) {
+        int fd = ::accept4(listen_fd_, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        size_t index = 0;
+        while (index < clients_.size() && clients_[index].fd >= 0)
+            index++;
+        if (index == clients_.size())
+            clients_.emplace_back();
+        clients_[index] = Client();
+        clients_[index].fd = fd;
+        num_clients_++;
+        watch(fd, EPOLLOUT | EPOLLET, tag(SOURCE_CLIENT, index));
+    }
+}
+
+void Server::write_client(size_t index) {
+    Client &c = clients_[index];
+
+    while (!c.out.empty()) {
+        ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return;  // EPOLLOUT will say when there's room
+        if (n <= 0) {
+            drop_client(c);
+            return;
+        }
+        c.out.erase(0, n);
+    }
+}
+
+void Server::drop_client(Client &c) {
+    if (c.fd < 0)
+        return;
+    ::close(c.fd);
+    c.fd = -1;
+    c.out.clear();
+    num_clients_--;
+}
+
+void Server::broadcast(const Fix &fix) {
+    char line[96];
+    int len;
+
+    if (clients_.empty())
+        return;
+    len = std::snprintf(line, sizeof(line), "%u %" PRId64 ".%06" PRId64
+                        " %.2f %.2f\n", fix.car, fix.time / 1000000,
+                        fix.time % 1000000, fix.x, fix.y);
+    for (size_t i = 0; i < clients_.size(); i++) {
+        Client &c = clients_[i];
+        if (c.fd < 0)
+            continue;
+        if (c.out.size() + len > MAX_CLIENT_BACKLOG) {
+            c.dropped++;
+            continue;
+        }
+        bool idle = c.out.empty();
+        c.out.append(line, len);
+        if (idle)
+            write_client(i);
+    }
+}
+
+void Server::flush_recorders() {
+    for (auto &r : recorders_)
+        if (r)
+            r->flush();
+}
+
+void Server::print_stats(FILE *out) const {
+    for (const Port &p : ports_)
+        std::fprintf(out, "%s: %" PRIu64 " bytes, %" PRIu64 " fixes, %"
+                     PRIu64 " bad lines\n", p.path.c_str(), p.bytes, p.fixes,
+                     p.bad_lines);
+    for (size_t car = 0; car < car_fixes_.size(); car++)
+        if (car_fixes_[car] > 0)
+            std::fprintf(out, "car %zu: %" PRIu64 " fixes\n", car,
+                         car_fixes_[car]);
+    uint64_t dropped = 0;
+    for (const Client &c : clients_)
+        dropped += c.dropped;
+    std::fprintf(out, "socket: %u readers, %" PRIu64 " lines dropped for "
+                 "slow readers\n", num_clients_.load(), dropped);
+}
+
+void usage(const char *name) {
+    std::fprintf(stderr,
+                 "usage: %s [-b baud] [-o directory] [-s socket] port...\n"
+                 "       %s test\n"
+                 "       %s bench [-n cars] [-f fixes per car] [-o directory]\n",
+                 name, name, name);
+    std::exit(2);
+}
+
+// ---- Pseudo-terminals standing in for radios ----
+
+// The master side of a pseudo-terminal, written to as a car would
+struct FakeRadio {
+    int master = -1;
+    std::string slave;
+
+    bool open() {
+        master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+            std::perror("pty");
+            return false;
+        }
+        slave = ptsname(master);
+        return true;
+    }
+
+    bool send(const std::string &data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = ::write(master, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            done += n;
+        }
+        return true;
+    }
+
+    void close() {
+        if (master >= 0)
+            ::close(master);
+        master = -1;
+    }
+};
+
+// Runs a server on its own thread until stop() or every radio closes
+class Running {
+public:
+    explicit Running(Server &server) : server_(server) {
+        stop_ = eventfd(0, EFD_CLOEXEC);
+        server_.stop_on(stop_);
+        thread_ = std::thread([this] { ok_ = server_.run(); });
+    }
+    ~Running() { stop(); ::close(stop_); }
+
+    bool stop() {
+        if (thread_.joinable()) {
+            uint64_t one = 1;
+            if (::write(stop_, &one, sizeof(one)) < 0)
+                std::perror("eventfd");
+            thread_.join();
+        }
+        return ok_;
+    }
+
+    bool wait() {
+        if (thread_.joinable())
+            thread_.join();
+        return ok_;
+    }
+
+private:
+    Server &server_;
+    int stop_;
+    std::thread thread_;
+    bool ok_ = false;
+};
+
+unsigned failures = 0;
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        std::printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+int connect_to(const std::string &path) {
+    struct sockaddr_un addr;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    if (fd < 0 || ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                            sizeof(addr)) < 0) {
+        std::perror("connect");
+        return -1;
+    }
+    return fd;
+}
+
+std::string read_all(int fd) {
+    std::string got;
+    char buf[4096];
+    ssize_t n;
+
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+        got.append(buf, n);
+    return got;
+}
+
+// Waits up to 10 s for the server to have decoded fixes fixes
+bool wait_for(const Server &server, uint64_t fixes) {
+    for (int i = 0; i < 10000 && server.fixes() < fixes; i++)
+        usleep(1000);
+    return server.fixes() == fixes;
+}
+
+std::string fix_line(float x, float y) {
+    char line[48];
+    std::snprintf(line, sizeof(line), "X%.2fY%.2f\n", x, y);
+    return line;
+}
+
+int test() {
+    char dir_template[] = "/tmp/telemetry_testXXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string dir = dir_template, sock = dir + "/sock";
+
+    {
+        auto parse = [](const std::string &line, int &car, float &x, float &y) {
+            return parse_fix(line.c_str(), line.size(), car, x, y);
+        };
+        float x = 0, y = 0;
+        int car = 0;
+        check(parse("X1.25Y-3.50", car, x, y) && x == 1.25f && y == -3.5f &&
+              car == -1, "parses a fix");
+        check(parse("garbageX-1.5Y2\r", car, x, y) && x == -1.5f && y == 2.0f,
+              "skips text before X and a CR after");
+        check(parse("12:X0.5Y1", car, x, y) && car == 12 && x == 0.5f,
+              "parses the car's number");
+        check(parse(std::string("\x01X\0\x7f" "3:X2Y-2", 11), car, x, y) &&
+              car == 3 && x == 2.0f && y == -2.0f,
+              "finds a fix after a latency test");
+        check(parse("99999:X1Y1", car, x, y) && car == -1,
+              "ignores a number too big for a car");
+        check(!parse("X1.25", car, x, y), "refuses a fix with no Y");
+        check(!parse("X1.2.5Y3", car, x, y), "refuses a malformed number");
+        check(!parse("X1Y2junk", car, x, y), "refuses trailing junk");
+        check(!parse(std::string("X1Y2\0", 5), car, x, y), "refuses a NUL after");
+        check(!parse("XnanY2", car, x, y), "refuses NaN");
+    }
+
+    // Three cars with radios of their own, which don't send their numbers,
+    // and a base station's radio that cars 7 and 8 share with the
+    // transmitters' latency tests
+    const unsigned radios_used = 4, base = 3, per_car = 500;
+    const unsigned cars[] = {0, 1, 2, 7, 8};
+    const unsigned num_cars = sizeof(cars) / sizeof(cars[0]);
+    FakeRadio radios[radios_used];
+    Server server;
+    for (unsigned r = 0; r < radios_used; r++)
+        if (!radios[r].open() || !server.add_port(radios[r].slave, 9600))
+            return 1;
+    server.record_to(dir);
+    if (!server.listen_on(sock))
+        return 1;
+    Running running(server);
+    int client = connect_to(sock);
+    std::string got;
+    std::thread reader([client, &got] { got = read_all(client); });
+    int stuck = connect_to(sock);  // never reads, and mustn't hold anything up
+    while (server.clients() < 2)
+        usleep(1000);
+
+    // Each radio sends its fixes with some noise, split at awkward places
+    std::string data[radios_used];
+    for (unsigned r = 0; r < radios_used; r++)
+        data[r] = "\n";  // what a radio might start with
+    for (unsigned i = 0; i < per_car; i++) {
+        for (unsigned c = 0; c < num_cars; c++) {
+            std::string line = fix_line(cars[c] * 100.0f + i * 0.25f, -0.5f * i);
+            if (c < base) {
+                data[c] += line;
+                continue;
+            }
+            // A latency test runs into the line, longer than one at times
+            std::string test("\x01\0\x80X\n\x02", 6);
+            data[base] += test.substr(0, 2 + i % 5) +
+                          std::string(i % 100 == 30 ? 80 : 0, 'X') +
+                          std::to_string(cars[c]) + ":" + line;
+        }
+        for (unsigned r = 0; r < radios_used; r++) {
+            if (i % 100 == 50)
+                data[r] += "noise without a newline then" + std::string(80, '#') + "\n";
+            if (i % 100 == 70)
+                data[r] += "Xgarbage\n";
+        }
+    }
+    for (unsigned r = 0; r < radios_used; r++)
+        for (size_t at = 0; at < data[r].size(); at += 7 + at % 13)
+            radios[r].send(data[r].substr(at, 7 + at % 13));
+
+    // Closing a pseudo-terminal's master throws away what the server
+    // hasn't read yet, as unplugging a radio would
+    check(wait_for(server, num_cars * per_car), "server kept up");
+    for (unsigned r = 0; r < radios_used; r++)
+        radios[r].close();
+    check(running.wait(), "server stops when every radio has gone");
+
+    for (unsigned r = 0; r < radios_used; r++) {
+        const Port &p = server.ports()[r];
+        check(p.fixes == (r == base ? 2 : 1) * per_car, "every fix decoded");
+        check(p.fd < 0, "closed radio noticed");
+    }
+    // The test bytes before a fix are dropped with the line before, so
+    // some lines of them are bad too
+    check(server.ports()[0].bad_lines == 2 * (per_car / 100),
+          "noise counted as bad lines");
+
+    // The socket got every fix, in order for each car
+    reader.join();
+    ::close(client);
+    ::close(stuck);
+    std::string per[num_cars];
+    size_t start = 0, lines = 0;
+    while (start < got.size()) {
+        size_t end = got.find('\n', start);
+        if (end == std::string::npos)
+            break;
+        std::string line = got.substr(start, end - start);
+        unsigned car;
+        char when[32];
+        float x, y;
+        if (std::sscanf(line.c_str(), "%u %31s %f %f", &car, when, &x, &y) == 4) {
+            char again[48];
+            std::snprintf(again, sizeof(again), "%.2fY%.2f\n", x, y);
+            for (unsigned c = 0; c < num_cars; c++)
+                if (cars[c] == car)
+                    per[c] += again;
+        }
+        lines++;
+        start = end + 1;
+    }
+    check(lines == num_cars * per_car, "socket got every fix");
+    for (unsigned c = 0; c < num_cars; c++) {
+        std::string want;
+        for (unsigned i = 0; i < per_car; i++) {
+            char line[48];
+            std::snprintf(line, sizeof(line), "%.2fY%.2f\n",
+                          cars[c] * 100.0f + i * 0.25f, -0.5f * i);
+            want += line;
+        }
+        check(per[c] == want, "socket got each car's fixes in order");
+    }
+
+    // And the recorder
+    for (unsigned c = 0; c < num_cars; c++) {
+        runlog::Reader log;
+        std::string path = dir + "/car" + std::to_string(cars[c]) + ".log";
+        check(log.open(path), "recorder wrote a log");
+        check(log.rows() == per_car, "recorder has every fix");
+        unsigned i = 0;
+        bool same = true;
+        for (const runlog::Slice &s : log.all()) {
+            const float *x = s.column<float>(1), *y = s.column<float>(2);
+            for (size_t r = 0; r < s.rows(); r++, i++)
+                same = same &&
+                       std::fabs(x[r] - (cars[c] * 100.0f + i * 0.25f)) < 0.006f &&
+                       std::fabs(y[r] - (-0.5f * i)) < 0.006f;
+        }
+        check(same, "recorded fixes match");
+        ::unlink(path.c_str());
+    }
+    ::rmdir(dir.c_str());
+    server.print_stats(stdout);
+
+    if (failures > 0) {
+        std::printf("%u checks failed\n", failures);
+        return 1;
+    }
+    std::printf("PASS\n");
+    return 0;
+}
+
+int bench(int argc, char **argv) {
+    unsigned cars = 16, per_car = 200000;
+    const char *directory = nullptr;
+
+    for (int i = 0; i < argc; i++) {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            cars = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            directory = argv[++i];
+        else if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            per_car = std::atoi(argv[++i]);
+        else
+            usage("telemetry");
+    }
+
+    std::vector<FakeRadio> radios(cars);
+    Server server;
+    for (unsigned c = 0; c < cars; c++)
+        if (!radios[c].open() || !server.add_port(radios[c].slave, 115200))
+            return 1;
+    if (directory != nullptr)
+        server.record_to(directory);
+
+    // Each car's whole run, ready to write as fast as the pty takes it
+    std::vector<std::string> data(cars);
+    for (unsigned c = 0; c < cars; c++)
+        for (unsigned i = 0; i < per_car; i++)
+            data[c] += fix_line((i % 2400) * 0.01f - 12.0f, (i % 3400) * 0.01f - 17.0f);
+
+    auto start = std::chrono::steady_clock::now();
+    Running running(server);
+    std::vector<std::thread> writers;
+    for (unsigned c = 0; c < cars; c++)
+        writers.emplace_back([&radios, &data, c] { radios[c].send(data[c]); });
+    for (auto &w : writers)
+        w.join();
+    wait_for(server, uint64_t(cars) * per_car);
+    for (unsigned c = 0; c < cars; c++)
+        radios[c].close();
+    running.wait();
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    uint64_t bytes = 0;
+    for (const Port &p : server.ports())
+        bytes += p.bytes;
+    std::printf("%u cars, %" PRIu64 " fixes in %.2f s: %.0f fixes/s, "
+                "%.1f MB/s\n", cars, server.fixes(), seconds,
+                server.fixes() / seconds, bytes / seconds / 1e6);
+    std::printf("a car at 9600 baud sends at most %u fixes/s\n", 960 / 12);
+    return server.fixes() == uint64_t(cars) * per_car ? 0 : 1;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    unsigned baud = 9600;
+    Server server;
+    bool any = false;
+
+    if (argc > 1 && std::strcmp(argv[1], "test") == 0)
+        return test();
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0)
+        return bench(argc - 2, argv + 2);
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            baud = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            server.record_to(argv[++i]);
+        } else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            if (!server.listen_on(argv[++i]))
+                return 1;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            if (!server.add_port(argv[i], baud))
+                return 1;
+            std::fprintf(stderr, "car %u: %s\n", unsigned(server.ports().size() - 1),
+                         argv[i]);
+            any = true;
+        }
+    }
+    if (!any)
+        usage(argv[0]);
+
+    // Ctrl-C stops the server through a signalfd, so it can flush first
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, nullptr);
+    server.stop_on(signalfd(-1, &stop_signals, SFD_CLOEXEC));
+
+    bool ok = server.run();
+    server.print_stats(stderr);
+    return ok ? 0 : 1;
+}
+
+//[] END OF FILE
@@ -0,0 +1,415 @@
+/* ========================================
+ * trace_decode.cpp
+ * Monica Lu and Victor Ying
+ *
+ * Decodes the event trace the car prints with the trace shell
+ * command (see trace.h), from a terminal log or a sim's output.
+ * Lines that aren't trace events are ignored, so the whole log can
+ * be fed in as is.
+ *
+ * Prints the events readably by default, grouped into one solve
+ * per set of pings. -c prints them as CSV instead, one row per
+ * event, for plotting; for example, to plot how fxy falls over
+ * the iterations of every solve with gnuplot:
+ *   ./trace_decode -c log.txt | grep ',iteration,' > it.csv
+ *   gnuplot -p -e "set datafile separator ','; set logscale y; \
+ *                  plot 'it.csv' using 4:7 with points"
+ * -s prints only a summary: how many solves gave fixes, why the
+ * rest didn't, how many iterations the fixes took, which
+ * transmitters' pings were left out as not agreeing with the rest,
+ * and for each ping, where agc.c kept its threshold and how its
+ * windows did: how often they heard nothing or more than the ping,
+ * and how far from their middles the pings came.
+ *
+ * Build from the repository root:
+ *   c++ -std=c++11 -O2 -Wall host/trace_decode.cpp -o trace_decode
+ *   ./trace_decode [-c | -s] [log]...
+ * ========================================
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Must match enum trace_type and enum trace_reject in trace.h
+enum Type {
+    EMPTY = 0,
+    PINGS = 1,
+    ITERATION = 2,
+    FIX = 3,
+    REJECT = 4,
+    EXCLUDE = 5,
+    AGC = 6,
+};
+
+enum Reject {
+    REJECT_STALE = 0,
+    REJECT_DIFF = 1,
+    REJECT_ERROR = 2,
+};
+
+const char *const type_names[] = {"empty", "pings", "iteration", "fix", "reject",
+                                  "exclude", "agc"};
+const char *const reject_names[] = {"stale", "diff", "error"};
+
+struct Event {
+    uint16_t seq;
+    unsigned type;
+    unsigned arg;
+    uint64_t time;  // microseconds, unwrapped
+    float value[3];
+};
+
+enum Mode { PRETTY, CSV, SUMMARY };
+
+float from_bits(uint32_t bits) {
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Parses "C high low", the car's whole clock count when it started dumping,
+// in hex. Returns false for anything else.
+bool parse_clock(const std::string &line, uint64_t &clock) {
+    std::istringstream in(line);
+    std::string tag;
+    uint32_t high, low;
+
+    in >> tag;
+    if (tag != "C" || !(in >> std::hex >> high >> low))
+        return false;
+    clock = uint64_t(high) << 32 | low;
+    return true;
+}
+
+// Parses "T seq type arg time a b c", all hex. Returns false for anything
+// else.
+bool parse(const std::string &line, Event &event, uint32_t &time) {
+    std::istringstream in(line);
+    std::string tag;
+    uint32_t fields[7];
+
+    in >> tag;
+    if (tag != "T")
+        return false;
+    in >> std::hex;
+    for (int i = 0; i < 7; i++) {
+        if (!(in >> fields[i]))
+            return false;
+    }
+    if (fields[0] > 0xFFFF || fields[1] > 0xFF || fields[2] > 0xFF)
+        return false;
+    event.seq = static_cast<uint16_t>(fields[0]);
+    event.type = fields[1];
+    event.arg = fields[2];
+    time = fields[3];
+    for (int i = 0; i < 3; i++)
+        event.value[i] = from_bits(fields[4 + i]);
+    return true;
+}
+
+const char *type_name(unsigned type) {
+    return type < sizeof(type_names) / sizeof(*type_names) ? type_names[type]
+                                                           : "unknown";
+}
+
+const char *reject_name(unsigned reason) {
+    return reason < sizeof(reject_names) / sizeof(*reject_names)
+               ? reject_names[reason] : "unknown";
+}
+
+void print_pretty(const Event &e, double start) {
+    double t = (e.time - start) * 1e-6;
+
+    switch (e.type) {
+    case PINGS:
+        std::printf("\n%10.6f s  pings      range differences %+8.3f %+8.3f "
+                    "%+8.3f ft\n", t, e.value[0], e.value[1], e.value[2]);
+        break;
+    case ITERATION:
+        std::printf("%10.6f s  iteration %3u  dx %+10.4f  dy %+10.4f  "
+                    "fxy %10.6f\n", t, e.arg, e.value[0], e.value[1],
+                    e.value[2]);
+        break;
+    case FIX:
+        std::printf("%10.6f s  fix        x %.3f  y %.3f ft  fxy %.6f after "
+                    "%u iterations\n", t, e.value[0], e.value[1], e.value[2],
+                    e.arg);
+        break;
+    case EXCLUDE:
+        std::printf("%10.6f s  excluded  ", t);
+        if (e.arg == 0)
+            std::printf(" none");
+        for (unsigned tx = 0; tx < 8; tx++)
+            if (e.arg & (1u << tx))
+                std::printf(" tx %u", tx);
+        std::printf(" after %.0f subsets: fxy %.6f, %.6f with them\n",
+                    e.value[0], e.value[2], e.value[1]);
+        break;
+    case AGC:
+        if (e.value[1] < 0)
+            std::printf("%10.6f s  agc        ping %u  threshold %.0f, not "
+                        "gated\n", t, e.arg, e.value[0]);
+        else
+            std::printf("%10.6f s  agc        ping %u  threshold %.0f, "
+                        "window tripped %.0f times, ping %+.0f us from its "
+                        "middle\n", t, e.arg, e.value[0], e.value[1],
+                        e.value[2]);
+        break;
+    case REJECT:
+        switch (e.arg) {
+        case REJECT_STALE:
+            std::printf("\n%10.6f s  rejected   ping %.0f captured %.0f us "
+                        "before the last of its set\n", t, e.value[0],
+                        e.value[1]);
+            break;
+        case REJECT_DIFF:
+            std::printf("%10.6f s  rejected   range difference to ping %.0f "
+                        "is %.1f ft\n", t, e.value[0], e.value[1]);
+            break;
+        case REJECT_ERROR:
+            std::printf("%10.6f s  rejected   no convergence: x %.3f  y %.3f "
+                        "ft  fxy %.6f\n", t, e.value[0], e.value[1],
+                        e.value[2]);
+            break;
+        default:
+            std::printf("%10.6f s  rejected   reason %u\n", t, e.arg);
+        }
+        break;
+    default:
+        std::printf("%10.6f s  %s %u  %g %g %g\n", t, type_name(e.type), e.arg,
+                    e.value[0], e.value[1], e.value[2]);
+    }
+}
+
+void print_csv(const Event &e) {
+    std::printf("%u,%llu,%s,%u,%s,%.9g,%.9g,%.9g\n", e.seq,
+                static_cast<unsigned long long>(e.time), type_name(e.type),
+                e.arg, e.type == REJECT ? reject_name(e.arg) : "",
+                e.value[0], e.value[1], e.value[2]);
+}
+
+// What agc.c traced for one ping
+struct Agc {
+    unsigned long cycles = 0, gated = 0, missed = 0, noisy = 0;
+    double threshold_sum = 0.0, offset_sum = 0.0, offset_max = 0.0;
+    float threshold = 0;  // the latest
+
+    void add(const Event &e) {
+        cycles++;
+        threshold = e.value[0];
+        threshold_sum += e.value[0];
+        if (e.value[1] < 0)
+            return;
+        gated++;
+        if (e.value[1] == 0)
+            missed++;
+        else if (e.value[1] > 1)
+            noisy++;
+        offset_sum += std::fabs(e.value[2]);
+        if (std::fabs(e.value[2]) > offset_max)
+            offset_max = std::fabs(e.value[2]);
+    }
+};
+
+struct Summary {
+    unsigned long events = 0, lost = 0, solves = 0, fixes = 0;
+    unsigned long iterations = 0, max_iterations = 0;
+    unsigned long consensus = 0, subsets = 0;
+    std::map<unsigned, unsigned long> rejects;
+    std::map<unsigned, unsigned long> excluded;  // by transmitter
+    std::map<unsigned, unsigned long> iteration_counts;
+    std::map<unsigned, Agc> agc;  // by transmitter
+
+    void add(const Event &e) {
+        events++;
+        switch (e.type) {
+        case PINGS:
+            solves++;
+            break;
+        case FIX:
+            fixes++;
+            iterations += e.arg;
+            if (e.arg > max_iterations)
+                max_iterations = e.arg;
+            iteration_counts[e.arg]++;
+            break;
+        case REJECT:
+            rejects[e.arg]++;
+            break;
+        case EXCLUDE:
+            if (e.value[0] > 0) {
+                consensus++;
+                subsets += static_cast<unsigned long>(e.value[0]);
+            }
+            for (unsigned tx = 0; tx < 8; tx++)
+                if (e.arg & (1u << tx))
+                    excluded[tx]++;
+            break;
+        case AGC:
+            agc[e.arg].add(e);
+            break;
+        }
+    }
+
+    void print() const {
+        std::printf("%lu events, %lu lost to the ring overflowing\n", events,
+                    lost);
+        std::printf("%lu solves, %lu fixes\n", solves, fixes);
+        for (const auto &r : rejects)
+            std::printf("rejected (%s): %lu\n", reject_name(r.first), r.second);
+        if (fixes > 0) {
+            std::printf("iterations per fix: mean %.1f, max %lu\n",
+                        static_cast<double>(iterations) / fixes,
+                        max_iterations);
+            for (const auto &c : iteration_counts)
+                std::printf("  %3u: %lu\n", c.first, c.second);
+        }
+        if (consensus > 0)
+            std::printf("pings disagreed %lu times, %.1f subsets tried each\n",
+                        consensus, static_cast<double>(subsets) / consensus);
+        for (const auto &x : excluded)
+            std::printf("left out transmitter %u's ping: %lu\n", x.first,
+                        x.second);
+        if (!agc.empty())
+            std::printf("agc   fixes  threshold      gated  windows   "
+                        "off middle (us)\n"
+                        "              mean  last           missed noisy  "
+                        "mean    max\n");
+        for (const auto &a : agc) {
+            const Agc &g = a.second;
+            std::printf("ping %u %6lu  %5.1f  %4.0f  %8lu  %6lu %5lu  %5.0f "
+                        "%6.0f\n", a.first, g.cycles,
+                        g.threshold_sum / g.cycles, g.threshold, g.gated,
+                        g.missed, g.noisy,
+                        g.gated > 0 ? g.offset_sum / g.gated : 0.0,
+                        g.offset_max);
+        }
+    }
+};
+
+class Decoder {
+public:
+    explicit Decoder(Mode mode) : mode_(mode) {}
+
+    void feed(std::istream &in) {
+        std::string line;
+        Event event = {};
+        uint32_t time;
+
+        while (std::getline(in, line)) {
+            if (parse_clock(line, clock_)) {
+                have_clock_ = true;
+                continue;
+            }
+            if (!parse(line, event, time))
+                continue;
+            add(event, time);
+        }
+    }
+
+    void finish() const {
+        if (mode_ == SUMMARY)
+            summary_.print();
+    }
+
+private:
+    void add(Event &event, uint32_t time) {
+        // The car's clock wraps every 71 minutes. Each event is within half
+        // a wrap of its dump's clock line; without one (older firmware),
+        // each is taken to be less than a wrap after the last.
+        if (have_clock_) {
+            event.time = clock_ - static_cast<int32_t>(
+                             static_cast<uint32_t>(clock_) - time);
+        } else {
+            if (started_ && time < last_time_)
+                epoch_ += uint64_t(1) << 32;
+            event.time = epoch_ + time;
+        }
+        last_time_ = time;
+
+        if (started_ && event.seq != next_seq_) {
+            unsigned lost = static_cast<uint16_t>(event.seq - next_seq_);
+            summary_.lost += lost;
+            if (mode_ == PRETTY)
+                std::printf("\n-- %u events lost --\n", lost);
+        }
+        if (!started_) {
+            start_ = event.time;
+            started_ = true;
+            if (mode_ == CSV)
+                std::printf("seq,time_us,type,arg,reason,a,b,c\n");
+        }
+        next_seq_ = static_cast<uint16_t>(event.seq + 1);
+
+        summary_.add(event);
+        if (mode_ == PRETTY)
+            print_pretty(event, start_);
+        else if (mode_ == CSV)
+            print_csv(event);
+    }
+
+    Mode mode_;
+    Summary summary_;
+    bool started_ = false;
+    uint16_t next_seq_ = 0;
+    uint32_t last_time_ = 0;
+    uint64_t epoch_ = 0;
+    bool have_clock_ = false;
+    uint64_t clock_ = 0;  // from the last clock line
+    double start_ = 0.0;
+};
+
+void usage(const char *name) {
+    std::fprintf(stderr, "usage: %s [-c | -s] [log]...\n", name);
+    std::exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Mode mode = PRETTY;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-c") == 0)
+            mode = CSV;
+        else if (std::strcmp(argv[i], "-s") == 0)
+            mode = SUMMARY;
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+            usage(argv[0]);
+        else
+            files.push_back(argv[i]);
+    }
+
+    Decoder decoder(mode);
+    if (files.empty()) {
+        decoder.feed(std::cin);
+    }
+    for (const auto &name : files) {
+        if (name == "-") {
+            decoder.feed(std::cin);
+            continue;
+        }
+        std::ifstream in(name);
+        if (!in) {
+            std::perror(name.c_str());
+            return 1;
+        }
+        decoder.feed(in);
+    }
+    decoder.finish();
+    return 0;
+}
+
+//[] END OF FILE
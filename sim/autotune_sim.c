@@ -0,0 +1,282 @@
+/* ========================================
+ * autotune_sim.c
+ * Monica Lu and Victor Ying
+ *
+ * Runs the relay auto-tuner in autotune.c against plant models of
+ * the drive motor and the steering, to check it finds the ultimate
+ * gain and period before trying it on the car. For each loop:
+ *   1. hold the setpoint with the firmware's initial gains,
+ *   2. run the relay experiment exactly as the interrupt handlers do,
+ *   3. compare Ku and Tu against the plant model's true ultimate point,
+ *   4. close the loop with the tuned gains and check a step response.
+ * Exits nonzero if any check fails.
+ *
+ * Build and run from the repository root:
+ *   cc -std=gnu89 -Wall -Isim/hal -IPSoC_Creator/Carlab.cydsn \
+ *      sim/autotune_sim.c sim/hal/hal.c \
+ *      PSoC_Creator/Carlab.cydsn/autotune.c PSoC_Creator/Carlab.cydsn/pid.c \
+ *      PSoC_Creator/Carlab.cydsn/usb_uart.c -lm -o autotune_sim
+ *   ./autotune_sim
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "pid.h"
+#include "autotune.h"
+
+#define PI 3.14159265358979
+#define SUBSTEP 0.0005  // in seconds; plants are integrated finer than control
+#define MAX_DELAY 256  // substeps of measurement delay
+#define KU_TOLERANCE 0.35  // allowed relative error of the relay estimates
+#define TU_TOLERANCE 0.2
+
+struct plant {
+    const char *name;
+    float interval;  // control interval in seconds
+    float setpoint;
+    void (*reset)(struct plant *p);
+    void (*step)(struct plant *p, float u, float dt);
+    float (*output)(const struct plant *p);
+    
+    // Frequency response, for the true ultimate point
+    float (*gain)(const struct plant *p, float w);
+    float (*phase)(const struct plant *p, float w);
+    
+    float x[3];  // model state
+    float delay;  // measurement delay in seconds
+    float history[MAX_DELAY];
+    uint16 head;
+};
+
+static uint32 now_us;
+
+/*
+ * clock_now:
+ * Simulated time base, for pid_update()'s timing.
+ */
+uint32 clock_now(void) {
+    return now_us;
+}
+
+
+/*
+ * Drive motor: speed approaches K*(u - u0) with time constant tau. The speed
+ * estimate lags by about half the estimator window.
+ */
+#define DRIVE_K 35.0  // feet per second per unit power
+#define DRIVE_U0 0.1  // power needed to overcome friction
+#define DRIVE_TAU 0.4  // seconds
+
+static void drive_reset(struct plant *p) {
+    p->x[0] = 0.0;
+}
+static void drive_step(struct plant *p, float u, float dt) {
+    float target = u > DRIVE_U0 ? DRIVE_K * (u - DRIVE_U0) : 0.0;
+    p->x[0] += (target - p->x[0]) * dt / DRIVE_TAU;
+}
+static float drive_output(const struct plant *p) {
+    return p->x[0];
+}
+static float drive_gain(const struct plant *p, float w) {
+    (void)p;
+    return DRIVE_K / sqrt(1 + w*DRIVE_TAU*w*DRIVE_TAU);
+}
+static float drive_phase(const struct plant *p, float w) {
+    return -atan(w*DRIVE_TAU) - w*p->delay;
+}
+
+/*
+ * Steering: the steering servo follows u with time constant tau, the
+ * curvature makes the heading relative to the line change at speed*curvature,
+ * and the heading makes the lateral offset change. The camera sees the line
+ * a lookahead distance in front of the rear axle, one field late.
+ */
+#define STEER_SPEED 6.0  // feet per second
+#define STEER_CURVATURE 0.33  // 1/feet at full steering
+#define STEER_TAU 0.08  // seconds
+#define STEER_LOOKAHEAD 1.0  // feet from the rear axle to the camera row
+#define STEER_HALF_ROW 1.0  // feet from the middle to the edge of the row
+
+static void steer_reset(struct plant *p) {
+    p->x[0] = 0.0;  // servo position
+    p->x[1] = 0.0;  // heading
+    p->x[2] = 0.0;  // lateral offset
+}
+static void steer_step(struct plant *p, float u, float dt) {
+    p->x[0] += (u - p->x[0]) * dt / STEER_TAU;
+    p->x[2] += STEER_SPEED * sin(p->x[1]) * dt;
+    p->x[1] += STEER_SPEED * STEER_CURVATURE * p->x[0] * dt;
+}
+static float steer_output(const struct plant *p) {
+    float m = (p->x[2] + STEER_LOOKAHEAD * sin(p->x[1])) / STEER_HALF_ROW;
+    
+    // The line leaves the row
+    if (m > 1.0)
+        return 1.0;
+    if (m < -1.0)
+        return -1.0;
+    return m;
+}
+static float steer_gain(const struct plant *p, float w) {
+    (void)p;
+    return STEER_SPEED * STEER_CURVATURE *
+           sqrt(STEER_SPEED*STEER_SPEED + w*STEER_LOOKAHEAD*w*STEER_LOOKAHEAD) /
+           (STEER_HALF_ROW * w*w * sqrt(1 + w*STEER_TAU*w*STEER_TAU));
+}
+static float steer_phase(const struct plant *p, float w) {
+    return -PI + atan(w*STEER_LOOKAHEAD/STEER_SPEED) - atan(w*STEER_TAU) -
+           w*p->delay;
+}
+
+
+/*
+ * ultimate_point:
+ * Finds the frequency where the plant's phase, including the half interval
+ * the zero order hold adds, reaches -180 degrees.
+ */
+static void ultimate_point(const struct plant *p, float *ku, float *tu) {
+    float lo = 0.01, hi = 1000.0, mid = 0.0;
+    uint8 i;
+    
+    for (i = 0u; i < 100u; i++) {
+        mid = sqrt(lo * hi);
+        if (p->phase(p, mid) - mid * p->interval / 2 > -PI)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    *ku = 1.0 / p->gain(p, mid);
+    *tu = 2 * PI / mid;
+}
+
+/*
+ * run:
+ * Advances the plant by one control interval with output u, and returns the
+ * delayed measurement at the end of it.
+ */
+static float run(struct plant *p, float u) {
+    uint16 delay_steps = (uint16)(p->delay / SUBSTEP + 0.5);
+    uint16 steps = (uint16)(p->interval / SUBSTEP + 0.5);
+    uint16 i;
+    
+    for (i = 0u; i < steps; i++) {
+        p->step(p, u, SUBSTEP);
+        p->head = (p->head + 1u) % MAX_DELAY;
+        p->history[p->head] = p->output(p);
+    }
+    now_us += (uint32)(p->interval * 1e6 + 0.5);
+    return p->history[(p->head + MAX_DELAY - delay_steps) % MAX_DELAY];
+}
+
+/*
+ * test:
+ * Tunes one loop and checks the result. Returns nonzero on success.
+ */
+static uint8 test(struct plant *p, float kp, float ki, float kd,
+                  float out_min, float out_max, float feedforward,
+                  enum autotune_rule rule, float amplitude, float hysteresis,
+                  float step) {
+    struct pid pid;
+    struct autotune tune;
+    float true_ku, true_tu, y, peak, error, final_error;
+    pid_value u;
+    uint16 i, n;
+    uint8 ok = 1u;
+    
+    printf("== %s\n", p->name);
+    p->reset(p);
+    p->head = 0u;
+    for (i = 0u; i < MAX_DELAY; i++)
+        p->history[i] = p->output(p);
+    pid_init(&pid, kp, ki, kd, p->interval, out_min, out_max, 0.0, 3u);
+    
+    // Settle at the setpoint with the hand tuned gains
+    y = p->output(p);
+    n = (uint16)(5.0 / p->interval);
+    for (i = 0u; i < n; i++) {
+        u = pid_update(&pid, PID_FROM_FLOAT(p->setpoint), PID_FROM_FLOAT(y),
+                       PID_FROM_FLOAT(feedforward));
+        y = run(p, PID_TO_FLOAT(u));
+    }
+    printf("settled at %.3f with output %.3f\n", y, PID_TO_FLOAT(pid.output));
+    
+    // Relay experiment
+    autotune_start(&tune, &pid, rule, PID_TO_FLOAT(pid.output), amplitude,
+                   hysteresis);
+    n = 0u;
+    while (autotune_running(&tune) && n < 60000u) {
+        u = autotune_update(&tune, p->setpoint, y);
+        y = run(p, PID_TO_FLOAT(u));
+        n++;
+    }
+    autotune_report(&tune, p->name);
+    if (tune.state != AUTOTUNE_DONE)
+        return 0u;
+    printf("relay ran for %.2f s\n", n * p->interval);
+    
+    ultimate_point(p, &true_ku, &true_tu);
+    printf("model:  Ku %.4f Tu %.3f s\n", true_ku, true_tu);
+    if (fabs(tune.ku - true_ku) > KU_TOLERANCE * true_ku) {
+        printf("FAIL: Ku off by %.0f%%\n", 100 * (tune.ku / true_ku - 1));
+        ok = 0u;
+    }
+    if (fabs(tune.tu - true_tu) > TU_TOLERANCE * true_tu) {
+        printf("FAIL: Tu off by %.0f%%\n", 100 * (tune.tu / true_tu - 1));
+        ok = 0u;
+    }
+    
+    // Let the tuned loop take over, then step the setpoint
+    n = (uint16)(2.0 / p->interval);
+    for (i = 0u; i < n; i++) {
+        u = pid_update(&pid, PID_FROM_FLOAT(p->setpoint), PID_FROM_FLOAT(y),
+                       PID_FROM_FLOAT(feedforward));
+        y = run(p, PID_TO_FLOAT(u));
+    }
+    n = (uint16)(4.0 / p->interval);
+    peak = 0.0;
+    final_error = 0.0;
+    p->setpoint += step;
+    for (i = 0u; i < n; i++) {
+        u = pid_update(&pid, PID_FROM_FLOAT(p->setpoint), PID_FROM_FLOAT(y),
+                       PID_FROM_FLOAT(feedforward));
+        y = run(p, PID_TO_FLOAT(u));
+        error = (y - p->setpoint) / step;
+        if (error > peak)
+            peak = error;
+        if (i >= n - n/4u && fabs(error) > final_error)
+            final_error = fabs(error);
+    }
+    printf("step: overshoot %.0f%%, error over last second %.1f%%\n",
+           100 * peak, 100 * final_error);
+    if (final_error > 0.05) {
+        printf("FAIL: step response doesn't settle\n");
+        ok = 0u;
+    }
+    return ok;
+}
+
+int main(void) {
+    struct plant drive = {
+        "Speed", 0.01, 6.0, drive_reset, drive_step, drive_output,
+        drive_gain, drive_phase, {0.0}, 0.04, {0.0}, 0u
+    };
+    struct plant steer = {
+        "Steering", 1.0 / 60.0, 0.0, steer_reset, steer_step, steer_output,
+        steer_gain, steer_phase, {0.0}, 1.0 / 60.0, {0.0}, 0u
+    };
+    uint8 ok = 1u;
+    
+    // Gains, limits and relay settings as in speed.c and steer.c
+    ok &= test(&drive, 0.1, 0.2, 0.0, 0.0, 1.0, 0.15,
+               AUTOTUNE_PI, 0.1, 0.05, 1.0);
+    ok &= test(&steer, 0.75, 0.0, 0.03, -1.0, 1.0, 0.0,
+               AUTOTUNE_PD, 0.3, 0.005, 0.3);
+    
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
+
+//[] END OF FILE
@@ -0,0 +1,779 @@
+/* ========================================
+ * car_sim.c
+ * Monica Lu and Victor Ying
+ *
+ * Closed-loop simulation of the car driving around an oval track,
+ * for benchmarking speed and steering control without a car. The
+ * firmware's interrupt handlers run unchanged against simulated
+ * components (hal/components.c); this file models what they
+ * control:
+ *   - the drive motor's speed response to the Drive_PWM compare
+ *     value and the coast/forward/brake control register,
+ *   - hall ticks every DISTANCE_PER_TICK feet of travel,
+ *   - the steering servo's response to the Steering_PWM compare
+ *     value, and the car's path for that steering,
+ *   - the camera rows the line is found in: CAMERA_ROWS 45 us rows
+ *     per 60 Hz field, on the ground where line.h says they are,
+ *     with the line's position along each.
+ * The main loop's sched.c tasks run between steps.
+ * Each run starts the car slightly off the line, lets drive_init()
+ * take over, then changes the speed setpoint, and measures how well
+ * the car follows the line and holds speed until drive.c brakes.
+ * Runs are forked, so every one starts from a freshly reset
+ * firmware, and are randomized (setpoint, starting offset, timing
+ * jitter) from the seed.
+ *
+ * Build and run from the repository root:
+ *   cc -std=gnu89 -Isim/hal -IPSoC_Creator/Carlab.cydsn \
+ *      sim/car_sim.c sim/hal/hal.c sim/hal/components.c \
+ *      $(ls PSoC_Creator/Carlab.cydsn/[a-z]*.c | grep -v main.c) -lm -o car_sim
+ *   ./car_sim [-n runs] [-s seed] [-S setpoint] [-v] [-x] [-l] [-p]
+ *             [-c "shell command"]...
+ * Commands given with -c are run through the firmware's shell after
+ * drive_init(), e.g. -c "steerkp 1.0". -S fixes the speed setpoint
+ * instead of picking one between 3 and 7 feet per second, e.g. to find
+ * how fast the car can corner; add -DCAMERA_ROWS=1 to the build to
+ * compare with a single row. -x lays wide crossing lines across the
+ * straights every CROSSING_SPACING feet, which hide the line from the
+ * rows on them. -l has the shell learn the first lap and plan a speed
+ * profile from it, then drives PROFILE_LAPS laps on the profile, checking
+ * that the middle of each curve is taken no faster than the profile's grip
+ * allows. -p follows the path in path.c instead of the line: the car
+ * starts on the path, the transmitters ping it from the corners of the
+ * room, and the shell's steerpath steers by position_now() until drive.c
+ * brakes after a lap. The line measurements are then of the distance from
+ * the path, with a run failing if their rms or max is over PATH_RMS or
+ * PATH_MAX.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "hal.h"
+#include "clock.h"
+#include "drive.h"
+#include "speed.h"
+#include "steer.h"
+#include "shell.h"
+#include "odometry.h"
+#include "line.h"
+#include "sched.h"
+#include "profile.h"
+#include "position.h"
+#include "path.h"
+
+#define PI 3.14159265358979
+
+#define STEP 20u  // simulation step in microseconds
+#define RUN_TIME 40u  // longest run, in seconds
+#define SETPOINT_TIME 0.5  // seconds until the speed setpoint changes
+#define MAX_COMMANDS 16
+
+// Drive motor: speed approaches MOTOR_K*(power - MOTOR_U0)
+#define MOTOR_K 35.0  // feet per second per unit power
+#define MOTOR_U0 0.1  // power needed to overcome friction
+#define MOTOR_TAU 0.4  // seconds
+#define COAST_DRAG 0.5  // 1/seconds
+#define COAST_FRICTION 1.0  // feet per second squared
+#define BRAKE_DECEL 15.0  // feet per second squared
+
+// Steering servo
+#define SERVO_RATE 5.0  // full scale per second
+#define SERVO_TAU 0.03  // seconds
+
+// Camera
+#define FIELD_PERIOD 16683u  // microseconds, 59.94 fields per second
+#define ROW_TIME 45.0  // microseconds
+#define ROW_JITTER 0.01  // relative
+#define ROW_PERIOD 508.0  // microseconds between captured rows, every 8th line
+#define LINE_WIDTH 0.06  // feet
+#define LINE_LOST_TIME 0.5  // seconds without the line before giving up
+#define CROSSING_WIDTH 0.3  // feet, of the crossing lines laid with -x
+#define CROSSING_SPACING 4.0  // feet between them along each straight
+#define CROSSING_HALF_LENGTH 2.0  // feet either side of the line
+
+// Hall sensor
+#define HALL_JITTER 20.0  // microseconds
+
+// Speed profile, with -l
+#define PROFILE_LAPS 2u  // driven on the profile after the one learned
+#define CORNER_ACCEL 12.0  // feet per second squared; profile.c plans for 11
+
+// Positioning and path following, with -p. The transmitters are where
+// position.c expects them.
+#define ROOM_X 23.5  // feet between the first and second transmitters
+#define ROOM_Y 33.75  // feet between the second and third transmitters
+#define ROOM_Z 7.583  // feet above the receiver
+#define WAVE_SPEED 1135.0  // feet per second
+#define PING_SPACING 100000u  // microseconds between transmitters' pings
+#define PING_CYCLE 600000u  // microseconds between cycles' first pings
+#define PING_JITTER 30.0  // microseconds, of the comparator tripping
+#define PATH_STEP 0.25  // feet between the points the path is measured with
+#define PATH_POINTS 512
+#define PATH_SPEED 3.0  // feet per second; faster, too many fixes are lost
+#define PATH_SETTLE 2.0  // seconds before the path is being followed
+#define PATH_RMS 1.0  // feet from the path, once settled
+#define PATH_MAX 4.0
+
+// Track: two straights joined by semicircles
+#define TRACK_STRAIGHT 16.0  // feet
+#define TRACK_RADIUS 5.0  // feet
+#define ARC_SEGMENTS 18
+#define TRACK_POINTS (2 * ARC_SEGMENTS + 2)
+
+// Settling thresholds
+#define SPEED_BAND 0.05  // relative
+#define LINE_BAND 0.1  // feet
+#define SAMPLE_PERIOD 10000u  // microseconds between measurements
+#define MAX_SAMPLES (RUN_TIME * (1000000u / SAMPLE_PERIOD) + 1u)
+
+enum drive_state {
+    COAST = 0u,
+    FORWARD = 1u,
+    BACKWARD = 2u,
+    BRAKE = 3u,
+};
+
+struct car {
+    double x, y, heading;  // of the center of the car
+    double speed;  // feet per second, forwards
+    double servo;  // -1.0 to 1.0, positive right
+    double to_tick;  // distance left until the next magnet
+};
+
+struct result {
+    uint8 ok;
+    double setpoint;
+    double speed_settle;  // seconds after the setpoint change
+    double line_settle;  // seconds after starting, on the first straight
+    double speed_rms, line_rms, line_max;  // after settling
+    double distance, time;
+    double corner_accel;  // most sideways acceleration mid-curve, with -l
+    struct hal_isr_stats isr[HAL_IRQ_COUNT];
+};
+
+static double track_x[TRACK_POINTS], track_y[TRACK_POINTS];
+static uint32 rng_state;
+static uint8 crossings = 0u;
+static uint8 profiling = 0u;
+static uint8 following = 0u;
+static double path_x[PATH_POINTS], path_y[PATH_POINTS];
+static uint16 path_points = 0u;
+static double speed_errors[MAX_SAMPLES], line_errors[MAX_SAMPLES];
+
+
+static double uniform(double lo, double hi) {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return lo + (hi - lo) * (rng_state / 4294967296.0);
+}
+
+/*
+ * track_init:
+ * Lays out the oval counterclockwise, starting at the beginning of the
+ * bottom straight.
+ */
+static void track_init(void) {
+    uint8 i, n = 0u;
+    double a;
+    
+    for (i = 0u; i <= ARC_SEGMENTS; i++, n++) {
+        a = -PI/2 + PI * i / ARC_SEGMENTS;
+        track_x[n] = TRACK_STRAIGHT/2 + TRACK_RADIUS * cos(a);
+        track_y[n] = TRACK_RADIUS * sin(a);
+    }
+    for (i = 0u; i <= ARC_SEGMENTS; i++, n++) {
+        a = PI/2 + PI * i / ARC_SEGMENTS;
+        track_x[n] = -TRACK_STRAIGHT/2 + TRACK_RADIUS * cos(a);
+        track_y[n] = TRACK_RADIUS * sin(a);
+    }
+}
+
+/*
+ * line_distance:
+ * Returns how far (x, y) is from the line.
+ */
+static double line_distance(double x, double y) {
+    double best = 1e9, dx, dy, t, ex, ey, d;
+    uint8 i, j;
+    
+    for (i = 0u; i < TRACK_POINTS; i++) {
+        j = (i + 1u) % TRACK_POINTS;
+        dx = track_x[j] - track_x[i];
+        dy = track_y[j] - track_y[i];
+        t = ((x - track_x[i])*dx + (y - track_y[i])*dy) / (dx*dx + dy*dy);
+        if (t < 0.0)
+            t = 0.0;
+        else if (t > 1.0)
+            t = 1.0;
+        ex = track_x[i] + t*dx - x;
+        ey = track_y[i] + t*dy - y;
+        d = sqrt(ex*ex + ey*ey);
+        if (d < best)
+            best = d;
+    }
+    return best;
+}
+
+/*
+ * path_trace:
+ * Samples the path in path.c every PATH_STEP feet, to measure the car
+ * against.
+ */
+static void path_trace(void) {
+    float x, y;
+    
+    for (path_points = 0u; path_points < PATH_POINTS &&
+            path_points * PATH_STEP < path_length(); path_points++) {
+        path_point(path_points * PATH_STEP, &x, &y);
+        path_x[path_points] = x;
+        path_y[path_points] = y;
+    }
+}
+
+/*
+ * path_distance:
+ * Returns how far (x, y) is from the path.
+ */
+static double path_distance(double x, double y) {
+    double best = 1e9, dx, dy, t, ex, ey, d;
+    uint16 i, j;
+    
+    for (i = 0u; i < path_points; i++) {
+        j = (i + 1u) % path_points;
+        dx = path_x[j] - path_x[i];
+        dy = path_y[j] - path_y[i];
+        t = ((x - path_x[i])*dx + (y - path_y[i])*dy) / (dx*dx + dy*dy);
+        if (t < 0.0)
+            t = 0.0;
+        else if (t > 1.0)
+            t = 1.0;
+        ex = path_x[i] + t*dx - x;
+        ey = path_y[i] + t*dy - y;
+        d = sqrt(ex*ex + ey*ey);
+        if (d < best)
+            best = d;
+    }
+    return best;
+}
+
+/*
+ * ping_arrives:
+ * Returns nonzero once the ping transmitter tx sent at time sent has
+ * reached the car.
+ */
+static uint8 ping_arrives(const struct car *car, uint8 tx, uint32 sent) {
+    double tx_x = (tx == 0u || tx == 3u) ? -ROOM_X/2 : ROOM_X/2;
+    double tx_y = tx < 2u ? -ROOM_Y/2 : ROOM_Y/2;
+    double d = sqrt((car->x - tx_x)*(car->x - tx_x) +
+                    (car->y - tx_y)*(car->y - tx_y) + ROOM_Z*ROOM_Z);
+    
+    return (hal_time - sent) * 1e-6 * WAVE_SPEED >= d;
+}
+
+/*
+ * ping_capture:
+ * Captures a ping that tripped the comparator, raising the positioning
+ * interrupt once UltraCounter has a set of them.
+ */
+static void ping_capture(void) {
+    hal_ultra_trip();
+    hal_ultra_capture((uint32)(hal_time - hal_ultra_reset +
+                               uniform(0.0, PING_JITTER)));
+    if (hal_ultra_count < POSITION_TRANSMITTERS)
+        return;
+    hal_interrupt(HAL_IRQ_ULTRA);
+    hal_ultra_reset = hal_time;
+    hal_ultra_count = 0u;
+}
+
+/*
+ * line_in_row:
+ * Finds where the camera row crosses the line, in feet left of the middle
+ * of the row. Returns zero if the line isn't in the row.
+ */
+static uint8 line_in_row(const struct car *car, double distance,
+                         double half_width, double *left) {
+    double cx = car->x + distance * cos(car->heading);
+    double cy = car->y + distance * sin(car->heading);
+    double nx = -sin(car->heading), ny = cos(car->heading);
+    double dx, dy, px, py, det, s, t;
+    uint8 i, j, found = 0u;
+    
+    *left = 0.0;
+    for (i = 0u; i < TRACK_POINTS; i++) {
+        j = (i + 1u) % TRACK_POINTS;
+        dx = track_x[j] - track_x[i];
+        dy = track_y[j] - track_y[i];
+        px = track_x[i] - cx;
+        py = track_y[i] - cy;
+        
+        // c + s*n = p_i + t*d
+        det = -nx*dy + ny*dx;
+        if (fabs(det) < 1e-12)
+            continue;
+        s = (-px*dy + py*dx) / det;
+        t = (nx*py - ny*px) / det;
+        if (t < 0.0 || t > 1.0 || fabs(s) > half_width)
+            continue;
+        if (!found || fabs(s) < fabs(*left))
+            *left = s;
+        found = 1u;
+    }
+    return found;
+}
+
+/*
+ * crossing_in_row:
+ * Returns nonzero if a camera row the given distance ahead lies on one of
+ * the crossing lines laid across the straights.
+ */
+static uint8 crossing_in_row(const struct car *car, double distance) {
+    double cx = car->x + distance * cos(car->heading);
+    double cy = car->y + distance * sin(car->heading);
+    double along = cx / CROSSING_SPACING;
+
+    if (!crossings || fabs(cx) > TRACK_STRAIGHT/2 - 1.0 ||
+            fabs(fabs(cy) - TRACK_RADIUS) > CROSSING_HALF_LENGTH)
+        return 0u;
+    return fabs(along - floor(along + 0.5)) * CROSSING_SPACING <
+           CROSSING_WIDTH / 2;
+}
+
+/*
+ * camera_row:
+ * Queues the captures for camera row i of CAMERA_ROWS, the farthest first,
+ * raising the camera interrupt whenever Camera_Timer has four. Returns zero
+ * if the line wasn't seen in the row.
+ */
+static uint8 camera_row(const struct car *car, uint8 i) {
+    static uint8 pending = 0u;
+    double start = hal_time - 2 * ROW_TIME;
+    double length = ROW_TIME * (1.0 + uniform(-ROW_JITTER, ROW_JITTER));
+    double beyond = (CAMERA_ROWS - 1u - i) * CAMERA_ROW_SPACING;
+    double half_width = CAMERA_NEAR_HALF_WIDTH * (1.0 + beyond / CAMERA_NEAR_ROW);
+    double left, middle, half_line;
+    uint8 found = line_in_row(car, CAMERA_NEAR_ROW + beyond, half_width, &left);
+    
+    hal_camera_capture(start);
+    if (crossing_in_row(car, CAMERA_NEAR_ROW + beyond)) {
+        // Black from edge to edge, hiding the line
+        hal_camera_capture(start + 0.02 * length);
+        hal_camera_capture(start + 0.98 * length);
+        pending += 2u;
+        found = 0u;
+    }
+    else if (found) {
+        // Rows are scanned left to right
+        middle = (0.5 - left / (2 * half_width)) * length;
+        half_line = LINE_WIDTH / (4 * half_width) * length;
+        hal_camera_capture(start + middle - half_line);
+        hal_camera_capture(start + middle + half_line);
+        pending += 2u;
+    }
+    hal_camera_capture(start + length);
+    
+    // Without the line only the row edges are captured, so the interrupt
+    // may see two rows' worth
+    pending += 2u;
+    if (pending >= CAMERA_CAPTURES) {
+        hal_interrupt(HAL_IRQ_CAMERA);
+        pending = 0u;
+    }
+    return found;
+}
+
+/*
+ * car_step:
+ * Moves the car on by STEP microseconds, raising the hall interrupt if a
+ * magnet passes.
+ */
+static void car_step(struct car *car) {
+    double dt = STEP * 1e-6;
+    double power = hal_drive_compare / 65535.0;
+    double command = (hal_steering_compare - 1500.0) / 500.0;
+    double target, step, distance, tick, late;
+    
+    // Motor
+    switch (hal_drive_control) {
+    case FORWARD:
+        target = power > MOTOR_U0 ? MOTOR_K * (power - MOTOR_U0) : 0.0;
+        car->speed += (target - car->speed) * dt / MOTOR_TAU;
+        break;
+    case BACKWARD:
+        target = power > MOTOR_U0 ? -MOTOR_K * (power - MOTOR_U0) : 0.0;
+        car->speed += (target - car->speed) * dt / MOTOR_TAU;
+        break;
+    case BRAKE:
+        if (fabs(car->speed) < BRAKE_DECEL * dt)
+            car->speed = 0.0;
+        else
+            car->speed -= (car->speed > 0 ? BRAKE_DECEL : -BRAKE_DECEL) * dt;
+        break;
+    default:
+        car->speed -= car->speed * COAST_DRAG * dt;
+        if (fabs(car->speed) < COAST_FRICTION * dt)
+            car->speed = 0.0;
+        else
+            car->speed -= (car->speed > 0 ? COAST_FRICTION : -COAST_FRICTION) * dt;
+        break;
+    }
+    
+    // Servo, rate limited with a little lag
+    if (command > 1.0)
+        command = 1.0;
+    else if (command < -1.0)
+        command = -1.0;
+    step = (command - car->servo) * dt / SERVO_TAU;
+    if (step > SERVO_RATE * dt)
+        step = SERVO_RATE * dt;
+    else if (step < -SERVO_RATE * dt)
+        step = -SERVO_RATE * dt;
+    car->servo += step;
+    
+    // Path
+    distance = fabs(car->speed) * dt;
+    car->heading += distance * steer_curvature(car->servo) *
+                    (car->speed < 0 ? -1 : 1);
+    car->x += car->speed * dt * cos(car->heading);
+    car->y += car->speed * dt * sin(car->heading);
+    
+    // Hall sensor
+    car->to_tick -= distance;
+    if (car->to_tick <= 0.0) {
+        tick = odometry_tick_distance(car->servo);
+        late = -car->to_tick / (fabs(car->speed) * 1e-6);
+        car->to_tick += tick;
+        hal_hall_capture((uint32)(hal_time - late +
+                                  uniform(-HALL_JITTER, HALL_JITTER)));
+    }
+}
+
+/*
+ * rms:
+ * Returns the root mean square of errors[from] to errors[n - 1], and their
+ * largest magnitude in *max if max isn't null.
+ */
+static double rms(const double *errors, uint16 from, uint16 n, double *max) {
+    double sum = 0.0;
+    uint16 i;
+    
+    if (max != 0)
+        *max = 0.0;
+    if (from >= n)
+        return 0.0;
+    for (i = from; i < n; i++) {
+        sum += errors[i] * errors[i];
+        if (max != 0 && fabs(errors[i]) > *max)
+            *max = fabs(errors[i]);
+    }
+    return sqrt(sum / (n - from));
+}
+
+/*
+ * run:
+ * Drives one randomized run and measures it.
+ */
+static void run(uint32 seed, double setpoint, char **commands,
+                uint8 n_commands, struct result *result) {
+    struct car car;
+    uint32 change_time = (uint32)(SETPOINT_TIME * 1e6);
+    uint32 next_pid, next_field = FIELD_PERIOD;
+    uint32 next_sample = 0u, lost_since = 0u, end;
+    uint32 cycle_start = 0u, sent;
+    double next_row = 0.0, last_x;
+    uint16 n = 0u, speed_settled = 0u, line_settled = 0u;
+    uint8 i, line_lost = 0u, changed = 0u, first_straight = 1u;
+    uint8 row = CAMERA_ROWS, found = 0u, laps = 0u, ping = 0u;
+    
+    rng_state = seed * 2654435761u + 1u;
+    memset(result, 0, sizeof(*result));
+    result->setpoint = following ? PATH_SPEED : uniform(3.0, 7.0);
+    if (setpoint > 0.0)
+        result->setpoint = setpoint;
+    
+    car.x = -TRACK_STRAIGHT/2;
+    car.y = -TRACK_RADIUS + uniform(-0.3, 0.3);
+    car.heading = uniform(-0.1, 0.1);
+    if (following) {
+        // At the start of the long right side of the path
+        car.x = 6.0 + uniform(-0.3, 0.3);
+        car.y = -9.0;
+        car.heading = PI/2 + uniform(-0.1, 0.1);
+    }
+    car.speed = 0.0;
+    car.servo = 0.0;
+    car.to_tick = uniform(0.0, DISTANCE_PER_TICK);
+    
+    hal_time = 0u;
+    clock_init();
+    drive_init();
+    for (i = 0u; i < n_commands; i++)
+        shell_do_command(commands[i]);
+    if (profiling)
+        shell_do_command("learn");
+    if (following) {
+        position_init();
+        path_trace();
+        shell_do_command("steerpath");
+        drive_stop_distance = path_length();
+        cycle_start = (uint32)uniform(0.0, PING_CYCLE);
+    }
+    next_pid = hal_speed_pid_period();
+    
+    end = RUN_TIME * 1000000u;
+    while (hal_time < end) {
+        hal_time += STEP;
+        last_x = car.x;
+        car_step(&car);
+        
+        // A lap ends where it started, at the start of the bottom straight
+        if (profiling && car.y < 0.0 && last_x < -TRACK_STRAIGHT/2 &&
+                car.x >= -TRACK_STRAIGHT/2) {
+            laps++;
+            if (laps == 1u) {
+                shell_do_command("plan");
+                if (!profile_ready())
+                    break;
+            }
+            else if (laps == 1u + PROFILE_LAPS) {
+                speed_brake();
+            }
+        }
+        // Judged over the middle third of each curve, as the speed lags the
+        // profile on the way in
+        if (profile_ready() &&
+                fabs(car.x) > TRACK_STRAIGHT/2 + TRACK_RADIUS * cos(PI/6) &&
+                car.speed * car.speed / TRACK_RADIUS > result->corner_accel)
+            result->corner_accel = car.speed * car.speed / TRACK_RADIUS;
+        
+        if (hal_time >= next_pid) {
+            hal_interrupt(HAL_IRQ_SPEED_PID);
+            next_pid = hal_speed_pid_period();
+        }
+        if (following) {
+            // Each transmitter pings in turn; the sound reaches the car
+            // before the next one pings
+            sent = cycle_start + ping * PING_SPACING;
+            if (hal_time >= sent && ping_arrives(&car, ping, sent)) {
+                ping_capture();
+                if (++ping == POSITION_TRANSMITTERS) {
+                    ping = 0u;
+                    cycle_start += PING_CYCLE;
+                }
+            }
+        }
+        else if (hal_time >= next_field) {
+            row = 0u;
+            found = 0u;
+            next_row = hal_time;
+            next_field += FIELD_PERIOD;
+        }
+        if (row < CAMERA_ROWS && hal_time >= next_row) {
+            found |= camera_row(&car, row);
+            next_row += ROW_PERIOD;
+            if (++row == CAMERA_ROWS) {
+                if (found) {
+                    lost_since = hal_time;
+                }
+                else if (hal_time - lost_since > LINE_LOST_TIME * 1e6) {
+                    line_lost = 1u;
+                    break;
+                }
+            }
+        }
+        // The main loop's tasks, as if it were always idle between steps
+        while (sched_poll())
+            ;
+        if (!changed && hal_time >= change_time && !profile_ready()) {
+            speed_set(result->setpoint);
+            changed = 1u;
+        }
+        
+        // Measure until drive.c brakes
+        if (hal_drive_control == BRAKE)
+            break;
+        if (hal_time >= next_sample && n < MAX_SAMPLES) {
+            // On the profile the setpoint keeps changing, so only the line
+            // is measured
+            speed_errors[n] = changed && !profile_ready() ?
+                              car.speed - result->setpoint : 0.0;
+            line_errors[n] = following ? path_distance(car.x, car.y) :
+                                         line_distance(car.x, car.y);
+            n++;
+            if (fabs(speed_errors[n - 1]) > SPEED_BAND * result->setpoint)
+                speed_settled = n;
+            // Turning in early for the curve ahead isn't losing the line
+            if (car.x > TRACK_STRAIGHT/2 - CAMERA_NEAR_ROW -
+                        (CAMERA_ROWS - 1u) * CAMERA_ROW_SPACING)
+                first_straight = 0u;
+            if (first_straight && line_errors[n - 1] > LINE_BAND)
+                line_settled = n;
+            // Steering is held until position_now() knows the heading
+            if (following && hal_time < PATH_SETTLE * 1e6)
+                line_settled = n;
+            next_sample += SAMPLE_PERIOD;
+        }
+    }
+    
+    result->ok = !line_lost && hal_drive_control == BRAKE;
+    if (profiling)
+        result->ok = result->ok && laps == 1u + PROFILE_LAPS &&
+                     result->corner_accel <= CORNER_ACCEL;
+    result->line_rms = rms(line_errors, line_settled, n, &result->line_max);
+    if (following)
+        result->ok = result->ok && result->line_rms <= PATH_RMS &&
+                     result->line_max <= PATH_MAX;
+    result->speed_settle = speed_settled * (SAMPLE_PERIOD * 1e-6) - SETPOINT_TIME;
+    result->line_settle = line_settled * (SAMPLE_PERIOD * 1e-6);
+    result->speed_rms = rms(speed_errors, speed_settled, n, 0);
+    result->distance = distance_traveled;
+    result->time = hal_time * 1e-6;
+    memcpy(result->isr, hal_isr_stats, sizeof(result->isr));
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-n runs] [-s seed] [-S setpoint] [-v] "
+            "[-x] [-l] [-p] [-c command]...\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static const char *irq_names[HAL_IRQ_COUNT] = {
+        "hall", "speed_pid", "camera", "ultra"
+    };
+    char *commands[MAX_COMMANDS];
+    uint8 n_commands = 0u, verbose = 0u;
+    uint32 runs = 20u, seed = 1u, r, failures = 0u;
+    double setpoint = 0.0;
+    int opt, fds[2], status;
+    struct result result, worst, mean;
+    struct hal_isr_stats isr[HAL_IRQ_COUNT];
+    uint8 i;
+    
+    while ((opt = getopt(argc, argv, "n:s:S:vxlpc:")) != -1) {
+        switch (opt) {
+        case 'n':
+            runs = (uint32)atol(optarg);
+            break;
+        case 's':
+            seed = (uint32)atol(optarg);
+            break;
+        case 'S':
+            setpoint = atof(optarg);
+            break;
+        case 'v':
+            verbose = 1u;
+            break;
+        case 'x':
+            crossings = 1u;
+            break;
+        case 'l':
+            profiling = 1u;
+            break;
+        case 'p':
+            following = 1u;
+            break;
+        case 'c':
+            if (n_commands == MAX_COMMANDS)
+                usage(argv[0]);
+            commands[n_commands++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (runs == 0u)
+        usage(argv[0]);
+    
+    track_init();
+    memset(&worst, 0, sizeof(worst));
+    memset(&mean, 0, sizeof(mean));
+    memset(isr, 0, sizeof(isr));
+    
+    if (verbose)
+        printf("run  setpoint  speed settle  line settle  speed rms  "
+               "line rms  line max\n");
+    for (r = 0u; r < runs; r++) {
+        // Every run gets freshly reset firmware
+        fflush(stdout);
+        if (pipe(fds) != 0) {
+            perror("pipe");
+            return 2;
+        }
+        if (fork() == 0) {
+            close(fds[0]);
+            run(seed + r, setpoint, commands, n_commands, &result);
+            fflush(stdout);
+            if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+                _exit(1);
+            _exit(0);
+        }
+        close(fds[1]);
+        if (read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+            fprintf(stderr, "run %u crashed\n", r);
+            return 2;
+        }
+        close(fds[0]);
+        wait(&status);
+        
+        if (verbose)
+            printf("%3u  %8.2f  %10.2f s  %9.2f s  %9.3f  %8.3f  %8.3f%s\n",
+                   r, result.setpoint, result.speed_settle, result.line_settle,
+                   result.speed_rms, result.line_rms, result.line_max,
+                   result.ok ? "" : "  FAILED");
+        if (!result.ok)
+            failures++;
+        
+#define ACCUMULATE(field) \
+        mean.field += result.field / runs; \
+        if (result.field > worst.field) \
+            worst.field = result.field;
+        ACCUMULATE(speed_settle)
+        ACCUMULATE(line_settle)
+        ACCUMULATE(speed_rms)
+        ACCUMULATE(line_rms)
+        ACCUMULATE(line_max)
+        ACCUMULATE(corner_accel)
+#undef ACCUMULATE
+        
+        for (i = 0u; i < HAL_IRQ_COUNT; i++) {
+            isr[i].count += result.isr[i].count;
+            isr[i].total_ns += result.isr[i].total_ns;
+            if (result.isr[i].max_ns > isr[i].max_ns)
+                isr[i].max_ns = result.isr[i].max_ns;
+        }
+    }
+    
+    printf("%u runs, %u failed (lost the line or never braked%s)\n",
+           runs, failures, profiling ? ", or cornered too fast" :
+           following ? ", or strayed from the path" : "");
+    printf("                 mean     worst\n");
+    printf("speed settle  %7.2f s %7.2f s\n", mean.speed_settle, worst.speed_settle);
+    printf("line settle   %7.2f s %7.2f s\n", mean.line_settle, worst.line_settle);
+    printf("speed rms     %7.3f   %7.3f   ft/s\n", mean.speed_rms, worst.speed_rms);
+    printf("line rms      %7.3f   %7.3f   ft\n", mean.line_rms, worst.line_rms);
+    printf("line max      %7.3f   %7.3f   ft\n", mean.line_max, worst.line_max);
+    if (profiling)
+        printf("corner accel  %7.2f   %7.2f   ft/s^2 on the profile\n",
+               mean.corner_accel, worst.corner_accel);
+    printf("interrupt handlers, host time:\n");
+    for (i = 0u; i < HAL_IRQ_COUNT; i++) {
+        if (isr[i].count == 0u)
+            continue;
+        printf("%-10s %8u calls  mean %7.0f ns  max %7.0f ns\n", irq_names[i],
+               isr[i].count, isr[i].total_ns / isr[i].count, isr[i].max_ns);
+    }
+    
+    return failures > 0u;
+}
+
+//[] END OF FILE
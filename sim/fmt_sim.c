@@ -0,0 +1,234 @@
+/* ========================================
+ * fmt_sim.c
+ * Monica Lu and Victor Ying
+ *
+ * Checks fmt_float() in fmt.c against the C library's printf, and
+ * times both.
+ *
+ * Checks, for every number of decimals the firmware uses, every
+ * float from 2^-26 up to the largest the firmware formats with
+ * that many decimals, of both signs; smaller floats print as zero
+ * either way, and a sample of them is checked too. Then every
+ * decimal count against random floats from 2^-30 to 2^32 (those
+ * from 2^31 up should come out as "inf"), and special values.
+ * Checking every float takes several minutes; -s n checks every
+ * nth instead.
+ *
+ * Build and run from the repository root:
+ *   cc -std=gnu89 -O2 -Wall -Isim/hal -IPSoC_Creator/Carlab.cydsn \
+ *      sim/fmt_sim.c PSoC_Creator/Carlab.cydsn/fmt.c -lm -o fmt_sim
+ *   ./fmt_sim [-s stride]
+ * Exits nonzero if any output differs.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fmt.h"
+
+#define RANDOM_CHECKS 10000000u
+#define BENCH_VALUES 4096u
+#define BENCH_ROUNDS 500u
+
+// What the firmware formats, and how
+struct range {
+    uint8 decimals;
+    float limit;  // every float smaller in size is checked
+    const char *used_for;
+};
+
+static const struct range ranges[] = {
+    {2u, 128.0f, "positions sent over the radio"},
+    {3u, 64.0f, "speed on the LCD"},
+    {4u, 4.0f, "line measurement and control outputs on the LCD"},
+};
+
+static uint32 rng_state = 1u;
+static unsigned long checked = 0u, failures = 0u;
+
+
+static uint32 xorshift(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static float from_bits(uint32 bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static uint32 to_bits(float f) {
+    uint32 bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+/*
+ * check:
+ * Formats value both ways and complains if they differ.
+ */
+static void check(float value, uint8 decimals) {
+    char want[64], got[FMT_MAX_LEN + 8];
+    char *end;
+
+    memset(got, 'x', sizeof(got));
+    end = fmt_float(got, value, decimals);
+    if (fabsf(value) < 2147483648.0f || isnan(value))
+        snprintf(want, sizeof(want), "%.*f", decimals, value);
+    else
+        snprintf(want, sizeof(want), "%sinf", signbit(value) ? "-" : "");
+    checked++;
+    if (strcmp(got, want) != 0 || end != got + strlen(got) ||
+            strlen(got) > FMT_MAX_LEN) {
+        if (failures < 20u)
+            printf("FAIL %.9g (0x%08x) to %u decimals: got \"%s\", "
+                   "expected \"%s\"\n", value, to_bits(value), decimals, got,
+                   want);
+        failures++;
+    }
+}
+
+/*
+ * check_range:
+ * Checks every stride-th float from 2^-26 up to the range's limit, and a
+ * sample of smaller ones, of both signs.
+ */
+static void check_range(const struct range *r, uint32 stride) {
+    uint32 bits, start = to_bits(1.0f / 67108864.0f), end = to_bits(r->limit);
+    unsigned long before = failures, n = checked;
+
+    for (bits = start; bits < end; bits += stride) {
+        check(from_bits(bits), r->decimals);
+        check(from_bits(bits | 0x80000000u), r->decimals);
+    }
+    for (bits = 0u; bits < start; bits += 4099u) {
+        check(from_bits(bits), r->decimals);
+        check(from_bits(bits | 0x80000000u), r->decimals);
+    }
+    printf("%u decimals below %-4g (%s): %lu checked, %lu differ\n",
+           r->decimals, r->limit, r->used_for, checked - n, failures - before);
+}
+
+/*
+ * check_random:
+ * Checks random floats from 2^-30 to 2^32 to every number of decimals, and
+ * special values.
+ */
+static void check_random(void) {
+    static const float specials[] = {
+        0.0f, 0.5f, 1.5f, 2.5f, 0.125f, 0.375f, 9.5f, 99.5f, 999999.5f,
+        0.9999999f, 9.9999995f, 2147483520.0f, 2147483648.0f, 1e30f,
+    };
+    unsigned long before = failures, n = checked;
+    uint32 i;
+    uint8 d;
+
+    for (i = 0u; i < RANDOM_CHECKS; i++) {
+        // Any sign and mantissa, exponents from 2^-30 to 2^31
+        uint32 bits = xorshift() & 0x807FFFFFu;
+        uint32 exponent = 127u - 30u + xorshift() % 62u;
+
+        check(from_bits(bits | exponent << 23),
+              (uint8)(i % (FMT_MAX_DECIMALS + 1u)));
+    }
+    for (d = 0u; d <= FMT_MAX_DECIMALS; d++) {
+        for (i = 0u; i < sizeof(specials) / sizeof(*specials); i++) {
+            check(specials[i], d);
+            check(-specials[i], d);
+        }
+        check(INFINITY, d);
+        check(-INFINITY, d);
+    }
+    printf("random and special values, 0 to %u decimals: %lu checked, "
+           "%lu differ\n", FMT_MAX_DECIMALS, checked - n, failures - before);
+    {
+        char buf[16];
+        fmt_float(buf, NAN, 2u);
+        if (strcmp(buf, "nan") != 0 && strcmp(buf, "-nan") != 0) {
+            printf("FAIL nan: got \"%s\"\n", buf);
+            failures++;
+        }
+    }
+}
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*
+ * bench:
+ * Times formatting a position to two decimals both ways.
+ */
+static void bench(void) {
+    static float values[BENCH_VALUES];
+    char buf[64];
+    unsigned long sum = 0u;
+    double start, fmt_time, printf_time;
+    uint32 i, round;
+
+    for (i = 0u; i < BENCH_VALUES; i++)
+        values[i] = ((float)(xorshift() % 200000u) - 100000.0f) / 2000.0f;
+
+    start = seconds();
+    for (round = 0u; round < BENCH_ROUNDS; round++)
+        for (i = 0u; i < BENCH_VALUES; i++)
+            sum += (unsigned long)(fmt_float(buf, values[i], 2u) - buf);
+    fmt_time = seconds() - start;
+
+    start = seconds();
+    for (round = 0u; round < BENCH_ROUNDS; round++)
+        for (i = 0u; i < BENCH_VALUES; i++)
+            sum += (unsigned long)sprintf(buf, "%.2f", values[i]);
+    printf_time = seconds() - start;
+
+    printf("\n%%.2f formatting, host time per value (checksum %lu):\n", sum);
+    printf("fmt_float  %6.1f ns\n",
+           fmt_time * 1e9 / (BENCH_ROUNDS * BENCH_VALUES));
+    printf("sprintf    %6.1f ns\n",
+           printf_time * 1e9 / (BENCH_ROUNDS * BENCH_VALUES));
+}
+
+int main(int argc, char **argv) {
+    uint32 stride = 1u;
+    uint8 i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+        case 's':
+            stride = (uint32)atol(optarg);
+            break;
+        default:
+            stride = 0u;
+        }
+    }
+    if (stride == 0u) {
+        fprintf(stderr, "usage: %s [-s stride]\n", argv[0]);
+        return 2;
+    }
+
+    for (i = 0u; i < sizeof(ranges) / sizeof(*ranges); i++)
+        check_range(&ranges[i], stride);
+    check_random();
+    bench();
+
+    if (failures > 0u) {
+        printf("%lu of %lu differ\n", failures, checked);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
+
+//[] END OF FILE
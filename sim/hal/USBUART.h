@@ -0,0 +1,46 @@
+/* ========================================
+ * USBUART.h
+ * Monica Lu and Victor Ying
+ *
+ * Stand-in for the generated USBUART component API. Output goes
+ * to the simulator's stdout.
+ * ========================================
+ */
+
+#ifndef USBUART_H
+#define USBUART_H
+
+#include <project.h>
+
+enum {
+    USBUART_PARITY_NONE,
+    USBUART_PARITY_ODD,
+    USBUART_PARITY_EVEN,
+    USBUART_PARITY_MARK,
+    USBUART_PARITY_SPACE,
+};
+enum {
+    USBUART_1_STOPBIT,
+    USBUART_1_5_STOPBITS,
+    USBUART_2_STOPBITS,
+};
+#define USBUART_5V_OPERATION 1u
+
+void USBUART_Start(uint8 device, uint8 mode) ;
+uint8 USBUART_GetConfiguration(void) ;
+void USBUART_CDC_Init(void) ;
+uint32 USBUART_GetDTERate(void) ;
+uint8 USBUART_GetCharFormat(void) ;
+uint8 USBUART_GetParityType(void) ;
+uint8 USBUART_GetDataBits(void) ;
+uint8 USBUART_CDCIsReady(void) ;
+void USBUART_PutData(uint8 *data, uint16 length) ;
+void USBUART_PutString(char8 *string) ;
+void USBUART_PutChar(char8 c) ;
+void USBUART_PutCRLF(void) ;
+uint8 USBUART_DataIsReady(void) ;
+uint16 USBUART_GetData(uint8 *data, uint16 length) ;
+
+#endif
+
+//[] END OF FILE
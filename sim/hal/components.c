@@ -0,0 +1,279 @@
+/* ========================================
+ * components.c
+ * Monica Lu and Victor Ying
+ *
+ * Simulated PSoC components. Timers count from hal_time the way
+ * the real ones count from their clocks: the 1 MHz timers count
+ * down from their period, and Camera_Timer counts down at 48 MHz.
+ * Captures are queued by the simulator through hal.h and read
+ * back by the firmware's interrupt handlers.
+ * ========================================
+ */
+
+#include <project.h>
+#include <time.h>
+
+#include "hal.h"
+
+#define SPEED_PID_PERIOD 10000u  // Speed_PID_Timer period, in microseconds
+// Captures the UDB timer holds. Building for more transmitters stands for
+// the TopDesign that takes a capture from each (see position.h).
+#if defined(POSITION_TRANSMITTERS) && POSITION_TRANSMITTERS > 4
+#define ULTRA_FIFO POSITION_TRANSMITTERS
+#else
+#define ULTRA_FIFO 4u
+#endif
+// UltraCounter's period, a capture from each transmitter
+#ifdef POSITION_TRANSMITTERS
+#define ULTRA_PERIOD POSITION_TRANSMITTERS
+#else
+#define ULTRA_PERIOD 4u
+#endif
+
+
+uint32 hal_time = 0u;
+uint16 hal_drive_compare = 0u;
+uint8 hal_drive_control = 0u;
+uint16 hal_steering_compare = 1500u;
+uint8 hal_ultra_threshold = UltraDAC_DEFAULT_DATA;
+uint8 hal_ultra_count = 0u;
+uint32 hal_ultra_reset = 0u;
+struct hal_isr_stats hal_isr_stats[HAL_IRQ_COUNT];
+
+static cyisraddress vectors[HAL_IRQ_COUNT];
+static uint8 irq_started[HAL_IRQ_COUNT];
+
+static uint32 hall_capture;
+
+static uint8 speed_pid_started = 0u;
+static uint32 speed_pid_start;
+static uint32 speed_pid_status_read;  // hal_time the status was last read
+
+static uint16 camera_fifo[HAL_CAMERA_FIFO];
+static uint8 camera_head = 0u, camera_count = 0u;
+
+static uint32 ultra_fifo[ULTRA_FIFO];
+static uint8 ultra_head = 0u, ultra_count = 0u;
+static uint8 glitches = 0u;
+
+
+void hal_interrupt(enum hal_irq irq) {
+    struct timespec start, end;
+    double ns;
+    
+    if (!irq_started[irq] || vectors[irq] == 0)
+        return;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    hal_interrupt_depth++;
+    vectors[irq]();
+    hal_interrupt_depth--;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    hal_isr_stats[irq].count++;
+    hal_isr_stats[irq].total_ns += ns;
+    if (ns > hal_isr_stats[irq].max_ns)
+        hal_isr_stats[irq].max_ns = ns;
+}
+
+// Hall sensor: a free-running 32 bit down counter at 1 MHz
+void hal_hall_capture(uint32 time) {
+    hall_capture = ~time;
+    hal_interrupt(HAL_IRQ_HALL);
+}
+void Hall_Timer_Start(void) {
+}
+uint32 Hall_Timer_ReadCapture(void) {
+    return hall_capture;
+}
+uint8 Hall_Timer_ReadStatusRegister(void) {
+    return 0u;
+}
+void Hall_IRQ_Start(void) {
+    irq_started[HAL_IRQ_HALL] = 1u;
+}
+void Hall_IRQ_SetVector(cyisraddress address) {
+    vectors[HAL_IRQ_HALL] = address;
+}
+
+// Speed PID timer: counts down from SPEED_PID_PERIOD - 1 at 1 MHz
+uint32 hal_speed_pid_period(void) {
+    return hal_time + SPEED_PID_PERIOD -
+           (hal_time - speed_pid_start) % SPEED_PID_PERIOD;
+}
+void Speed_PID_Timer_Start(void) {
+    if (!speed_pid_started) {
+        speed_pid_start = hal_time;
+        speed_pid_status_read = hal_time;
+        speed_pid_started = 1u;
+    }
+}
+uint32 Speed_PID_Timer_ReadCounter(void) {
+    return SPEED_PID_PERIOD - 1u - (hal_time - speed_pid_start) % SPEED_PID_PERIOD;
+}
+// The terminal count bit is set at the end of each period, until read
+uint8 Speed_PID_Timer_ReadStatusRegister(void) {
+    uint32 ended = (hal_time - speed_pid_start) / SPEED_PID_PERIOD;
+    uint32 read = (speed_pid_status_read - speed_pid_start) / SPEED_PID_PERIOD;
+    
+    speed_pid_status_read = hal_time;
+    return ended != read ? Speed_PID_Timer_STATUS_TC : 0u;
+}
+void Speed_PID_IRQ_Start(void) {
+    irq_started[HAL_IRQ_SPEED_PID] = 1u;
+}
+void Speed_PID_IRQ_SetVector(cyisraddress address) {
+    vectors[HAL_IRQ_SPEED_PID] = address;
+}
+
+// Drive motor
+void Drive_PWM_Start(void) {
+}
+void Drive_PWM_WriteCompare(uint16 compare) {
+    hal_drive_compare = compare;
+}
+void Drive_Control_Reg_Wakeup(void) {
+}
+void Drive_Control_Reg_Write(uint8 control) {
+    hal_drive_control = control;
+}
+
+// Camera: a free-running 16 bit down counter at 48 MHz
+void hal_camera_capture(double t) {
+    uint16 count = (uint16)~(uint32)(t * HAL_CAMERA_CLOCK);
+    
+    if (camera_count < HAL_CAMERA_FIFO) {
+        camera_fifo[(camera_head + camera_count) % HAL_CAMERA_FIFO] = count;
+        camera_count++;
+    }
+}
+void Camera_Comp_Start(void) {
+}
+void Camera_Counter_Start(void) {
+}
+void Camera_Timer_Start(void) {
+}
+uint16 Camera_Timer_ReadCapture(void) {
+    uint16 count;
+    
+    // An empty FIFO keeps returning the last capture
+    if (camera_count == 0u)
+        return camera_fifo[(camera_head + HAL_CAMERA_FIFO - 1u) % HAL_CAMERA_FIFO];
+    count = camera_fifo[camera_head];
+    camera_head = (camera_head + 1u) % HAL_CAMERA_FIFO;
+    camera_count--;
+    return count;
+}
+uint8 Camera_Timer_ReadStatusRegister(void) {
+    camera_count = 0u;
+    return 0u;
+}
+void Camera_IRQ_Start(void) {
+    irq_started[HAL_IRQ_CAMERA] = 1u;
+}
+void Camera_IRQ_SetVector(cyisraddress address) {
+    vectors[HAL_IRQ_CAMERA] = address;
+}
+
+// Steering servo
+void Steering_PWM_Start(void) {
+}
+void Steering_PWM_WriteCompare(uint16 compare) {
+    hal_steering_compare = compare;
+}
+
+// Ultrasonic receiver: UltraTimer is a 32 bit down counter at 1 MHz,
+// captured by each ping and reset by whoever simulates the receiver
+void hal_ultra_capture(uint32 time) {
+    if (ultra_count < ULTRA_FIFO) {
+        ultra_fifo[(ultra_head + ultra_count) % ULTRA_FIFO] = ~time;
+        ultra_count++;
+    }
+    hal_ultra_count++;
+}
+void hal_ultra_trip(void) {
+    glitches++;
+}
+void UltraCounter_Start(void) {
+}
+// It counts down to its terminal count
+uint8 UltraCounter_ReadCounter(void) {
+    return (uint8)ULTRA_PERIOD - hal_ultra_count;
+}
+uint8 UltraCounter_ReadPeriod(void) {
+    return (uint8)ULTRA_PERIOD;
+}
+void UltraCounter_WriteCounter(uint8 count) {
+    hal_ultra_count = UltraCounter_ReadPeriod() - count;
+}
+void GlitchCounter_Start(void) {
+}
+uint8 GlitchCounter_ReadCounter(void) {
+    return glitches;
+}
+void UltraTimer_Start(void) {
+}
+uint32 UltraTimer_ReadCapture(void) {
+    uint32 count;
+    
+    if (ultra_count == 0u)
+        return ultra_fifo[(ultra_head + ULTRA_FIFO - 1u) % ULTRA_FIFO];
+    count = ultra_fifo[ultra_head];
+    ultra_head = (ultra_head + 1u) % ULTRA_FIFO;
+    ultra_count--;
+    return count;
+}
+uint8 UltraTimer_ReadStatusRegister(void) {
+    ultra_count = 0u;
+    return 0u;
+}
+void UltraTimer_ClearFIFO(void) {
+    ultra_count = 0u;
+}
+void UltraTimer_WriteCounter(uint32 count) {
+    hal_ultra_reset = hal_time - ~count;
+}
+void UltraComp_Start(void) {
+}
+void UltraDAC_Start(void) {
+}
+void UltraDAC_SetValue(uint8 value) {
+    hal_ultra_threshold = value;
+}
+void UltraIRQ_Start(void) {
+    irq_started[HAL_IRQ_ULTRA] = 1u;
+}
+void UltraIRQ_SetVector(cyisraddress address) {
+    vectors[HAL_IRQ_ULTRA] = address;
+}
+
+// Nobody is watching the LCD or listening to the radio
+void LCD_Start(void) {
+}
+void LCD_Position(uint8 row, uint8 column) {
+    (void)row;
+    (void)column;
+}
+void LCD_PrintString(const char8 *string) {
+    (void)string;
+}
+void LCD_PutChar(char8 c) {
+    (void)c;
+}
+void LCD_PrintNumber(uint16 number) {
+    (void)number;
+}
+void LCD_ClearDisplay(void) {
+}
+// The radio; the simulator takes what's sent with hal_uart_output
+void (*hal_uart_output)(const char *string) = 0;
+
+void UART_Start(void) {
+}
+void UART_PutString(const char8 *string) {
+    if (hal_uart_output)
+        hal_uart_output(string);
+}
+
+//[] END OF FILE
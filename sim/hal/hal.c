@@ -0,0 +1,108 @@
+/* ========================================
+ * hal.c
+ * Monica Lu and Victor Ying
+ *
+ * PC implementations of the PSoC library functions that don't
+ * depend on simulated hardware.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "USBUART.h"
+#include "hal.h"
+
+
+uint8 CyEnterCriticalSection(void) {
+    return 0u;
+}
+
+void CyExitCriticalSection(uint8 status) {
+    (void)status;
+}
+
+void CyDelay(uint32 milliseconds) {
+    (void)milliseconds;
+}
+
+uint8 hal_interrupt_depth = 0u;  // kept up by hal_interrupt() in components.c
+
+uint8 hal_flash[CY_FLASH_SIZE];
+uint32 hal_flash_writes[CY_FLASH_NUMBER_ROWS];
+uint32 hal_flash_isr_writes = 0u;
+
+cystatus CySetTemp(void) {
+    return CYRET_SUCCESS;
+}
+
+cystatus CyWriteRowData(uint8 arrayId, uint16 rowAddress, const uint8 *rowData) {
+    uint32 row = (uint32)arrayId * (CY_FLASH_SIZEOF_ARRAY / CY_FLASH_SIZEOF_ROW) +
+                 rowAddress;
+
+    memcpy(hal_flash + row * CY_FLASH_SIZEOF_ROW, rowData, CY_FLASH_SIZEOF_ROW);
+    hal_flash_writes[row]++;
+    if (hal_interrupt_depth > 0u)
+        hal_flash_isr_writes++;
+    return CYRET_SUCCESS;
+}
+
+// The USB serial port is the simulator's stdin and stdout, unless the
+// simulator takes the output with hal_usbuart_output
+void (*hal_usbuart_output)(const uint8 *data, uint16 length) = 0;
+uint8 hal_usbuart_ready = 1u;
+
+static void usbuart_write(const void *data, uint16 length) {
+    if (hal_usbuart_output)
+        hal_usbuart_output((const uint8 *)data, length);
+    else
+        fwrite(data, 1, length, stdout);
+}
+
+void USBUART_Start(uint8 device, uint8 mode) {
+    (void)device;
+    (void)mode;
+}
+uint8 USBUART_GetConfiguration(void) {
+    return 1u;
+}
+void USBUART_CDC_Init(void) {
+}
+uint32 USBUART_GetDTERate(void) {
+    return 115200u;
+}
+uint8 USBUART_GetCharFormat(void) {
+    return USBUART_1_STOPBIT;
+}
+uint8 USBUART_GetParityType(void) {
+    return USBUART_PARITY_NONE;
+}
+uint8 USBUART_GetDataBits(void) {
+    return 8u;
+}
+uint8 USBUART_CDCIsReady(void) {
+    return hal_usbuart_ready;
+}
+void USBUART_PutData(uint8 *data, uint16 length) {
+    usbuart_write(data, length);
+}
+void USBUART_PutString(char8 *string) {
+    usbuart_write(string, (uint16)strlen(string));
+}
+void USBUART_PutChar(char8 c) {
+    usbuart_write(&c, 1u);
+}
+void USBUART_PutCRLF(void) {
+    usbuart_write("\n", 1u);
+}
+uint8 USBUART_DataIsReady(void) {
+    return 0u;
+}
+uint16 USBUART_GetData(uint8 *data, uint16 length) {
+    (void)data;
+    (void)length;
+    return 0u;
+}
+
+//[] END OF FILE
@@ -0,0 +1,112 @@
+/* ========================================
+ * hal.h
+ * Monica Lu and Victor Ying
+ *
+ * The simulator's side of the simulated components: what the
+ * firmware wrote to them, and ways to make their inputs change
+ * and their interrupts fire.
+ * ========================================
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <project.h>
+
+
+#define HAL_CAMERA_CLOCK 48  // Camera_Timer counts per microsecond
+#define HAL_CAMERA_FIFO 8u
+
+enum hal_irq {
+    HAL_IRQ_HALL = 0u,
+    HAL_IRQ_SPEED_PID = 1u,
+    HAL_IRQ_CAMERA = 2u,
+    HAL_IRQ_ULTRA = 3u,
+    HAL_IRQ_COUNT = 4u,
+};
+
+// Host time spent in each interrupt handler
+struct hal_isr_stats {
+    uint32 count;
+    double total_ns, max_ns;
+};
+
+// Simulated time in microseconds since power up. The simulator advances it.
+extern uint32 hal_time;
+
+// What the firmware last wrote
+extern uint16 hal_drive_compare;
+extern uint8 hal_drive_control;
+extern uint16 hal_steering_compare;
+extern uint8 hal_ultra_threshold;  // UltraDAC, the receiver's comparator threshold
+
+// The receiver's counters. The simulator raises UltraIRQ once
+// hal_ultra_count reaches UltraCounter's period, then starts both over, as
+// UltraCounter's terminal count does; the firmware can start them over too.
+extern uint8 hal_ultra_count;  // captures since UltraCounter started over
+extern uint32 hal_ultra_reset;  // hal_time UltraTimer was last reset
+
+extern struct hal_isr_stats hal_isr_stats[HAL_IRQ_COUNT];
+extern uint8 hal_interrupt_depth;  // handlers running, while one is
+
+// Times each flash row has been programmed, and how many of those were
+// from inside an interrupt handler
+extern uint32 hal_flash_writes[CY_FLASH_NUMBER_ROWS];
+extern uint32 hal_flash_isr_writes;
+
+// Receives everything the firmware sends over USB UART, if set; otherwise
+// it goes to stdout
+extern void (*hal_usbuart_output)(const uint8 *data, uint16 length);
+
+// Zero while the host isn't taking what the firmware sends over USB UART
+extern uint8 hal_usbuart_ready;
+
+// Receives everything the firmware sends to the radio, if set; otherwise
+// it is thrown away
+extern void (*hal_uart_output)(const char *string);
+
+
+/*
+ * hal_interrupt:
+ * Runs the handler for irq, if the firmware has started it, and times it.
+ */
+void hal_interrupt(enum hal_irq irq) ;
+
+/*
+ * hal_hall_capture:
+ * A magnet passed the hall sensor at the given time in microseconds.
+ * Raises the hall interrupt.
+ */
+void hal_hall_capture(uint32 time) ;
+
+/*
+ * hal_camera_capture:
+ * Queues a Camera_Timer capture of the time t in microseconds, which may be
+ * fractional.
+ */
+void hal_camera_capture(double t) ;
+
+/*
+ * hal_ultra_capture:
+ * Queues an UltraTimer capture of the given time in microseconds since the
+ * timer was last reset, and counts it in hal_ultra_count.
+ */
+void hal_ultra_capture(uint32 time) ;
+
+/*
+ * hal_ultra_trip:
+ * The receiver's comparator tripped, so GlitchCounter counts one, whether
+ * or not it makes a capture.
+ */
+void hal_ultra_trip(void) ;
+
+/*
+ * hal_speed_pid_period:
+ * Returns the time of the next Speed_PID_Timer terminal count.
+ */
+uint32 hal_speed_pid_period(void) ;
+
+
+#endif
+
+//[] END OF FILE
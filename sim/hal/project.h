@@ -0,0 +1,116 @@
+/* ========================================
+ * project.h
+ * Monica Lu and Victor Ying
+ *
+ * Stand-in for the header PSoC Creator generates, so firmware
+ * sources can be compiled and run on a PC. Types match the
+ * 8051 build where it matters (int16/int32 widths). Component
+ * functions are simulated in components.c, and the simulators
+ * drive them through hal.h.
+ * ========================================
+ */
+
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include <stdint.h>
+#include <ctype.h>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t int8;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef char char8;
+
+#define CY_ISR_PROTO(f) void f(void)
+#define CY_ISR(f) void f(void)
+typedef void (*cyisraddress)(void);
+
+// Keil C51 keywords
+#define CYREENTRANT
+#define CYCODE
+#define CYXDATA
+
+// Interrupts are only ever called by the simulator between instructions of
+// the main program, so critical sections have nothing to do
+#define CyGlobalIntEnable
+uint8 CyEnterCriticalSection(void) ;
+void CyExitCriticalSection(uint8 status) ;
+void CyDelay(uint32 milliseconds) ;
+
+// Flash, laid out as on the CY8C3866, in hal_flash. Rows are programmed
+// with CyWriteRowData(), which counts them in hal.h.
+#define CY_FLASH_SIZE 0x10000u
+#define CY_FLASH_SIZEOF_ARRAY 0x10000u
+#define CY_FLASH_SIZEOF_ROW 0x100u
+#define CY_FLASH_NUMBER_ROWS (CY_FLASH_SIZE / CY_FLASH_SIZEOF_ROW)
+#define CY_FLASH_BASE ((uintptr_t)hal_flash)
+typedef uint32 cystatus;
+#define CYRET_SUCCESS 0x00u
+extern uint8 hal_flash[CY_FLASH_SIZE];
+cystatus CySetTemp(void) ;
+cystatus CyWriteRowData(uint8 arrayId, uint16 rowAddress, const uint8 *rowData) ;
+
+// Components on the schematic, implemented in components.c
+void Hall_Timer_Start(void) ;
+uint32 Hall_Timer_ReadCapture(void) ;
+uint8 Hall_Timer_ReadStatusRegister(void) ;
+void Hall_IRQ_Start(void) ;
+void Hall_IRQ_SetVector(cyisraddress address) ;
+
+void Speed_PID_Timer_Start(void) ;
+uint32 Speed_PID_Timer_ReadCounter(void) ;
+uint8 Speed_PID_Timer_ReadStatusRegister(void) ;
+#define Speed_PID_Timer_STATUS_TC 0x01u
+void Speed_PID_IRQ_Start(void) ;
+void Speed_PID_IRQ_SetVector(cyisraddress address) ;
+
+void Drive_PWM_Start(void) ;
+void Drive_PWM_WriteCompare(uint16 compare) ;
+void Drive_Control_Reg_Wakeup(void) ;
+void Drive_Control_Reg_Write(uint8 control) ;
+
+void Camera_Comp_Start(void) ;
+void Camera_Counter_Start(void) ;
+void Camera_Timer_Start(void) ;
+uint16 Camera_Timer_ReadCapture(void) ;
+uint8 Camera_Timer_ReadStatusRegister(void) ;
+void Camera_IRQ_Start(void) ;
+void Camera_IRQ_SetVector(cyisraddress address) ;
+
+void Steering_PWM_Start(void) ;
+void Steering_PWM_WriteCompare(uint16 compare) ;
+
+void UltraCounter_Start(void) ;
+uint8 UltraCounter_ReadCounter(void) ;
+uint8 UltraCounter_ReadPeriod(void) ;
+void UltraCounter_WriteCounter(uint8 count) ;
+void GlitchCounter_Start(void) ;
+uint8 GlitchCounter_ReadCounter(void) ;
+void UltraTimer_Start(void) ;
+uint32 UltraTimer_ReadCapture(void) ;
+uint8 UltraTimer_ReadStatusRegister(void) ;
+void UltraTimer_ClearFIFO(void) ;
+void UltraTimer_WriteCounter(uint32 count) ;
+void UltraComp_Start(void) ;
+#define UltraDAC_DEFAULT_DATA 32u  // the simulator's idea of the schematic's value
+void UltraDAC_Start(void) ;
+void UltraDAC_SetValue(uint8 value) ;
+void UltraIRQ_Start(void) ;
+void UltraIRQ_SetVector(cyisraddress address) ;
+
+void LCD_Start(void) ;
+void LCD_Position(uint8 row, uint8 column) ;
+void LCD_PrintString(const char8 *string) ;
+void LCD_PutChar(char8 c) ;
+void LCD_PrintNumber(uint16 number) ;
+void LCD_ClearDisplay(void) ;
+
+void UART_Start(void) ;
+void UART_PutString(const char8 *string) ;
+
+#endif
+
+//[] END OF FILE
@@ -0,0 +1,732 @@
+/* ========================================
+ * journal_sim.c
+ * Monica Lu and Victor Ying
+ *
+ * Checks the flash journal in journal.c, with the car driving
+ * forward under speed control against a simple motor model and
+ * sets of pings and their fixes handed to the journal the way the
+ * positioning interrupt handler and drive_report_fix() do: a dump
+ * sends back every entry in order with the values the firmware
+ * had, nothing is ever programmed from an interrupt handler, the
+ * journal wraps round keeping the newest pages with every row
+ * programmed about as often, a page that isn't full reaches flash
+ * within two JOURNAL_FLUSH once positioning goes quiet, a reset
+ * carries on after the last page with the boot count one up, and
+ * a dump held up by a stalled USB comes out whole, with entries
+ * that found both pages full counted dropped. Anything but pages
+ * in the journal's rows, as code linked there would be, turns the
+ * journal off rather than being programmed over.
+ *
+ * With -p, serves the firmware's shell on a pseudo-terminal
+ * instead, with pings coming in, so host/journal can be tried
+ * against it:
+ *   ./journal_sim -p &
+ *   ./journal -d /dev/pts/N -o run.bin
+ *
+ * Build and run from the repository root:
+ *   cc -std=gnu89 -Wall -Isim/hal -IPSoC_Creator/Carlab.cydsn \
+ *      sim/journal_sim.c sim/hal/hal.c sim/hal/components.c \
+ *      $(ls PSoC_Creator/Carlab.cydsn/[a-z]*.c | grep -v main.c) -lm -o journal_sim
+ *   ./journal_sim [-p]
+ * Exits nonzero if a check fails.
+ * ========================================
+ */
+
+#define _GNU_SOURCE
+
+#include <project.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "hal.h"
+#include "clock.h"
+#include "drive.h"
+#include "shell.h"
+#include "sched.h"
+#include "journal.h"
+#include "speed.h"
+#include "steer.h"
+#include "odometry.h"
+#include "position.h"
+
+#define STEP 100u  // simulation step in microseconds
+#define CYCLE 250000u  // in microseconds between sets of pings
+#define FIX_AFTER 40000u  // in microseconds from a set to its fix
+#define MAX_SENT 8192u
+#define MAX_PERIODS 32768u
+#define MAX_PAGES 64u
+#define MAX_TEXT 4096u
+#define CONTROL_VALUES 6u
+#define TX_SPACING 100000u  // in microseconds between pings of a set, as in position.c
+
+// Drive motor, as in car_sim.c: speed approaches MOTOR_K*(power - MOTOR_U0)
+#define MOTOR_K 35.0  // feet per second per unit power
+#define MOTOR_U0 0.1
+#define MOTOR_TAU 0.4  // seconds
+
+// An entry, as handed to the journal or as read back from a dump
+struct entry {
+    uint8 boot;
+    uint8 type;
+    uint32 time;
+    uint32 captures[POSITION_TRANSMITTERS];
+    float value[CONTROL_VALUES];  // x, y, error for a fix
+    uint16 seq;
+    uint8 excluded;
+};
+
+// What a dump sent back
+struct dump {
+    uint8 pages[MAX_PAGES][JOURNAL_PAGE];
+    unsigned received[MAX_PAGES];  // bytes of each page
+    unsigned num_pages, end_count, frames, bad_frames, max_frame;
+    int ended;
+    struct entry entries[MAX_SENT];
+    unsigned num_entries;
+    char text[MAX_TEXT];
+    unsigned text_len;
+};
+
+static uint8 output[1u << 20];
+static unsigned output_len = 0u;
+static unsigned failures = 0u;
+static int pty = -1;
+static uint32 next_pid, next_pings, next_fix;
+static int pinging = 0, fix_due = 0;
+static double car_speed = 0.0, to_tick = DISTANCE_PER_TICK;
+static uint8 boot = 0u;  // as the firmware should count them
+static uint16 fix_seq = 0u;
+
+static struct entry sent[MAX_SENT];  // pings and fixes handed over
+static unsigned num_sent = 0u;
+static unsigned sent_before_dump = 0u;  // those handed over before the last dump began
+static struct entry periods[MAX_PERIODS];  // controllers after each period
+static unsigned num_periods = 0u;
+static struct dump dump;
+
+
+static void capture(const uint8 *data, uint16 length) {
+    if (output_len + length <= sizeof(output)) {
+        memcpy(output + output_len, data, length);
+        output_len += length;
+    }
+}
+
+// Stalls USB once the dump's first frame goes out, if set
+static int stall_armed = 0;
+
+static void capture_and_stall(const uint8 *data, uint16 length) {
+    capture(data, length);
+    if (stall_armed && length > 0u && data[0] == JOURNAL_SYNC) {
+        hal_usbuart_ready = 0u;
+        stall_armed = 0;
+    }
+}
+
+static void to_pty(const uint8 *data, uint16 length) {
+    if (write(pty, data, length) != length)
+        perror("write");
+}
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+/*
+ * remember_period:
+ * Keeps the controllers' state just after a speed PID period, when the
+ * journal samples it.
+ */
+static void remember_period(void) {
+    struct entry *e;
+
+    if (num_periods == MAX_PERIODS)
+        return;
+    e = &periods[num_periods++];
+    e->boot = boot;
+    e->type = JOURNAL_CONTROL;
+    e->time = clock_now();
+    e->value[0] = speed;
+    e->value[1] = speed_setpoint;
+    e->value[2] = power_output;
+    e->value[3] = distance_traveled;
+    e->value[4] = steer_output;
+    e->value[5] = steer_measurement();
+}
+
+/*
+ * pings:
+ * Hands the journal a made up set of captures from inside an interrupt, as
+ * the positioning interrupt handler would, and remembers it.
+ */
+static void pings(void) {
+    struct entry *e = &sent[num_sent];
+    uint8 i;
+
+    e->boot = boot;
+    e->type = JOURNAL_PINGS;
+    e->time = clock_now();
+    for (i = 0u; i < POSITION_TRANSMITTERS; i++)
+        e->captures[i] = 0x80000000u + (POSITION_TRANSMITTERS - 1u - i) *
+                         TX_SPACING + (uint32)(rand() % 5000);
+    hal_interrupt_depth++;
+    journal_pings(e->captures, e->time);
+    hal_interrupt_depth--;
+    if (num_sent < MAX_SENT - 1u)
+        num_sent++;
+}
+
+/*
+ * fix:
+ * Hands the journal a fix from the main loop, as drive_report_fix() does.
+ */
+static void fix(void) {
+    struct entry *e = &sent[num_sent];
+    struct position_fix f;
+
+    f.x = (float)(rand() % 2000) / 100.0f;
+    f.y = (float)(rand() % 2000) / 100.0f;
+    f.error = (float)(rand() % 100) / 1000.0f;
+    f.time = clock_now() - FIX_AFTER;
+    f.seq = fix_seq++;
+    f.excluded = (uint8)(rand() % 2);
+    e->boot = boot;
+    e->type = JOURNAL_FIX;
+    e->time = f.time;
+    e->value[0] = f.x;
+    e->value[1] = f.y;
+    e->value[2] = f.error;
+    e->seq = f.seq;
+    e->excluded = f.excluded;
+    journal_fix(&f);
+    if (num_sent < MAX_SENT - 1u)
+        num_sent++;
+}
+
+/*
+ * poll_tasks:
+ * Runs the main loop for a while. Not until nothing is ready, since the
+ * journal task keeps posting itself while USB is stalled.
+ */
+static void poll_tasks(void) {
+    unsigned i;
+
+    for (i = 0u; i < SCHED_TASKS && sched_poll(); i++)
+        ;
+}
+
+/*
+ * advance:
+ * Moves simulated time on, driving the car forward, running the
+ * interrupts as they come due and the main loop's tasks after each.
+ */
+static void advance(uint32 microseconds) {
+    uint32 end = hal_time + microseconds;
+    double dt = STEP * 1e-6, power, target;
+
+    while ((int32)(end - hal_time) > 0) {
+        hal_time += STEP;
+        power = hal_drive_compare / 65535.0;
+        target = power > MOTOR_U0 ? MOTOR_K * (power - MOTOR_U0) : 0.0;
+        car_speed += (target - car_speed) * dt / MOTOR_TAU;
+        to_tick -= car_speed * dt;
+        if (to_tick <= 0.0) {
+            to_tick += DISTANCE_PER_TICK;
+            hal_hall_capture(hal_time);
+        }
+        if ((int32)(next_pid - hal_time) <= 0) {
+            hal_interrupt(HAL_IRQ_SPEED_PID);
+            next_pid = hal_speed_pid_period();
+            remember_period();
+        }
+        if (pinging && (int32)(next_pings - hal_time) <= 0) {
+            pings();
+            next_pings += CYCLE;
+            next_fix = hal_time + FIX_AFTER;
+            fix_due = 1;
+        }
+        if (fix_due && (int32)(next_fix - hal_time) <= 0) {
+            fix();
+            fix_due = 0;
+        }
+        poll_tasks();
+    }
+}
+
+static void type_line(const char *line) {
+    while (*line != '\0')
+        shell_handle_char(*line++);
+    shell_handle_char('\r');
+    poll_tasks();
+}
+
+static void start_pings(void) {
+    pinging = 1;
+    next_pings = hal_time + CYCLE;
+}
+
+static uint32 get_u32(const uint8 *bytes) {
+    return (uint32)bytes[0] << 24 | (uint32)bytes[1] << 16 |
+           (uint32)bytes[2] << 8 | bytes[3];
+}
+
+static float get_float(const uint8 *bytes) {
+    uint32 u = get_u32(bytes);
+    float f;
+
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/*
+ * decode:
+ * Appends the entries of a page to dump.entries. Returns zero if they
+ * don't fill the page exactly.
+ */
+static int decode(const uint8 *page) {
+    unsigned i = JOURNAL_HEADER, end = JOURNAL_HEADER + page[1], k;
+    struct entry *e;
+
+    while (i + 5u <= end && dump.num_entries < MAX_SENT) {
+        e = &dump.entries[dump.num_entries++];
+        memset(e, 0, sizeof(*e));
+        e->boot = page[10];
+        e->type = page[i];
+        e->time = get_u32(page + i + 1u);
+        i += 5u;
+        switch (e->type) {
+        case JOURNAL_PINGS:
+            if (page[i] != POSITION_TRANSMITTERS)
+                return 0;
+            for (k = 0u; k < POSITION_TRANSMITTERS; k++)
+                e->captures[k] = get_u32(page + i + 1u + 4u * k);
+            i += 1u + 4u * POSITION_TRANSMITTERS;
+            break;
+        case JOURNAL_FIX:
+            for (k = 0u; k < 3u; k++)
+                e->value[k] = get_float(page + i + 4u * k);
+            e->seq = (uint16)(page[i + 12u] << 8 | page[i + 13u]);
+            e->excluded = page[i + 14u];
+            i += 15u;
+            break;
+        case JOURNAL_CONTROL:
+            for (k = 0u; k < CONTROL_VALUES; k++)
+                e->value[k] = get_float(page + i + 4u * k);
+            i += 4u * CONTROL_VALUES;
+            break;
+        default:
+            return 0;
+        }
+    }
+    return i == end;
+}
+
+/*
+ * take_dump:
+ * Splits the captured output into frames and text, the way a host has to,
+ * puts the pages together and decodes their entries into dump.
+ */
+static void take_dump(void) {
+    unsigned i = 0u, j, len, n, offset;
+    uint8 sum;
+    const uint8 *body;
+
+    memset(&dump, 0, sizeof(dump));
+    while (i < output_len) {
+        if (output[i] != JOURNAL_SYNC || i + 1u >= output_len ||
+                output[i + 1u] < 3u || i + output[i + 1u] + 3u > output_len) {
+            if (output[i] == JOURNAL_SYNC)
+                dump.bad_frames++;
+            else if (dump.text_len < MAX_TEXT - 1u)
+                dump.text[dump.text_len++] = (char)output[i];
+            i++;
+            continue;
+        }
+        len = output[i + 1u];
+        sum = 0u;
+        for (j = 1u; j < len + 3u; j++)
+            sum += output[i + j];
+        if (sum != 0u) {
+            dump.bad_frames++;
+            i++;
+            continue;
+        }
+        body = output + i + 2u;
+        dump.frames++;
+        if (len + 3u > dump.max_frame)
+            dump.max_frame = len + 3u;
+        n = (unsigned)(body[0] << 8 | body[1]);
+        offset = body[2];
+        if (offset == JOURNAL_END) {
+            dump.ended = 1;
+            dump.end_count = n;
+        } else if (n >= MAX_PAGES || offset != dump.received[n] ||
+                   offset + len - 3u > JOURNAL_PAGE) {
+            dump.bad_frames++;
+        } else {
+            memcpy(dump.pages[n] + offset, body + 3, len - 3u);
+            dump.received[n] += len - 3u;
+            if (n + 1u > dump.num_pages)
+                dump.num_pages = n + 1u;
+        }
+        i += len + 3u;
+    }
+    dump.text[dump.text_len] = '\0';
+    output_len = 0u;
+
+    for (n = 0u; n < dump.num_pages; n++)
+        if (dump.received[n] != JOURNAL_HEADER + dump.pages[n][1] ||
+                !decode(dump.pages[n]))
+            dump.bad_frames++;
+}
+
+/*
+ * run_dump:
+ * Types "journal dump" and collects what comes back.
+ */
+static void run_dump(void) {
+    output_len = 0u;
+    sent_before_dump = num_sent;
+    type_line("journal dump");
+    advance(200000u);
+    take_dump();
+}
+
+/*
+ * find:
+ * Returns the entry in list of the given boot, type and time, or null.
+ */
+static const struct entry *find(const struct entry *list, unsigned n,
+                                const struct entry *e) {
+    unsigned i;
+
+    for (i = n; i-- > 0u; )
+        if (list[i].boot == e->boot && list[i].type == e->type &&
+                list[i].time == e->time)
+            return &list[i];
+    return NULL;
+}
+
+/*
+ * check_dump:
+ * Checks the dump came out whole, its pages in order, and every entry in
+ * it holds what the firmware had. Returns how many of the pings and fixes
+ * handed over from since until the dump began are missing from it.
+ */
+static unsigned check_dump(const char *what, uint8 since_boot, uint32 since) {
+    char msg[160];
+    unsigned i, wrong = 0u, unknown = 0u, order = 0u, missing = 0u;
+    const struct entry *e, *was, *prev = NULL;
+    uint32 seq;
+
+    sprintf(msg, "%s: no corrupt frames or pages", what);
+    check(dump.bad_frames == 0u, msg);
+    sprintf(msg, "%s: ended, with the number of pages sent", what);
+    check(dump.ended && dump.end_count == dump.num_pages, msg);
+    sprintf(msg, "%s: frames fit a USB packet", what);
+    check(dump.max_frame <= 64u, msg);
+    for (i = 1u; i < dump.num_pages; i++) {
+        seq = get_u32(dump.pages[i] + 2);
+        if (seq != get_u32(dump.pages[i - 1u] + 2) + 1u)
+            order++;
+    }
+    sprintf(msg, "%s: pages oldest first, numbered one apart (%u not)",
+            what, order);
+    check(order == 0u, msg);
+
+    order = 0u;
+    for (i = 0u; i < dump.num_entries; i++) {
+        e = &dump.entries[i];
+        if (prev != NULL && (e->boot < prev->boot ||
+                (e->boot == prev->boot && (int32)(e->time - prev->time) < 0 &&
+                 e->type != JOURNAL_FIX && prev->type != JOURNAL_FIX)))
+            order++;
+        prev = e;
+        if (e->type == JOURNAL_CONTROL)
+            was = find(periods, num_periods, e);
+        else
+            was = find(sent, num_sent, e);
+        if (was == NULL)
+            unknown++;
+        else if (memcmp(was->captures, e->captures, sizeof(e->captures)) != 0 ||
+                 memcmp(was->value, e->value, sizeof(e->value)) != 0 ||
+                 was->seq != e->seq || was->excluded != e->excluded)
+            wrong++;
+    }
+    sprintf(msg, "%s: entries in the order they came (%u not)", what, order);
+    check(order == 0u, msg);
+    sprintf(msg, "%s: every entry is one handed over (%u not)", what,
+            unknown);
+    check(unknown == 0u, msg);
+    sprintf(msg, "%s: values match the firmware's (%u wrong)", what, wrong);
+    check(wrong == 0u, msg);
+
+    for (i = 0u; i < sent_before_dump; i++)
+        if ((sent[i].boot > since_boot || (sent[i].boot == since_boot &&
+                (int32)(sent[i].time - since) >= 0)) &&
+                find(dump.entries, dump.num_entries, &sent[i]) == NULL)
+            missing++;
+    return missing;
+}
+
+/*
+ * count_type:
+ * Returns how many entries of the dump are of the given type.
+ */
+static unsigned count_type(uint8 type) {
+    unsigned i, n = 0u;
+
+    for (i = 0u; i < dump.num_entries; i++)
+        n += dump.entries[i].type == type;
+    return n;
+}
+
+/*
+ * check_first:
+ * A few seconds of driving from an empty journal all come back.
+ */
+static void check_first(void) {
+    unsigned missing;
+
+    start_pings();
+    advance(5000000u);
+    run_dump();
+    missing = check_dump("first dump", 0u, 0u);
+    check(missing == 0u, "first dump: every set of pings and fix is there");
+    check(count_type(JOURNAL_CONTROL) >= 24u,
+          "first dump: control every 200 ms while driving");
+    check(dump.num_pages > 1u && dump.pages[0][10] == 0u &&
+          get_u32(dump.pages[0] + 2) == 0u,
+          "first dump: starts at page 0 of boot 0");
+    printf("first dump: %u pages, %u entries (%u pings, %u fixes, "
+           "%u control) in %u frames\n", dump.num_pages, dump.num_entries,
+           count_type(JOURNAL_PINGS), count_type(JOURNAL_FIX),
+           count_type(JOURNAL_CONTROL), dump.frames);
+}
+
+/*
+ * check_wrap:
+ * A minute more fills the journal several times over. The dump holds the
+ * newest JOURNAL_ROWS pages, none of the rows is worn much more than the
+ * rest, and no row outside the journal was touched.
+ */
+static void check_wrap(void) {
+    unsigned row, least = ~0u, most = 0u, outside = 0u, missing;
+
+    advance(60000000u);
+    run_dump();
+    missing = check_dump("wrapped", boot, dump.num_entries > 0u ?
+                         dump.entries[0].time + CYCLE : 0u);
+    check(dump.num_pages == JOURNAL_ROWS, "wrapped: every row sent");
+    check(missing == 0u, "wrapped: nothing missing after the oldest page");
+    for (row = 0u; row < CY_FLASH_NUMBER_ROWS; row++) {
+        if (row < JOURNAL_FIRST_ROW) {
+            outside += hal_flash_writes[row];
+            continue;
+        }
+        if (hal_flash_writes[row] < least)
+            least = hal_flash_writes[row];
+        if (hal_flash_writes[row] > most)
+            most = hal_flash_writes[row];
+    }
+    check(outside == 0u, "wrapped: no rows outside the journal programmed");
+    check(most <= least + 4u, "wrapped: rows programmed about as often");
+    check(hal_flash_isr_writes == 0u,
+          "no flash programmed from an interrupt handler");
+    printf("wrapped: pages %lu to %lu kept, rows programmed %u to %u times\n",
+           (unsigned long)get_u32(dump.pages[0] + 2),
+           (unsigned long)get_u32(dump.pages[dump.num_pages - 1u] + 2),
+           least, most);
+}
+
+/*
+ * check_reset:
+ * Positioning goes quiet and the controllers stop being journaled. Two
+ * JOURNAL_FLUSH later the car resets, losing what was in RAM, and carries
+ * on. The last fix before is in the dump after, followed by the new boot.
+ */
+static void check_reset(void) {
+    unsigned missing, i, first_new;
+    uint32 last_page = 0u, seq;
+
+    type_line("journalctl 0");
+    pinging = 0;
+    advance(FIX_AFTER + STEP + 2u * JOURNAL_FLUSH);
+
+    // The reset: RAM is lost, flash is kept
+    for (i = 0u; i < JOURNAL_ROWS; i++) {
+        seq = get_u32(hal_flash + (JOURNAL_FIRST_ROW + i) * JOURNAL_PAGE + 2u);
+        if ((int32)(seq - last_page) > 0)
+            last_page = seq;
+    }
+    clock_init();
+    journal_init();
+    boot++;
+    type_line("journalctl 20");
+    start_pings();
+    advance(3000000u);
+
+    run_dump();
+    missing = check_dump("after reset", boot - 1u, dump.num_entries > 0u ?
+                         dump.entries[0].time + CYCLE : 0u);
+    check(missing == 0u, "after reset: the sets and fixes from before the "
+          "reset reached flash");
+    for (first_new = 0u; first_new < dump.num_pages &&
+            dump.pages[first_new][10] != boot; first_new++)
+        ;
+    check(first_new < dump.num_pages &&
+          get_u32(dump.pages[first_new] + 2) == last_page + 1u,
+          "after reset: the new boot carries on after the last page");
+    check(first_new > 0u && dump.pages[first_new - 1u][10] == boot - 1u,
+          "after reset: boot count one up");
+}
+
+/*
+ * check_stall:
+ * USB stops taking the dump part way for a few seconds, while entries keep
+ * coming. The dump comes out whole once it's back, and the entries that
+ * found both pages full are counted.
+ */
+static void check_stall(void) {
+    output_len = 0u;
+    sent_before_dump = num_sent;
+    hal_usbuart_output = capture_and_stall;
+    stall_armed = 1;
+    type_line("journal dump");
+    check(hal_usbuart_ready == 0u, "stalled dump: stalled after a frame");
+    advance(4000000u);
+    hal_usbuart_ready = 1u;
+    hal_usbuart_output = capture;
+    advance(300000u);
+    take_dump();
+    check(check_dump("stalled dump", boot, dump.num_entries > 0u ?
+                     dump.entries[0].time + CYCLE : 0u) == 0u,
+          "stalled dump: nothing missing after the oldest page");
+    check(dump.num_pages == JOURNAL_ROWS, "stalled dump: every row sent");
+
+    output_len = 0u;
+    type_line("journal");
+    take_dump();
+    check(strstr(dump.text, "32 of 32 pages kept") != NULL,
+          "journal prints how many pages are kept");
+    check(strstr(dump.text, "0 failed") != NULL &&
+          strstr(dump.text, " 0 entries dropped") == NULL,
+          "stalled dump: entries dropped and counted");
+}
+
+/*
+ * check_foreign:
+ * Something that isn't a page in one of the journal's rows, as code the
+ * linker put there would be. The journal turns itself off rather than
+ * program over it.
+ */
+static void check_foreign(void) {
+    uint8 *row = hal_flash + (JOURNAL_FIRST_ROW + 5u) * JOURNAL_PAGE;
+    uint32 writes = 0u, before = 0u;
+    unsigned i;
+
+    memset(row, 0, JOURNAL_PAGE);
+    row[0] = 0x02u;  // LJMP, say
+    row[1] = 0x12u;
+    for (i = JOURNAL_FIRST_ROW; i < CY_FLASH_NUMBER_ROWS; i++)
+        before += hal_flash_writes[i];
+    journal_init();
+    start_pings();
+    advance(5000000u);
+    for (i = JOURNAL_FIRST_ROW; i < CY_FLASH_NUMBER_ROWS; i++)
+        writes += hal_flash_writes[i];
+    check(writes == before, "foreign row: nothing programmed");
+    check(row[0] == 0x02u && row[1] == 0x12u, "foreign row: left alone");
+
+    output_len = 0u;
+    type_line("journal");
+    take_dump();
+    check(strstr(dump.text, "Journal off") != NULL,
+          "foreign row: journal says it's off");
+}
+
+/*
+ * serve:
+ * Runs the firmware's shell on a pseudo-terminal until killed, with
+ * simulated time following real time.
+ */
+static int serve(void) {
+    struct timespec start_time, now;
+    struct pollfd fd;
+    uint8 buf[256];
+    ssize_t i, n;
+
+    pty = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty < 0 || grantpt(pty) < 0 || unlockpt(pty) < 0) {
+        perror("pty");
+        return 1;
+    }
+    hal_usbuart_output = to_pty;
+    printf("%s\n", ptsname(pty));
+    fflush(stdout);
+
+    start_pings();
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    fd.fd = pty;
+    fd.events = POLLIN;
+    for (;;) {
+        if (poll(&fd, 1, 5) < 0)
+            break;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        num_sent = 0u;
+        num_periods = 0u;
+        advance((uint32)((now.tv_sec - start_time.tv_sec) * 1000000 +
+                         (now.tv_nsec - start_time.tv_nsec) / 1000) - hal_time);
+        if (!(fd.revents & POLLIN))
+            continue;
+        n = read(pty, buf, sizeof(buf));
+        if (n <= 0) {
+            usleep(10000);  // nobody has the terminal open
+            continue;
+        }
+        for (i = 0; i < n; i++)
+            shell_handle_char((char)buf[i]);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    hal_time = 0u;
+    clock_init();
+    journal_init();
+    drive_init();
+    drive_stop_distance = 1e6;
+    next_pid = hal_speed_pid_period();
+    srand(1);
+
+    if (argc > 1 && strcmp(argv[1], "-p") == 0)
+        return serve();
+    if (argc > 1) {
+        fprintf(stderr, "usage: %s [-p]\n", argv[0]);
+        return 2;
+    }
+
+    hal_usbuart_output = capture;
+    check_first();
+    check_wrap();
+    check_reset();
+    check_stall();
+    check_foreign();
+
+    if (failures > 0u) {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
+
+//[] END OF FILE
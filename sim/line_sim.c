@@ -0,0 +1,498 @@
+/* ========================================
+ * line_sim.c
+ * Monica Lu and Victor Ying
+ *
+ * Checks the multi-row line fit in line.c against synthetic
+ * Camera_Timer captures of lines whose offset and curvature are
+ * known:
+ *   - straight and curved lines across the rows, exactly quadratic
+ *     and as true circular arcs,
+ *   - rows where the 16 bit timer wraps around,
+ *   - rows that must be left out (intersections, no line), and
+ *     fields where a crossing line hides the line,
+ *   - the expected row length following the camera, and jumping to
+ *     a new one when every row is rejected,
+ *   - where line_predict() expects the line after the car has driven
+ *     on, against the true geometry,
+ *   - fields of one row and of CAMERA_ROWS rows arriving through
+ *     the camera interrupt, to check when line_capture() decides
+ *     a field is complete.
+ * Exits nonzero if any check fails.
+ *
+ * Build and run from the repository root:
+ *   cc -std=gnu89 -Wall -Isim/hal -IPSoC_Creator/Carlab.cydsn \
+ *      sim/line_sim.c sim/hal/hal.c sim/hal/components.c \
+ *      PSoC_Creator/Carlab.cydsn/line.c PSoC_Creator/Carlab.cydsn/usb_uart.c \
+ *      -lm -o line_sim
+ *   ./line_sim
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "hal.h"
+#include "line.h"
+
+#define ROW_TIME 45.0  // microseconds
+#define ROW_PERIOD 508.0  // microseconds between captured rows
+#define FIELD_PERIOD 16683.0  // microseconds
+#define LINE_WIDTH 0.06  // feet
+#define OFFSET_TOLERANCE 0.01  // row widths
+#define CURVATURE_TOLERANCE 0.01  // 1/feet, for six rows
+#define ARC_TOLERANCE 0.1  // relative
+#define PREDICT_TOLERANCE 0.05  // row widths, after 1.5 feet
+#define MAX_ROWS (CAMERA_ROWS > 2 ? CAMERA_ROWS : 2)
+
+static uint16 rows[MAX_ROWS * CAMERA_CAPTURES];
+static uint16 failures = 0u;
+
+
+/*
+ * clock_now:
+ * Simulated time base, for line_capture()'s field timing.
+ */
+uint32 clock_now(void) {
+    return hal_time;
+}
+
+static double distance(uint8 i, uint8 n) {
+    return CAMERA_NEAR_ROW + (n - 1u - i) * CAMERA_ROW_SPACING;
+}
+
+static double half_width(uint8 i, uint8 n) {
+    return CAMERA_NEAR_HALF_WIDTH * distance(i, n) / CAMERA_NEAR_ROW;
+}
+
+/*
+ * capture_row_length:
+ * Stores the captures of a row row_time microseconds long, starting at
+ * count start (in 48 MHz ticks, counting down) with the line left feet
+ * left of its middle, for a row half feet wide each side.
+ */
+static void capture_row_length(uint16 *row, uint16 start, double left,
+                               double half, double row_time) {
+    double length = row_time * HAL_CAMERA_CLOCK;
+    double middle = (0.5 - left / (2 * half)) * length;
+    double half_line = LINE_WIDTH / (4 * half) * length;
+
+    row[0] = start;
+    row[1] = (uint16)(start - (uint16)(middle - half_line));
+    row[2] = (uint16)(start - (uint16)(middle + half_line));
+    row[3] = (uint16)(start - (uint16)length);
+}
+
+static void capture_row(uint16 *row, uint16 start, double left, double half) {
+    capture_row_length(row, start, left, half, ROW_TIME);
+}
+
+static void check(const char *name, uint8 ok, double got, double want) {
+    if (!ok) {
+        printf("FAIL %s: got %.4f, expected %.4f\n", name, got, want);
+        failures++;
+    }
+}
+
+/*
+ * check_fit:
+ * Fits n rows and compares against the expected offset (row widths) and
+ * curvature (1/feet).
+ */
+static void check_fit(const char *name, uint8 n, uint8 expect_rows,
+                      double offset, double curvature, double tolerance) {
+    struct line_estimate est;
+    char buf[96];
+
+    est.offset = est.curvature = 99.0;
+    est.rows = 0u;
+    if (line_fit_rows(rows, n, &est) != LINE_FOUND) {
+        printf("FAIL %s: no fit\n", name);
+        failures++;
+        return;
+    }
+    sprintf(buf, "%s rows", name);
+    check(buf, est.rows == expect_rows, est.rows, expect_rows);
+    sprintf(buf, "%s offset", name);
+    check(buf, fabs(est.offset - offset) < OFFSET_TOLERANCE, est.offset, offset);
+    // Fewer rows, spanning less distance, pin the curvature down less
+    sprintf(buf, "%s curvature", name);
+    check(buf, fabs(est.curvature - curvature) <
+               CURVATURE_TOLERANCE * 36.0 / (n*n) + tolerance * fabs(curvature),
+          est.curvature, curvature);
+}
+
+/*
+ * test_quadratic:
+ * Lines that are exactly left = offset + slope*d + k*d^2/2 in front of the
+ * car, d feet beyond the nearest row, which the fit should find whatever
+ * the rows' start counts, including ones where the timer wraps. The
+ * curvature expected is the curve's halfway out.
+ */
+static void test_quadratic(void) {
+    static const double offsets[] = {-0.3, 0.0, 0.2};
+    static const double slopes[] = {-0.3, 0.0, 0.25};
+    static const double curvatures[] = {-0.33, -0.1, 0.0, 0.1, 0.33};
+    static const uint16 starts[] = {40000u, 1000u, 60u};
+    double d, left, near, mid_slope, curvature;
+    uint8 o, s, c, w, i;
+    char name[64];
+
+    for (o = 0u; o < 3u; o++)
+        for (s = 0u; s < 3u; s++)
+            for (c = 0u; c < 5u; c++)
+                for (w = 0u; w < 3u; w++) {
+                    near = 0.0;
+                    for (i = 0u; i < CAMERA_ROWS; i++) {
+                        d = distance(i, CAMERA_ROWS) - CAMERA_NEAR_ROW;
+                        left = offsets[o] + slopes[s]*d + curvatures[c]*d*d/2;
+                        if (i == CAMERA_ROWS - 1u)
+                            near = left;
+                        capture_row(&rows[i * CAMERA_CAPTURES],
+                                    (uint16)(starts[w] - i * 3000u), left,
+                                    half_width(i, CAMERA_ROWS));
+                    }
+                    mid_slope = slopes[s] + curvatures[c] *
+                                (CAMERA_ROWS - 1) * CAMERA_ROW_SPACING / 2;
+                    curvature = curvatures[c] /
+                                pow(1.0 + mid_slope*mid_slope, 1.5);
+                    sprintf(name, "quadratic %.2f %.2f %.2f @%u", offsets[o],
+                            slopes[s], curvatures[c], starts[w]);
+                    check_fit(name, CAMERA_ROWS, CAMERA_ROWS,
+                              near / CAMERA_NEAR_HALF_WIDTH,
+                              CAMERA_ROWS >= 3 ? curvature : 0.0, 0.0);
+                }
+}
+
+/*
+ * test_arc:
+ * The car heading along a circular arc of the line, sitting on it.
+ */
+static void test_arc(void) {
+    static const double radii[] = {3.0, -3.0, 5.0, 10.0};
+    double r, d, left;
+    uint8 k, i;
+    char name[64];
+
+    for (k = 0u; k < 4u; k++) {
+        // The line has to reach the farthest row
+        r = radii[k];
+        if (fabs(r) < 1.5 * distance(0u, CAMERA_ROWS))
+            continue;
+        for (i = 0u; i < CAMERA_ROWS; i++) {
+            d = distance(i, CAMERA_ROWS);
+            left = r > 0 ? r - sqrt(r*r - d*d) : r + sqrt(r*r - d*d);
+            capture_row(&rows[i * CAMERA_CAPTURES], (uint16)(20000u - i * 3000u),
+                        left, half_width(i, CAMERA_ROWS));
+        }
+        d = CAMERA_NEAR_ROW;
+        left = r > 0 ? r - sqrt(r*r - d*d) : r + sqrt(r*r - d*d);
+        sprintf(name, "arc radius %.0f", r);
+        check_fit(name, CAMERA_ROWS, CAMERA_ROWS, left / CAMERA_NEAR_HALF_WIDTH,
+                  CAMERA_ROWS >= 3 ? 1.0 / r : 0.0, ARC_TOLERANCE);
+    }
+}
+
+/*
+ * test_bad_rows:
+ * Rows that aren't a full row with one line in them must be left out,
+ * leaving the fit of the others.
+ */
+static void test_bad_rows(void) {
+    struct line_estimate est;
+    uint8 i;
+#if CAMERA_ROWS >= 4
+    uint16 *row;
+
+    // A straight line 0.1 feet left, with an intersection through the
+    // first row and the line missing from the second (so its captures
+    // cover two rows)
+    for (i = 0u; i < CAMERA_ROWS; i++)
+        capture_row(&rows[i * CAMERA_CAPTURES], (uint16)(30000u - i * 3000u),
+                    0.1, half_width(i, CAMERA_ROWS));
+    row = &rows[0];
+    row[1] = row[0] - 10u;
+    row[2] = row[0] - 20u;
+    row[3] = row[0] - 30u;
+    row = &rows[CAMERA_CAPTURES];
+    row[1] = row[3];
+    row[2] = row[3] - 3000u;
+    row[3] = row[2] - (uint16)(ROW_TIME * HAL_CAMERA_CLOCK);
+    check_fit("bad rows", CAMERA_ROWS, CAMERA_ROWS - 2u,
+              0.1 / CAMERA_NEAR_HALF_WIDTH, 0.0, 0.0);
+#endif
+
+    // Just the nearest row, and the nearest two
+    capture_row(rows, 30000u, 0.1, half_width(0u, 1u));
+    check_fit("one row", 1u, 1u, 0.1 / CAMERA_NEAR_HALF_WIDTH, 0.0, 0.0);
+    for (i = 0u; i < 2u; i++)
+        capture_row(&rows[i * CAMERA_CAPTURES], (uint16)(30000u - i * 3000u),
+                    0.1 + 0.2 * (1u - i) * CAMERA_ROW_SPACING, half_width(i, 2u));
+    check_fit("two rows", 2u, 2u, 0.1 / CAMERA_NEAR_HALF_WIDTH, 0.0, 0.0);
+
+    // Nothing usable leaves the estimate alone
+    for (i = 0u; i < CAMERA_CAPTURES; i++)
+        rows[i] = 0u;
+    est.offset = 0.5;
+    if (line_fit_rows(rows, 1u, &est) != LINE_NONE || est.offset != 0.5) {
+        printf("FAIL no rows: fit something\n");
+        failures++;
+    }
+}
+
+/*
+ * field:
+ * Sends n rows of a straight line offset left feet through the camera
+ * interrupt's path, one interrupt per row, starting at time t. Returns the
+ * number of the row (from 1) after which line_capture() reported the field
+ * complete, or zero if it didn't.
+ */
+static uint8 field(double t, uint8 n, double left, uint8 *completed_early) {
+    uint16 row[CAMERA_CAPTURES];
+    uint8 i, k, done = 0u;
+
+    *completed_early = 0u;
+    for (i = 0u; i < n; i++) {
+        hal_time = (uint32)(t + i * ROW_PERIOD);
+        capture_row(row, 0u, left, half_width(i, n));
+        for (k = 0u; k < CAMERA_CAPTURES; k++)
+            hal_camera_capture(hal_time + (uint16)(0u - row[k]) /
+                               (double)HAL_CAMERA_CLOCK);
+        if (line_capture()) {
+            if (done)
+                *completed_early = 1u;
+            done = i + 1u;
+        }
+        Camera_Timer_ReadStatusRegister();
+    }
+    return done;
+}
+
+/*
+ * test_fields:
+ * line_capture() should complete each field on its last row once it knows
+ * how many rows a field has, including after that changes.
+ */
+static void test_fields(void) {
+    struct line_estimate est;
+    double t = FIELD_PERIOD;
+    uint8 f, done, early;
+    char name[64];
+
+    for (f = 0u; f < 4u; f++, t += FIELD_PERIOD) {
+        done = field(t, CAMERA_ROWS, 0.2, &early);
+        sprintf(name, "full field %u completed at row", f);
+        check(name, done == CAMERA_ROWS && !early, done, CAMERA_ROWS);
+    }
+    if (line_fit(&est) != LINE_FOUND || fabs(est.offset - 0.2 / CAMERA_NEAR_HALF_WIDTH) >
+            OFFSET_TOLERANCE) {
+        printf("FAIL field fit: offset %.4f\n", est.offset);
+        failures++;
+    }
+
+    // One row a field, as with a single row camera. The first short field
+    // is only known to be over when the next one starts.
+    for (f = 0u; f < 4u; f++, t += FIELD_PERIOD) {
+        done = field(t, 1u, -0.1, &early);
+        sprintf(name, "short field %u completed at row", f);
+        check(name, done == 1u || (f == 0u && CAMERA_ROWS > 1), done, 1u);
+    }
+    if (line_fit(&est) != LINE_FOUND || fabs(est.offset + 0.1 / CAMERA_NEAR_HALF_WIDTH) >
+            OFFSET_TOLERANCE) {
+        printf("FAIL short field fit: offset %.4f\n", est.offset);
+        failures++;
+    }
+
+    // And back to full fields, which should be recognized within one
+    for (f = 0u; f < 3u; f++, t += FIELD_PERIOD) {
+        done = field(t, CAMERA_ROWS, 0.0, &early);
+        sprintf(name, "regrown field %u completed at row", f);
+        check(name, f == 0u || (done == CAMERA_ROWS && !early), done,
+              CAMERA_ROWS);
+    }
+}
+
+/*
+ * test_crossing:
+ * A black strip as wide as the row is a crossing line, not the line. If
+ * it hides the line in every row, the field says so.
+ */
+static void test_crossing(void) {
+    struct line_estimate est;
+    struct line_stats before, after;
+    uint16 *row;
+    uint8 i;
+
+    line_get_stats(&before);
+    for (i = 0u; i < CAMERA_ROWS; i++) {
+        row = &rows[i * CAMERA_CAPTURES];
+        capture_row(row, (uint16)(50000u - i * 3000u), 0.0,
+                    half_width(i, CAMERA_ROWS));
+        if (i < CAMERA_ROWS / 2u || CAMERA_ROWS == 1) {
+            row[1] = row[0] - 20u;
+            row[2] = row[3] + 20u;
+        }
+    }
+    if (CAMERA_ROWS >= 2)
+        check_fit("partly crossed", CAMERA_ROWS, CAMERA_ROWS - CAMERA_ROWS / 2u,
+                  0.0, 0.0, 0.0);
+
+    for (i = 0u; i < CAMERA_ROWS; i++) {
+        row = &rows[i * CAMERA_CAPTURES];
+        row[1] = row[0] - 20u;
+        row[2] = row[3] + 20u;
+    }
+    est.offset = 0.5;
+    if (line_fit_rows(rows, CAMERA_ROWS, &est) != LINE_CROSSING ||
+            est.offset != 0.5) {
+        printf("FAIL crossed: not reported as a crossing\n");
+        failures++;
+    }
+    line_get_stats(&after);
+    check("crossing rows counted", after.rows_crossing - before.rows_crossing ==
+          CAMERA_ROWS + (CAMERA_ROWS >= 2 ? CAMERA_ROWS / 2u : 0u),
+          after.rows_crossing - before.rows_crossing, CAMERA_ROWS);
+    check("crossing fields counted",
+          after.fields_crossing - before.fields_crossing == 1u,
+          after.fields_crossing - before.fields_crossing, 1u);
+}
+
+/*
+ * row_crossing:
+ * Where the row through (px, py), square to heading, crosses the test line:
+ * through (CAMERA_NEAR_ROW, y0) at the given angle, and curving with
+ * curvature k. Returns feet left of (px, py).
+ */
+static double row_crossing(const double *line, double px, double py,
+                           double heading) {
+    double rx = -sin(heading), ry = cos(heading);  // along the row, left
+    double dx = px - CAMERA_NEAR_ROW, dy = py - line[0];
+    double cx, cy, b, c, t;
+
+    if (line[2] == 0.0) {
+        // Straight: (d + t*r) . n = 0, with n square to the line
+        return (dx*sin(line[1]) - dy*cos(line[1])) /
+               (ry*cos(line[1]) - rx*sin(line[1]));
+    }
+
+    // On the circle: |p + t*r - centre| = 1/|k|, the root nearer the row
+    cx = -sin(line[1]) / line[2];
+    cy = cos(line[1]) / line[2];
+    b = rx*(dx - cx) + ry*(dy - cy);
+    c = (dx - cx)*(dx - cx) + (dy - cy)*(dy - cy) - 1.0/(line[2]*line[2]);
+    t = -b - sqrt(b*b - c);
+    if (fabs(-b + sqrt(b*b - c)) < fabs(t))
+        t = -b + sqrt(b*b - c);
+    return t;
+}
+
+/*
+ * test_predict:
+ * Drives the car along arcs near the line, predicting the line every field's
+ * worth of distance, and compares with where the nearest row really crosses
+ * it.
+ */
+static void test_predict(void) {
+    static const double lines[][3] = {  // offset (feet), angle, curvature
+        {0.0, 0.0, 0.0}, {0.15, 0.1, 0.0}, {0.0, 0.0, 0.2}, {-0.1, 0.05, -0.25},
+    };
+    static const double steering[] = {0.0, 0.1, -0.1};  // from the line's
+    struct line_estimate est;
+    double k, x, y, heading, driven, want;
+    uint8 l, c, step;
+    char name[64];
+
+    for (l = 0u; l < 4u; l++)
+        for (c = 0u; c < 3u; c++) {
+            est.offset = lines[l][0] / CAMERA_NEAR_HALF_WIDTH;
+            est.slope = tan(lines[l][1]);
+            est.curvature = lines[l][2];
+            k = lines[l][2] + steering[c];
+
+            // 1.5 feet in steps of a field at 6 feet per second
+            for (step = 0u, driven = 0.0; step < 15u; step++) {
+                line_predict(&est, 0.1, k);
+                driven += 0.1;
+            }
+
+            // Where the car got to
+            heading = k * driven;
+            if (k == 0.0) {
+                x = driven;
+                y = 0.0;
+            }
+            else {
+                x = sin(heading) / k;
+                y = (1.0 - cos(heading)) / k;
+            }
+            want = row_crossing(lines[l], x + CAMERA_NEAR_ROW * cos(heading),
+                                y + CAMERA_NEAR_ROW * sin(heading), heading)
+                   / CAMERA_NEAR_HALF_WIDTH;
+            sprintf(name, "predict line %u, steering %+.1f offset", l,
+                    steering[c]);
+            check(name, fabs(est.offset - want) < PREDICT_TOLERANCE,
+                  est.offset, want);
+        }
+}
+
+/*
+ * test_row_length:
+ * The expected row length should follow rows a little longer than it, and
+ * jump to rows far enough off to be rejected once enough agree.
+ */
+static void test_row_length(void) {
+    struct line_estimate est;
+    struct line_stats stats;
+    uint16 length;
+    uint8 i, f;
+
+    // 47 us rows are within the margin, and pull the length along
+    for (f = 0u; f < 100u; f++) {
+        for (i = 0u; i < CAMERA_ROWS; i++)
+            capture_row_length(&rows[i * CAMERA_CAPTURES],
+                               (uint16)(f * 7919u + i * 3000u), 0.1,
+                               half_width(i, CAMERA_ROWS), 47.0);
+        line_fit_rows(rows, CAMERA_ROWS, &est);
+    }
+    line_get_stats(&stats);
+    length = (uint16)(47.0 * HAL_CAMERA_CLOCK);
+    check("row length followed", abs((int)stats.row_length - length) < 8,
+          stats.row_length, length);
+    check("row length not relocked", stats.relocks == 0u, stats.relocks, 0.0);
+
+    // 60 us rows are rejected, until there have been enough of them
+    for (f = 0u; f < 100u; f++) {
+        for (i = 0u; i < CAMERA_ROWS; i++)
+            capture_row_length(&rows[i * CAMERA_CAPTURES],
+                               (uint16)(f * 7919u + i * 3000u), 0.1,
+                               half_width(i, CAMERA_ROWS), 60.0);
+        line_fit_rows(rows, CAMERA_ROWS, &est);
+    }
+    line_get_stats(&stats);
+    length = (uint16)(60.0 * HAL_CAMERA_CLOCK);
+    check("row length relocked", stats.relocks == 1u, stats.relocks, 1.0);
+    check("row length after relocking", abs((int)stats.row_length - length) < 8,
+          stats.row_length, length);
+    check_fit("fit after relocking", CAMERA_ROWS, CAMERA_ROWS,
+              0.1 / CAMERA_NEAR_HALF_WIDTH, 0.0, 0.0);
+}
+
+int main(void) {
+    test_quadratic();
+    test_arc();
+    test_bad_rows();
+    test_fields();
+    test_crossing();
+    test_predict();
+    test_row_length();
+
+    if (failures > 0u) {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
+
+//[] END OF FILE
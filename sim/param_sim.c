@@ -0,0 +1,446 @@
+/* ========================================
+ * param_sim.c
+ * Monica Lu and Victor Ying
+ *
+ * Checks the parameter table in param.c and its binary frame
+ * protocol, by typing into the firmware's shell: listing every
+ * parameter and finding it again by name, getting and setting
+ * them from text commands and in batches of frames, rejecting
+ * values out of range without setting any of a batch, and
+ * recovering from corrupt and abandoned frames.
+ *
+ * With -p, serves the firmware's shell on a pseudo-terminal
+ * instead, so host/param can be tried against it:
+ *   ./param_sim -p &
+ *   ./param -d /dev/pts/N speedkp steerkp=1.2
+ *
+ * Build and run from the repository root:
+ *   cc -std=gnu89 -Wall -Isim/hal -IPSoC_Creator/Carlab.cydsn \
+ *      sim/param_sim.c sim/hal/hal.c sim/hal/components.c \
+ *      $(ls PSoC_Creator/Carlab.cydsn/[a-z]*.c | grep -v main.c) -lm -o param_sim
+ *   ./param_sim [-p]
+ * Exits nonzero if a check fails.
+ * ========================================
+ */
+
+#define _GNU_SOURCE
+
+#include <project.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "hal.h"
+#include "clock.h"
+#include "drive.h"
+#include "shell.h"
+#include "param.h"
+#include "pid.h"
+#include "speed.h"
+#include "position.h"
+
+#define MAX_PARAMS 64u
+
+struct reply {
+    uint8 op, status;
+    uint8 body[PARAM_MAX_BODY];
+    uint8 len;  // of body, after op and status
+};
+
+static uint8 output[4096];
+static unsigned output_len = 0u;
+static unsigned failures = 0u;
+static int pty = -1;
+static uint32 next_pid;
+
+static char names[MAX_PARAMS][PARAM_MAX_BODY + 1u];
+static uint8 types[MAX_PARAMS];
+static uint8 num_params = 0u;
+
+
+static void capture(const uint8 *data, uint16 length) {
+    if (output_len + length <= sizeof(output)) {
+        memcpy(output + output_len, data, length);
+        output_len += length;
+    }
+}
+
+static void to_pty(const uint8 *data, uint16 length) {
+    if (write(pty, data, length) != length)
+        perror("write");
+}
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+/*
+ * advance:
+ * Moves simulated time on, running the speed PID interrupt, which keeps
+ * the firmware's clock, as it comes due.
+ */
+static void advance(uint32 microseconds) {
+    uint32 end = hal_time + microseconds;
+
+    while ((int32)(next_pid - end) <= 0) {
+        hal_time = next_pid;
+        hal_interrupt(HAL_IRQ_SPEED_PID);
+        next_pid = hal_speed_pid_period();
+    }
+    hal_time = end;
+}
+
+static void type_bytes(const uint8 *bytes, unsigned n) {
+    unsigned i;
+
+    for (i = 0u; i < n; i++) {
+        advance(100u);  // about a byte at 115200 baud
+        shell_handle_char((char)bytes[i]);
+    }
+}
+
+static void type_line(const char *line) {
+    type_bytes((const uint8 *)line, strlen(line));
+    type_bytes((const uint8 *)"\r", 1u);
+}
+
+static void put_float(uint8 *bytes, float value) {
+    uint32 u;
+
+    memcpy(&u, &value, sizeof(u));
+    bytes[0] = u >> 24;
+    bytes[1] = u >> 16;
+    bytes[2] = u >> 8;
+    bytes[3] = u;
+}
+
+static float get_float(const uint8 *bytes) {
+    uint32 u = (uint32)bytes[0] << 24 | (uint32)bytes[1] << 16 |
+               (uint32)bytes[2] << 8 | bytes[3];
+    float f;
+
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/*
+ * send_frame:
+ * Types a frame with the given body into the shell. A nonzero corrupt is
+ * added to the check byte.
+ */
+static void send_frame(const uint8 *body, uint8 len, uint8 corrupt) {
+    uint8 frame[PARAM_MAX_BODY + 3u];
+    uint8 sum = len;
+    unsigned i;
+
+    frame[0] = PARAM_SYNC;
+    frame[1] = len;
+    for (i = 0u; i < len; i++) {
+        frame[2u + i] = body[i];
+        sum += body[i];
+    }
+    frame[2u + len] = (uint8)(-sum + corrupt);
+    type_bytes(frame, len + 3u);
+}
+
+/*
+ * take_reply:
+ * Takes one reply frame from the captured output, checking it is the only
+ * output. Returns zero if there isn't exactly one well formed reply.
+ */
+static int take_reply(struct reply *r) {
+    uint8 sum = 0u;
+    unsigned i, len;
+
+    if (output_len < 5u || output[0] != PARAM_SYNC)
+        return 0;
+    len = output[1];
+    if (output_len != len + 3u || len < 2u)
+        return 0;
+    for (i = 1u; i < output_len; i++)
+        sum += output[i];
+    if (sum != 0u)
+        return 0;
+    r->op = output[2];
+    r->status = output[3];
+    r->len = len - 2u;
+    memcpy(r->body, output + 4, r->len);
+    output_len = 0u;
+    return 1;
+}
+
+/*
+ * request:
+ * Sends a frame and takes its reply.
+ */
+static int request(const uint8 *body, uint8 len, struct reply *r) {
+    output_len = 0u;
+    send_frame(body, len, 0u);
+    return take_reply(r) && r->op == body[0];
+}
+
+/*
+ * check_list:
+ * Lists every parameter, a frame at a time, and checks param_find() finds
+ * each by name, which needs the table to be sorted.
+ */
+static void check_list(void) {
+    uint8 body[2] = {PARAM_OP_LIST, 0u};
+    struct reply r;
+    char what[2u * PARAM_MAX_BODY + 32u];
+
+    for (;;) {
+        uint8 n = 0u, got = 0u;
+
+        if (!request(body, 2u, &r) || r.status != PARAM_OK) {
+            check(0, "list reply");
+            return;
+        }
+        while (n + 3u <= r.len) {
+            uint8 id = r.body[n], len = r.body[n + 2u];
+
+            check(id == num_params, "list ids in order");
+            types[num_params] = r.body[n + 1u];
+            memcpy(names[num_params], r.body + n + 3u, len);
+            names[num_params][len] = '\0';
+            sprintf(what, "param_find(\"%s\") is its id", names[num_params]);
+            check(param_find(names[num_params]) == id, what);
+            if (num_params > 0u) {
+                sprintf(what, "\"%s\" sorted after \"%s\"", names[num_params],
+                        names[num_params - 1u]);
+                check(strcmp(names[num_params - 1u], names[num_params]) < 0,
+                      what);
+            }
+            num_params++;
+            got++;
+            n += 3u + len;
+        }
+        check(n == r.len, "list reply length");
+        if (got == 0u)
+            break;
+        body[1] = num_params;
+    }
+    check(num_params > 0u, "some parameters listed");
+    check(param_find("nonsense") == PARAM_NONE, "unknown name not found");
+    check(param_find("") == PARAM_NONE, "empty name not found");
+    printf("%u parameters listed:", num_params);
+    {
+        uint8 i;
+        for (i = 0u; i < num_params; i++)
+            printf(" %s", names[i]);
+    }
+    printf("\n");
+}
+
+/*
+ * check_text:
+ * Sets and gets parameters by typing their names.
+ */
+static void check_text(void) {
+    uint8 kp = param_find("speedkp"), iter = param_find("maxiter");
+    uint8 before;
+
+    output_len = 0u;
+    type_line("speedkp 0.25");
+    check(param_get(kp) == 0.25f, "speedkp 0.25 sets the gain");
+    check(speed_pid.kp == PID_FROM_FLOAT(0.25), "speedkp reaches the PID");
+    check(memmem(output, output_len, "speedkp = 0.25", 14) != NULL,
+          "speedkp 0.25 prints the new value");
+
+    before = position_max_iterations;
+    output_len = 0u;
+    type_line("maxiter 300");
+    check(position_max_iterations == before, "maxiter 300 is rejected");
+    check(memmem(output, output_len, "must be from", 12) != NULL,
+          "maxiter 300 says why");
+    type_line("maxiter 20");
+    check(position_max_iterations == 20u, "maxiter 20 is set");
+    check(param_get(iter) == 20.0f, "maxiter reads back");
+
+    output_len = 0u;
+    type_line("params");
+    check(memmem(output, output_len, "stopdist", 8) != NULL,
+          "params lists the parameters");
+    output_len = 0u;
+    type_line("nonsense 1");
+    check(memmem(output, output_len, "not recognized", 14) != NULL,
+          "unknown commands are still reported");
+}
+
+/*
+ * check_batch:
+ * Gets every parameter in one frame, then sets every one in another, then
+ * tries a batch with one value out of range.
+ */
+static void check_batch(void) {
+    uint8 body[PARAM_MAX_BODY];
+    float values[MAX_PARAMS];
+    struct reply r;
+    uint8 i, len;
+
+    body[0] = PARAM_OP_GET;
+    for (i = 0u; i < num_params; i++)
+        body[1u + i] = i;
+    body[1u + num_params] = 200u;
+    check(request(body, num_params + 2u, &r), "get reply");
+    check(r.status == PARAM_BAD_ID, "get of a bad id says so");
+    check(r.len == (num_params + 1u) * 6u, "get reply length");
+    for (i = 0u; i < num_params; i++) {
+        check(r.body[i * 6u] == i && r.body[i * 6u + 1u] == PARAM_OK,
+              "get result");
+        check(get_float(r.body + i * 6u + 2u) == param_get(i), "get value");
+    }
+    check(r.body[num_params * 6u + 1u] == PARAM_BAD_ID, "bad id result");
+
+    // Every parameter to somewhere in its range: 1 is in every byte's, even
+    // the switches', and no float's goes below 0 or ends under 1
+    body[0] = PARAM_OP_SET;
+    len = 1u;
+    for (i = 0u; i < num_params; i++) {
+        values[i] = types[i] == PARAM_UINT8 ? 1.0f : 0.125f * (i % 8u + 1u);
+        body[len] = i;
+        put_float(body + len + 1u, values[i]);
+        len += 5u;
+    }
+    check(request(body, len, &r), "set reply");
+    check(r.status == PARAM_OK, "set status");
+    for (i = 0u; i < num_params; i++) {
+        check(r.body[i * 6u + 1u] == PARAM_OK, "set result");
+        check(get_float(r.body + i * 6u + 2u) == values[i], "set read back");
+        check(param_get(i) == values[i], "set value");
+    }
+    check(position_max_iterations == 1u, "maxiter set in the batch");
+    check(position_max_error == values[param_find("maxerror")],
+          "maxerror set in the batch");
+    check(PID_TO_FLOAT(speed_pid.kd) == values[param_find("speedkd")],
+          "speedkd set in the batch");
+
+    // One bad value, and nothing changes
+    body[0] = PARAM_OP_SET;
+    body[1] = param_find("steerkp");
+    put_float(body + 2, 2.5f);
+    body[6] = param_find("maxiter");
+    put_float(body + 7, 1000.0f);
+    check(request(body, 11u, &r), "bad set reply");
+    check(r.status == PARAM_OUT_OF_RANGE, "bad set status");
+    check(r.body[1] == PARAM_OK && r.body[7] == PARAM_OUT_OF_RANGE,
+          "bad set results");
+    check(param_get(body[1]) == values[body[1]], "batch with a bad value sets nothing");
+    put_float(body + 7, NAN);
+    check(request(body, 11u, &r) && r.status == PARAM_OUT_OF_RANGE,
+          "NaN is out of range");
+}
+
+/*
+ * check_errors:
+ * Corrupt, malformed and abandoned frames, and the shell still working
+ * around them.
+ */
+static void check_errors(void) {
+    uint8 body[8] = {PARAM_OP_GET, 0u};
+    struct reply r;
+    uint8 frame[3] = {PARAM_SYNC, 4u, PARAM_OP_GET};
+
+    output_len = 0u;
+    send_frame(body, 2u, 1u);
+    check(take_reply(&r) && r.status == PARAM_BAD_CHECK && r.len == 0u,
+          "corrupt frame is refused");
+
+    body[0] = 99u;
+    check(request(body, 2u, &r) && r.status == PARAM_BAD_REQUEST,
+          "unknown operation is refused");
+    body[0] = PARAM_OP_SET;
+    check(request(body, 3u, &r) && r.status == PARAM_BAD_REQUEST,
+          "partial set is refused");
+
+    // A frame abandoned part way is dropped, and typing works again
+    output_len = 0u;
+    type_bytes(frame, sizeof(frame));
+    advance(200000u);
+    type_line("speedkp 0.5");
+    check(param_get(param_find("speedkp")) == 0.5f,
+          "shell works after an abandoned frame");
+
+    body[0] = PARAM_OP_GET;
+    check(request(body, 2u, &r) && r.status == PARAM_OK,
+          "frames work after an abandoned frame");
+}
+
+/*
+ * serve:
+ * Runs the firmware's shell on a pseudo-terminal until killed, with
+ * simulated time following real time.
+ */
+static int serve(void) {
+    struct timespec start, now;
+    struct pollfd fd;
+    uint8 buf[256];
+    ssize_t i, n;
+
+    pty = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty < 0 || grantpt(pty) < 0 || unlockpt(pty) < 0) {
+        perror("pty");
+        return 1;
+    }
+    hal_usbuart_output = to_pty;
+    printf("%s\n", ptsname(pty));
+    fflush(stdout);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fd.fd = pty;
+    fd.events = POLLIN;
+    for (;;) {
+        if (poll(&fd, 1, 10) < 0)
+            break;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        advance((uint32)((now.tv_sec - start.tv_sec) * 1000000 +
+                         (now.tv_nsec - start.tv_nsec) / 1000) - hal_time);
+        if (!(fd.revents & POLLIN))
+            continue;
+        n = read(pty, buf, sizeof(buf));
+        if (n <= 0) {
+            usleep(10000);  // nobody has the terminal open
+            continue;
+        }
+        for (i = 0; i < n; i++)
+            shell_handle_char((char)buf[i]);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    hal_time = 0u;
+    clock_init();
+    drive_init();
+    next_pid = hal_speed_pid_period();
+
+    if (argc > 1 && strcmp(argv[1], "-p") == 0)
+        return serve();
+    if (argc > 1) {
+        fprintf(stderr, "usage: %s [-p]\n", argv[0]);
+        return 2;
+    }
+
+    hal_usbuart_output = capture;
+    check_list();
+    check_text();
+    check_batch();
+    check_errors();
+
+    if (failures > 0u) {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
+
+//[] END OF FILE
@@ -0,0 +1,1448 @@
+/* ========================================
+ * position_sim.c
+ * Monica Lu and Victor Ying
+ *
+ * Deterministic discrete-event simulation of the whole positioning
+ * system, from the transmitter stations' radio protocol to fixes
+ * coming out of position.c, running much faster than real time.
+ *
+ * Modeled:
+ *   - master_transmitter.ino and three slave_transmitter.ino
+ *     sketches, step for step: latency tests, the latency message,
+ *     'p', and sendPing() timing. SoftwareSerial writes block for
+ *     a character time per byte and lose any byte received while
+ *     writing; the receive buffer holds 64 bytes.
+ *   - XBees in transparent mode at 9600 baud: bytes are sent over
+ *     the air once the serial input has been idle for the
+ *     packetization timeout. Unslotted CSMA-CA: a random backoff,
+ *     then a clear channel assessment, backing off longer while
+ *     the channel is busy; two radios that both find it clear
+ *     within a turnaround time collide, and neither packet gets
+ *     through. The transmitters broadcast to every other radio,
+ *     once. The cars send only to the base station (their DL is
+ *     its address), which acknowledges, so a car's packet that
+ *     collides is sent again up to MAC_RETRIES times.
+ *   - The cars' own radio traffic: radio.c sending every fix to
+ *     the base station's XBee, in slots or at once (disable the
+ *     simulated car's with -q). With -n, more cars share the
+ *     channel. They stand still and are given a fix every cycle,
+ *     but send it with radio.c's radio_plan(), as the firmware
+ *     does. The base station counts the fixes that reach it.
+ *   - Sound travelling from each transmitter, Z feet above the
+ *     car, to the receiver on the moving car, and the receiver
+ *     tripping a few carrier cycles after the ping arrives, as
+ *     the transducer rings up past UltraDAC's threshold: more
+ *     cycles the farther and quieter the ping, or the higher the
+ *     threshold, and none if the ping never gets there. With -e,
+ *     the direct path of a ping is blocked at that rate and the
+ *     receiver trips on an echo that came a few feet farther.
+ *   - With -N, bursts of noise at that rate per second, of random
+ *     loudness and length. One louder than the threshold trips
+ *     the comparator, which GlitchCounter counts, and one longer
+ *     than the glitch filter makes a capture as a ping would.
+ *   - UltraTimer capturing every ping, its interrupt after every
+ *     POSITION_TRANSMITTERS pings, and the timer being reset then. One ping keeps the
+ *     receiver busy for HOLDOFF, so echoes within that merge in.
+ *     agc.c setting UltraDAC, and starting UltraCounter over.
+ *   - The rest of the car firmware position.c depends on: the
+ *     clock, and hall ticks for dead reckoning with position_now().
+ * Not modeled: the Arduinos' hardware serial debug output, and
+ * how long the solver takes on the 8051, beyond a fixed delay for
+ * the other cars.
+ *
+ * Reports fix rate, latency from the master's ping to the fix, fix
+ * accuracy against where the car really was, how far off each
+ * slave's ping timing was, what went wrong when cycles were lost,
+ * how many of each car's fixes reached the base station, how
+ * often the solver left out the pings that came off echoes, how
+ * many pings were too quiet for the threshold or came while the
+ * receiver was shut, and what UltraDAC was as each ping arrived.
+ * -g runs the simulation for 1 up to the given number of cars,
+ * with the fixes sent at once and in slots, and prints a table of
+ * how many fixes each car gets through as the number grows.
+ *
+ * Build and run from the repository root:
+ *   cc -std=gnu89 -O2 -Isim/hal -IPSoC_Creator/Carlab.cydsn \
+ *      sim/position_sim.c sim/hal/hal.c sim/hal/components.c \
+ *      $(ls PSoC_Creator/Carlab.cydsn/[a-z]*.c | grep -v main.c) -lm \
+ *      -o position_sim
+ *   ./position_sim [-t seconds] [-s seed] [-v speed] [-r radius]
+ *                  [-m miss probability] [-e echo probability]
+ *                  [-l radio loss probability] [-N noise bursts per second]
+ *                  [-n cars] [-S slots] [-g cars] [-A] [-q] [-c] [-T]
+ * -A sets the agc parameter to 0, for UltraDAC's fixed threshold.
+ * -c prints every fix as CSV. -T dumps position.c's event trace after
+ * every receiver interrupt, as the trace shell command would, for
+ * host/trace_decode. -S sets radio_slots for every car; it is the
+ * number of cars by default, and 0 sends fixes at once. Add
+ * -DPOSITION_TRANSMITTERS=5 (or 6) to the cc line to simulate a room
+ * with more transmitters. Exits nonzero if there were no fixes at all.
+ * ========================================
+ */
+
+#include <project.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "hal.h"
+#include "clock.h"
+#include "speed.h"
+#include "steer.h"
+#include "position.h"
+#include "odometry.h"
+#include "trace.h"
+#include "radio.h"
+#include "sched.h"
+#include "agc.h"
+#include "journal.h"
+
+#define PI 3.14159265358979
+
+// Transmitter stations, as position.c assumes they are
+#define X 23.5  // feet between the first and second transmitters
+#define Y 33.75  // feet between the second and third transmitters
+#define Z 7.583  // feet above the receiver
+#define WAVE_SPEED 1135.0  // feet per second
+#define NUM_SLAVES (POSITION_TRANSMITTERS - 1u)
+
+// From the sketches, in microseconds
+#define NUM_TESTS 5
+#define TIMEOUT 50000.0
+#define DURATION 5000.0
+#define MAX_LAT_TIME 20000.0
+#define SOFTWARE_SERIAL_DELAY 2000.0
+#define SLAVE_SPACING 100000.0
+#define MASTER_DELAY (SLAVE_SPACING * NUM_SLAVES)
+#define LOOP_OVERHEAD 20.0  // for loop() to come around and notice a byte
+
+// Radio
+#define BYTE_TIME (10 * 1e6 / 9600)  // 8N1 at 9600 baud
+#define RX_BUFFER 64  // SoftwareSerial's receive buffer
+#define XBEE_BUFFER 100  // bytes in one packet
+#define PACKETIZATION (3 * BYTE_TIME)  // XBee RO: idle time before sending
+#define RF_LATENCY 600.0  // processing, before and after the air time
+#define RF_BYTE_TIME 32.0  // 250 kbit/s over the air
+#define RF_OVERHEAD 15  // bytes of PHY and MAC framing per packet
+#define BACKOFF_PERIOD 320.0
+#define TURNAROUND 192.0  // from a clear channel assessment to sending
+#define MIN_BE 3  // CSMA-CA backoff exponents
+#define MAX_BE 5
+#define MAX_BACKOFFS 4  // busy assessments before a packet is dropped
+#define MAC_RETRIES 3  // of a collided packet sent to one radio
+#define PACKET_POOL 128
+#define MAX_AIR 32  // packets on the air at once
+
+// Receiver
+#define CARRIER_PERIOD 40.0  // 25 kHz
+#define DETECT_CYCLES 3.0  // carrier cycles to trip the comparator up close
+#define RING_CYCLES 8.0  // for the transducer to ring up to 63% of a ping's level
+#define PING_LEVEL 2560.0  // UltraDAC codes a ping reaches, times feet travelled
+#define NOISE_LEVEL 16.0  // mean UltraDAC codes a burst of noise reaches
+#define NOISE_LENGTH 100.0  // mean microseconds a burst lasts
+#define GLITCH_FILTER 100.0  // shorter trips don't make a capture
+#define HOLDOFF 6000.0  // a ping keeps the comparator busy this long
+#define PING_CAPTURES POSITION_TRANSMITTERS  // captures per interrupt
+#define ECHO_MIN 2.0  // feet farther an echo comes than the direct path
+#define ECHO_MAX 20.0
+#define NOISE 0xFFu  // a capture's tx when noise made it
+
+// Cars
+#define MAX_CARS 32
+#define SOLVE_TIME 30000.0  // from the last ping arriving to another car's fix
+#define SENT_ERROR 1000.0  // how far off another car's idea of the cycle is
+#define LINE_LEN 32
+
+#define MAX_EVENTS 8192
+#define PID_PERIOD 10000.0
+#define POLL_PERIOD 1000.0  // for the main loop's tasks
+
+// The simulated car is car 0; the other cars follow it
+enum {
+    MASTER = 0,
+    BASE = NUM_SLAVES + 1,
+    CAR = NUM_SLAVES + 2,
+    MAX_NODES = CAR + MAX_CARS,
+};
+
+enum event_type {
+    EV_WAKE,  // an Arduino's loop() continues
+    EV_XBEE_SEND,  // a radio's packetization timeout expires
+    EV_DELIVER,  // a packet reaches a radio
+    EV_RX_BYTE,  // a byte reaches an Arduino from its radio
+    EV_PING,  // a ping reaches the receiver
+    EV_TRIP,  // the comparator trips on a ping
+    EV_NOISE,  // a burst of noise reaches the receiver
+    EV_PID,  // Speed_PID_Timer period
+    EV_HALL,  // a magnet passes the hall sensor
+    EV_CCA,  // a radio assesses the channel before sending a packet
+    EV_AIR_END,  // a packet has been sent over the air
+    EV_POLL,  // the car's main loop runs its tasks
+    EV_OTHER_FIX,  // another car has worked out a fix
+    EV_OTHER_SEND,  // another car's slot comes
+};
+
+struct event {
+    double time;
+    uint32 order;  // breaks ties in the order events were scheduled
+    enum event_type type;
+    uint8 node, byte;
+    uint32 generation;
+    double a, b;
+};
+
+enum master_state {
+    M_CYCLE, M_TESTS, M_SEND, M_WAIT, M_NEXT, M_REPORT, M_ACK, M_NEXT_SLAVE,
+    M_PING, M_EMIT, M_DELAY,
+};
+
+enum slave_state {
+    S_IDLE, S_LAT, S_LAT_DONE, S_PING_WAIT, S_EMIT,
+};
+
+struct node {
+    // Arduino and SoftwareSerial
+    uint8 rx[RX_BUFFER];
+    uint8 rx_head, rx_count;
+    double write_start, busy_until;  // current SoftwareSerial write
+
+    // XBee
+    uint8 tx[XBEE_BUFFER];
+    uint8 tx_count;
+    uint32 tx_generation;
+    double serial_in_free, serial_out_free;
+
+    // loop(), as a state machine
+    uint8 state;
+    uint32 wake_generation;
+    uint8 waiting_byte;
+    int i, j, success;
+    double start, total, lat_time;
+    uint8 c, bytes[4];
+};
+
+struct packet {
+    uint8 bytes[XBEE_BUFFER];
+    uint8 count;
+};
+
+struct transmission {
+    double start, end;
+    uint8 node, packet, retry, collided;
+};
+
+// A car other than the simulated one
+struct other_car {
+    double x, y;
+    struct radio_cycle cycle;
+    char line[LINE_LEN];  // waiting for its slot
+    uint32 generation;  // of the EV_OTHER_SEND that will send line
+};
+
+// What reached the base station from each car
+struct car_stats {
+    uint32 fixes, sent, delivered;
+};
+
+struct capture {
+    uint8 tx;
+    uint8 echo;  // the direct path was blocked
+    double emitted, arrived;
+};
+
+struct stat {
+    uint32 n;
+    double sum, sum_squares, max;
+};
+
+// Simulation state
+static struct event events[MAX_EVENTS];
+static uint16 n_events = 0u;
+static uint32 event_order = 0u;
+static double now = 0.0;
+static struct node nodes[MAX_NODES];
+static struct packet packets[PACKET_POOL];
+static uint8 next_packet = 0u;
+static struct transmission air[MAX_AIR];
+static uint8 n_air = 0u;
+static struct other_car others[MAX_CARS];
+static uint32 rng_state;
+
+// Parameters
+static double sim_time = 120.0;  // seconds
+static double car_speed = 4.0;  // feet per second
+static double car_radius = 8.0;  // feet
+static double miss_probability = 0.0;
+static double echo_probability = 0.0;
+static double loss_probability = 0.0;
+static uint8 car_quiet = 0u;
+static uint8 csv = 0u;
+static uint8 dump_trace = 0u;
+static uint8 num_cars = 1u;
+static int slots = -1;  // radio_slots; -1 for the number of cars
+static uint8 sweep = 0u;  // print one row of the -g table
+static double noise_rate = 0.0;  // bursts per second
+static uint8 agc_off = 0u;
+
+// Receiver
+static struct capture group[PING_CAPTURES];  // by hal_ultra_count
+static double last_detect = -1e9;
+static double ping_level[POSITION_TRANSMITTERS];  // of each one on its way
+static double ping_jitter[POSITION_TRANSMITTERS];  // carrier cycles
+
+// Results
+static uint32 cycles = 0u, pings_missed = 0u, pings_merged = 0u;
+static uint32 pings_shut_out = 0u, pings_too_quiet = 0u;
+static uint32 noise_bursts = 0u, noise_trips = 0u, noise_captures = 0u;
+static uint32 pings_echoed = 0u, echo_sets = 0u, echo_fixes = 0u;
+static uint32 echoes_excluded = 0u, wrongly_excluded = 0u;
+static uint32 interrupts = 0u, misaligned = 0u, fixes = 0u;
+static uint32 bytes_lost_writing = 0u, bytes_lost_overflow = 0u;
+static uint32 packets_lost = 0u, latency_messages = 0u;
+static uint32 packets_sent = 0u, channel_busy = 0u;
+static uint32 collisions = 0u;  // of the transmitters' packets, which are lost
+static uint32 car_collisions = 0u, car_retries = 0u;  // of the cars' packets
+static struct car_stats car_stats[MAX_CARS];
+static char base_line[LINE_LEN];
+static uint8 base_len = 0u;
+static uint32 base_garbled = 0u;
+static double last_master_ping = -1e9;
+static struct stat slave_offset[NUM_SLAVES + 1], slave_lat[NUM_SLAVES + 1];
+static struct stat latency, time_error, now_error;
+static struct stat stale_error;  // of the fix position_now() started from
+static struct stat moved, moved_error;  // since that fix, and by propagating it
+static struct stat threshold[POSITION_TRANSMITTERS];  // as each ping arrived
+static double *fix_errors = 0;
+static uint32 fix_errors_size = 0u;
+
+
+static double uniform(double lo, double hi) {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return lo + (hi - lo) * (rng_state / 4294967296.0);
+}
+
+static void stat_add(struct stat *s, double value) {
+    s->n++;
+    s->sum += value;
+    s->sum_squares += value * value;
+    if (fabs(value) > s->max)
+        s->max = fabs(value);
+}
+
+static double stat_mean(const struct stat *s) {
+    return s->n > 0u ? s->sum / s->n : 0.0;
+}
+
+static double stat_sd(const struct stat *s) {
+    double mean = stat_mean(s);
+    return s->n > 1u ? sqrt(fabs(s->sum_squares / s->n - mean * mean)) : 0.0;
+}
+
+
+/*
+ * Event queue: a binary heap ordered by time, then by scheduling order, so
+ * the simulation is deterministic.
+ */
+static uint8 before(const struct event *a, const struct event *b) {
+    return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
+
+static void schedule(double time, enum event_type type, uint8 node,
+                     uint8 byte, uint32 generation, double a, double b) {
+    struct event e, tmp;
+    uint16 i;
+
+    if (n_events == MAX_EVENTS) {
+        fprintf(stderr, "event queue full\n");
+        exit(2);
+    }
+    e.time = time;
+    e.order = event_order++;
+    e.type = type;
+    e.node = node;
+    e.byte = byte;
+    e.generation = generation;
+    e.a = a;
+    e.b = b;
+
+    i = n_events++;
+    events[i] = e;
+    while (i > 0u && before(&events[i], &events[(i - 1u) / 2u])) {
+        tmp = events[i];
+        events[i] = events[(i - 1u) / 2u];
+        events[(i - 1u) / 2u] = tmp;
+        i = (i - 1u) / 2u;
+    }
+}
+
+static struct event next_event(void) {
+    struct event top = events[0], tmp;
+    uint16 i = 0u, child;
+
+    events[0] = events[--n_events];
+    for (;;) {
+        child = 2u*i + 1u;
+        if (child >= n_events)
+            break;
+        if (child + 1u < n_events && before(&events[child + 1u], &events[child]))
+            child++;
+        if (!before(&events[child], &events[i]))
+            break;
+        tmp = events[i];
+        events[i] = events[child];
+        events[child] = tmp;
+        i = child;
+    }
+    return top;
+}
+
+
+/*
+ * The car drives counterclockwise around a circle centered on the origin.
+ */
+static void car_position(double t, double *x, double *y) {
+    double angle = car_speed * t * 1e-6 / car_radius;
+
+    *x = car_radius * cos(angle);
+    *y = car_radius * sin(angle);
+}
+
+static void transmitter_position(uint8 tx, double *x, double *y) {
+    // Counterclockwise from the corner position.c calls the first, then
+    // the middle of the left side and of the right
+    static const double tx_x[] = {-X/2, X/2, X/2, -X/2, -X/2, X/2};
+    static const double tx_y[] = {-Y/2, -Y/2, Y/2, Y/2, 0.0, 0.0};
+
+    *x = tx_x[tx];
+    *y = tx_y[tx];
+}
+
+static void set_time(double t) {
+    hal_time = (uint32)t;
+}
+
+
+/*
+ * Radios
+ */
+
+// Bytes reach the node's XBee by done; it sends them once it's been idle
+// for the packetization timeout.
+static void xbee_accept(uint8 id, const uint8 *bytes, uint8 count, double done) {
+    struct node *n = &nodes[id];
+    uint8 i;
+
+    for (i = 0u; i < count && n->tx_count < XBEE_BUFFER; i++)
+        n->tx[n->tx_count++] = bytes[i];
+    n->tx_generation++;
+    schedule(done + PACKETIZATION, EV_XBEE_SEND, id, 0u, n->tx_generation,
+             0.0, 0.0);
+}
+
+// SoftwareSerial.write(): blocks until the bytes are out. Returns when.
+static double arduino_write(uint8 id, const uint8 *bytes, uint8 count) {
+    struct node *n = &nodes[id];
+
+    n->write_start = now;
+    n->busy_until = now + count * BYTE_TIME;
+    xbee_accept(id, bytes, count, n->busy_until);
+    return n->busy_until;
+}
+
+// The PSoC's UART buffers, so sending doesn't block
+static void car_send(uint8 id, const char *string) {
+    struct node *n = &nodes[id];
+    uint8 count = (uint8)strlen(string);
+    double start = n->serial_in_free > now ? n->serial_in_free : now;
+
+    n->serial_in_free = start + count * BYTE_TIME;
+    xbee_accept(id, (const uint8 *)string, count, n->serial_in_free);
+    car_stats[id - CAR].sent++;
+}
+
+// What radio.c sends from the simulated car
+static void uart_output(const char *string) {
+    car_send(CAR, string);
+}
+
+// A random CSMA-CA backoff, longer after every busy assessment
+static double backoff(uint32 backoffs) {
+    uint32 be = MIN_BE + backoffs;
+
+    if (be > MAX_BE)
+        be = MAX_BE;
+    return floor(uniform(0.0, 1u << be)) * BACKOFF_PERIOD;
+}
+
+// The packetization timeout has expired, so the XBee sends what it has
+static void xbee_send(uint8 id) {
+    struct node *n = &nodes[id];
+    struct packet *p = &packets[next_packet];
+
+    memcpy(p->bytes, n->tx, n->tx_count);
+    p->count = n->tx_count;
+    n->tx_count = 0u;
+    schedule(now + backoff(0u), EV_CCA, id, next_packet, 0u, 0.0, 0.0);
+    next_packet = (next_packet + 1u) % PACKET_POOL;
+}
+
+// The channel looks clear if nothing is on the air right now
+static uint8 channel_clear(void) {
+    uint8 i;
+
+    for (i = 0u; i < n_air; i++)
+        if (air[i].start <= now && air[i].end > now)
+            return 0u;
+    return 1u;
+}
+
+// A clear channel assessment, after backoffs busy ones, for the given
+// retry of the packet
+static void xbee_assess(uint8 id, uint8 packet, uint8 backoffs, uint8 retry) {
+    struct transmission *t;
+    uint8 i;
+
+    if (!channel_clear()) {
+        if (backoffs >= MAX_BACKOFFS)
+            channel_busy++;
+        else
+            schedule(now + backoff(backoffs + 1u), EV_CCA, id, packet,
+                     (uint32)retry << 8 | (backoffs + 1u), 0.0, 0.0);
+        return;
+    }
+    if (n_air == MAX_AIR) {
+        fprintf(stderr, "too many packets on the air\n");
+        exit(2);
+    }
+    t = &air[n_air++];
+    t->start = now + TURNAROUND;
+    t->end = t->start + (packets[packet].count + RF_OVERHEAD) * RF_BYTE_TIME;
+    t->node = id;
+    t->packet = packet;
+    t->retry = retry;
+    t->collided = 0u;
+    for (i = 0u; i + 1u < n_air; i++) {
+        if (air[i].end > t->start && air[i].start < t->end) {
+            air[i].collided = 1u;
+            t->collided = 1u;
+        }
+    }
+    packets_sent++;
+    schedule(t->end, EV_AIR_END, id, packet, 0u, 0.0, 0.0);
+}
+
+// A packet has finished going over the air. The radios it was for pass it
+// on, unless it collided.
+static void xbee_air_end(uint8 id, uint8 packet) {
+    uint8 i, r, collided = 0u, retry = 0u;
+
+    for (i = 0u; i < n_air; i++) {
+        if (air[i].node == id && air[i].packet == packet) {
+            collided = air[i].collided;
+            retry = air[i].retry;
+            air[i] = air[--n_air];
+            break;
+        }
+    }
+    if (collided && id < CAR) {
+        collisions++;
+        return;
+    }
+    if (collided) {
+        // No acknowledgement from the base station
+        if (retry < MAC_RETRIES) {
+            car_retries++;
+            schedule(now + backoff(0u), EV_CCA, id, packet,
+                     (uint32)(retry + 1u) << 8, 0.0, 0.0);
+        }
+        else {
+            car_collisions++;
+        }
+        return;
+    }
+    for (r = 0u; r < CAR; r++) {
+        if (r == id || (id >= CAR && r != BASE))
+            continue;
+        if (uniform(0.0, 1.0) < loss_probability) {
+            packets_lost++;
+            continue;
+        }
+        schedule(now + RF_LATENCY, EV_DELIVER, r, packet, 0u, 0.0, 0.0);
+    }
+}
+
+/*
+ * base_receive:
+ * The base station's XBee passes on everything it hears, including the
+ * transmitters' traffic, and the fixes are picked out of it as
+ * host/telemetry does: the end of each line, from the last X, with the
+ * car number in the digits just before the ":X".
+ */
+static void base_receive(uint8 byte) {
+    char *x;
+    unsigned car = 0u, scale = 1u;
+    float fx, fy;
+
+    if (byte != '\n') {
+        if (base_len == LINE_LEN - 1u)
+            memmove(base_line, base_line + 1, --base_len);
+        base_line[base_len++] = (char)byte;
+        return;
+    }
+    // The latency messages are binary, so there may be NULs before the X
+    base_line[base_len] = '\0';
+    x = base_line + base_len;
+    while (x > base_line && *x != 'X')
+        x--;
+    if (x - base_line >= 2 && x[-1] == ':' && x[-2] >= '0' && x[-2] <= '9' &&
+            sscanf(x, "X%fY%f", &fx, &fy) == 2) {
+        x--;
+        while (x > base_line && x[-1] >= '0' && x[-1] <= '9') {
+            x--;
+            car += (unsigned)(*x - '0') * scale;
+            scale *= 10u;
+        }
+        if (car < num_cars)
+            car_stats[car].delivered++;
+        else
+            base_garbled++;
+    }
+    else if (base_len > 0u) {
+        base_garbled++;
+    }
+    base_len = 0u;
+}
+
+// The receiving XBee passes the packet on at 9600 baud
+static void xbee_deliver(uint8 id, const struct packet *p) {
+    struct node *n = &nodes[id];
+    double start = n->serial_out_free > now ? n->serial_out_free : now;
+    uint8 i;
+
+    for (i = 0u; i < p->count; i++)
+        schedule(start + (i + 1u) * BYTE_TIME, EV_RX_BYTE, id, p->bytes[i], 0u,
+                 0.0, 0.0);
+    n->serial_out_free = start + p->count * BYTE_TIME;
+}
+
+
+/*
+ * Arduino loop()s. Each runs until it would wait, and asks to be woken.
+ */
+static void wake_at(uint8 id, double t) {
+    nodes[id].wake_generation++;
+    schedule(t, EV_WAKE, id, 0u, nodes[id].wake_generation, 0.0, 0.0);
+}
+
+// Wait for a byte to arrive, or until deadline (if it isn't zero)
+static void wait_byte(uint8 id, double deadline) {
+    nodes[id].waiting_byte = 1u;
+    nodes[id].wake_generation++;
+    if (deadline > 0.0)
+        schedule(deadline, EV_WAKE, id, 0u, nodes[id].wake_generation, 0.0, 0.0);
+}
+
+static uint8 available(uint8 id) {
+    return nodes[id].rx_count > 0u;
+}
+
+static uint8 read_byte(uint8 id) {
+    struct node *n = &nodes[id];
+    uint8 c = n->rx[n->rx_head];
+
+    n->rx_head = (n->rx_head + 1u) % RX_BUFFER;
+    n->rx_count--;
+    return c;
+}
+
+static void arduino_receive(uint8 id, uint8 byte) {
+    struct node *n = &nodes[id];
+
+    if (id == BASE) {
+        base_receive(byte);
+        return;
+    }
+
+    // SoftwareSerial turns interrupts off while it writes
+    if (now - BYTE_TIME < n->busy_until && now > n->write_start) {
+        bytes_lost_writing++;
+        return;
+    }
+    if (n->rx_count == RX_BUFFER) {
+        bytes_lost_overflow++;
+        return;
+    }
+    n->rx[(n->rx_head + n->rx_count) % RX_BUFFER] = byte;
+    n->rx_count++;
+    if (n->waiting_byte) {
+        n->waiting_byte = 0u;
+        wake_at(id, now + LOOP_OVERHEAD);
+    }
+}
+
+static void emit_ping(uint8 tx) ;
+
+static void master_step(void) {
+    struct node *n = &nodes[MASTER];
+    uint8 b[5];
+    double done;
+    uint32 lat;
+
+    n->waiting_byte = 0u;
+    for (;;) {
+        switch (n->state) {
+        case M_CYCLE:
+            n->i = 0;
+            n->state = M_TESTS;
+            break;
+        case M_TESTS:
+            n->total = 0.0;
+            n->success = 0;
+            n->j = 0;
+            n->state = M_SEND;
+            break;
+        case M_SEND:
+            n->start = now;
+            b[0] = (uint8)('a' + n->i);
+            n->state = M_WAIT;
+            wake_at(MASTER, arduino_write(MASTER, b, 1u));
+            return;
+        case M_WAIT:
+            if (available(MASTER)) {
+                read_byte(MASTER);
+                n->total += now - n->start;
+                n->success++;
+            }
+            else if (now < n->start + TIMEOUT) {
+                wait_byte(MASTER, n->start + TIMEOUT);
+                return;
+            }
+            n->state = M_NEXT;
+            break;
+        case M_NEXT:
+            n->j++;
+            n->state = n->j < NUM_TESTS ? M_SEND : M_REPORT;
+            break;
+        case M_REPORT:
+            if (n->success == 0) {
+                n->state = M_NEXT_SLAVE;
+                break;
+            }
+            lat = (uint32)(n->total / (2 * n->success));
+            stat_add(&slave_lat[n->i + 1], lat / 1000.0);
+            latency_messages++;
+            b[0] = (uint8)('A' + n->i);
+            b[1] = (uint8)(lat >> 24);
+            b[2] = (uint8)(lat >> 16);
+            b[3] = (uint8)(lat >> 8);
+            b[4] = (uint8)lat;
+            done = arduino_write(MASTER, b, 5u);
+            n->start = done;
+            n->state = M_ACK;
+            wake_at(MASTER, done);
+            return;
+        case M_ACK:
+            if (available(MASTER)) {
+                read_byte(MASTER);
+            }
+            else if (now < n->start + TIMEOUT) {
+                wait_byte(MASTER, n->start + TIMEOUT);
+                return;
+            }
+            n->state = M_NEXT_SLAVE;
+            break;
+        case M_NEXT_SLAVE:
+            n->i++;
+            n->state = n->i < (int)NUM_SLAVES ? M_TESTS : M_PING;
+            break;
+        case M_PING:
+            b[0] = 'p';
+            n->state = M_EMIT;
+            wake_at(MASTER, arduino_write(MASTER, b, 1u));
+            return;
+        case M_EMIT:
+            emit_ping(0u);
+            cycles++;
+            n->state = M_DELAY;
+            wake_at(MASTER, now + DURATION);
+            return;
+        case M_DELAY:
+            n->state = M_CYCLE;
+            wake_at(MASTER, now + MASTER_DELAY);
+            return;
+        }
+    }
+}
+
+static void slave_step(uint8 id) {
+    struct node *n = &nodes[id];
+    double temp;
+
+    n->waiting_byte = 0u;
+    for (;;) {
+        switch (n->state) {
+        case S_IDLE:
+            if (!available(id)) {
+                wait_byte(id, 0.0);
+                return;
+            }
+            n->c = read_byte(id);
+            if (n->c == 'a' + id - 1) {
+                wake_at(id, arduino_write(id, &n->c, 1u));
+                return;
+            }
+            else if (n->c == 'A' + id - 1) {
+                n->j = 0;
+                n->start = now;
+                n->state = S_LAT;
+            }
+            else if (n->c == 'p') {
+                n->state = S_PING_WAIT;
+                wake_at(id, now + SOFTWARE_SERIAL_DELAY);
+                return;
+            }
+            break;
+        case S_LAT:
+            if (available(id)) {
+                n->bytes[n->j++] = read_byte(id);
+                n->start = now;
+                if (n->j == 4)
+                    n->state = S_LAT_DONE;
+            }
+            else if (now < n->start + TIMEOUT) {
+                wait_byte(id, n->start + TIMEOUT);
+                return;
+            }
+            else {
+                n->state = S_LAT_DONE;
+            }
+            break;
+        case S_LAT_DONE:
+            if (n->j == 4) {
+                temp = (double)((uint32)n->bytes[0] << 24 |
+                                (uint32)n->bytes[1] << 16 |
+                                (uint32)n->bytes[2] << 8 | n->bytes[3]);
+                if (temp < MAX_LAT_TIME)
+                    n->lat_time = temp;
+            }
+            n->state = S_IDLE;
+            wake_at(id, arduino_write(id, &n->c, 1u));
+            return;
+        case S_PING_WAIT:
+            n->state = S_EMIT;
+            wake_at(id, now + SLAVE_SPACING * id - n->lat_time);
+            return;
+        case S_EMIT:
+            emit_ping(id);
+            n->state = S_IDLE;
+            wake_at(id, now + DURATION);
+            return;
+        }
+    }
+}
+
+
+/*
+ * The other cars
+ */
+
+// The last ping of a cycle has been sent. Each other car works out its
+// fix once the ping has reached it, if it heard the whole cycle.
+static void others_locate(void) {
+    double tx_x, tx_y, d;
+    uint8 k;
+
+    if (now - last_master_ping > SLAVE_SPACING * (NUM_SLAVES + 1))
+        return;
+    transmitter_position(NUM_SLAVES, &tx_x, &tx_y);
+    for (k = 1u; k < num_cars; k++) {
+        d = sqrt((others[k].x - tx_x)*(others[k].x - tx_x) +
+                 (others[k].y - tx_y)*(others[k].y - tx_y) + Z*Z);
+        schedule(now + d / WAVE_SPEED * 1e6 + SOLVE_TIME, EV_OTHER_FIX, k, 0u,
+                 0u, last_master_ping + uniform(-SENT_ERROR, SENT_ERROR), 0.0);
+    }
+}
+
+// Another car has a fix of the cycle whose first ping was sent at sent,
+// and hands it to radio_plan() as radio_report_fix() would
+static void other_fix(uint8 k, double sent) {
+    struct other_car *c = &others[k];
+    uint32 at;
+
+    car_stats[k].fixes++;
+    sprintf(c->line, "%u:X%.2fY%.2f\n", (unsigned)k, c->x, c->y);
+    if (radio_slots == 0u) {
+        car_send(CAR + k, c->line);
+        return;
+    }
+    at = radio_plan(&c->cycle, (uint32)sent, (uint32)now, k, radio_slots);
+    if (at != 0u)
+        schedule(now + (int32)(at - (uint32)now), EV_OTHER_SEND, k, 0u,
+                 ++c->generation, 0.0, 0.0);
+}
+
+
+/*
+ * Sound and the receiver
+ */
+static void emit_ping(uint8 tx) {
+    double tx_x, tx_y, x, y, d = 0.0, arrival = now;
+    uint8 i, echo = 0u;
+
+    if (tx == 0u)
+        last_master_ping = now;
+    else
+        stat_add(&slave_offset[tx],
+                 (now - last_master_ping - SLAVE_SPACING * tx) / 1000.0);
+
+    // The car moves a little while the sound is on its way
+    transmitter_position(tx, &tx_x, &tx_y);
+    for (i = 0u; i < 3u; i++) {
+        car_position(arrival, &x, &y);
+        d = sqrt((x - tx_x)*(x - tx_x) + (y - tx_y)*(y - tx_y) + Z*Z);
+        arrival = now + d / WAVE_SPEED * 1e6;
+    }
+
+    if (tx == NUM_SLAVES)
+        others_locate();
+
+    if (uniform(0.0, 1.0) < miss_probability) {
+        pings_missed++;
+        return;
+    }
+    if (echo_probability > 0.0 && uniform(0.0, 1.0) < echo_probability) {
+        pings_echoed++;
+        echo = 1u;
+        d += uniform(ECHO_MIN, ECHO_MAX);
+    }
+    ping_level[tx] = PING_LEVEL / d;
+    ping_jitter[tx] = uniform(0.0, 1.0);
+    schedule(now + d / WAVE_SPEED * 1e6, EV_PING, tx, echo, 0u, now,
+             arrival);
+}
+
+// A ping reaches the receiver. The transducer rings up towards the ping's
+// level, and the comparator trips once it passes UltraDAC's, if it ever
+// does; so the quieter the ping, or the higher the threshold, the later.
+static void ping_arrives(uint8 tx, uint8 echo, double emitted,
+                         double arrived) {
+    double ratio = hal_ultra_threshold / ping_level[tx], cycles_to_trip;
+
+    stat_add(&threshold[tx], hal_ultra_threshold);
+    if (ratio >= 1.0) {
+        if (hal_ultra_threshold == AGC_CLOSED)
+            pings_shut_out++;
+        else
+            pings_too_quiet++;
+        return;
+    }
+    cycles_to_trip = ceil(DETECT_CYCLES - RING_CYCLES * log(1.0 - ratio) +
+                          ping_jitter[tx]);
+    schedule(now + cycles_to_trip * CARRIER_PERIOD, EV_TRIP, tx, echo, 0u,
+             emitted, arrived);
+}
+
+/*
+ * main_loop:
+ * What main.c does with a new fix, plus measuring it.
+ */
+static void main_loop(uint8 aligned) {
+    struct position_fix fix;
+    struct position_estimate est;
+    double true_x, true_y, then_x, then_y, error, arrived = 0.0;
+    uint8 echoed = 0u, used = 0u, i;
+
+    if (!position_data_available())
+        return;
+    position_snapshot(&fix);
+    fixes++;
+
+    // Whether the solver left out the pings that came off echoes, and no
+    // others
+    if (aligned) {
+        for (i = 0u; i < PING_CAPTURES; i++)
+            if (group[i].echo)
+                echoed |= 1u << i;
+        if (echoed != 0u)
+            echo_fixes++;
+        if (echoed != 0u && fix.excluded == echoed)
+            echoes_excluded++;
+        if (fix.excluded & ~echoed)
+            wrongly_excluded++;
+    }
+
+    car_position(fix.time, &true_x, &true_y);
+    error = sqrt((fix.x - true_x)*(fix.x - true_x) +
+                 (fix.y - true_y)*(fix.y - true_y));
+    if (fixes > fix_errors_size) {
+        fix_errors_size = fix_errors_size ? 2u * fix_errors_size : 256u;
+        fix_errors = realloc(fix_errors, fix_errors_size * sizeof(double));
+    }
+    fix_errors[fixes - 1u] = error;
+
+    if (aligned) {
+        stat_add(&latency, (now - group[0].emitted) / 1000.0);
+        for (i = 0u; i < PING_CAPTURES; i++)
+            if (!(fix.excluded & (1u << i))) {
+                arrived += group[i].arrived;
+                used++;
+            }
+        stat_add(&time_error, fix.time - arrived / used);
+    }
+
+    position_now(&est);
+    if (est.propagated) {
+        car_position(now, &true_x, &true_y);
+        stat_add(&now_error, sqrt((est.x - true_x)*(est.x - true_x) +
+                                  (est.y - true_y)*(est.y - true_y)));
+        stat_add(&stale_error, sqrt((fix.x - true_x)*(fix.x - true_x) +
+                                    (fix.y - true_y)*(fix.y - true_y)));
+
+        // Less the fix's own error: how well it was carried from its time
+        car_position(fix.time, &then_x, &then_y);
+        true_x -= then_x;
+        true_y -= then_y;
+        stat_add(&moved, sqrt(true_x*true_x + true_y*true_y));
+        true_x -= est.x - fix.x;
+        true_y -= est.y - fix.y;
+        stat_add(&moved_error, sqrt(true_x*true_x + true_y*true_y));
+    }
+
+    if (csv) {
+        car_position(fix.time, &true_x, &true_y);
+        printf("%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", now * 1e-6, fix.x,
+               fix.y, true_x, true_y, error,
+               aligned ? (now - group[0].emitted) / 1000.0 : 0.0);
+    }
+
+    // As drive_report_fix() does
+    if (!car_quiet) {
+        car_stats[0].fixes++;
+        radio_report_fix(&fix);
+    }
+}
+
+static void receiver_trip(uint8 tx, uint8 echo, double emitted,
+                          double arrived) {
+    uint8 i, aligned = 1u;
+
+    if (now - last_detect < HOLDOFF) {
+        if (tx != NOISE)
+            pings_merged++;
+        return;
+    }
+    last_detect = now;
+    if (tx == NOISE)
+        noise_captures++;
+
+    set_time(now);
+    group[hal_ultra_count].tx = tx;
+    group[hal_ultra_count].echo = echo;
+    group[hal_ultra_count].emitted = emitted;
+    group[hal_ultra_count].arrived = arrived;
+    hal_ultra_capture(hal_time - hal_ultra_reset);
+    if (hal_ultra_count < PING_CAPTURES)
+        return;
+
+    hal_interrupt(HAL_IRQ_ULTRA);
+    if (dump_trace)
+        trace_dump();
+    hal_ultra_reset = hal_time;
+    hal_ultra_count = 0u;
+    interrupts++;
+    for (i = 0u; i < PING_CAPTURES; i++)
+        if (group[i].tx != i)
+            aligned = 0u;
+    if (!aligned)
+        misaligned++;
+    for (i = 0u; aligned && i < PING_CAPTURES; i++)
+        if (group[i].echo) {
+            echo_sets++;
+            break;
+        }
+    main_loop(aligned);
+}
+
+// A burst of noise, and when the next one comes. It trips the comparator
+// if it's louder than UltraDAC's threshold, and makes a capture if it's
+// longer than the glitch filter too.
+static void noise_burst(void) {
+    double level = -NOISE_LEVEL * log(1.0 - uniform(0.0, 1.0));
+    double length = -NOISE_LENGTH * log(1.0 - uniform(0.0, 1.0));
+
+    schedule(now - log(1.0 - uniform(0.0, 1.0)) / noise_rate * 1e6, EV_NOISE,
+             0u, 0u, 0u, 0.0, 0.0);
+    noise_bursts++;
+    if (level <= hal_ultra_threshold)
+        return;
+    noise_trips++;
+    hal_ultra_trip();
+    if (length >= GLITCH_FILTER)
+        receiver_trip(NOISE, 0u, now, now);
+}
+
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-t seconds] [-s seed] [-v speed] [-r radius]"
+            " [-m miss probability] [-e echo probability]\n"
+            "       [-l radio loss probability] [-N noise bursts per second]\n"
+            "       [-n cars] [-S slots] [-g cars] [-A] [-q] [-c] [-T]\n",
+            name);
+    exit(2);
+}
+
+/*
+ * print_cars:
+ * Prints how many of each car's fixes reached the base station.
+ */
+static void print_cars(void) {
+    uint8 k;
+
+    if (radio_slots == 0u)
+        printf("\n%u cars sending each fix at once\n", (unsigned)num_cars);
+    else
+        printf("\n%u cars sending in %u slots\n", (unsigned)num_cars,
+               (unsigned)radio_slots);
+    printf("car   fixes    sent  at base  per second\n");
+    for (k = 0u; k < num_cars; k++)
+        printf("%3u  %6u  %6u  %7u  %10.2f\n", (unsigned)k, car_stats[k].fixes,
+               car_stats[k].sent, car_stats[k].delivered,
+               car_stats[k].delivered / sim_time);
+    printf("lines garbled at the base %u\n", base_garbled);
+}
+
+/*
+ * print_row:
+ * Prints one row of the -g table.
+ */
+static void print_row(void) {
+    double sum = 0.0, least = 1e9, rate;
+    uint32 fixes_made = 0u, delivered = 0u;
+    uint8 k;
+
+    // The simulated car's fixes depend on its own solver, so the rates are
+    // of the other cars, which get one every cycle, where there are any
+    for (k = num_cars > 1u ? 1u : 0u; k < num_cars; k++) {
+        rate = car_stats[k].delivered / sim_time;
+        sum += rate;
+        if (rate < least)
+            least = rate;
+        fixes_made += car_stats[k].fixes;
+        delivered += car_stats[k].delivered;
+    }
+    printf("%4u  %5u  %6.2f  %8.2f  %8.2f  %7.0f%%  %9u  %8u  %8u\n",
+           (unsigned)num_cars, (unsigned)radio_slots, cycles / sim_time,
+           sum / (num_cars > 1u ? num_cars - 1u : 1u), least,
+           fixes_made > 0u ? 100.0 * delivered / fixes_made : 0.0,
+           latency_messages, collisions, car_collisions);
+}
+
+/*
+ * simulate:
+ * Runs the simulation with the settings from the command line and prints
+ * what happened. Returns nonzero if there were no fixes at all.
+ */
+static int simulate(uint32 seed) {
+    struct event e;
+    struct timespec wall_start, wall_end;
+    double wall, end, tick, rms = 0.0;
+    uint32 i;
+    uint8 k;
+
+    rng_state = seed * 2654435761u + 1u;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    // Car firmware, as far as positioning and the radio need it
+    hal_time = 0u;
+    hal_uart_output = uart_output;
+    clock_init();
+    journal_init();
+    speed_init();
+    position_init();
+    if (agc_off)
+        agc_enabled = 0u;
+    steer_output = -1.0 / (car_radius * STEER_MAX_CURVATURE);
+    schedule(PID_PERIOD, EV_PID, 0u, 0u, 0u, 0.0, 0.0);
+    schedule(POLL_PERIOD, EV_POLL, 0u, 0u, 0u, 0.0, 0.0);
+    if (car_speed > 0.0) {
+        tick = odometry_tick_distance(steer_output) / car_speed * 1e6;
+        schedule(uniform(0.0, tick), EV_HALL, 0u, 0u, 0u, 0.0, 0.0);
+    }
+    if (noise_rate > 0.0)
+        schedule(-log(1.0 - uniform(0.0, 1.0)) / noise_rate * 1e6, EV_NOISE,
+                 0u, 0u, 0u, 0.0, 0.0);
+    radio_car = 0u;
+    if (slots < 0)
+        radio_slots = num_cars < RADIO_MAX_SLOTS ? num_cars : RADIO_MAX_SLOTS;
+    else
+        radio_slots = (uint8)slots;
+
+    // The other cars stand still, anywhere in the rectangle
+    for (k = 1u; k < num_cars; k++) {
+        others[k].x = uniform(-X/2, X/2);
+        others[k].y = uniform(-Y/2, Y/2);
+    }
+
+    // The slaves are listening by the time the master starts
+    memset(nodes, 0, sizeof(nodes));
+    for (k = 1u; k <= NUM_SLAVES; k++) {
+        nodes[k].state = S_IDLE;
+        wake_at(k, uniform(0.0, 1000.0));
+    }
+    nodes[MASTER].state = M_CYCLE;
+    wake_at(MASTER, 100000.0);
+
+    if (csv)
+        printf("time,x,y,true_x,true_y,error,latency_ms\n");
+    end = sim_time * 1e6;
+    while (n_events > 0u) {
+        e = next_event();
+        if (e.time > end)
+            break;
+        now = e.time;
+
+        switch (e.type) {
+        case EV_WAKE:
+            if (e.generation != nodes[e.node].wake_generation)
+                break;
+            if (e.node == MASTER)
+                master_step();
+            else
+                slave_step(e.node);
+            break;
+        case EV_XBEE_SEND:
+            if (e.generation == nodes[e.node].tx_generation &&
+                    nodes[e.node].tx_count > 0u)
+                xbee_send(e.node);
+            break;
+        case EV_CCA:
+            xbee_assess(e.node, e.byte, (uint8)e.generation,
+                        (uint8)(e.generation >> 8));
+            break;
+        case EV_AIR_END:
+            xbee_air_end(e.node, e.byte);
+            break;
+        case EV_DELIVER:
+            xbee_deliver(e.node, &packets[e.byte]);
+            break;
+        case EV_RX_BYTE:
+            arduino_receive(e.node, e.byte);
+            break;
+        case EV_PING:
+            ping_arrives(e.node, e.byte, e.a, e.b);
+            break;
+        case EV_TRIP:
+            hal_ultra_trip();
+            receiver_trip(e.node, e.byte, e.a, e.b);
+            break;
+        case EV_NOISE:
+            noise_burst();
+            break;
+        case EV_PID:
+            set_time(now);
+            hal_interrupt(HAL_IRQ_SPEED_PID);
+            schedule(now + PID_PERIOD, EV_PID, 0u, 0u, 0u, 0.0, 0.0);
+            break;
+        case EV_HALL:
+            set_time(now);
+            hal_hall_capture(hal_time);
+            schedule(now + odometry_tick_distance(steer_output) / car_speed * 1e6,
+                     EV_HALL, 0u, 0u, 0u, 0.0, 0.0);
+            break;
+        case EV_POLL:
+            // A task can keep itself ready, so don't wait for them all to
+            // finish
+            set_time(now);
+            for (k = 0u; k < SCHED_TASKS && sched_poll(); k++)
+                ;
+            schedule(now + POLL_PERIOD, EV_POLL, 0u, 0u, 0u, 0.0, 0.0);
+            break;
+        case EV_OTHER_FIX:
+            other_fix(e.node, e.a);
+            break;
+        case EV_OTHER_SEND:
+            if (e.generation == others[e.node].generation)
+                car_send(CAR + e.node, others[e.node].line);
+            break;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    wall = (wall_end.tv_sec - wall_start.tv_sec) +
+           (wall_end.tv_nsec - wall_start.tv_nsec) * 1e-9;
+    if (csv)
+        return 0;
+    if (sweep) {
+        print_row();
+        return 0;
+    }
+
+    printf("simulated %.0f s in %.3f s (%.0fx real time)\n", sim_time, wall,
+           sim_time / wall);
+    printf("car: %.1f ft/s around a %.1f ft circle; radio %s\n", car_speed,
+           car_radius, car_quiet ? "quiet" : "sends every fix");
+    printf("\nmaster cycles      %6u  (%.0f ms apart)\n", cycles,
+           cycles > 0u ? sim_time * 1000 / cycles : 0.0);
+    printf("receiver interrupts %5u  misaligned %u\n", interrupts, misaligned);
+    printf("fixes              %6u  (%.2f per second, %.0f%% of cycles)\n",
+           fixes, fixes / sim_time, cycles > 0u ? 100.0 * fixes / cycles : 0.0);
+    printf("pings missed %u, merged into the previous ping %u\n",
+           pings_missed, pings_merged);
+    printf("receiver: pings too quiet for the threshold %u, shut out between "
+           "windows %u\n", pings_too_quiet, pings_shut_out);
+    if (noise_rate > 0.0)
+        printf("noise: %u bursts, %u tripped the comparator, %u made "
+               "captures\n", noise_bursts, noise_trips, noise_captures);
+    if (echo_probability > 0.0)
+        printf("%u transmitters: pings off echoes %u, in %u sets; fixes from "
+               "them %u,\n     %u leaving out just the echoes; fixes leaving "
+               "out direct pings %u\n", (unsigned)POSITION_TRANSMITTERS,
+               pings_echoed, echo_sets, echo_fixes, echoes_excluded,
+               wrongly_excluded);
+    printf("radio: %u latency messages, %u packets lost, %u bytes lost while "
+           "writing, %u to full buffers\n", latency_messages, packets_lost,
+           bytes_lost_writing, bytes_lost_overflow);
+    printf("air: %u packets, %u of the transmitters' lost to collisions, "
+           "%u to a busy channel;\n     %u of the cars' sent again after "
+           "colliding, %u lost\n", packets_sent, collisions, channel_busy,
+           car_retries, car_collisions);
+
+    printf("\nslave ping timing error (ms)   mean     sd    max   latTime\n");
+    for (k = 1u; k <= NUM_SLAVES; k++)
+        printf("slave %u                     %6.2f %6.2f %6.2f  %6.2f\n", k,
+               stat_mean(&slave_offset[k]), stat_sd(&slave_offset[k]),
+               slave_offset[k].max, stat_mean(&slave_lat[k]));
+
+    printf("\nlatency, master ping to fix   %7.1f ms mean %7.1f ms max\n",
+           stat_mean(&latency), latency.max);
+    printf("fix time vs mean arrival      %7.1f us mean %7.1f us max\n",
+           stat_mean(&time_error), time_error.max);
+    if (fixes > 0u) {
+        qsort(fix_errors, fixes, sizeof(double), compare_doubles);
+        for (i = 0u; i < fixes; i++)
+            rms += fix_errors[i] * fix_errors[i];
+        rms = sqrt(rms / fixes);
+        printf("fix error (ft)      median %.3f  rms %.3f  95%% %.3f  max %.3f\n",
+               fix_errors[fixes / 2u], rms, fix_errors[fixes * 95u / 100u],
+               fix_errors[fixes - 1u]);
+    }
+    if (now_error.n > 0u) {
+        printf("position_now() error (ft)   mean %.3f  max %.3f\n",
+               stat_mean(&now_error), now_error.max);
+        printf("  the fix it started from   mean %.3f  max %.3f\n",
+               stat_mean(&stale_error), stale_error.max);
+        printf("  moved since the fix       mean %.3f  missed by mean %.3f\n",
+               stat_mean(&moved), stat_mean(&moved_error));
+    }
+    if (!car_quiet || num_cars > 1u)
+        print_cars();
+
+    printf("\nUltraDAC as the ping arrived  mean     sd    max  (agc %s)\n",
+           agc_enabled ? "on" : "off");
+    for (k = 0u; k < POSITION_TRANSMITTERS; k++)
+        printf("ping %u                     %7.1f %6.1f %6.0f\n", k,
+               stat_mean(&threshold[k]), stat_sd(&threshold[k]),
+               threshold[k].max);
+
+    // Propagating the fix to now must get closer than not moving it at all
+    return fixes == 0u ||
+           (moved.n > 0u && stat_mean(&moved_error) > stat_mean(&moved));
+}
+
+int main(int argc, char **argv) {
+    uint32 seed = 1u;
+    int opt, status;
+    uint8 grow = 0u, n, scheme;
+
+    while ((opt = getopt(argc, argv, "t:s:v:r:m:e:l:N:n:S:g:AqcT")) != -1) {
+        switch (opt) {
+        case 't':
+            sim_time = atof(optarg);
+            break;
+        case 's':
+            seed = (uint32)atol(optarg);
+            break;
+        case 'v':
+            car_speed = atof(optarg);
+            break;
+        case 'r':
+            car_radius = atof(optarg);
+            break;
+        case 'm':
+            miss_probability = atof(optarg);
+            break;
+        case 'e':
+            echo_probability = atof(optarg);
+            break;
+        case 'l':
+            loss_probability = atof(optarg);
+            break;
+        case 'N':
+            noise_rate = atof(optarg);
+            break;
+        case 'n':
+            num_cars = (uint8)atoi(optarg);
+            break;
+        case 'S':
+            slots = atoi(optarg);
+            break;
+        case 'g':
+            grow = (uint8)atoi(optarg);
+            break;
+        case 'A':
+            agc_off = 1u;
+            break;
+        case 'q':
+            car_quiet = 1u;
+            break;
+        case 'c':
+            csv = 1u;
+            break;
+        case 'T':
+            dump_trace = 1u;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (sim_time <= 0.0 || noise_rate < 0.0 || car_radius < 1.0 / STEER_MAX_CURVATURE ||
+            num_cars < 1u || num_cars > MAX_CARS || grow > MAX_CARS ||
+            slots > (int)RADIO_MAX_SLOTS)
+        usage(argv[0]);
+    if (grow == 0u)
+        return simulate(seed);
+
+    // Each run in a process of its own, since the firmware keeps its state
+    // in globals
+    printf("cars  slots  cycles  fixes/s per car   reached  latency   "
+           "collisions\n");
+    printf("              /s      mean     least   the base  messages  "
+           "trans.   cars\n");
+    for (n = 1u; n <= grow; n++) {
+        for (scheme = 0u; scheme < 2u; scheme++) {
+            fflush(stdout);
+            if (fork() == 0) {
+                num_cars = n;
+                slots = scheme == 0u ? 0 : -1;
+                sweep = 1u;
+                exit(simulate(seed));
+            }
+            wait(&status);
+        }
+    }
+    return 0;
+}
+
+//[] END OF FILE
@@ -0,0 +1,524 @@
+/* ========================================
+ * scope_sim.c
+ * Monica Lu and Victor Ying
+ *
+ * Checks the variable streaming in scope.c, with the car driving
+ * forward under speed control against a simple motor model:
+ * streams started from the shell arrive as frames of consecutive
+ * samples at the right times holding the values the firmware had,
+ * decimation spaces them out, every variable at once still fits
+ * a USB packet, and while USB is stalled samples are dropped and
+ * counted, and the frames after it catch up with several samples
+ * in each. Text the shell prints meanwhile never corrupts a frame.
+ *
+ * With -p, serves the firmware's shell on a pseudo-terminal
+ * instead, so host/scope can be tried against it:
+ *   ./scope_sim -p &
+ *   ./scope -d /dev/pts/N -o run.csv speed power
+ *
+ * Build and run from the repository root:
+ *   cc -std=gnu89 -Wall -Isim/hal -IPSoC_Creator/Carlab.cydsn \
+ *      sim/scope_sim.c sim/hal/hal.c sim/hal/components.c \
+ *      $(ls PSoC_Creator/Carlab.cydsn/[a-z]*.c | grep -v main.c) -lm -o scope_sim
+ *   ./scope_sim [-p]
+ * Exits nonzero if a check fails.
+ * ========================================
+ */
+
+#define _GNU_SOURCE
+
+#include <project.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "hal.h"
+#include "clock.h"
+#include "drive.h"
+#include "shell.h"
+#include "sched.h"
+#include "scope.h"
+#include "speed.h"
+#include "steer.h"
+#include "odometry.h"
+#include "position.h"
+
+#define STEP 100u  // simulation step in microseconds
+#define MAX_SAMPLES 4096u
+#define MAX_PERIODS 4096u
+#define MAX_TEXT 4096u
+
+// Drive motor, as in car_sim.c: speed approaches MOTOR_K*(power - MOTOR_U0)
+#define MOTOR_K 35.0  // feet per second per unit power
+#define MOTOR_U0 0.1
+#define MOTOR_TAU 0.4  // seconds
+
+struct sample {
+    uint16 seq;
+    uint32 time;
+    float value[SCOPE_VARS];
+};
+
+// What arrived over USB UART, split into frames and text
+struct stream {
+    struct sample samples[MAX_SAMPLES];
+    unsigned num_samples;
+    unsigned frames, bad_frames, max_count, max_frame;
+    uint16 mask, dropped;
+    uint8 decimation;
+    char text[MAX_TEXT];
+    unsigned text_len;
+};
+
+// The firmware's variables after each speed PID period
+struct period {
+    uint32 time;
+    float value[SCOPE_VARS];
+};
+
+static uint8 output[1u << 16];
+static unsigned output_len = 0u;
+static unsigned failures = 0u;
+static int pty = -1;
+static uint32 next_pid;
+static double car_speed = 0.0, to_tick = DISTANCE_PER_TICK;
+static struct position_fix fix = {0.0, 0.0, 0.0, 0u, 0u, 0u};
+
+static struct period periods[MAX_PERIODS];
+static unsigned num_periods = 0u;
+static struct stream stream;
+
+
+static void capture(const uint8 *data, uint16 length) {
+    if (output_len + length <= sizeof(output)) {
+        memcpy(output + output_len, data, length);
+        output_len += length;
+    }
+}
+
+static void to_pty(const uint8 *data, uint16 length) {
+    if (write(pty, data, length) != length)
+        perror("write");
+}
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+/*
+ * remember_period:
+ * Keeps every variable's value just after a speed PID period, when the
+ * scope samples them.
+ */
+static void remember_period(void) {
+    struct period *p;
+
+    if (num_periods == MAX_PERIODS)
+        return;
+    p = &periods[num_periods++];
+    p->time = clock_now();
+    p->value[SCOPE_SPEED] = speed;
+    p->value[SCOPE_SETPOINT] = speed_setpoint;
+    p->value[SCOPE_POWER] = power_output;
+    p->value[SCOPE_DISTANCE] = distance_traveled;
+    p->value[SCOPE_STEER] = steer_output;
+    p->value[SCOPE_MEASUREMENT] = steer_measurement();
+    p->value[SCOPE_X] = fix.x;
+    p->value[SCOPE_Y] = fix.y;
+    p->value[SCOPE_ERROR] = fix.error;
+}
+
+/*
+ * poll_tasks:
+ * Runs the main loop for a while. Not until nothing is ready, since the
+ * scope task keeps posting itself while USB is stalled.
+ */
+static void poll_tasks(void) {
+    unsigned i;
+
+    for (i = 0u; i < SCHED_TASKS && sched_poll(); i++)
+        ;
+}
+
+/*
+ * advance:
+ * Moves simulated time on, driving the car forward, running the
+ * interrupts as they come due and the main loop's tasks after each.
+ */
+static void advance(uint32 microseconds) {
+    uint32 end = hal_time + microseconds;
+    double dt = STEP * 1e-6, power, target;
+
+    while ((int32)(end - hal_time) > 0) {
+        hal_time += STEP;
+        power = hal_drive_compare / 65535.0;
+        target = power > MOTOR_U0 ? MOTOR_K * (power - MOTOR_U0) : 0.0;
+        car_speed += (target - car_speed) * dt / MOTOR_TAU;
+        to_tick -= car_speed * dt;
+        if (to_tick <= 0.0) {
+            to_tick += DISTANCE_PER_TICK;
+            hal_hall_capture(hal_time);
+        }
+        if ((int32)(next_pid - hal_time) <= 0) {
+            hal_interrupt(HAL_IRQ_SPEED_PID);
+            next_pid = hal_speed_pid_period();
+            remember_period();
+        }
+        poll_tasks();
+    }
+}
+
+static void type_line(const char *line) {
+    while (*line != '\0')
+        shell_handle_char(*line++);
+    shell_handle_char('\r');
+    poll_tasks();
+}
+
+static float get_float(const uint8 *bytes) {
+    uint32 u = (uint32)bytes[0] << 24 | (uint32)bytes[1] << 16 |
+               (uint32)bytes[2] << 8 | bytes[3];
+    float f;
+
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static unsigned bits(uint16 mask) {
+    unsigned n = 0u;
+
+    for (; mask != 0u; mask >>= 1)
+        n += mask & 1u;
+    return n;
+}
+
+/*
+ * take_stream:
+ * Splits the captured output into frames and text, the way a host has to,
+ * appending to stream.
+ */
+static void take_stream(void) {
+    unsigned i = 0u, j, k, v, len, count;
+    uint8 sum;
+    const uint8 *body;
+
+    while (i < output_len) {
+        if (output[i] != SCOPE_SYNC || i + 1u >= output_len ||
+                output[i + 1u] > SCOPE_MAX_BODY ||
+                i + output[i + 1u] + 3u > output_len) {
+            if (output[i] == SCOPE_SYNC)
+                stream.bad_frames++;
+            else if (stream.text_len < MAX_TEXT - 1u)
+                stream.text[stream.text_len++] = (char)output[i];
+            i++;
+            continue;
+        }
+        len = output[i + 1u];
+        sum = 0u;
+        for (j = 1u; j < len + 3u; j++)
+            sum += output[i + j];
+        body = output + i + 2u;
+        if (sum != 0u || len < SCOPE_HEADER) {
+            stream.bad_frames++;
+            i++;
+            continue;
+        }
+
+        stream.frames++;
+        if (len + 3u > stream.max_frame)
+            stream.max_frame = len + 3u;
+        stream.mask = (uint16)(body[0] << 8 | body[1]);
+        stream.dropped = (uint16)(body[8] << 8 | body[9]);
+        stream.decimation = body[10];
+        count = body[11];
+        if (count > stream.max_count)
+            stream.max_count = count;
+        if (len != SCOPE_HEADER + count * 4u * bits(stream.mask))
+            stream.bad_frames++;
+        for (k = 0u; k < count && stream.num_samples < MAX_SAMPLES; k++) {
+            struct sample *s = &stream.samples[stream.num_samples++];
+            const uint8 *value = body + SCOPE_HEADER +
+                                 k * 4u * bits(stream.mask);
+
+            s->seq = (uint16)((body[2] << 8 | body[3]) + k);
+            s->time = (uint32)body[4] << 24 | (uint32)body[5] << 16 |
+                      (uint32)body[6] << 8 | body[7];
+            s->time += k * stream.decimation * CLOCK_TICKS_PER_PERIOD;
+            for (v = 0u; v < SCOPE_VARS; v++) {
+                if (stream.mask & (1u << v)) {
+                    s->value[v] = get_float(value);
+                    value += 4;
+                } else {
+                    s->value[v] = NAN;
+                }
+            }
+        }
+        i += len + 3u;
+    }
+    stream.text[stream.text_len] = '\0';
+    output_len = 0u;
+}
+
+/*
+ * start:
+ * Types a scope command, and starts a fresh record of what comes back.
+ */
+static void start(const char *command) {
+    output_len = 0u;
+    memset(&stream, 0, sizeof(stream));
+    num_periods = 0u;
+    type_line(command);
+}
+
+/*
+ * find_period:
+ * Returns the period the firmware's clock said was the given time, or null.
+ */
+static const struct period *find_period(uint32 time) {
+    unsigned i;
+
+    for (i = 0u; i < num_periods; i++)
+        if (periods[i].time == time)
+            return &periods[i];
+    return NULL;
+}
+
+/*
+ * check_samples:
+ * Checks the samples in stream are numbered from zero with the given gaps
+ * accounted for by the drop count, decimation periods apart, and hold the
+ * variables' values at the periods they were taken.
+ */
+static void check_samples(uint8 decimation, const char *what) {
+    char msg[160];
+    unsigned i, v, gaps = 0u, wrong_time = 0u, wrong_value = 0u;
+    const struct sample *s, *prev = NULL;
+    const struct period *p;
+
+    sprintf(msg, "%s: no corrupt frames", what);
+    check(stream.bad_frames == 0u, msg);
+    sprintf(msg, "%s: frames fit a USB packet", what);
+    check(stream.max_frame <= SCOPE_MAX_FRAME, msg);
+    sprintf(msg, "%s: frames say decimation %u", what, decimation);
+    check(stream.frames == 0u || stream.decimation == decimation, msg);
+    sprintf(msg, "%s: samples arrived", what);
+    check(stream.num_samples > 0u, msg);
+    if (stream.num_samples == 0u)
+        return;
+    sprintf(msg, "%s: first sample is number 0", what);
+    check(stream.samples[0].seq == 0u, msg);
+
+    for (i = 0u; i < stream.num_samples; i++) {
+        s = &stream.samples[i];
+        if (prev != NULL) {
+            gaps += (uint16)(s->seq - prev->seq - 1u);
+            if (s->time - prev->time !=
+                    (uint32)(s->seq - prev->seq) * decimation *
+                    CLOCK_TICKS_PER_PERIOD)
+                wrong_time++;
+        }
+        p = find_period(s->time);
+        if (p == NULL) {
+            wrong_time++;
+        } else {
+            for (v = 0u; v < SCOPE_VARS; v++)
+                if ((stream.mask & (1u << v)) && s->value[v] != p->value[v])
+                    wrong_value++;
+        }
+        prev = s;
+    }
+    sprintf(msg, "%s: samples %u periods apart (%u wrong)", what, decimation,
+            wrong_time);
+    check(wrong_time == 0u, msg);
+    sprintf(msg, "%s: values match the firmware's (%u wrong)", what,
+            wrong_value);
+    check(wrong_value == 0u, msg);
+    sprintf(msg, "%s: missing samples (%u) are the ones counted dropped (%u)",
+            what, gaps, stream.dropped);
+    check(gaps == stream.dropped, msg);
+}
+
+/*
+ * check_stream:
+ * A few variables at the full rate, then decimated.
+ */
+static void check_stream(void) {
+    start("scope speed power setpoint dist");
+    advance(2000000u);
+    take_stream();
+    check_samples(1u, "full rate");
+    check(stream.num_samples >= 199u && stream.num_samples <= 201u,
+          "full rate: 100 samples a second");
+    check(stream.dropped == 0u, "full rate: nothing dropped");
+    printf("full rate: %u samples of 4 variables in %u frames, "
+           "up to %u bytes\n", stream.num_samples, stream.frames,
+           stream.max_frame);
+
+    start("scope 5 speed");
+    advance(1000000u);
+    take_stream();
+    check_samples(5u, "decimation 5");
+    check(stream.num_samples >= 19u && stream.num_samples <= 21u,
+          "decimation 5: 20 samples a second");
+}
+
+/*
+ * check_all:
+ * Every variable at once, including a position fix.
+ */
+static void check_all(void) {
+    fix.x = 3.25f;
+    fix.y = -2.5f;
+    fix.error = 0.0625f;
+    scope_fix(&fix);
+    start("scope 1 speed setpoint power dist steer meas x y err");
+    advance(500000u);
+    take_stream();
+    check_samples(1u, "every variable");
+    check(stream.mask == (1u << SCOPE_VARS) - 1u, "every variable: mask");
+    check(stream.num_samples > 0u &&
+          stream.samples[0].value[SCOPE_X] == 3.25f &&
+          stream.samples[0].value[SCOPE_ERROR] == 0.0625f,
+          "every variable: position fix");
+}
+
+/*
+ * check_stall:
+ * USB stops taking data for half a second. The ring fills, later samples
+ * are dropped, and once USB is back the backlog goes out several samples
+ * to a frame.
+ */
+static void check_stall(void) {
+    unsigned before;
+
+    start("scope speed power");
+    advance(100000u);
+    hal_usbuart_ready = 0u;
+    advance(500000u);
+    before = output_len;
+    hal_usbuart_ready = 1u;
+    advance(300000u);
+    take_stream();
+    check(before > 0u, "stall: frames before the stall");
+    check_samples(1u, "stall");
+    check(stream.dropped >= 50u - SCOPE_RING && stream.dropped <= 50u,
+          "stall: samples dropped while the ring was full");
+    check(stream.max_count > 1u, "stall: backlog sent several to a frame");
+    check(stream.samples[stream.num_samples - 1u].seq + 1u ==
+              stream.num_samples + stream.dropped,
+          "stall: every sample sent or counted dropped");
+    printf("stall: %u samples dropped, up to %u in a frame after\n",
+           stream.dropped, stream.max_count);
+}
+
+/*
+ * check_text:
+ * Commands typed while streaming, and turning it off.
+ */
+static void check_text(void) {
+    start("scope 2 speed steer");
+    advance(200000u);
+    type_line("scope");
+    advance(200000u);
+    take_stream();
+    check_samples(2u, "text while streaming");
+    check(strstr(stream.text, "Scope every 20 ms: speed steer") != NULL,
+          "scope prints what is streaming");
+
+    type_line("scope 0 speed");
+    type_line("scope speed bogus");
+    advance(100000u);
+    take_stream();
+    check(strstr(stream.text, "decimation must be") != NULL,
+          "bad decimation is refused");
+    check(strstr(stream.text, "variable..., or off") != NULL,
+          "unknown variable is refused");
+    check_samples(2u, "after refused commands");
+
+    type_line("scope off");
+    output_len = 0u;
+    advance(200000u);
+    check(output_len == 0u, "scope off stops the stream");
+}
+
+/*
+ * serve:
+ * Runs the firmware's shell on a pseudo-terminal until killed, with
+ * simulated time following real time.
+ */
+static int serve(void) {
+    struct timespec start_time, now;
+    struct pollfd fd;
+    uint8 buf[256];
+    ssize_t i, n;
+
+    pty = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty < 0 || grantpt(pty) < 0 || unlockpt(pty) < 0) {
+        perror("pty");
+        return 1;
+    }
+    hal_usbuart_output = to_pty;
+    printf("%s\n", ptsname(pty));
+    fflush(stdout);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    fd.fd = pty;
+    fd.events = POLLIN;
+    for (;;) {
+        if (poll(&fd, 1, 5) < 0)
+            break;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        num_periods = 0u;
+        advance((uint32)((now.tv_sec - start_time.tv_sec) * 1000000 +
+                         (now.tv_nsec - start_time.tv_nsec) / 1000) - hal_time);
+        if (!(fd.revents & POLLIN))
+            continue;
+        n = read(pty, buf, sizeof(buf));
+        if (n <= 0) {
+            usleep(10000);  // nobody has the terminal open
+            continue;
+        }
+        for (i = 0; i < n; i++)
+            shell_handle_char((char)buf[i]);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    hal_time = 0u;
+    clock_init();
+    drive_init();
+    drive_stop_distance = 1e6;
+    next_pid = hal_speed_pid_period();
+
+    if (argc > 1 && strcmp(argv[1], "-p") == 0)
+        return serve();
+    if (argc > 1) {
+        fprintf(stderr, "usage: %s [-p]\n", argv[0]);
+        return 2;
+    }
+
+    hal_usbuart_output = capture;
+    advance(500000u);  // up to speed
+    check_stream();
+    check_all();
+    check_stall();
+    check_text();
+
+    if (failures > 0u) {
+        printf("%u checks failed\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
+
+//[] END OF FILE